@@ -7,13 +7,19 @@
  */
 
 /* C++ STL */
+#include <algorithm>
 #include <functional>
+#include <string>
+#include <vector>
 
 /* CPPTOML */
 #include <include/cpptoml.h>
 
 /* TOML */
 #include "private.h"
+#include "node.h"
+#include "builder.h"
+#include "error.h"
 #include "array.h"
 
 namespace cg {
@@ -23,15 +29,15 @@ namespace toml {
 class Array {
  public:
   /* The data of the array */
-  using Data = std::shared_ptr<const cpptoml::array>;
-
-  /* The for each function for values */
-  template <typename T>
-  using ForEachValueFunction = std::function<void(const T*, gpointer)>;
+  using Data = OwnedNode;
 
   /* The for each function for arrays of values */
   using ForEachArrayFunction = std::function<void(CgTomlArray *, gpointer )>;
 
+  /* The for each function for views of arrays of values */
+  using ForEachArrayViewFunction =
+      std::function<void(const CgTomlArrayView *, gpointer)>;
+
   /* Constructor */
   Array(Data data) :
       data_(std::move(data)) {
@@ -41,26 +47,79 @@ class Array {
   virtual ~Array() {
   }
 
-  /* Calls the given callback for values */
-  template <typename T>
-  void ForEachValue(ForEachValueFunction<T> func, gpointer user_data) const {
-    for (const std::shared_ptr<cpptoml::value<T>>& v : data_->array_of<T>()) {
-      if (v) {
-        const T val = v->get();
-        func(&val, user_data);
-      } else {
-        func(nullptr, user_data);
-      }
-    }
+  /* Gets the array without increasing its reference count */
+  Node Get() const {
+    return data_.node;
+  }
+
+  /* Gets the array along with its owner */
+  const Data& GetData() const {
+    return data_;
+  }
+
+  /* Calls the given callable with each value converted to the given type,
+   * or with nullptr if the value cannot be converted */
+  template <typename T, typename F>
+  static void ForEachValue(Node array, F func) {
+    ForEachElement(array, [&](Node v) {
+        T val;
+        func(GetValue(v, &val) ? &val : nullptr);
+        return true;
+      });
+  }
+
+  /* Calls the given callable with each string value without copying it */
+  template <typename F>
+  static void ForEachString(Node array, F func) {
+    ForEachElement(array, [&](Node v) {
+        func(GetString(v, nullptr));
+        return true;
+      });
+  }
+
+  /* Copies up to n values into a contiguous buffer, returning the number of
+   * values copied before the first one that cannot be converted */
+  template <typename T, typename U>
+  static gsize CopyValues(Node array, U *dst, gsize n) {
+    gsize copied = 0;
+    ForEachElement(array, [&](Node v) {
+        T val;
+        if (copied == n || !GetValue(v, &val))
+          return false;
+        dst[copied++] = static_cast<U>(val);
+        return true;
+      });
+    return copied;
   }
 
   /* Calls the given callback for arrays of values */
   void ForEachArray(ForEachArrayFunction func, gpointer user_data) const {
-    for (const Data& val : data_->nested_array()) {
-      gconstpointer d = static_cast<gconstpointer>(&val);
-      g_autoptr (CgTomlArray) a = cg_toml_array_new(d);
-      func(a, user_data);
-    }
+    ForEachElement(data_.node, [&](Node v) {
+        if (!IsArray(v)) {
+          func(nullptr, user_data);
+          return true;
+        }
+        OwnedNode array = Own(data_.owner, v);
+        g_autoptr (CgTomlArray) a =
+            cg_toml_array_new(static_cast<gconstpointer>(&array));
+        func(a, user_data);
+        return true;
+      });
+  }
+
+  /* Calls the given callback with a view of each array of values */
+  static void ForEachArrayView(Node array, ForEachArrayViewFunction func,
+      gpointer user_data) {
+    CgTomlArrayView view = {};
+    ForEachElement(array, [&](Node v) {
+        if (!IsArray(v)) {
+          func(nullptr, user_data);
+          return true;
+        }
+        view.data = v.ToData();
+        func(&view, user_data);
+        return true;
+      });
   }
 
  private:
@@ -98,7 +157,7 @@ cg_toml_array_new (gconstpointer data)
   g_return_val_if_fail (data, nullptr);
 
   try {
-    g_autoptr(CgTomlArray) self = g_rc_box_new (CgTomlArray);
+    g_autoptr(CgTomlArray) self = g_atomic_rc_box_new (CgTomlArray);
 
     /* Set the data */
     const cg::toml::Array::Data *d =
@@ -119,7 +178,7 @@ CgTomlArray *
 cg_toml_array_ref (CgTomlArray * self)
 {
   return static_cast<CgTomlArray *>(
-    g_rc_box_acquire (static_cast<gpointer>(self)));
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
 }
 
 void
@@ -129,44 +188,167 @@ cg_toml_array_unref (CgTomlArray * self)
     CgTomlArray *a = static_cast<CgTomlArray *>(p);
     delete a->data;
   };
-  g_rc_box_release_full (self, free_func);
+  g_atomic_rc_box_release_full (self, free_func);
 }
 
-void
-cg_toml_array_for_each_boolean (const CgTomlArray *self,
+gconstpointer
+cg_toml_array_get_data (const CgTomlArray *self)
+{
+  return static_cast<gconstpointer>(&self->data->GetData());
+}
+
+static inline cg::toml::Node
+array_data (const CgTomlArray *self)
+{
+  return self->data->Get();
+}
+
+static inline cg::toml::Node
+array_data (const CgTomlArrayView *self)
+{
+  return cg::toml::Node::FromData(self->data);
+}
+
+static void
+iter_init (CgTomlArrayIter *iter, cg::toml::Node array)
+{
+  g_return_if_fail (iter);
+  *iter = {};
+  iter->data = array.ToData();
+}
+
+static void
+for_each_boolean (cg::toml::Node array,
     CgTomlArrayForEachBoolFunc func, gpointer user_data)
 {
-  self->data->ForEachValue<bool>([&](const bool *v, gpointer d){
+  cg::toml::Array::ForEachValue<bool>(array, [&](const bool *v){
       if (v) {
         const gboolean b = *v ? TRUE : FALSE;
-        func(&b, d);
+        func(&b, user_data);
       } else {
-        func(nullptr, d);
+        func(nullptr, user_data);
       }
-    }, user_data);
+    });
+}
+
+static void
+for_each_int64 (cg::toml::Node array,
+    CgTomlArrayForEachInt64Func func, gpointer user_data)
+{
+  cg::toml::Array::ForEachValue<int64_t>(array, [&](const int64_t *v){
+      func(v, user_data);
+    });
+}
+
+static void
+for_each_double (cg::toml::Node array,
+    CgTomlArrayForEachDoubleFunc func, gpointer user_data)
+{
+  cg::toml::Array::ForEachValue<double>(array, [&](const double *v){
+      func(v, user_data);
+    });
+}
+
+static void
+for_each_string (cg::toml::Node array,
+    CgTomlArrayForEachStringFunc func, gpointer user_data)
+{
+  cg::toml::Array::ForEachString(array, [&](const char *v){
+      func(v, user_data);
+    });
+}
+
+static gboolean
+get_nth_boolean (cg::toml::Node array, guint index, gboolean *val)
+{
+  g_return_val_if_fail (val, false);
+  bool v;
+  if (!cg::toml::GetValue(cg::toml::GetNth(array, index), &v))
+    return false;
+  *val = v ? TRUE : FALSE;
+  return true;
+}
+
+template <typename T>
+static gboolean
+get_nth_value (cg::toml::Node array, guint index, T *val)
+{
+  g_return_val_if_fail (val, false);
+  return cg::toml::GetValue(cg::toml::GetNth(array, index), val);
+}
+
+static char *
+get_nth_string (cg::toml::Node array, guint index)
+{
+  gsize len = 0;
+  const char *str = cg::toml::GetString(cg::toml::GetNth(array, index), &len);
+  return str ? g_strndup (str, len) : nullptr;
+}
+
+template <typename T, typename U>
+static gboolean
+copy_values (cg::toml::Node array, U *dst, gsize n,
+    const char *type_name, GError **error)
+{
+  g_return_val_if_fail (dst || n == 0, false);
+  const gsize copied = cg::toml::Array::CopyValues<T>(array, dst, n);
+  if (copied < std::min<gsize>(n, cg::toml::GetLength(array))) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+        "Array element %" G_GSIZE_FORMAT " is not a valid %s value", copied,
+        type_name);
+    return false;
+  }
+  return true;
+}
+
+template <typename T, typename U>
+static GArray *
+dup_values (cg::toml::Node array, const char *type_name,
+    GError **error)
+{
+  const guint len = cg::toml::GetLength(array);
+  GArray *res = g_array_sized_new (FALSE, FALSE, sizeof (U), len);
+  g_array_set_size (res, len);
+  if (!copy_values<T> (array, reinterpret_cast<U *>(res->data), len,
+      type_name, error)) {
+    g_array_unref (res);
+    return nullptr;
+  }
+  return res;
+}
+
+static const char *
+peek_string (cg::toml::Node array, guint index, gsize *len)
+{
+  return cg::toml::GetString(cg::toml::GetNth(array, index), len);
+}
+
+void
+cg_toml_array_for_each_boolean (const CgTomlArray *self,
+    CgTomlArrayForEachBoolFunc func, gpointer user_data)
+{
+  for_each_boolean (array_data (self), func, user_data);
 }
 
 void
 cg_toml_array_for_each_int64 (const CgTomlArray *self,
     CgTomlArrayForEachInt64Func func, gpointer user_data)
 {
-  self->data->ForEachValue<int64_t>(func, user_data);
+  for_each_int64 (array_data (self), func, user_data);
 }
 
 void
 cg_toml_array_for_each_double (const CgTomlArray *self,
     CgTomlArrayForEachDoubleFunc func, gpointer user_data)
 {
-  self->data->ForEachValue<double>(func, user_data);
+  for_each_double (array_data (self), func, user_data);
 }
 
 void
 cg_toml_array_for_each_string (const CgTomlArray *self,
     CgTomlArrayForEachStringFunc func, gpointer user_data)
 {
-  self->data->ForEachValue<std::string>([&](const std::string *v, gpointer d){
-      func(v ? v->c_str() : nullptr, d);
-    }, user_data);
+  for_each_string (array_data (self), func, user_data);
 }
 
 void
@@ -175,3 +357,386 @@ cg_toml_array_for_each_array (const CgTomlArray *self,
 {
   self->data->ForEachArray(func, user_data);
 }
+
+void
+cg_toml_array_for_each_array_view (const CgTomlArray *self,
+    CgTomlArrayViewForEachArrayFunc func, gpointer user_data)
+{
+  cg::toml::Array::ForEachArrayView(array_data (self), func, user_data);
+}
+
+const char *
+cg_toml_array_peek_string (const CgTomlArray *self, guint index, gsize *len)
+{
+  return peek_string (array_data (self), index, len);
+}
+
+guint
+cg_toml_array_get_length (const CgTomlArray *self)
+{
+  return cg::toml::GetLength(array_data (self));
+}
+
+gboolean
+cg_toml_array_get_nth_boolean (const CgTomlArray *self, guint index,
+    gboolean *val)
+{
+  return get_nth_boolean (array_data (self), index, val);
+}
+
+gboolean
+cg_toml_array_get_nth_int64 (const CgTomlArray *self, guint index,
+    int64_t *val)
+{
+  return get_nth_value (array_data (self), index, val);
+}
+
+gboolean
+cg_toml_array_get_nth_double (const CgTomlArray *self, guint index,
+    double *val)
+{
+  return get_nth_value (array_data (self), index, val);
+}
+
+char *
+cg_toml_array_get_nth_string (const CgTomlArray *self, guint index)
+{
+  return get_nth_string (array_data (self), index);
+}
+
+gboolean
+cg_toml_array_copy_boolean (const CgTomlArray *self, gboolean *dst, gsize n,
+    GError **error)
+{
+  return copy_values<bool> (array_data (self), dst, n, "boolean", error);
+}
+
+gboolean
+cg_toml_array_copy_int64 (const CgTomlArray *self, int64_t *dst, gsize n,
+    GError **error)
+{
+  return copy_values<int64_t> (array_data (self), dst, n, "int64", error);
+}
+
+gboolean
+cg_toml_array_copy_double (const CgTomlArray *self, double *dst, gsize n,
+    GError **error)
+{
+  return copy_values<double> (array_data (self), dst, n, "double", error);
+}
+
+GArray *
+cg_toml_array_dup_boolean (const CgTomlArray *self, GError **error)
+{
+  return dup_values<bool, gboolean> (array_data (self), "boolean", error);
+}
+
+GArray *
+cg_toml_array_dup_int64 (const CgTomlArray *self, GError **error)
+{
+  return dup_values<int64_t, int64_t> (array_data (self), "int64", error);
+}
+
+GArray *
+cg_toml_array_dup_double (const CgTomlArray *self, GError **error)
+{
+  return dup_values<double, double> (array_data (self), "double", error);
+}
+
+void
+cg_toml_array_get_view (const CgTomlArray *self, CgTomlArrayView *view)
+{
+  g_return_if_fail (view);
+  *view = {};
+  view->data = array_data (self).ToData();
+}
+
+void
+cg_toml_array_view_for_each_boolean (const CgTomlArrayView *self,
+    CgTomlArrayForEachBoolFunc func, gpointer user_data)
+{
+  for_each_boolean (array_data (self), func, user_data);
+}
+
+void
+cg_toml_array_view_for_each_int64 (const CgTomlArrayView *self,
+    CgTomlArrayForEachInt64Func func, gpointer user_data)
+{
+  for_each_int64 (array_data (self), func, user_data);
+}
+
+void
+cg_toml_array_view_for_each_double (const CgTomlArrayView *self,
+    CgTomlArrayForEachDoubleFunc func, gpointer user_data)
+{
+  for_each_double (array_data (self), func, user_data);
+}
+
+void
+cg_toml_array_view_for_each_string (const CgTomlArrayView *self,
+    CgTomlArrayForEachStringFunc func, gpointer user_data)
+{
+  for_each_string (array_data (self), func, user_data);
+}
+
+void
+cg_toml_array_view_for_each_array (const CgTomlArrayView *self,
+    CgTomlArrayViewForEachArrayFunc func, gpointer user_data)
+{
+  cg::toml::Array::ForEachArrayView(array_data (self), func, user_data);
+}
+
+const char *
+cg_toml_array_view_peek_string (const CgTomlArrayView *self, guint index,
+    gsize *len)
+{
+  return peek_string (array_data (self), index, len);
+}
+
+guint
+cg_toml_array_view_get_length (const CgTomlArrayView *self)
+{
+  return cg::toml::GetLength(array_data (self));
+}
+
+gboolean
+cg_toml_array_view_get_nth_boolean (const CgTomlArrayView *self, guint index,
+    gboolean *val)
+{
+  return get_nth_boolean (array_data (self), index, val);
+}
+
+gboolean
+cg_toml_array_view_get_nth_int64 (const CgTomlArrayView *self, guint index,
+    int64_t *val)
+{
+  return get_nth_value (array_data (self), index, val);
+}
+
+gboolean
+cg_toml_array_view_get_nth_double (const CgTomlArrayView *self, guint index,
+    double *val)
+{
+  return get_nth_value (array_data (self), index, val);
+}
+
+char *
+cg_toml_array_view_get_nth_string (const CgTomlArrayView *self, guint index)
+{
+  return get_nth_string (array_data (self), index);
+}
+
+gboolean
+cg_toml_array_view_copy_boolean (const CgTomlArrayView *self, gboolean *dst,
+    gsize n, GError **error)
+{
+  return copy_values<bool> (array_data (self), dst, n, "boolean", error);
+}
+
+gboolean
+cg_toml_array_view_copy_int64 (const CgTomlArrayView *self, int64_t *dst,
+    gsize n, GError **error)
+{
+  return copy_values<int64_t> (array_data (self), dst, n, "int64", error);
+}
+
+gboolean
+cg_toml_array_view_copy_double (const CgTomlArrayView *self, double *dst,
+    gsize n, GError **error)
+{
+  return copy_values<double> (array_data (self), dst, n, "double", error);
+}
+
+gboolean
+cg_toml_value_view_get_array (const CgTomlValueView *self,
+    CgTomlArrayView *array)
+{
+  g_return_val_if_fail (array, false);
+  const cg::toml::Node node = cg::toml::Node::FromData(self->data);
+  if (!cg::toml::IsArray(node))
+    return false;
+  *array = {};
+  array->data = node.ToData();
+  return true;
+}
+
+void
+cg_toml_array_iter_init (CgTomlArrayIter *iter, const CgTomlArray *array)
+{
+  iter_init (iter, array_data (array));
+}
+
+void
+cg_toml_array_iter_init_view (CgTomlArrayIter *iter,
+    const CgTomlArrayView *array)
+{
+  iter_init (iter, array_data (array));
+}
+
+gboolean
+cg_toml_array_iter_next (CgTomlArrayIter *iter, CgTomlValueView *value)
+{
+  g_return_val_if_fail (iter, false);
+  const cg::toml::Node node = cg::toml::GetNth(
+      cg::toml::Node::FromData(iter->data), iter->index);
+  if (!node)
+    return false;
+  iter->index++;
+  if (value) {
+    *value = {};
+    value->data = node.ToData();
+  }
+  return true;
+}
+
+static CgTomlArray *
+array_new_tree (const std::shared_ptr<cpptoml::array>& array)
+{
+  const cg::toml::OwnedNode d {array, cg::toml::Node {array.get()}};
+  return cg_toml_array_new (static_cast<gconstpointer>(&d));
+}
+
+template <typename F>
+static CgTomlArray *
+array_append (const CgTomlArray *self, F make_value)
+{
+  try {
+    std::shared_ptr<cpptoml::array> res = cg::toml::Append (array_data (self),
+        make_value ());
+    return res ? array_new_tree (res) : nullptr;
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not append to CgTomlArray: %s", ba.what());
+    return nullptr;
+  }
+}
+
+template <typename F>
+static CgTomlArray *
+array_extend (const CgTomlArray *self, gsize n, F make_value)
+{
+  try {
+    std::vector<std::shared_ptr<cpptoml::base>> values;
+    values.reserve (n);
+    for (gsize i = 0; i < n; i++)
+      values.push_back (make_value (i));
+    std::shared_ptr<cpptoml::array> res = cg::toml::Extend (array_data (self),
+        values);
+    return res ? array_new_tree (res) : nullptr;
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not append to CgTomlArray: %s", ba.what());
+    return nullptr;
+  }
+}
+
+CgTomlArray *
+cg_toml_array_new_empty (void)
+{
+  try {
+    return array_new_tree (cpptoml::make_array ());
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlArray: %s", ba.what());
+    return nullptr;
+  }
+}
+
+CgTomlArray *
+cg_toml_array_append_boolean (const CgTomlArray *self, gboolean val)
+{
+  g_return_val_if_fail (self, nullptr);
+
+  return array_append (self, [val]() {
+    return cpptoml::make_value (val != FALSE);
+  });
+}
+
+CgTomlArray *
+cg_toml_array_append_int64 (const CgTomlArray *self, int64_t val)
+{
+  g_return_val_if_fail (self, nullptr);
+
+  return array_append (self, [val]() {
+    return cpptoml::make_value (static_cast<int64_t>(val));
+  });
+}
+
+CgTomlArray *
+cg_toml_array_append_double (const CgTomlArray *self, double val)
+{
+  g_return_val_if_fail (self, nullptr);
+
+  return array_append (self, [val]() {
+    return cpptoml::make_value (static_cast<double>(val));
+  });
+}
+
+CgTomlArray *
+cg_toml_array_append_string (const CgTomlArray *self, const char *val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (val, nullptr);
+
+  return array_append (self, [val]() {
+    return cpptoml::make_value (std::string {val});
+  });
+}
+
+CgTomlArray *
+cg_toml_array_append_array (const CgTomlArray *self, const CgTomlArray *val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (val, nullptr);
+
+  return array_append (self, [val]() {
+    return cg::toml::Thaw (array_data (val));
+  });
+}
+
+CgTomlArray *
+cg_toml_array_extend_boolean (const CgTomlArray *self, const gboolean *src,
+    gsize n)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (src || n == 0, nullptr);
+
+  return array_extend (self, n, [src](gsize i) {
+    return cpptoml::make_value (src[i] != FALSE);
+  });
+}
+
+CgTomlArray *
+cg_toml_array_extend_int64 (const CgTomlArray *self, const int64_t *src,
+    gsize n)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (src || n == 0, nullptr);
+
+  return array_extend (self, n, [src](gsize i) {
+    return cpptoml::make_value (static_cast<int64_t>(src[i]));
+  });
+}
+
+CgTomlArray *
+cg_toml_array_extend_double (const CgTomlArray *self, const double *src,
+    gsize n)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (src || n == 0, nullptr);
+
+  return array_extend (self, n, [src](gsize i) {
+    return cpptoml::make_value (static_cast<double>(src[i]));
+  });
+}
+
+CgTomlArray *
+cg_toml_array_extend_string (const CgTomlArray *self,
+    const char *const *src, gsize n)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (src || n == 0, nullptr);
+  for (gsize i = 0; i < n; i++)
+    g_return_val_if_fail (src[i], nullptr);
+
+  return array_extend (self, n, [src](gsize i) {
+    return cpptoml::make_value (std::string {src[i]});
+  });
+}
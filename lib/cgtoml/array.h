@@ -13,6 +13,8 @@
 
 #include <stdint.h>
 
+#include "value.h"
+
 G_BEGIN_DECLS
 
 /* CgTomlArray */
@@ -22,6 +24,23 @@ CgTomlArray * cg_toml_array_ref (CgTomlArray * self);
 void cg_toml_array_unref (CgTomlArray * self);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlArray, cg_toml_array_unref)
 
+/* CgTomlArrayView */
+typedef struct _CgTomlArrayView CgTomlArrayView;
+struct _CgTomlArrayView {
+  /*< private >*/
+  gconstpointer data;
+  gpointer reserved[3];
+};
+
+/* CgTomlArrayIter */
+typedef struct _CgTomlArrayIter CgTomlArrayIter;
+struct _CgTomlArrayIter {
+  /*< private >*/
+  gconstpointer data;
+  gsize index;
+  gpointer reserved[2];
+};
+
 /* API */
 typedef void (*CgTomlArrayForEachBoolFunc)(const gboolean *, gpointer);
 void cg_toml_array_for_each_boolean (const CgTomlArray *self,
@@ -38,6 +57,93 @@ void cg_toml_array_for_each_string (const CgTomlArray *self,
 typedef void (*CgTomlArrayForEachArrayFunc)(CgTomlArray *, gpointer);
 void cg_toml_array_for_each_array (const CgTomlArray *self,
     CgTomlArrayForEachArrayFunc func, gpointer user_data);
+typedef void (*CgTomlArrayViewForEachArrayFunc)(const CgTomlArrayView *,
+    gpointer);
+void cg_toml_array_for_each_array_view (const CgTomlArray *self,
+    CgTomlArrayViewForEachArrayFunc func, gpointer user_data);
+const char * cg_toml_array_peek_string (const CgTomlArray *self, guint index,
+    gsize *len);
+guint cg_toml_array_get_length (const CgTomlArray *self);
+gboolean cg_toml_array_get_nth_boolean (const CgTomlArray *self, guint index,
+    gboolean *val);
+gboolean cg_toml_array_get_nth_int64 (const CgTomlArray *self, guint index,
+    int64_t *val);
+gboolean cg_toml_array_get_nth_double (const CgTomlArray *self, guint index,
+    double *val);
+char * cg_toml_array_get_nth_string (const CgTomlArray *self, guint index);
+gboolean cg_toml_array_copy_boolean (const CgTomlArray *self, gboolean *dst,
+    gsize n, GError **error);
+gboolean cg_toml_array_copy_int64 (const CgTomlArray *self, int64_t *dst,
+    gsize n, GError **error);
+gboolean cg_toml_array_copy_double (const CgTomlArray *self, double *dst,
+    gsize n, GError **error);
+GArray * cg_toml_array_dup_boolean (const CgTomlArray *self, GError **error);
+GArray * cg_toml_array_dup_int64 (const CgTomlArray *self, GError **error);
+GArray * cg_toml_array_dup_double (const CgTomlArray *self, GError **error);
+
+/* Builder API, arrays are immutable so appending gives a new one sharing
+ * the elements of the original, or NULL if a value is not of the type of
+ * the elements. Every append copies the list of elements, so building an
+ * array one element at a time is quadratic, the extend functions append n
+ * elements with a single copy */
+CgTomlArray * cg_toml_array_new_empty (void);
+CgTomlArray * cg_toml_array_append_boolean (const CgTomlArray *self,
+    gboolean val);
+CgTomlArray * cg_toml_array_append_int64 (const CgTomlArray *self,
+    int64_t val);
+CgTomlArray * cg_toml_array_append_double (const CgTomlArray *self,
+    double val);
+CgTomlArray * cg_toml_array_append_string (const CgTomlArray *self,
+    const char *val);
+CgTomlArray * cg_toml_array_append_array (const CgTomlArray *self,
+    const CgTomlArray *val);
+CgTomlArray * cg_toml_array_extend_boolean (const CgTomlArray *self,
+    const gboolean *src, gsize n);
+CgTomlArray * cg_toml_array_extend_int64 (const CgTomlArray *self,
+    const int64_t *src, gsize n);
+CgTomlArray * cg_toml_array_extend_double (const CgTomlArray *self,
+    const double *src, gsize n);
+CgTomlArray * cg_toml_array_extend_string (const CgTomlArray *self,
+    const char *const *src, gsize n);
+
+/* Views API */
+void cg_toml_array_get_view (const CgTomlArray *self, CgTomlArrayView *view);
+void cg_toml_array_view_for_each_boolean (const CgTomlArrayView *self,
+    CgTomlArrayForEachBoolFunc func, gpointer user_data);
+void cg_toml_array_view_for_each_int64 (const CgTomlArrayView *self,
+    CgTomlArrayForEachInt64Func func, gpointer user_data);
+void cg_toml_array_view_for_each_double (const CgTomlArrayView *self,
+    CgTomlArrayForEachDoubleFunc func, gpointer user_data);
+void cg_toml_array_view_for_each_string (const CgTomlArrayView *self,
+    CgTomlArrayForEachStringFunc func, gpointer user_data);
+void cg_toml_array_view_for_each_array (const CgTomlArrayView *self,
+    CgTomlArrayViewForEachArrayFunc func, gpointer user_data);
+const char * cg_toml_array_view_peek_string (const CgTomlArrayView *self,
+    guint index, gsize *len);
+guint cg_toml_array_view_get_length (const CgTomlArrayView *self);
+gboolean cg_toml_array_view_get_nth_boolean (const CgTomlArrayView *self,
+    guint index, gboolean *val);
+gboolean cg_toml_array_view_get_nth_int64 (const CgTomlArrayView *self,
+    guint index, int64_t *val);
+gboolean cg_toml_array_view_get_nth_double (const CgTomlArrayView *self,
+    guint index, double *val);
+char * cg_toml_array_view_get_nth_string (const CgTomlArrayView *self,
+    guint index);
+gboolean cg_toml_array_view_copy_boolean (const CgTomlArrayView *self,
+    gboolean *dst, gsize n, GError **error);
+gboolean cg_toml_array_view_copy_int64 (const CgTomlArrayView *self,
+    int64_t *dst, gsize n, GError **error);
+gboolean cg_toml_array_view_copy_double (const CgTomlArrayView *self,
+    double *dst, gsize n, GError **error);
+gboolean cg_toml_value_view_get_array (const CgTomlValueView *self,
+    CgTomlArrayView *array);
+
+/* Iterators API */
+void cg_toml_array_iter_init (CgTomlArrayIter *iter, const CgTomlArray *array);
+void cg_toml_array_iter_init_view (CgTomlArrayIter *iter,
+    const CgTomlArrayView *array);
+gboolean cg_toml_array_iter_next (CgTomlArrayIter *iter,
+    CgTomlValueView *value);
 
 G_END_DECLS
 
@@ -0,0 +1,116 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_BUFFER_H__
+#define __CG_TOML_BUFFER_H__
+
+/* C++ STL */
+#include <algorithm>
+#include <streambuf>
+
+/* GLib */
+#include <glib.h>
+
+namespace cg {
+namespace toml {
+
+/* Read-only stream buffer that reads directly from contiguous memory */
+class MemoryBuffer : public std::streambuf {
+ public:
+  /* Constructor */
+  MemoryBuffer(const char *data, gsize size) {
+    char *begin = const_cast<char *>(data);
+    setg(begin, begin, begin + size);
+  }
+
+  /* Destructor */
+  virtual ~MemoryBuffer() {
+  }
+
+ private:
+  /* Copy Constructor */
+  MemoryBuffer(const MemoryBuffer&) = delete;
+
+  /* Move Constructor */
+  MemoryBuffer(MemoryBuffer &&) = delete;
+
+  /* Copy-Assign Constructor */
+  MemoryBuffer& operator=(const MemoryBuffer&) = delete;
+
+  /* Move-Assign Constructr */
+  MemoryBuffer& operator=(MemoryBuffer &&) = delete;
+};
+
+/* Read-only stream buffer that hands contiguous memory out in chunks, so
+ * the reading can be followed and stopped in between. The progress function
+ * is called before each chunk after the first one, returning false ends the
+ * stream there */
+class ChunkedMemoryBuffer : public std::streambuf {
+ public:
+  /* The progress function, gets the bytes read so far and the total */
+  typedef bool (*Progress)(gsize current, gsize total, gpointer user_data);
+
+  /* Constructor */
+  ChunkedMemoryBuffer(const char *data, gsize size, gsize chunk_size,
+      Progress progress, gpointer user_data) :
+      begin_(const_cast<char *>(data)),
+      end_(begin_ + size),
+      chunk_size_(chunk_size),
+      progress_(progress),
+      user_data_(user_data) {
+    setg(begin_, begin_, begin_ + std::min(size, chunk_size_));
+  }
+
+  /* Destructor */
+  virtual ~ChunkedMemoryBuffer() {
+  }
+
+ protected:
+  /* Moves to the next chunk */
+  int_type underflow() override {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    char *next = egptr();
+    if (next == end_ || !progress_(next - begin_, end_ - begin_, user_data_))
+      return traits_type::eof();
+    setg(begin_, next, next + std::min(static_cast<gsize>(end_ - next),
+        chunk_size_));
+    return traits_type::to_int_type(*gptr());
+  }
+
+ private:
+  /* Copy Constructor */
+  ChunkedMemoryBuffer(const ChunkedMemoryBuffer&) = delete;
+
+  /* Move Constructor */
+  ChunkedMemoryBuffer(ChunkedMemoryBuffer &&) = delete;
+
+  /* Copy-Assign Constructor */
+  ChunkedMemoryBuffer& operator=(const ChunkedMemoryBuffer&) = delete;
+
+  /* Move-Assign Constructr */
+  ChunkedMemoryBuffer& operator=(ChunkedMemoryBuffer &&) = delete;
+
+ private:
+  /* The memory */
+  char *const begin_;
+  char *const end_;
+
+  /* The size of the chunks */
+  const gsize chunk_size_;
+
+  /* The progress function and its data */
+  const Progress progress_;
+  const gpointer user_data_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
@@ -0,0 +1,226 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* TOML */
+#include "builder.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* Copies a date or time node */
+std::shared_ptr<cpptoml::base> ThawDatetime(Node node, CgTomlValueType type) {
+  dom::Datetime d;
+  GetDatetime(node, &d);
+  cpptoml::offset_datetime res;
+  res.year = d.year;
+  res.month = d.month;
+  res.day = d.day;
+  res.hour = d.hour;
+  res.minute = d.minute;
+  res.second = d.second;
+  res.microsecond = d.microsecond;
+  res.hour_offset = d.hour_offset;
+  res.minute_offset = d.minute_offset;
+  switch (type) {
+    case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+      return cpptoml::make_value(static_cast<cpptoml::local_date>(res));
+    case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+      return cpptoml::make_value(static_cast<cpptoml::local_time>(res));
+    case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+      return cpptoml::make_value(static_cast<cpptoml::local_datetime>(res));
+    default:
+      return cpptoml::make_value(std::move(res));
+  }
+}
+
+/* Copies the elements of an array into a cpptoml one */
+template <typename A, typename T>
+std::shared_ptr<A> CopyElements(Node array, std::shared_ptr<A> res) {
+  if (const cpptoml::base *base = array.GetBase()) {
+    res->get() = static_cast<const A *>(base)->get();
+    return res;
+  }
+  res->get().reserve(GetLength(array));
+  ForEachElement(array, [&](Node element) {
+    res->get().push_back(std::static_pointer_cast<T>(Thaw(element)));
+    return true;
+  });
+  return res;
+}
+
+/* Sets a value at the given keys of a copy of a table */
+std::shared_ptr<cpptoml::table> SetKeys(Node table,
+    const std::vector<std::string>& keys, gsize index,
+    const std::shared_ptr<cpptoml::base>& value) {
+  const std::string& key = keys[index];
+  std::shared_ptr<cpptoml::table> res = CopyTable(table);
+  if (index + 1 == keys.size()) {
+    if (value)
+      res->insert(key, value);
+    else
+      res->erase(key);
+    return res;
+  }
+
+  /* Copy the next table of the path */
+  const Node child = Lookup(table, key.data(), key.size());
+  if (child && !IsTable(child))
+    return nullptr;
+  std::shared_ptr<cpptoml::table> sub = SetKeys(child, keys, index + 1,
+      value);
+  if (!sub)
+    return nullptr;
+  res->insert(key, sub);
+  return res;
+}
+
+}  /* namespace */
+
+std::shared_ptr<cpptoml::base>
+Thaw(Node node)
+{
+  if (const cpptoml::base *base = node.GetBase())
+    return std::const_pointer_cast<cpptoml::base>(base->shared_from_this());
+
+  const CgTomlValueType type = GetValueType(node);
+  switch (type) {
+    case CG_TOML_VALUE_TYPE_TABLE:
+      return CopyTable(node);
+    case CG_TOML_VALUE_TYPE_ARRAY:
+      return CopyElements<cpptoml::array, cpptoml::base>(node,
+          cpptoml::make_array());
+    case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+      return CopyElements<cpptoml::table_array, cpptoml::table>(node,
+          cpptoml::make_table_array());
+    case CG_TOML_VALUE_TYPE_BOOLEAN: {
+      bool b = false;
+      GetValue(node, &b);
+      return cpptoml::make_value(std::move(b));
+    }
+    case CG_TOML_VALUE_TYPE_INT64: {
+      int64_t i = 0;
+      GetInteger(node, &i);
+      return cpptoml::make_value(std::move(i));
+    }
+    case CG_TOML_VALUE_TYPE_DOUBLE: {
+      double d = 0;
+      GetValue(node, &d);
+      return cpptoml::make_value(std::move(d));
+    }
+    case CG_TOML_VALUE_TYPE_STRING: {
+      gsize len = 0;
+      const char *str = GetString(node, &len);
+      return cpptoml::make_value(std::string {str, len});
+    }
+    case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+    case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+    case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+    case CG_TOML_VALUE_TYPE_OFFSET_DATETIME:
+      return ThawDatetime(node, type);
+    default:
+      return nullptr;
+  }
+}
+
+std::shared_ptr<cpptoml::table>
+CopyTable(Node table)
+{
+  std::shared_ptr<cpptoml::table> res = cpptoml::make_table();
+  if (const cpptoml::table *t = AsTable(table.GetBase())) {
+    for (const auto& entry : *t)
+      res->insert(entry.first, entry.second);
+    return res;
+  }
+
+  /* The keys of an invalid section would be missing from the copy */
+  if (const LazyDocument *l = table.GetLazy()) {
+    GError *error = nullptr;
+    if (!l->Check(nullptr, &error)) {
+      const std::string message {error->message};
+      g_error_free(error);
+      throw cpptoml::parse_exception(message);
+    }
+  }
+
+  ForEachEntry(table, [&](const char *key, gsize len, Node value) {
+    std::shared_ptr<cpptoml::base> v = Thaw(value);
+    if (v)
+      res->insert(std::string {key, len}, v);
+    return true;
+  });
+  return res;
+}
+
+std::shared_ptr<cpptoml::table>
+Set(Node table, const char *key, bool qualified,
+    const std::shared_ptr<cpptoml::base>& value)
+{
+  std::vector<std::string> keys;
+  if (qualified) {
+    const char *dot;
+    while ((dot = std::strchr(key, '.'))) {
+      keys.emplace_back(key, dot - key);
+      key = dot + 1;
+    }
+  }
+  keys.emplace_back(key);
+  return SetKeys(table, keys, 0, value);
+}
+
+std::shared_ptr<cpptoml::array>
+Append(Node array, const std::shared_ptr<cpptoml::base>& value)
+{
+  return Extend(array, {value});
+}
+
+std::shared_ptr<cpptoml::array>
+Extend(Node array, const std::vector<std::shared_ptr<cpptoml::base>>& values)
+{
+  CgTomlValueType type = GetLength(array) > 0 ?
+      GetValueType(GetNth(array, 0)) : CG_TOML_VALUE_TYPE_NONE;
+  for (const std::shared_ptr<cpptoml::base>& value : values) {
+    if (!value)
+      return nullptr;
+    const CgTomlValueType t = GetValueType(Node {value.get()});
+    if (type != CG_TOML_VALUE_TYPE_NONE && t != type)
+      return nullptr;
+    type = t;
+  }
+  std::shared_ptr<cpptoml::array> res =
+      CopyElements<cpptoml::array, cpptoml::base>(array,
+          cpptoml::make_array());
+  res->get().insert(res->get().end(), values.begin(), values.end());
+  return res;
+}
+
+std::shared_ptr<cpptoml::table_array>
+AppendTable(Node array, const std::shared_ptr<cpptoml::table>& table)
+{
+  return ExtendTables(array, {table});
+}
+
+std::shared_ptr<cpptoml::table_array>
+ExtendTables(Node array,
+    const std::vector<std::shared_ptr<cpptoml::table>>& tables)
+{
+  std::shared_ptr<cpptoml::table_array> res =
+      CopyElements<cpptoml::table_array, cpptoml::table>(array,
+          cpptoml::make_table_array());
+  res->get().insert(res->get().end(), tables.begin(), tables.end());
+  return res;
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
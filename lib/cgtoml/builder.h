@@ -0,0 +1,67 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_BUILDER_H__
+#define __CG_TOML_BUILDER_H__
+
+/* C++ STL */
+#include <memory>
+#include <vector>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* TOML */
+#include "node.h"
+
+namespace cg {
+namespace toml {
+
+/* Documents are never modified, a change gives a new cpptoml tree that
+ * shares every node off the path of the change with the original one.
+ * Nodes of a cpptoml tree are shared as they are, while compact and lazy
+ * nodes are copied into cpptoml ones, so the first change of such a
+ * document converts it into a tree */
+
+/* Gets a node as a cpptoml node that a new document can share */
+std::shared_ptr<cpptoml::base> Thaw(Node node);
+
+/* Copies a table, sharing its values. A missing table gives an empty one.
+ * Throws cpptoml::parse_exception if the table is a lazy document with an
+ * invalid section, the functions below copy tables too */
+std::shared_ptr<cpptoml::table> CopyTable(Node table);
+
+/* Sets a value at a key, optionally dotted, of a copy of a table, a null
+ * value removes the key. Only the tables along the path are copied and the
+ * missing ones are created. Returns nullptr if one of them is not a
+ * table */
+std::shared_ptr<cpptoml::table> Set(Node table, const char *key,
+    bool qualified, const std::shared_ptr<cpptoml::base>& value);
+
+/* Appends a value to a copy of an array, sharing its elements. Returns
+ * nullptr if the value is not of the type of the elements, as arrays are
+ * homogeneous */
+std::shared_ptr<cpptoml::array> Append(Node array,
+    const std::shared_ptr<cpptoml::base>& value);
+
+/* Appends values to a single copy of an array, as Append() does */
+std::shared_ptr<cpptoml::array> Extend(Node array,
+    const std::vector<std::shared_ptr<cpptoml::base>>& values);
+
+/* Appends a table to a copy of an array of tables, sharing its elements */
+std::shared_ptr<cpptoml::table_array> AppendTable(Node array,
+    const std::shared_ptr<cpptoml::table>& table);
+
+/* Appends tables to a single copy of an array of tables */
+std::shared_ptr<cpptoml::table_array> ExtendTables(Node array,
+    const std::vector<std::shared_ptr<cpptoml::table>>& tables);
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
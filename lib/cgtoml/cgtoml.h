@@ -6,6 +6,13 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include "error.h"
+#include "value.h"
 #include "array.h"
+#include "path.h"
+#include "schema.h"
 #include "table.h"
 #include "file.h"
+#include "holder.h"
+#include "parser.h"
+#include "monitor.h"
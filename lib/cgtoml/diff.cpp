@@ -0,0 +1,199 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <cmath>
+#include <cstring>
+
+/* TOML */
+#include "diff.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* Appends a key to a qualified key */
+std::string Qualify(const std::string& prefix, const char *key, gsize len) {
+  std::string res;
+  res.reserve(prefix.size() + len + 1);
+  if (!prefix.empty()) {
+    res.append(prefix);
+    res.push_back('.');
+  }
+  res.append(key, len);
+  return res;
+}
+
+/* Checks whether two containers of compact documents have the same content
+ * hash, in which case they are equal without walking them */
+bool SameContent(Node a, Node b) {
+  const dom::Node *x = a.GetCompact();
+  const dom::Node *y = b.GetCompact();
+  if (!x || !y || x->type != y->type)
+    return false;
+  switch (x->type) {
+    case CG_TOML_VALUE_TYPE_ARRAY:
+    case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+    case CG_TOML_VALUE_TYPE_TABLE:
+      return dom::GetContentHash(x) == dom::GetContentHash(y);
+    default:
+      return false;
+  }
+}
+
+/* Checks whether a table has a key, without parsing lazy sections */
+bool Contains(Node table, const char *key, gsize len) {
+  if (const LazyDocument *l = table.GetLazy())
+    return l->Contains(key, len);
+  return static_cast<bool>(Lookup(table, key, len));
+}
+
+/* Calls the given callable with each key of a table, without parsing lazy
+ * sections */
+template <typename F>
+void ForEachKey(Node table, F func) {
+  if (const LazyDocument *l = table.GetLazy()) {
+    for (gsize i = 0; i < l->GetLength(); i++) {
+      const char *key = l->GetNthKey(i);
+      if (!func(key, std::strlen(key)))
+        return;
+    }
+    return;
+  }
+  ForEachEntry(table, [&](const char *key, gsize len, Node) {
+    return func(key, len);
+  });
+}
+
+/* Compares two tables, collecting their differences if the changes are
+ * given or stopping at the first one otherwise. Returns whether both
+ * tables are equal */
+bool DiffTables(Node a, Node b, const std::string& prefix, Changes *changes) {
+  if (a.ToData() == b.ToData() || SameContent(a, b))
+    return true;
+
+  bool equal = true;
+  const LazyDocument *la = a.GetLazy();
+  const LazyDocument *lb = b.GetLazy();
+
+  /* Removed and modified keys */
+  ForEachKey(a, [&](const char *key, gsize len) {
+    if (la && lb && la->SharesSection(*lb, key, len))
+      return true;
+    const Node va = Lookup(a, key, len);
+    const Node vb = Lookup(b, key, len);
+    if (!vb) {
+      equal = false;
+      if (changes)
+        changes->removed.push_back(Qualify(prefix, key, len));
+    } else if (IsTable(va) && IsTable(vb)) {
+      if (changes)
+        equal &= DiffTables(va, vb, Qualify(prefix, key, len), changes);
+      else
+        equal = DiffTables(va, vb, prefix, nullptr);
+    } else if (!Equal(va, vb)) {
+      equal = false;
+      if (changes)
+        changes->modified.push_back(Qualify(prefix, key, len));
+    }
+    return equal || changes;
+  });
+  if (!equal && !changes)
+    return false;
+
+  /* Added keys */
+  ForEachKey(b, [&](const char *key, gsize len) {
+    if (Contains(a, key, len))
+      return true;
+    equal = false;
+    if (changes)
+      changes->added.push_back(Qualify(prefix, key, len));
+    return changes != nullptr;
+  });
+  return equal;
+}
+
+/* Compares the elements of two arrays or arrays of tables */
+bool EqualElements(Node a, Node b) {
+  const gsize length = GetLength(a);
+  if (length != GetLength(b))
+    return false;
+  for (gsize i = 0; i < length; i++) {
+    if (!Equal(GetNth(a, i), GetNth(b, i)))
+      return false;
+  }
+  return true;
+}
+
+}  /* namespace */
+
+bool
+Equal(Node a, Node b)
+{
+  if (a.ToData() == b.ToData())
+    return true;
+
+  const CgTomlValueType type = GetValueType(a);
+  if (type != GetValueType(b))
+    return false;
+
+  switch (type) {
+    case CG_TOML_VALUE_TYPE_BOOLEAN: {
+      bool x = false, y = false;
+      return GetValue(a, &x) && GetValue(b, &y) && x == y;
+    }
+    case CG_TOML_VALUE_TYPE_INT64: {
+      int64_t x = 0, y = 0;
+      return GetInteger(a, &x) && GetInteger(b, &y) && x == y;
+    }
+    case CG_TOML_VALUE_TYPE_DOUBLE: {
+      double x = 0, y = 0;
+      return GetValue(a, &x) && GetValue(b, &y) &&
+          (x == y || (std::isnan(x) && std::isnan(y)));
+    }
+    case CG_TOML_VALUE_TYPE_STRING: {
+      gsize x_len = 0, y_len = 0;
+      const char *x = GetString(a, &x_len);
+      const char *y = GetString(b, &y_len);
+      return x && y && x_len == y_len && std::memcmp(x, y, x_len) == 0;
+    }
+    case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+    case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+    case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+    case CG_TOML_VALUE_TYPE_OFFSET_DATETIME: {
+      dom::Datetime x, y;
+      return GetDatetime(a, &x) && GetDatetime(b, &y) &&
+          std::memcmp(&x, &y, sizeof (x)) == 0;
+    }
+    case CG_TOML_VALUE_TYPE_ARRAY:
+    case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+      return SameContent(a, b) || EqualElements(a, b);
+    case CG_TOML_VALUE_TYPE_TABLE:
+      return DiffTables(a, b, std::string {}, nullptr);
+    case CG_TOML_VALUE_TYPE_NONE:
+    default:
+      return false;
+  }
+}
+
+bool
+Diff(Node a, Node b, Changes *changes, GError **error)
+{
+  /* Lazy documents are only found at the root, parse them up front */
+  const LazyDocument *la = a.GetLazy();
+  const LazyDocument *lb = b.GetLazy();
+  if ((la && !la->Check(lb, error)) || (lb && !lb->Check(la, error)))
+    return false;
+
+  DiffTables(a, b, std::string {}, changes);
+  return true;
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
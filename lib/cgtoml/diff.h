@@ -0,0 +1,47 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_DIFF_H__
+#define __CG_TOML_DIFF_H__
+
+/* C++ STL */
+#include <string>
+#include <vector>
+
+/* TOML */
+#include "node.h"
+
+namespace cg {
+namespace toml {
+
+/* The qualified keys that differ between two tables */
+struct Changes {
+  std::vector<std::string> added;
+  std::vector<std::string> removed;
+  std::vector<std::string> modified;
+};
+
+/* Checks whether two values are equal, containers are compared
+ * recursively. Values without a type, such as the keys of an invalid lazy
+ * section, are never equal */
+bool Equal(Node a, Node b);
+
+/* Collects the qualified keys that differ between two tables. Tables found
+ * in both are compared key by key, tables found in only one of them are
+ * listed by their own key. Any other value is compared as a whole, arrays
+ * and arrays of tables included. Subtrees shared by both tables are
+ * skipped, so are the sections shared by two revisions of a lazy document
+ * and the containers of two compact documents with the same content hash.
+ * Fails with CG_TOML_ERROR_PARSE if a lazy document has an invalid section
+ * that is not shared, as its keys would be reported as removed */
+bool Diff(Node a, Node b, Changes *changes, GError **error);
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
@@ -0,0 +1,68 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_DIRECTORY_H__
+#define __CG_TOML_DIRECTORY_H__
+
+/* C++ STL */
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* GLib */
+#include <glib.h>
+
+/* TOML */
+#include "node.h"
+
+namespace cg {
+namespace toml {
+
+/* Lists the names of the files of a conf.d style directory, in the order
+ * they are merged. Hidden files and files without the .toml extension are
+ * skipped */
+inline bool ListFragments(const char *path, std::vector<std::string> *names,
+    GError **error) {
+  g_autoptr (GDir) dir = g_dir_open(path, 0, error);
+  if (!dir)
+    return false;
+  while (const char *name = g_dir_read_name(dir))
+    if (name[0] != '.' && g_str_has_suffix(name, ".toml"))
+      names->emplace_back(name);
+  std::sort(names->begin(), names->end());
+  return true;
+}
+
+/* Merges a table over another one into a new table. Tables found in both
+ * are merged key by key, any other value of the overlay replaces the base
+ * one. Neither table is modified, the values they do not share are reused
+ * as they are */
+inline std::shared_ptr<cpptoml::table> Merge(const cpptoml::table& base,
+    const cpptoml::table& overlay) {
+  std::shared_ptr<cpptoml::table> res = cpptoml::make_table();
+  for (const auto& entry : base)
+    res->insert(entry.first, entry.second);
+  for (const auto& entry : overlay) {
+    const cpptoml::table *b = AsTable(Find(&base, entry.first));
+    const cpptoml::table *o = AsTable(entry.second.get());
+    if (b && o)
+      res->insert(entry.first, Merge(*b, *o));
+    else
+      res->insert(entry.first, entry.second);
+  }
+  return res;
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
@@ -0,0 +1,424 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* TOML */
+#include "node.h"
+#include "dom.h"
+
+namespace cg {
+namespace toml {
+namespace dom {
+
+/* The Builder class, lays out a cpptoml tree into a compact DOM */
+class Builder {
+ public:
+  /* Constructor */
+  Builder(guint8 *data) :
+      cursor_(data) {
+  }
+
+  /* Destructor */
+  virtual ~Builder() {
+  }
+
+  /* Gets the size of the payload of a node, without the node itself */
+  static gsize Measure(const cpptoml::base& node) {
+    gsize size = 0;
+    switch (GetValueType(cg::toml::Node {&node})) {
+      case CG_TOML_VALUE_TYPE_STRING:
+        return Align(AsValue<std::string>(&node)->get().size() + 1);
+      case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+      case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+      case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+      case CG_TOML_VALUE_TYPE_OFFSET_DATETIME:
+        return sizeof (Datetime);
+      case CG_TOML_VALUE_TYPE_ARRAY:
+        size = sizeof (guint64);
+        for (const std::shared_ptr<cpptoml::base>& v :
+            static_cast<const cpptoml::array&>(node).get())
+          size += sizeof (Node) + Measure(*v);
+        return size;
+      case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+        size = sizeof (guint64);
+        for (const std::shared_ptr<cpptoml::table>& t :
+            static_cast<const cpptoml::table_array&>(node).get())
+          size += sizeof (Node) + Measure(*t);
+        return size;
+      case CG_TOML_VALUE_TYPE_TABLE:
+        size = sizeof (guint64);
+        for (const auto& entry : static_cast<const cpptoml::table&>(node)) {
+          size += sizeof (Entry) + sizeof (Node) +
+              Align(entry.first.size() + 1) + Measure(*entry.second);
+        }
+        return size;
+      default:
+        return 0;
+    }
+  }
+
+  /* Writes a node, appending its payload. Returns its content hash */
+  guint64 Write(const cpptoml::base& src, Node *dst) {
+    dst->type = GetValueType(cg::toml::Node {&src});
+    guint64 hash = HashContent(CONTENT_HASH_SEED, &dst->type,
+        sizeof (dst->type));
+    switch (dst->type) {
+      case CG_TOML_VALUE_TYPE_BOOLEAN:
+        dst->boolean = AsValue<bool>(&src)->get() ? 1 : 0;
+        return HashContent(hash, &dst->boolean, sizeof (dst->boolean));
+      case CG_TOML_VALUE_TYPE_INT64:
+        dst->integer = AsValue<int64_t>(&src)->get();
+        return HashContent(hash, &dst->integer, sizeof (dst->integer));
+      case CG_TOML_VALUE_TYPE_DOUBLE:
+        dst->floating = AsValue<double>(&src)->get();
+        return HashContent(hash, &dst->floating, sizeof (dst->floating));
+      case CG_TOML_VALUE_TYPE_STRING: {
+        const std::string& str = AsValue<std::string>(&src)->get();
+        dst->length = str.size();
+        dst->offset = Offset(dst, WriteString(str));
+        return HashContent(hash, str.data(), str.size() + 1);
+      }
+      case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+      case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+      case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+      case CG_TOML_VALUE_TYPE_OFFSET_DATETIME: {
+        const Datetime *datetime = WriteDatetime(src);
+        dst->offset = Offset(dst, datetime);
+        return HashContent(hash, datetime, sizeof (Datetime));
+      }
+      case CG_TOML_VALUE_TYPE_ARRAY:
+        return WriteElements(static_cast<const cpptoml::array&>(src).get(),
+            dst, hash);
+      case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+        return WriteElements(
+            static_cast<const cpptoml::table_array&>(src).get(), dst, hash);
+      case CG_TOML_VALUE_TYPE_TABLE:
+        return WriteTable(static_cast<const cpptoml::table&>(src), dst, hash);
+      default:
+        return hash;
+    }
+  }
+
+  /* Gets the position where the next payload would be written */
+  const guint8 *GetCursor() const {
+    return cursor_;
+  }
+
+ private:
+  /* Rounds a size up to the alignment of the layout */
+  static gsize Align(gsize size) {
+    return (size + 7) & ~static_cast<gsize>(7);
+  }
+
+  /* Gets the offset of a payload relative to the place referring to it */
+  static gint64 Offset(const void *from, const void *to) {
+    return static_cast<const guint8 *>(to) -
+        static_cast<const guint8 *>(from);
+  }
+
+  /* Reserves room for a payload */
+  guint8 *Reserve(gsize size) {
+    guint8 *res = cursor_;
+    cursor_ += Align(size);
+    return res;
+  }
+
+  /* Writes a NUL terminated string */
+  const char *WriteString(const std::string& str) {
+    char *res = reinterpret_cast<char *>(Reserve(str.size() + 1));
+    std::memcpy(res, str.c_str(), str.size() + 1);
+    return res;
+  }
+
+  /* Writes the date and time of a value */
+  const Datetime *WriteDatetime(const cpptoml::base& src) {
+    Datetime *res = reinterpret_cast<Datetime *>(Reserve(sizeof (Datetime)));
+    if (const auto *v = AsValue<cpptoml::local_date>(&src)) {
+      SetDate(v->get(), res);
+    } else if (const auto *v = AsValue<cpptoml::local_time>(&src)) {
+      SetTime(v->get(), res);
+    } else if (const auto *v = AsValue<cpptoml::local_datetime>(&src)) {
+      SetDate(v->get(), res);
+      SetTime(v->get(), res);
+    } else if (const auto *v = AsValue<cpptoml::offset_datetime>(&src)) {
+      SetDate(v->get(), res);
+      SetTime(v->get(), res);
+      res->hour_offset = v->get().hour_offset;
+      res->minute_offset = v->get().minute_offset;
+    }
+    return res;
+  }
+
+  static void SetDate(const cpptoml::local_date& date, Datetime *dst) {
+    dst->year = date.year;
+    dst->month = date.month;
+    dst->day = date.day;
+  }
+
+  static void SetTime(const cpptoml::local_time& time, Datetime *dst) {
+    dst->hour = time.hour;
+    dst->minute = time.minute;
+    dst->second = time.second;
+    dst->microsecond = time.microsecond;
+  }
+
+  /* Writes the consecutive elements of an array or array of tables after
+   * their content hash */
+  template <typename T>
+  guint64 WriteElements(const std::vector<std::shared_ptr<T>>& values,
+      Node *dst, guint64 hash) {
+    guint64 *content_hash = reinterpret_cast<guint64 *>(
+        Reserve(sizeof (guint64)));
+    Node *elements = reinterpret_cast<Node *>(
+        Reserve(values.size() * sizeof (Node)));
+    dst->length = values.size();
+    dst->offset = Offset(dst, elements);
+    hash = HashContent(hash, &dst->length, sizeof (dst->length));
+    for (gsize i = 0; i < values.size(); i++) {
+      const guint64 h = Write(*values[i], &elements[i]);
+      hash = HashContent(hash, &h, sizeof (h));
+    }
+    *content_hash = hash;
+    return hash;
+  }
+
+  /* Writes the entries of a table sorted by hash and key, followed by its
+   * values */
+  guint64 WriteTable(const cpptoml::table& src, Node *dst, guint64 hash) {
+    using Item = std::pair<guint32, const cpptoml::string_to_base_map::
+        value_type *>;
+    std::vector<Item> items;
+    for (const auto& entry : src)
+      items.emplace_back(Hash(entry.first.data(), entry.first.size()),
+          &entry);
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+      return a.first != b.first ? a.first < b.first :
+          a.second->first < b.second->first;
+    });
+
+    guint64 *content_hash = reinterpret_cast<guint64 *>(
+        Reserve(sizeof (guint64)));
+    Entry *entries = reinterpret_cast<Entry *>(
+        Reserve(items.size() * (sizeof (Entry) + sizeof (Node))));
+    Node *values = reinterpret_cast<Node *>(entries + items.size());
+    dst->length = items.size();
+    dst->offset = Offset(dst, entries);
+    hash = HashContent(hash, &dst->length, sizeof (dst->length));
+    for (gsize i = 0; i < items.size(); i++) {
+      const std::string& key = items[i].second->first;
+      entries[i].hash = items[i].first;
+      entries[i].length = key.size();
+      entries[i].offset = Offset(&entries[i], WriteString(key));
+      hash = HashContent(hash, key.c_str(), key.size() + 1);
+      const guint64 h = Write(*items[i].second->second, &values[i]);
+      hash = HashContent(hash, &h, sizeof (h));
+    }
+    *content_hash = hash;
+    return hash;
+  }
+
+  /* Copy Constructor */
+  Builder(const Builder&) = delete;
+
+  /* Move Constructor */
+  Builder(Builder &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Builder& operator=(const Builder&) = delete;
+
+  /* Move-Assign Constructr */
+  Builder& operator=(Builder &&) = delete;
+
+ private:
+  /* Where the next payload is written */
+  guint8 *cursor_;
+};
+
+/* The Validator class, checks that the payloads of the nodes are laid out
+ * where the builder writes them, in the order it writes them */
+class Validator {
+ public:
+  /* Constructor */
+  Validator(const guint8 *cursor, const guint8 *end) :
+      cursor_(cursor),
+      end_(end) {
+  }
+
+  /* Destructor */
+  virtual ~Validator() {
+  }
+
+  /* Checks a node and its payload */
+  bool Check(const Node *node, guint depth) {
+    if (depth >= MAX_DEPTH)
+      return false;
+    switch (node->type) {
+      case CG_TOML_VALUE_TYPE_NONE:
+      case CG_TOML_VALUE_TYPE_BOOLEAN:
+      case CG_TOML_VALUE_TYPE_INT64:
+      case CG_TOML_VALUE_TYPE_DOUBLE:
+        return true;
+      case CG_TOML_VALUE_TYPE_STRING:
+        return CheckString(node, node->offset, node->length);
+      case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+      case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+      case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+      case CG_TOML_VALUE_TYPE_OFFSET_DATETIME:
+        return Take(node, node->offset, 1, sizeof (Datetime)) != nullptr;
+      case CG_TOML_VALUE_TYPE_ARRAY:
+      case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+        return CheckElements(node, depth);
+      case CG_TOML_VALUE_TYPE_TABLE:
+        return CheckTable(node, depth);
+      default:
+        return false;
+    }
+  }
+
+  /* Checks whether every byte of the block was taken by a payload */
+  bool IsAtEnd() const {
+    return cursor_ == end_;
+  }
+
+ private:
+  /* Bounds the recursion of crafted blocks */
+  static constexpr guint MAX_DEPTH = 1024;
+
+  /* Rounds a size up to the alignment of the layout */
+  static gsize Align(gsize size) {
+    return (size + 7) & ~static_cast<gsize>(7);
+  }
+
+  /* Takes the next payload of n items, the offset must refer to it. The
+   * offset is compared as a number, so a bogus one is never resolved */
+  const guint8 *Take(const void *from, gint64 offset, gsize n, gsize size) {
+    const gsize available = end_ - cursor_;
+    if (offset != cursor_ - static_cast<const guint8 *>(from) ||
+        n > available / size || Align(n * size) > available)
+      return nullptr;
+    const guint8 *res = cursor_;
+    cursor_ += Align(n * size);
+    return res;
+  }
+
+  /* Takes the content hash that precedes elements and entries */
+  bool TakeContentHash() {
+    return Take(cursor_, 0, 1, sizeof (guint64)) != nullptr;
+  }
+
+  /* Checks a NUL terminated string */
+  bool CheckString(const void *from, gint64 offset, guint32 length) {
+    const guint8 *str = Take(from, offset, static_cast<gsize>(length) + 1, 1);
+    return str && str[length] == '\0';
+  }
+
+  /* Checks the elements of an array or array of tables */
+  bool CheckElements(const Node *node, guint depth) {
+    if (!TakeContentHash())
+      return false;
+    const Node *elements = reinterpret_cast<const Node *>(
+        Take(node, node->offset, node->length, sizeof (Node)));
+    if (!elements)
+      return false;
+    for (gsize i = 0; i < node->length; i++) {
+      if (node->type == CG_TOML_VALUE_TYPE_TABLE_ARRAY &&
+          elements[i].type != CG_TOML_VALUE_TYPE_TABLE)
+        return false;
+      if (!Check(&elements[i], depth + 1))
+        return false;
+    }
+    return true;
+  }
+
+  /* Checks the entries and values of a table */
+  bool CheckTable(const Node *node, guint depth) {
+    if (!TakeContentHash())
+      return false;
+    const Entry *entries = reinterpret_cast<const Entry *>(
+        Take(node, node->offset, node->length, sizeof (Entry) + sizeof (Node)));
+    if (!entries)
+      return false;
+    const Node *values = reinterpret_cast<const Node *>(entries + node->length);
+    for (gsize i = 0; i < node->length; i++) {
+      if (!CheckString(&entries[i], entries[i].offset, entries[i].length) ||
+          !Check(&values[i], depth + 1))
+        return false;
+    }
+    return true;
+  }
+
+  /* Copy Constructor */
+  Validator(const Validator&) = delete;
+
+  /* Move Constructor */
+  Validator(Validator &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Validator& operator=(const Validator&) = delete;
+
+  /* Move-Assign Constructr */
+  Validator& operator=(Validator &&) = delete;
+
+ private:
+  /* The start of the next payload */
+  const guint8 *cursor_;
+
+  /* The end of the block */
+  const guint8 *const end_;
+};
+
+bool
+IsValid(const void *data, gsize size)
+{
+  const Header *header = static_cast<const Header *>(data);
+  if (reinterpret_cast<guintptr>(data) % 8 != 0 ||
+      size < sizeof (Header) ||
+      std::memcmp(header->magic, MAGIC, sizeof (MAGIC)) != 0 ||
+      header->version != VERSION ||
+      header->size != size ||
+      header->root.type != CG_TOML_VALUE_TYPE_TABLE)
+    return false;
+
+  const guint8 *start = static_cast<const guint8 *>(data);
+  Validator validator {start + sizeof (Header), start + size};
+  return validator.Check(&header->root, 0) && validator.IsAtEnd();
+}
+
+}  /* namespace dom */
+
+std::shared_ptr<const Dom>
+Dom::New(const cpptoml::table& root)
+{
+  /* Everything goes into a single zeroed block, measured up front */
+  const gsize size = sizeof (dom::Header) + dom::Builder::Measure(root);
+  guint8 *data = static_cast<guint8 *>(g_malloc0 (size));
+  std::shared_ptr<const Dom> res {new Dom {g_bytes_new_take (data, size)}};
+
+  /* Write the header and the tree */
+  dom::Header *header = reinterpret_cast<dom::Header *>(data);
+  std::memcpy(header->magic, dom::MAGIC, sizeof (header->magic));
+  header->version = dom::VERSION;
+  header->size = size;
+  dom::Builder builder {data + sizeof (dom::Header)};
+  builder.Write(root, &header->root);
+  g_assert (builder.GetCursor() == data + size);
+
+  return res;
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
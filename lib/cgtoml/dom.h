@@ -0,0 +1,241 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_DOM_H__
+#define __CG_TOML_DOM_H__
+
+/* C++ STL */
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* GLib */
+#include <glib.h>
+
+/* TOML */
+#include "value.h"
+
+namespace cg {
+namespace toml {
+namespace dom {
+
+/* The compact DOM keeps a whole document in a single block of memory. Nodes
+ * refer to their strings and children with offsets relative to themselves,
+ * so the block can be moved around, written to disk and mapped back as is.
+ * Every part of the block is aligned to 8 bytes. */
+
+/* The version of the layout, it must be bumped on any change to it */
+constexpr guint32 VERSION = 2;
+
+/* A node, whose payload depends on its type:
+ *  - Booleans, integers and doubles are stored in the node itself.
+ *  - Strings point to their NUL terminated bytes.
+ *  - Arrays and arrays of tables point to their consecutive elements.
+ *  - Tables point to their entries, sorted by hash and key, which are
+ *    immediately followed by the values in the same order.
+ *  - Dates and times point to a Datetime.
+ * The elements and entries are preceded by the content hash of their
+ * subtree, so equal subtrees of two documents are found without walking
+ * them. */
+struct Node {
+  guint8 type;
+  guint8 boolean;
+  guint16 padding;
+  guint32 length;
+  union {
+    gint64 integer;
+    double floating;
+    gint64 offset;
+  };
+};
+
+/* The key of a table entry */
+struct Entry {
+  guint32 hash;
+  guint32 length;
+  gint64 offset;
+};
+
+/* A date, a time or both, with an optional offset */
+struct Datetime {
+  gint32 year;
+  gint32 month;
+  gint32 day;
+  gint32 hour;
+  gint32 minute;
+  gint32 second;
+  gint32 microsecond;
+  gint32 hour_offset;
+  gint32 minute_offset;
+  gint32 padding;
+};
+
+/* The header at the start of the block */
+struct Header {
+  char magic[8];
+  guint32 version;
+  guint32 padding;
+  guint64 size;
+  Node root;
+};
+
+static_assert (sizeof (Node) == 16, "Unexpected size of dom::Node");
+static_assert (sizeof (Entry) == 16, "Unexpected size of dom::Entry");
+static_assert (sizeof (Datetime) % 8 == 0, "Unexpected size of dom::Datetime");
+static_assert (sizeof (Header) % 8 == 0, "Unexpected size of dom::Header");
+
+/* The magic at the start of the header */
+constexpr char MAGIC[8] = "CGTOMLD";
+
+/* Gets the header of the block holding a root node */
+inline const Header *GetHeader(const Node *root) {
+  return reinterpret_cast<const Header *>(
+      reinterpret_cast<const guint8 *>(root) - offsetof(Header, root));
+}
+
+/* Checks whether a block of memory holds a compact DOM of this layout.
+ * Besides the header, the nodes are walked in the order they were written,
+ * so every offset must refer to a payload inside the block */
+bool IsValid(const void *data, gsize size);
+
+/* Hashes a key, the hash is part of the layout so it must never change */
+inline guint32 Hash(const char *key, gsize len) {
+  guint32 hash = 2166136261u;
+  for (gsize i = 0; i < len; i++) {
+    hash ^= static_cast<guint8>(key[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* The seed of content hashes */
+constexpr guint64 CONTENT_HASH_SEED = 14695981039346656037ull;
+
+/* Adds bytes to a content hash, FNV-1a as for keys but on 64 bits. It is
+ * part of the layout so it must never change */
+inline guint64 HashContent(guint64 hash, const void *data, gsize len) {
+  const guint8 *p = static_cast<const guint8 *>(data);
+  for (gsize i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/* Resolves an offset relative to the given address */
+template <typename T>
+inline const T *Resolve(const void *from, gint64 offset) {
+  return reinterpret_cast<const T *>(
+      static_cast<const guint8 *>(from) + offset);
+}
+
+/* Gets the bytes of a string node */
+inline const char *GetString(const Node *node) {
+  return Resolve<char>(node, node->offset);
+}
+
+/* Gets the elements of an array or array of tables node */
+inline const Node *GetElements(const Node *node) {
+  return Resolve<Node>(node, node->offset);
+}
+
+/* Gets the entries of a table node */
+inline const Entry *GetEntries(const Node *node) {
+  return Resolve<Entry>(node, node->offset);
+}
+
+/* Gets the values of a table node */
+inline const Node *GetValues(const Node *node) {
+  return reinterpret_cast<const Node *>(GetEntries(node) + node->length);
+}
+
+/* Gets the key of a table entry */
+inline const char *GetKey(const Entry *entry) {
+  return Resolve<char>(entry, entry->offset);
+}
+
+/* Gets the content hash of an array, array of tables or table node */
+inline guint64 GetContentHash(const Node *node) {
+  return Resolve<guint64>(node, node->offset)[-1];
+}
+
+/* Gets the date and time of a date or time node */
+inline const Datetime *GetDatetime(const Node *node) {
+  return Resolve<Datetime>(node, node->offset);
+}
+
+/* Looks up a key with the given hash in a table node */
+inline const Node *Lookup(const Node *table, const char *key, gsize len,
+    guint32 hash) {
+  const Entry *entries = GetEntries(table);
+  const Entry *end = entries + table->length;
+  const Entry *entry = std::lower_bound(entries, end, hash,
+      [](const Entry& e, guint32 h) { return e.hash < h; });
+  for (; entry != end && entry->hash == hash; entry++) {
+    if (entry->length == len && std::memcmp(GetKey(entry), key, len) == 0)
+      return GetValues(table) + (entry - entries);
+  }
+  return nullptr;
+}
+
+}  /* namespace dom */
+
+/* The Dom class, a whole document in a single block of memory */
+class Dom {
+ public:
+  /* Builds the compact DOM of a cpptoml tree */
+  static std::shared_ptr<const Dom> New(const cpptoml::table& root);
+
+  /* Constructor, takes the ownership of the bytes */
+  Dom(GBytes *bytes) :
+      bytes_(bytes) {
+  }
+
+  /* Destructor */
+  virtual ~Dom() {
+    g_bytes_unref(bytes_);
+  }
+
+  /* Gets the root table */
+  const dom::Node *GetRoot() const {
+    const dom::Header *header =
+        static_cast<const dom::Header *>(g_bytes_get_data(bytes_, nullptr));
+    return &header->root;
+  }
+
+  /* Gets the block of memory */
+  GBytes *GetBytes() const {
+    return bytes_;
+  }
+
+ private:
+  /* Copy Constructor */
+  Dom(const Dom&) = delete;
+
+  /* Move Constructor */
+  Dom(Dom &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Dom& operator=(const Dom&) = delete;
+
+  /* Move-Assign Constructr */
+  Dom& operator=(Dom &&) = delete;
+
+ private:
+  /* The block of memory */
+  GBytes *const bytes_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
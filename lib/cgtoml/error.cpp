@@ -0,0 +1,12 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* TOML */
+#include "error.h"
+
+G_DEFINE_QUARK (cg-toml-error-quark, cg_toml_error)
@@ -0,0 +1,31 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_ERROR_H__
+#define __CG_TOML_ERROR_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* CgTomlError */
+#define CG_TOML_ERROR (cg_toml_error_quark ())
+GQuark cg_toml_error_quark (void);
+
+typedef enum {
+  CG_TOML_ERROR_FAILED,
+  CG_TOML_ERROR_TYPE_MISMATCH,
+  CG_TOML_ERROR_INVALID_SNAPSHOT,
+  CG_TOML_ERROR_PARSE,
+  CG_TOML_ERROR_STOPPED,
+  CG_TOML_ERROR_MISSING_FIELD,
+} CgTomlError;
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,201 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_FIELD_H__
+#define __CG_TOML_FIELD_H__
+
+/* C++ STL */
+#include <limits>
+
+/* GLib */
+#include <glib.h>
+
+/* TOML */
+#include "node.h"
+#include "schema.h"
+
+namespace cg {
+namespace toml {
+
+/* Storage of values into the C variables described by a CgTomlFieldType,
+ * shared by schemas and batched getters */
+
+/* Gets the size of the C type of a field, 0 if the type is invalid */
+inline gsize GetFieldTypeSize(CgTomlFieldType type) {
+  switch (type) {
+    case CG_TOML_FIELD_TYPE_BOOLEAN:
+      return sizeof (gboolean);
+    case CG_TOML_FIELD_TYPE_INT8:
+    case CG_TOML_FIELD_TYPE_UINT8:
+      return sizeof (int8_t);
+    case CG_TOML_FIELD_TYPE_INT16:
+    case CG_TOML_FIELD_TYPE_UINT16:
+      return sizeof (int16_t);
+    case CG_TOML_FIELD_TYPE_INT32:
+    case CG_TOML_FIELD_TYPE_UINT32:
+      return sizeof (int32_t);
+    case CG_TOML_FIELD_TYPE_INT64:
+    case CG_TOML_FIELD_TYPE_UINT64:
+      return sizeof (int64_t);
+    case CG_TOML_FIELD_TYPE_DOUBLE:
+      return sizeof (double);
+    case CG_TOML_FIELD_TYPE_STRING:
+      return sizeof (char *);
+    default:
+      return 0;
+  }
+}
+
+/* Gets the name of the C type of a field */
+inline const char *GetFieldTypeName(CgTomlFieldType type) {
+  switch (type) {
+    case CG_TOML_FIELD_TYPE_BOOLEAN:
+      return "boolean";
+    case CG_TOML_FIELD_TYPE_INT8:
+      return "int8";
+    case CG_TOML_FIELD_TYPE_UINT8:
+      return "uint8";
+    case CG_TOML_FIELD_TYPE_INT16:
+      return "int16";
+    case CG_TOML_FIELD_TYPE_UINT16:
+      return "uint16";
+    case CG_TOML_FIELD_TYPE_INT32:
+      return "int32";
+    case CG_TOML_FIELD_TYPE_UINT32:
+      return "uint32";
+    case CG_TOML_FIELD_TYPE_INT64:
+      return "int64";
+    case CG_TOML_FIELD_TYPE_UINT64:
+      return "uint64";
+    case CG_TOML_FIELD_TYPE_DOUBLE:
+      return "double";
+    case CG_TOML_FIELD_TYPE_STRING:
+      return "string";
+    default:
+      return "unknown";
+  }
+}
+
+/* Checks whether an integer fits in the given type */
+template <typename T>
+inline bool FitsIn(int64_t i) {
+  return i >= static_cast<int64_t>(std::numeric_limits<T>::min()) &&
+      (i < 0 || static_cast<uint64_t>(i) <=
+          static_cast<uint64_t>(std::numeric_limits<T>::max()));
+}
+
+/* Checks whether a default fits in the type of its field */
+inline bool CheckFieldDefault(CgTomlFieldType type,
+    const CgTomlFieldDefault& d) {
+  switch (type) {
+    case CG_TOML_FIELD_TYPE_INT8:
+      return FitsIn<int8_t>(d.v_int64);
+    case CG_TOML_FIELD_TYPE_UINT8:
+      return FitsIn<uint8_t>(d.v_int64);
+    case CG_TOML_FIELD_TYPE_INT16:
+      return FitsIn<int16_t>(d.v_int64);
+    case CG_TOML_FIELD_TYPE_UINT16:
+      return FitsIn<uint16_t>(d.v_int64);
+    case CG_TOML_FIELD_TYPE_INT32:
+      return FitsIn<int32_t>(d.v_int64);
+    case CG_TOML_FIELD_TYPE_UINT32:
+      return FitsIn<uint32_t>(d.v_int64);
+    default:
+      return true;
+  }
+}
+
+/* Stores a value in a variable of the given type, failing if the value has
+ * another type or does not fit. Strings are duplicated */
+inline bool StoreField(CgTomlFieldType type, Node value, gpointer dst) {
+  switch (type) {
+    case CG_TOML_FIELD_TYPE_BOOLEAN: {
+      bool b = false;
+      if (!GetValue(value, &b))
+        return false;
+      *static_cast<gboolean *>(dst) = b ? TRUE : FALSE;
+      return true;
+    }
+    case CG_TOML_FIELD_TYPE_INT8:
+      return GetValue(value, static_cast<int8_t *>(dst));
+    case CG_TOML_FIELD_TYPE_UINT8:
+      return GetValue(value, static_cast<uint8_t *>(dst));
+    case CG_TOML_FIELD_TYPE_INT16:
+      return GetValue(value, static_cast<int16_t *>(dst));
+    case CG_TOML_FIELD_TYPE_UINT16:
+      return GetValue(value, static_cast<uint16_t *>(dst));
+    case CG_TOML_FIELD_TYPE_INT32:
+      return GetValue(value, static_cast<int32_t *>(dst));
+    case CG_TOML_FIELD_TYPE_UINT32:
+      return GetValue(value, static_cast<uint32_t *>(dst));
+    case CG_TOML_FIELD_TYPE_INT64:
+      return GetValue(value, static_cast<int64_t *>(dst));
+    case CG_TOML_FIELD_TYPE_UINT64:
+      return GetValue(value, static_cast<uint64_t *>(dst));
+    case CG_TOML_FIELD_TYPE_DOUBLE:
+      return GetValue(value, static_cast<double *>(dst));
+    case CG_TOML_FIELD_TYPE_STRING: {
+      gsize len = 0;
+      const char *str = GetString(value, &len);
+      if (!str)
+        return false;
+      *static_cast<char **>(dst) = g_strndup (str, len);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+/* Stores a default in a variable of the given type. Strings are
+ * duplicated */
+inline void StoreFieldDefault(CgTomlFieldType type,
+    const CgTomlFieldDefault& d, gpointer dst) {
+  switch (type) {
+    case CG_TOML_FIELD_TYPE_BOOLEAN:
+      *static_cast<gboolean *>(dst) = d.v_boolean;
+      break;
+    case CG_TOML_FIELD_TYPE_INT8:
+      *static_cast<int8_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_UINT8:
+      *static_cast<uint8_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_INT16:
+      *static_cast<int16_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_UINT16:
+      *static_cast<uint16_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_INT32:
+      *static_cast<int32_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_UINT32:
+      *static_cast<uint32_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_INT64:
+      *static_cast<int64_t *>(dst) = d.v_int64;
+      break;
+    case CG_TOML_FIELD_TYPE_UINT64:
+      *static_cast<uint64_t *>(dst) = d.v_uint64;
+      break;
+    case CG_TOML_FIELD_TYPE_DOUBLE:
+      *static_cast<double *>(dst) = d.v_double;
+      break;
+    case CG_TOML_FIELD_TYPE_STRING:
+      *static_cast<char **>(dst) = g_strdup (d.v_string);
+      break;
+    default:
+      break;
+  }
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
@@ -6,52 +6,785 @@
  * SPDX-License-Identifier: MIT
  */
 
+/* C++ STL */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <vector>
+
+/* GLib */
+#include <glib/gstdio.h>
+
 /* CPPTOML */
 #include <include/cpptoml.h>
 
 /* TOML */
 #include "private.h"
+#include "buffer.h"
+#include "node.h"
+#include "dom.h"
+#include "lazy.h"
+#include "directory.h"
+#include "patch.h"
+#include "error.h"
 #include "file.h"
 
+namespace cg {
+namespace toml {
+
+/* The version of the snapshot format, it must be bumped on any change */
+constexpr guint32 SNAPSHOT_VERSION = 1;
+
+/* Written in native byte order to reject snapshots from other machines */
+constexpr guint32 SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+/* The magic at the start of a snapshot */
+constexpr char SNAPSHOT_MAGIC[8] = "CGTOMLS";
+
+/* The identity of the text a snapshot was made from */
+struct SnapshotSource {
+  guint64 size;
+  gint64 mtime;
+  guint8 hash[32];
+};
+
+/* The header of a snapshot. It is followed by the NUL terminated name of
+ * the file, padded to 8 bytes, and by the compact DOM, which is used in
+ * place once the snapshot is mapped */
+struct SnapshotHeader {
+  char magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 name_size;
+  guint32 has_source;
+  SnapshotSource source;
+  guint64 dom_size;
+};
+
+static_assert (sizeof (SnapshotHeader) % 8 == 0,
+    "Unexpected size of SnapshotHeader");
+
+/* The bytes parsed between progress reports and cancellation checks of
+ * asynchronous loads */
+constexpr gsize ASYNC_CHUNK_SIZE = 1024 * 1024;
+
+/* A file of a directory, parsed in a worker thread */
+struct Fragment {
+  std::string path;
+  std::shared_ptr<cpptoml::table> root;
+  GError *error;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+static gboolean
+snapshot_source_stat (const char *name, cg::toml::SnapshotSource *source)
+{
+  GStatBuf st;
+  if (g_stat (name, &st) != 0)
+    return false;
+  source->size = st.st_size;
+  source->mtime = st.st_mtime;
+  return true;
+}
+
+static void
+snapshot_source_hash (const char *data, gsize size,
+    cg::toml::SnapshotSource *source)
+{
+  GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, reinterpret_cast<const guchar *>(data), size);
+  gsize len = sizeof (source->hash);
+  g_checksum_get_digest (checksum, source->hash, &len);
+  g_checksum_free (checksum);
+}
+
 struct _CgTomlFile
 {
   char *name;
   CgTomlTable *table;
+
+  /* The text the table was parsed from, if it was parsed from the file */
+  gboolean has_source;
+  cg::toml::SnapshotSource source;
 };
 
 G_DEFINE_BOXED_TYPE(CgTomlFile, cg_toml_file, cg_toml_file_ref,
     cg_toml_file_unref)
 
+/* Records the text a file was parsed from, patching it checks that the file
+ * still holds it. Lazy documents keep their text and do not need it */
+static void
+cg_toml_file_set_source (CgTomlFile *self, const char *data, gsize size)
+{
+  self->source.size = size;
+  snapshot_source_hash (data, size, &self->source);
+  self->has_source = true;
+}
+
+static CgTomlFile *cg_toml_file_new_cached (const char *name,
+    GError **error);
+static CgTomlFile *cg_toml_file_new_lazy (const char *name, GError **error);
+
+static CgTomlTable *
+cg_toml_file_new_table (std::shared_ptr<cpptoml::table> root,
+    CgTomlFileFlags flags)
+{
+  /* Lay out the tree into a compact DOM if requested, the tree itself is
+   * dropped right after */
+  if (flags & CG_TOML_FILE_FLAGS_COMPACT) {
+    std::shared_ptr<const cg::toml::Dom> dom = cg::toml::Dom::New(*root);
+    cg::toml::OwnedNode data {dom, cg::toml::Node {dom->GetRoot()}};
+    return cg_toml_table_new (static_cast<gconstpointer>(&data));
+  }
+
+  cg::toml::OwnedNode data {root, cg::toml::Node {root.get()}};
+  return cg_toml_table_new (static_cast<gconstpointer>(&data));
+}
+
+static CgTomlFile *
+cg_toml_file_new_checked (CgTomlFile *self, GError *error)
+{
+  /* Creators without a GError report failures as criticals */
+  if (!self) {
+    g_critical ("Could not create CgTomlFile: %s", error->message);
+    g_error_free (error);
+  }
+  return self;
+}
+
+static CgTomlFile *
+cg_toml_file_new_from_data (const char *name, const char *data, gsize size,
+    CgTomlFileFlags flags, GError **error)
+{
+  g_return_val_if_fail (data || size == 0, nullptr);
+
+  try {
+    g_autoptr (CgTomlFile) self = g_atomic_rc_box_new0 (CgTomlFile);
+
+    /* Set the name */
+    self->name = g_strdup (name);
+
+    /* Set the table by parsing the data in place */
+    cg::toml::MemoryBuffer buffer {data, size};
+    std::istream stream {&buffer};
+    cpptoml::parser parser {stream};
+    std::shared_ptr<cpptoml::table> table = parser.parse();
+    self->table = cg_toml_file_new_table (std::move(table), flags);
+
+    return static_cast<CgTomlFile *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not create CgTomlFile from '%s': %s",
+        name ? name : "data", ba.what());
+    return nullptr;
+  } catch (std::exception& e) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s': %s", name ? name : "data", e.what());
+    return nullptr;
+  } catch (...) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s'", name ? name : "data");
+    return nullptr;
+  }
+}
+
+static CgTomlFile *
+cg_toml_file_new_parsed (const char *name, CgTomlFileFlags flags,
+    GError **error)
+{
+  /* Map the file, the file does not need it once parsed */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (name, FALSE, error);
+  if (!mapped)
+    return nullptr;
+  const char *data = g_mapped_file_get_contents (mapped);
+  const gsize size = g_mapped_file_get_length (mapped);
+
+  CgTomlFile *self = cg_toml_file_new_from_data (name, data, size, flags,
+      error);
+  if (self)
+    cg_toml_file_set_source (self, data, size);
+  return self;
+}
+
+static CgTomlFile *
+cg_toml_file_load (const char *name, CgTomlFileFlags flags, GError **error)
+{
+  if (flags & CG_TOML_FILE_FLAGS_CACHE)
+    return cg_toml_file_new_cached (name, error);
+  if (flags & CG_TOML_FILE_FLAGS_LAZY)
+    return cg_toml_file_new_lazy (name, error);
+  return cg_toml_file_new_parsed (name, flags, error);
+}
+
 CgTomlFile *
 cg_toml_file_new (const char *name)
+{
+  return cg_toml_file_new_full (name, CG_TOML_FILE_FLAGS_NONE);
+}
+
+CgTomlFile *
+cg_toml_file_new_full (const char *name, CgTomlFileFlags flags)
 {
   g_return_val_if_fail (name, nullptr);
 
+  GError *error = nullptr;
+  CgTomlFile *self = cg_toml_file_load (name, flags, &error);
+  return cg_toml_file_new_checked (self, error);
+}
+
+CgTomlFile *
+cg_toml_file_new_from_bytes (GBytes *bytes)
+{
+  g_return_val_if_fail (bytes, nullptr);
+
+  gsize size = 0;
+  const char *data = static_cast<const char *>(g_bytes_get_data (bytes, &size));
+  GError *error = nullptr;
+  CgTomlFile *self = cg_toml_file_new_from_data (nullptr, data, size,
+      CG_TOML_FILE_FLAGS_NONE, &error);
+  return cg_toml_file_new_checked (self, error);
+}
+
+CgTomlFile *
+cg_toml_file_new_mapped (const char *name)
+{
+  g_return_val_if_fail (name, nullptr);
+
+  GError *error = nullptr;
+  CgTomlFile *self = cg_toml_file_new_parsed (name, CG_TOML_FILE_FLAGS_NONE,
+      &error);
+  return cg_toml_file_new_checked (self, error);
+}
+
+static CgTomlFile *
+cg_toml_file_new_lazy (const char *name, GError **error)
+{
+  /* Map the file, the document keeps the mapping to parse its sections */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (name, FALSE, error);
+  if (!mapped)
+    return nullptr;
+  g_autoptr (GBytes) text = g_mapped_file_get_bytes (mapped);
+
   try {
-    g_autoptr (CgTomlFile) self = g_rc_box_new (CgTomlFile);
+    /* Parse the whole text if it cannot be split into sections */
+    std::shared_ptr<const cg::toml::LazyDocument> document =
+        cg::toml::LazyDocument::New(g_bytes_ref (text));
+    if (!document) {
+      const char *data = g_mapped_file_get_contents (mapped);
+      const gsize size = g_mapped_file_get_length (mapped);
+      CgTomlFile *self = cg_toml_file_new_from_data (name, data, size,
+          CG_TOML_FILE_FLAGS_NONE, error);
+      if (self)
+        cg_toml_file_set_source (self, data, size);
+      return self;
+    }
+
+    g_autoptr (CgTomlFile) self = g_atomic_rc_box_new0 (CgTomlFile);
 
     /* Set the name */
     self->name = g_strdup (name);
 
-    /* Set the table by parsing the file */
-    std::shared_ptr<cpptoml::table> data = cpptoml::parse_file(name);
-    self->table = cg_toml_table_new (static_cast<gconstpointer>(&data));
+    /* Set the table, its sections are parsed when looked up */
+    cg::toml::OwnedNode d {document, cg::toml::Node {document.get()}};
+    self->table = cg_toml_table_new (static_cast<gconstpointer>(&d));
 
     return static_cast<CgTomlFile *>(g_steal_pointer (&self));
   } catch (std::bad_alloc& ba) {
-    g_critical ("Could not create CgTomlFile from '%s': %s", name, ba.what());
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not create CgTomlFile from '%s': %s", name, ba.what());
+    return nullptr;
+  } catch (std::exception& e) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s': %s", name, e.what());
     return nullptr;
   } catch (...) {
-    g_critical ("Could not create CgTomlFile from '%s'", name);
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s'", name);
     return nullptr;
   }
 }
 
+static gsize
+snapshot_align (gsize size)
+{
+  return (size + 7) & ~static_cast<gsize>(7);
+}
+
+static gboolean
+snapshot_write (const char *path, const char *name,
+    const cg::toml::dom::Header *dom, const cg::toml::SnapshotSource *source,
+    GError **error)
+{
+  const gsize name_size = name ? std::strlen (name) + 1 : 0;
+  const gsize dom_offset =
+      sizeof (cg::toml::SnapshotHeader) + snapshot_align (name_size);
+  const gsize size = dom_offset + dom->size;
+  g_autofree char *data = static_cast<char *>(g_malloc0 (size));
+
+  /* Header */
+  cg::toml::SnapshotHeader *header =
+      reinterpret_cast<cg::toml::SnapshotHeader *>(data);
+  std::memcpy (header->magic, cg::toml::SNAPSHOT_MAGIC,
+      sizeof (header->magic));
+  header->version = cg::toml::SNAPSHOT_VERSION;
+  header->byte_order = cg::toml::SNAPSHOT_BYTE_ORDER;
+  header->name_size = name_size;
+  header->has_source = source != nullptr;
+  if (source)
+    header->source = *source;
+  header->dom_size = dom->size;
+
+  /* Name and DOM */
+  if (name)
+    std::memcpy (data + sizeof (cg::toml::SnapshotHeader), name, name_size);
+  std::memcpy (data + dom_offset, dom, dom->size);
+
+  return g_file_set_contents (path, data, size, error);
+}
+
+static CgTomlFile *
+snapshot_load (const char *path, cg::toml::SnapshotSource *source,
+    gboolean *has_source, GError **error)
+{
+  /* Map the snapshot, the DOM keeps the mapping alive */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (path, FALSE, error);
+  if (!mapped)
+    return nullptr;
+  g_autoptr (GBytes) bytes = g_mapped_file_get_bytes (mapped);
+  gsize size = 0;
+  const char *data = static_cast<const char *>(g_bytes_get_data (bytes, &size));
+
+  /* Check the header */
+  const cg::toml::SnapshotHeader *header =
+      reinterpret_cast<const cg::toml::SnapshotHeader *>(data);
+  if (size < sizeof (cg::toml::SnapshotHeader) ||
+      std::memcmp (header->magic, cg::toml::SNAPSHOT_MAGIC,
+          sizeof (header->magic)) != 0 ||
+      header->version != cg::toml::SNAPSHOT_VERSION ||
+      header->byte_order != cg::toml::SNAPSHOT_BYTE_ORDER) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_INVALID_SNAPSHOT,
+        "'%s' is not a compatible snapshot", path);
+    return nullptr;
+  }
+
+  /* Check the name and the DOM */
+  const char *name = data + sizeof (cg::toml::SnapshotHeader);
+  const gsize dom_offset =
+      sizeof (cg::toml::SnapshotHeader) + snapshot_align (header->name_size);
+  if (dom_offset > size || size - dom_offset != header->dom_size ||
+      (header->name_size > 0 && name[header->name_size - 1] != '\0') ||
+      !cg::toml::dom::IsValid (data + dom_offset, header->dom_size)) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_INVALID_SNAPSHOT,
+        "'%s' is a corrupted snapshot", path);
+    return nullptr;
+  }
+
+  if (source)
+    *source = header->source;
+  if (has_source)
+    *has_source = header->has_source != 0;
+
+  try {
+    g_autoptr (CgTomlFile) self = g_atomic_rc_box_new0 (CgTomlFile);
+
+    /* Set the name and the text it was made from */
+    self->name = header->name_size > 0 ? g_strdup (name) : nullptr;
+    self->has_source = header->has_source != 0;
+    self->source = header->source;
+
+    /* Use the DOM in place */
+    std::shared_ptr<const cg::toml::Dom> dom {new cg::toml::Dom {
+        g_bytes_new_from_bytes (bytes, dom_offset, header->dom_size)}};
+    cg::toml::OwnedNode d {dom, cg::toml::Node {dom->GetRoot()}};
+    self->table = cg_toml_table_new (static_cast<gconstpointer>(&d));
+
+    return static_cast<CgTomlFile *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not load snapshot '%s': %s", path, ba.what());
+    return nullptr;
+  }
+}
+
+static char *
+snapshot_get_cache_path (const char *name)
+{
+  g_autofree char *path = g_canonicalize_filename (name, nullptr);
+  g_autofree char *key = g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+      path, -1);
+  g_autofree char *file_name = g_strconcat (key, ".snapshot", nullptr);
+  return g_build_filename (g_get_user_cache_dir (), "cgtoml", file_name,
+      nullptr);
+}
+
+static CgTomlFile *
+cg_toml_file_new_cached (const char *name, GError **error)
+{
+  /* Without a source there is nothing to cache, let parsing report it */
+  cg::toml::SnapshotSource source = {};
+  if (!snapshot_source_stat (name, &source))
+    return cg_toml_file_new_parsed (name, CG_TOML_FILE_FLAGS_COMPACT, error);
+
+  /* Map the source, it is needed to check the cache and to parse it */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (name, FALSE, error);
+  if (!mapped)
+    return nullptr;
+  const char *data = g_mapped_file_get_contents (mapped);
+  const gsize size = g_mapped_file_get_length (mapped);
+
+  /* Use the cached snapshot if it was made from the same source. Size and
+   * modification time discard most stale snapshots without hashing */
+  g_autofree char *cache = snapshot_get_cache_path (name);
+  cg::toml::SnapshotSource cached = {};
+  gboolean has_source = false;
+  g_autoptr (CgTomlFile) snapshot = snapshot_load (cache, &cached, &has_source,
+      nullptr);
+  if (snapshot && has_source && cached.size == source.size &&
+      cached.mtime == source.mtime) {
+    snapshot_source_hash (data, size, &source);
+    if (std::memcmp (cached.hash, source.hash, sizeof (source.hash)) == 0) {
+      /* The same file may have been opened with another relative name */
+      g_free (snapshot->name);
+      snapshot->name = g_strdup (name);
+      return static_cast<CgTomlFile *>(g_steal_pointer (&snapshot));
+    }
+  } else {
+    snapshot_source_hash (data, size, &source);
+  }
+
+  /* Otherwise parse the text and refresh the snapshot */
+  CgTomlFile *self = cg_toml_file_new_from_data (name, data, size,
+      CG_TOML_FILE_FLAGS_COMPACT, error);
+  if (!self)
+    return nullptr;
+  self->has_source = true;
+  self->source = source;
+  GError *cache_error = nullptr;
+  g_autofree char *dir = g_path_get_dirname (cache);
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_table_get_data (self->table));
+  if (g_mkdir_with_parents (dir, 0700) != 0 ||
+      !snapshot_write (cache, name,
+          cg::toml::dom::GetHeader (d->node.GetCompact()), &source,
+          &cache_error)) {
+    g_debug ("Could not cache '%s' in '%s': %s", name, cache,
+        cache_error ? cache_error->message : g_strerror (errno));
+    g_clear_error (&cache_error);
+  }
+  return self;
+}
+
+CgTomlFile *
+cg_toml_file_new_from_node (const char *name, gconstpointer data)
+{
+  try {
+    g_autoptr (CgTomlFile) self = g_atomic_rc_box_new0 (CgTomlFile);
+
+    /* Set the name */
+    self->name = g_strdup (name);
+
+    /* Set the table */
+    self->table = cg_toml_table_new (data);
+
+    return static_cast<CgTomlFile *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlFile from '%s': %s", name, ba.what());
+    return nullptr;
+  }
+}
+
+CgTomlFile *
+cg_toml_file_new_from_table (const char *name, const CgTomlTable *table)
+{
+  g_return_val_if_fail (table, nullptr);
+
+  return cg_toml_file_new_from_node (name, cg_toml_table_get_data (table));
+}
+
+CgTomlFile *
+cg_toml_file_new_from_snapshot (const char *path, GError **error)
+{
+  g_return_val_if_fail (path, nullptr);
+
+  return snapshot_load (path, nullptr, nullptr, error);
+}
+
+static void
+directory_parse_fragment (gpointer data, gpointer user_data)
+{
+  cg::toml::Fragment *f = static_cast<cg::toml::Fragment *>(data);
+
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (f->path.c_str (), FALSE,
+      &f->error);
+  if (!mapped)
+    return;
+
+  try {
+    cg::toml::MemoryBuffer buffer {g_mapped_file_get_contents (mapped),
+        g_mapped_file_get_length (mapped)};
+    std::istream stream {&buffer};
+    cpptoml::parser parser {stream};
+    f->root = parser.parse();
+  } catch (std::bad_alloc& ba) {
+    g_set_error (&f->error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not parse '%s': %s", f->path.c_str (), ba.what());
+  } catch (std::exception& e) {
+    g_set_error (&f->error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s': %s", f->path.c_str (), e.what());
+  }
+}
+
+CgTomlFile *
+cg_toml_file_new_from_directory (const char *path, CgTomlFileFlags flags,
+    GError **error)
+{
+  g_return_val_if_fail (path, nullptr);
+
+  /* List the files, in the order they are merged */
+  std::vector<cg::toml::Fragment> fragments;
+  try {
+    std::vector<std::string> names;
+    if (!cg::toml::ListFragments (path, &names, error))
+      return nullptr;
+    for (const auto& name : names) {
+      g_autofree char *file = g_build_filename (path, name.c_str (), nullptr);
+      fragments.push_back ({file, nullptr, nullptr});
+    }
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not list '%s': %s", path, ba.what());
+    return nullptr;
+  }
+
+  /* Parse the files across the cores */
+  const guint n_threads = std::min<guint> (g_get_num_processors (),
+      fragments.size());
+  GThreadPool *pool = n_threads > 1 ?
+      g_thread_pool_new (directory_parse_fragment, nullptr, n_threads, FALSE,
+          nullptr) : nullptr;
+  for (auto& f : fragments) {
+    if (!pool || !g_thread_pool_push (pool, &f, nullptr))
+      directory_parse_fragment (&f, nullptr);
+  }
+  if (pool)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  /* Report the first error */
+  GError *first = nullptr;
+  for (auto& f : fragments) {
+    if (f.error && !first)
+      first = f.error;
+    else if (f.error)
+      g_error_free (f.error);
+  }
+  if (first) {
+    g_propagate_error (error, first);
+    return nullptr;
+  }
+
+  try {
+    g_autoptr (CgTomlFile) self = g_atomic_rc_box_new0 (CgTomlFile);
+
+    /* Set the name */
+    self->name = g_strdup (path);
+
+    /* Set the table by merging the files over the first one */
+    std::shared_ptr<cpptoml::table> root = fragments.empty() ?
+        cpptoml::make_table() : fragments[0].root;
+    for (gsize i = 1; i < fragments.size(); i++)
+      root = cg::toml::Merge (*root, *fragments[i].root);
+    self->table = cg_toml_file_new_table (std::move(root), flags);
+
+    return static_cast<CgTomlFile *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not merge '%s': %s", path, ba.what());
+    return nullptr;
+  }
+}
+
+/* The state of an asynchronous load */
+struct FileNewData {
+  char *name;
+  CgTomlFileFlags flags;
+  CgTomlFileProgressCallback progress_callback;
+  gpointer progress_data;
+  GCancellable *cancellable;
+  GMainContext *context;
+  int priority;
+};
+
+/* A progress report, dispatched in the context the load was started from */
+struct FileNewProgress {
+  CgTomlFileProgressCallback callback;
+  gpointer data;
+  goffset current;
+  goffset total;
+};
+
+static void
+file_new_data_free (gpointer p)
+{
+  FileNewData *d = static_cast<FileNewData *>(p);
+  g_free (d->name);
+  g_clear_object (&d->cancellable);
+  g_main_context_unref (d->context);
+  g_free (d);
+}
+
+static gboolean
+file_new_progress_dispatch (gpointer p)
+{
+  FileNewProgress *progress = static_cast<FileNewProgress *>(p);
+  progress->callback (progress->current, progress->total, progress->data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+file_new_report (const FileNewData *d, gsize current, gsize total)
+{
+  if (!d->progress_callback)
+    return;
+
+  FileNewProgress *progress = g_new0 (FileNewProgress, 1);
+  progress->callback = d->progress_callback;
+  progress->data = d->progress_data;
+  progress->current = current;
+  progress->total = total;
+  g_main_context_invoke_full (d->context, d->priority,
+      file_new_progress_dispatch, progress, g_free);
+}
+
+static bool
+file_new_progress (gsize current, gsize total, gpointer p)
+{
+  const FileNewData *d = static_cast<const FileNewData *>(p);
+
+  /* Ending the text early stops the parsing */
+  if (g_cancellable_is_cancelled (d->cancellable))
+    return false;
+  file_new_report (d, current, total);
+  return true;
+}
+
+static void
+file_new_thread (GTask *task, gpointer source, gpointer task_data,
+    GCancellable *cancellable)
+{
+  const FileNewData *d = static_cast<const FileNewData *>(task_data);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* Cached and lazy loads do not parse the whole text */
+  GError *error = nullptr;
+  if (d->flags & (CG_TOML_FILE_FLAGS_CACHE | CG_TOML_FILE_FLAGS_LAZY)) {
+    g_autoptr (CgTomlFile) self = cg_toml_file_load (d->name, d->flags,
+        &error);
+    if (!self) {
+      g_task_return_error (task, error);
+      return;
+    }
+    if (g_task_return_error_if_cancelled (task))
+      return;
+    GStatBuf st;
+    if (g_stat (d->name, &st) == 0)
+      file_new_report (d, st.st_size, st.st_size);
+    g_task_return_pointer (task, g_steal_pointer (&self),
+        reinterpret_cast<GDestroyNotify>(cg_toml_file_unref));
+    return;
+  }
+
+  /* Map the file */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (d->name, FALSE, &error);
+  if (!mapped) {
+    g_task_return_error (task, error);
+    return;
+  }
+  const char *data = g_mapped_file_get_contents (mapped);
+  const gsize size = g_mapped_file_get_length (mapped);
+
+  try {
+    g_autoptr (CgTomlFile) self = g_atomic_rc_box_new0 (CgTomlFile);
+
+    /* Set the name */
+    self->name = g_strdup (d->name);
+
+    /* Set the table by parsing the mapping a chunk at a time */
+    cg::toml::ChunkedMemoryBuffer buffer {data, size,
+        cg::toml::ASYNC_CHUNK_SIZE, file_new_progress,
+        const_cast<FileNewData *>(d)};
+    std::istream stream {&buffer};
+    cpptoml::parser parser {stream};
+    std::shared_ptr<cpptoml::table> root = parser.parse();
+
+    /* A cancelled load may have parsed a truncated text */
+    if (g_task_return_error_if_cancelled (task))
+      return;
+    self->table = cg_toml_file_new_table (std::move(root), d->flags);
+    cg_toml_file_set_source (self, data, size);
+    file_new_report (d, size, size);
+
+    g_task_return_pointer (task, g_steal_pointer (&self),
+        reinterpret_cast<GDestroyNotify>(cg_toml_file_unref));
+  } catch (std::bad_alloc& ba) {
+    g_task_return_new_error (task, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not create CgTomlFile from '%s': %s", d->name, ba.what());
+  } catch (std::exception& e) {
+    if (g_task_return_error_if_cancelled (task))
+      return;
+    g_task_return_new_error (task, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s': %s", d->name, e.what());
+  }
+}
+
+void
+cg_toml_file_new_async (const char *name, CgTomlFileFlags flags,
+    int io_priority, GCancellable *cancellable,
+    CgTomlFileProgressCallback progress_callback, gpointer progress_data,
+    GAsyncReadyCallback callback, gpointer user_data)
+{
+  g_return_if_fail (name);
+
+  g_autoptr (GTask) task = g_task_new (nullptr, cancellable, callback,
+      user_data);
+  g_task_set_source_tag (task,
+      reinterpret_cast<gpointer>(cg_toml_file_new_async));
+  g_task_set_priority (task, io_priority);
+
+  FileNewData *d = g_new0 (FileNewData, 1);
+  d->name = g_strdup (name);
+  d->flags = flags;
+  d->progress_callback = progress_callback;
+  d->progress_data = progress_data;
+  d->cancellable = cancellable ?
+      G_CANCELLABLE (g_object_ref (cancellable)) : nullptr;
+  d->context = g_main_context_ref (g_task_get_context (task));
+  d->priority = io_priority;
+  g_task_set_task_data (task, d, file_new_data_free);
+
+  /* Parse in the worker threads shared by GIO */
+  g_task_run_in_thread (task, file_new_thread);
+}
+
+CgTomlFile *
+cg_toml_file_new_finish (GAsyncResult *res, GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, nullptr), nullptr);
+
+  return static_cast<CgTomlFile *>(g_task_propagate_pointer (G_TASK (res),
+      error));
+}
+
 CgTomlFile *
 cg_toml_file_ref (CgTomlFile * self)
 {
   return static_cast<CgTomlFile *>(
-    g_rc_box_acquire (static_cast<gpointer>(self)));
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
 }
 
 void
@@ -59,12 +792,10 @@ cg_toml_file_unref (CgTomlFile * self)
 {
   static void (*free_func)(gpointer) = [](gpointer p){
     CgTomlFile *f = static_cast<CgTomlFile *>(p);
-    g_free (f->name);
-    f->name = nullptr;
-    cg_toml_table_unref (f->table);
-    f->table = nullptr;
+    g_clear_pointer (&f->name, g_free);
+    g_clear_pointer (&f->table, cg_toml_table_unref);
   };
-  g_rc_box_release_full (self, free_func);
+  g_atomic_rc_box_release_full (self, free_func);
 }
 
 const char *
@@ -78,3 +809,138 @@ cg_toml_file_get_table (const CgTomlFile *self)
 {
   return cg_toml_table_ref (self->table);
 }
+
+gboolean
+cg_toml_file_check (const CgTomlFile *self, GError **error)
+{
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_table_get_data (self->table));
+
+  /* Only lazy files have sections that were not parsed yet */
+  const cg::toml::LazyDocument *l = d->node.GetLazy();
+  return !l || l->Check(nullptr, error);
+}
+
+gboolean
+cg_toml_file_save_snapshot (const CgTomlFile *self, const char *path,
+    GError **error)
+{
+  g_return_val_if_fail (path, false);
+
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_table_get_data (self->table));
+
+  /* Compact files are written as they are */
+  if (const cg::toml::dom::Node *root = d->node.GetCompact())
+    return snapshot_write (path, self->name, cg::toml::dom::GetHeader (root),
+        nullptr, error);
+
+  /* Others are laid out first, lazy ones after parsing all their sections */
+  try {
+    std::shared_ptr<cpptoml::table> loaded;
+    const cpptoml::table *root = cg::toml::AsTable (d->node.GetBase());
+    if (const cg::toml::LazyDocument *l = d->node.GetLazy()) {
+      loaded = l->Load();
+      root = loaded.get();
+    }
+    std::shared_ptr<const cg::toml::Dom> dom = cg::toml::Dom::New(*root);
+    return snapshot_write (path, self->name,
+        cg::toml::dom::GetHeader (dom->GetRoot()), nullptr, error);
+  } catch (std::exception& e) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not save snapshot '%s': %s", path, e.what());
+    return false;
+  }
+}
+
+static gboolean
+cg_toml_file_check_source (const CgTomlFile *self, const char *data,
+    gsize size, GError **error)
+{
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_table_get_data (self->table));
+  bool same = false;
+  if (const cg::toml::LazyDocument *l = d->node.GetLazy()) {
+    same = l->HasText(data, size);
+  } else if (self->has_source) {
+    cg::toml::SnapshotSource source = {};
+    if (size == self->source.size) {
+      snapshot_source_hash (data, size, &source);
+      same = std::memcmp (source.hash, self->source.hash,
+          sizeof (source.hash)) == 0;
+    }
+  } else {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not patch '%s': it was not parsed from the file", self->name);
+    return false;
+  }
+
+  if (!same) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG,
+        "Could not patch '%s': it changed since it was parsed", self->name);
+    return false;
+  }
+  return true;
+}
+
+gboolean
+cg_toml_file_patch (const CgTomlFile *self, const CgTomlTable *table,
+    GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (table, false);
+
+  if (!self->name) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not patch file without a name");
+    return false;
+  }
+
+  /* Map the text on disk, the edits are found in the text the file was
+   * parsed from, so it must not have changed since */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (self->name, FALSE,
+      error);
+  if (!mapped)
+    return false;
+  if (!cg_toml_file_check_source (self, g_mapped_file_get_contents (mapped),
+      g_mapped_file_get_length (mapped), error))
+    return false;
+
+  /* The new text goes to a temporary file that replaces the file once it is
+   * closed */
+  g_autoptr (GFile) file = g_file_new_for_path (self->name);
+  g_autoptr (GFileOutputStream) out = g_file_replace (file, nullptr, FALSE,
+      G_FILE_CREATE_NONE, cancellable, error);
+  if (!out)
+    return false;
+
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_table_get_data (self->table));
+  const cg::toml::OwnedNode *t = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_table_get_data (table));
+  GError *write_error = nullptr;
+  bool res = false;
+  try {
+    res = cg::toml::Patch (g_mapped_file_get_contents (mapped),
+        g_mapped_file_get_length (mapped), d->node, t->node,
+        [&](const char *data, gsize size) {
+      return g_output_stream_write_all (G_OUTPUT_STREAM (out), data, size,
+          nullptr, cancellable, &write_error) != FALSE;
+    }, error);
+    if (write_error)
+      g_propagate_error (error, write_error);
+  } catch (std::exception& e) {
+    g_clear_error (&write_error);
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not patch '%s': %s", self->name, e.what());
+  }
+
+  /* Closing the stream once cancelled leaves the file as it was */
+  if (!res) {
+    g_autoptr (GCancellable) abort = g_cancellable_new ();
+    g_cancellable_cancel (abort);
+    g_output_stream_close (G_OUTPUT_STREAM (out), abort, nullptr);
+    return false;
+  }
+  return g_output_stream_close (G_OUTPUT_STREAM (out), cancellable, error);
+}
@@ -10,15 +10,48 @@
 #define __CG_TOML_FILE_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "table.h"
 
 G_BEGIN_DECLS
 
-/* CgTomlFile */
+/* CgTomlFileFlags */
+typedef enum {
+  CG_TOML_FILE_FLAGS_NONE = 0,
+  CG_TOML_FILE_FLAGS_COMPACT = 1 << 0,
+  CG_TOML_FILE_FLAGS_CACHE = 1 << 1,
+  CG_TOML_FILE_FLAGS_LAZY = 1 << 2,
+} CgTomlFileFlags;
+
+/* CgTomlFileProgressCallback, gets the bytes parsed so far and the size of
+ * the file */
+typedef void (*CgTomlFileProgressCallback) (goffset current, goffset total,
+    gpointer user_data);
+
+/* CgTomlFile, immutable and atomically reference counted like its tables
+ * and arrays, so it can be read from several threads at once */
 GType cg_toml_file_get_type (void);
 typedef struct _CgTomlFile CgTomlFile;
 CgTomlFile * cg_toml_file_new (const char *name);
+CgTomlFile * cg_toml_file_new_full (const char *name, CgTomlFileFlags flags);
+CgTomlFile * cg_toml_file_new_from_bytes (GBytes *bytes);
+CgTomlFile * cg_toml_file_new_mapped (const char *name);
+CgTomlFile * cg_toml_file_new_from_snapshot (const char *path, GError **error);
+CgTomlFile * cg_toml_file_new_from_table (const char *name,
+    const CgTomlTable *table);
+
+/* Parses the .toml files of a directory in parallel and deep-merges them in
+ * the order of their names, tables are merged key by key and any other
+ * value of a later file replaces the earlier one. Hidden files are skipped,
+ * only the compact flag applies to the merged document */
+CgTomlFile * cg_toml_file_new_from_directory (const char *path,
+    CgTomlFileFlags flags, GError **error);
+void cg_toml_file_new_async (const char *name, CgTomlFileFlags flags,
+    int io_priority, GCancellable *cancellable,
+    CgTomlFileProgressCallback progress_callback, gpointer progress_data,
+    GAsyncReadyCallback callback, gpointer user_data);
+CgTomlFile * cg_toml_file_new_finish (GAsyncResult *res, GError **error);
 CgTomlFile * cg_toml_file_ref (CgTomlFile * self);
 void cg_toml_file_unref (CgTomlFile * self);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlFile, cg_toml_file_unref)
@@ -27,6 +60,22 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlFile, cg_toml_file_unref)
 const char * cg_toml_file_get_name (const CgTomlFile *self);
 CgTomlTable * cg_toml_file_get_table (const CgTomlFile *self);
 
+/* Parses the sections of a lazy file that were not parsed yet. The getters
+ * report the keys of an invalid section as missing, this tells them apart
+ * by failing with CG_TOML_ERROR_PARSE. Other files are always valid */
+gboolean cg_toml_file_check (const CgTomlFile *self, GError **error);
+gboolean cg_toml_file_save_snapshot (const CgTomlFile *self, const char *path,
+    GError **error);
+
+/* Rewrites the file so that it holds a new revision of its table, such as
+ * one made with the builder API. Only the statements of the keys that
+ * changed are rewritten, comments and layout are kept, and the file is
+ * replaced atomically once the new text is complete. Fails with
+ * G_IO_ERROR_WRONG_ETAG if the file changed since it was parsed, which a
+ * patch does too: reload the file before patching it again */
+gboolean cg_toml_file_patch (const CgTomlFile *self, const CgTomlTable *table,
+    GCancellable *cancellable, GError **error);
+
 G_END_DECLS
 
 #endif
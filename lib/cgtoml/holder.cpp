@@ -0,0 +1,187 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <atomic>
+#include <new>
+
+/* TOML */
+#include "holder.h"
+
+namespace cg {
+namespace toml {
+
+/* The SnapshotHolder class, a left-right scheme over two slots. Readers
+ * announce themselves on one of two counters, which is all they write, and
+ * take a reference on the file of the current slot. The writer fills the
+ * other slot, switches to it and waits for both counters to drain before
+ * releasing the file of the previous slot, at which point no reader can be
+ * looking at it anymore. Readers never loop nor wait, and the references
+ * they took keep old files alive after that */
+class SnapshotHolder {
+ public:
+  /* Constructor */
+  SnapshotHolder(CgTomlFile *file) :
+      current_(0),
+      version_(0) {
+    slots_[0].store(file ? cg_toml_file_ref(file) : nullptr);
+    slots_[1].store(nullptr);
+    readers_[0].count.store(0);
+    readers_[1].count.store(0);
+    g_mutex_init(&mutex_);
+  }
+
+  /* Destructor */
+  virtual ~SnapshotHolder() {
+    for (auto& slot : slots_) {
+      CgTomlFile *file = slot.exchange(nullptr);
+      if (file)
+        cg_toml_file_unref(file);
+    }
+    g_mutex_clear(&mutex_);
+  }
+
+  /* Pins the current file */
+  CgTomlFile *Acquire() {
+    const guint version = version_.load();
+    readers_[version].count.fetch_add(1);
+    CgTomlFile *file = slots_[current_.load()].load();
+    if (file)
+      file = cg_toml_file_ref(file);
+    readers_[version].count.fetch_sub(1);
+    return file;
+  }
+
+  /* Makes a file the current one */
+  void Publish(CgTomlFile *file) {
+    CgTomlFile *old = nullptr;
+    {
+      g_autoptr (GMutexLocker) locker = g_mutex_locker_new(&mutex_);
+      const guint current = current_.load();
+      slots_[!current].store(file ? cg_toml_file_ref(file) : nullptr);
+      current_.store(!current);
+      Drain();
+      old = slots_[current].exchange(nullptr);
+    }
+    if (old)
+      cg_toml_file_unref(old);
+  }
+
+ private:
+  /* Waits for the readers that could have seen the previous slot */
+  void Drain() {
+    const guint version = version_.load();
+    Wait(!version);
+    version_.store(!version);
+    Wait(version);
+  }
+
+  /* Waits for the readers of a counter to leave */
+  void Wait(guint version) {
+    while (readers_[version].count.load() != 0)
+      g_thread_yield();
+  }
+
+  /* A counter of readers, on its own cache line */
+  struct Readers {
+    std::atomic<gint> count;
+    char padding[64 - sizeof (std::atomic<gint>)];
+  };
+
+  /* Copy Constructor */
+  SnapshotHolder(const SnapshotHolder&) = delete;
+
+  /* Move Constructor */
+  SnapshotHolder(SnapshotHolder &&) = delete;
+
+  /* Copy-Assign Constructor */
+  SnapshotHolder& operator=(const SnapshotHolder&) = delete;
+
+  /* Move-Assign Constructr */
+  SnapshotHolder& operator=(SnapshotHolder &&) = delete;
+
+ private:
+  /* The files, only the current one is read */
+  std::atomic<CgTomlFile *> slots_[2];
+
+  /* The current slot */
+  std::atomic<guint> current_;
+
+  /* The counter new readers announce themselves on */
+  std::atomic<guint> version_;
+
+  /* The counters of readers */
+  Readers readers_[2];
+
+  /* Serializes the writers */
+  GMutex mutex_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+struct _CgTomlSnapshotHolder
+{
+  cg::toml::SnapshotHolder *data;
+};
+
+G_DEFINE_BOXED_TYPE(CgTomlSnapshotHolder, cg_toml_snapshot_holder,
+    cg_toml_snapshot_holder_ref, cg_toml_snapshot_holder_unref)
+
+CgTomlSnapshotHolder *
+cg_toml_snapshot_holder_new (CgTomlFile *file)
+{
+  try {
+    g_autoptr (CgTomlSnapshotHolder) self =
+        g_atomic_rc_box_new0 (CgTomlSnapshotHolder);
+
+    /* Hold the initial file */
+    self->data = new cg::toml::SnapshotHolder {file};
+
+    return static_cast<CgTomlSnapshotHolder *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlSnapshotHolder: %s", ba.what());
+    return nullptr;
+  } catch (...) {
+    g_critical ("Could not create CgTomlSnapshotHolder");
+    return nullptr;
+  }
+}
+
+CgTomlSnapshotHolder *
+cg_toml_snapshot_holder_ref (CgTomlSnapshotHolder * self)
+{
+  return static_cast<CgTomlSnapshotHolder *>(
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
+}
+
+void
+cg_toml_snapshot_holder_unref (CgTomlSnapshotHolder * self)
+{
+  static void (*free_func)(gpointer) = [](gpointer p){
+    CgTomlSnapshotHolder *h = static_cast<CgTomlSnapshotHolder *>(p);
+    delete h->data;
+  };
+  g_atomic_rc_box_release_full (self, free_func);
+}
+
+CgTomlFile *
+cg_toml_snapshot_holder_acquire (CgTomlSnapshotHolder *self)
+{
+  g_return_val_if_fail (self, nullptr);
+
+  return self->data->Acquire();
+}
+
+void
+cg_toml_snapshot_holder_publish (CgTomlSnapshotHolder *self, CgTomlFile *file)
+{
+  g_return_if_fail (self);
+
+  self->data->Publish(file);
+}
@@ -0,0 +1,40 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_HOLDER_H__
+#define __CG_TOML_HOLDER_H__
+
+#include <glib-object.h>
+
+#include "file.h"
+
+G_BEGIN_DECLS
+
+/* CgTomlSnapshotHolder, holds the current revision of a document shared by
+ * several threads. Readers pin the current revision with a wait-free
+ * acquire and keep it, consistent, for as long as they need it, while a
+ * writer publishes the next one. Each revision is released once its last
+ * reader unrefs it */
+GType cg_toml_snapshot_holder_get_type (void);
+typedef struct _CgTomlSnapshotHolder CgTomlSnapshotHolder;
+CgTomlSnapshotHolder * cg_toml_snapshot_holder_new (CgTomlFile *file);
+CgTomlSnapshotHolder * cg_toml_snapshot_holder_ref (
+    CgTomlSnapshotHolder * self);
+void cg_toml_snapshot_holder_unref (CgTomlSnapshotHolder * self);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlSnapshotHolder,
+    cg_toml_snapshot_holder_unref)
+
+/* API, the pinned file is released with cg_toml_file_unref(). Publishing
+ * can be done from any thread, concurrent writers are serialized */
+CgTomlFile * cg_toml_snapshot_holder_acquire (CgTomlSnapshotHolder *self);
+void cg_toml_snapshot_holder_publish (CgTomlSnapshotHolder *self,
+    CgTomlFile *file);
+
+G_END_DECLS
+
+#endif
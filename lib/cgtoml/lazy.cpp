@@ -0,0 +1,329 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <cstring>
+#include <istream>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* TOML */
+#include "buffer.h"
+#include "scanner.h"
+#include "error.h"
+#include "lazy.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* Parses a whole document from memory */
+std::shared_ptr<cpptoml::table> Parse(const char *data, gsize size) {
+  MemoryBuffer buffer {data, size};
+  std::istream stream {&buffer};
+  cpptoml::parser parser {stream};
+  return parser.parse();
+}
+
+/* Checks whether a character can be part of a bare key */
+bool IsBareKey(char c) {
+  return g_ascii_isalnum(c) || c == '_' || c == '-';
+}
+
+/* Reads the first segment of the key of a table header */
+bool ScanHeaderKey(const char *p, const char *end, std::string *key) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  if (p == end)
+    return false;
+
+  const char *start = p;
+  if (*p == '"' || *p == '\'') {
+    /* Escapes are left to the parser, the section is not split then */
+    const char quote = *p++;
+    start = p;
+    while (p < end && *p != quote && *p != '\n' && *p != '\\')
+      p++;
+    if (p == end || *p != quote)
+      return false;
+    key->assign(start, p - start);
+    p++;
+  } else {
+    while (p < end && IsBareKey(*p))
+      p++;
+    if (p == start)
+      return false;
+    key->assign(start, p - start);
+  }
+
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p < end && (*p == '.' || *p == ']');
+}
+
+}  /* namespace */
+
+LazyDocument::Section::Section(const std::string& k, GBytes *t) :
+    key(k),
+    text(g_bytes_ref(t)),
+    parsed(0) {
+  g_mutex_init(&mutex);
+}
+
+LazyDocument::Section::~Section() {
+  g_mutex_clear(&mutex);
+  g_bytes_unref(text);
+}
+
+bool
+LazyDocument::Section::HasSameBytes(const Section& other) const
+{
+  if (ranges.size() != other.ranges.size())
+    return false;
+  const char *data = static_cast<const char *>(g_bytes_get_data(text,
+      nullptr));
+  const char *other_data = static_cast<const char *>(g_bytes_get_data(
+      other.text, nullptr));
+  for (gsize i = 0; i < ranges.size(); i++) {
+    const gsize len = ranges[i].second - ranges[i].first;
+    if (len != other.ranges[i].second - other.ranges[i].first ||
+        std::memcmp(data + ranges[i].first,
+            other_data + other.ranges[i].first, len) != 0)
+      return false;
+  }
+  return true;
+}
+
+void
+LazyDocument::Section::ParseRanges()
+{
+  /* Parse the ranges as a document of their own */
+  const char *data = static_cast<const char *>(g_bytes_get_data(text,
+      nullptr));
+  try {
+    std::shared_ptr<cpptoml::table> root;
+    if (ranges.size() == 1) {
+      root = Parse(data + ranges[0].first, ranges[0].second - ranges[0].first);
+    } else {
+      std::string joined;
+      for (const auto& range : ranges)
+        joined.append(data + range.first, range.second - range.first);
+      root = Parse(joined.data(), joined.size());
+    }
+    value = root->get(key);
+  } catch (std::exception& e) {
+    error = e.what();
+  }
+  g_atomic_int_set(&parsed, 1);
+}
+
+LazyDocument::LazyDocument(GBytes *text) :
+    text_(text) {
+}
+
+LazyDocument::~LazyDocument() {
+  g_bytes_unref(text_);
+}
+
+std::shared_ptr<const LazyDocument>
+LazyDocument::New(GBytes *text, const LazyDocument *previous)
+{
+  std::shared_ptr<LazyDocument> res {new LazyDocument {text}};
+  if (!res->Scan())
+    return nullptr;
+  if (previous)
+    res->Reuse(*previous);
+  return res;
+}
+
+bool
+LazyDocument::Scan()
+{
+  gsize size = 0;
+  const char *data = static_cast<const char *>(g_bytes_get_data(text_, &size));
+  const char *p = data;
+  const char *end = data + size;
+  const char *preamble_end = end;
+  Section *current = nullptr;
+  std::string key;
+
+  while (p < end) {
+    const char *line = p;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+      p++;
+    if (p == end)
+      break;
+
+    /* Key/value pairs, comments and blank lines belong to the current
+     * section */
+    if (*p != '[') {
+      p = FindStatementEnd(p, end);
+      if (!p)
+        break;
+      continue;
+    }
+
+    /* A table header closes the current range and opens a new one */
+    if (!ScanHeaderKey(p + (p + 1 < end && p[1] == '[' ? 2 : 1), end, &key))
+      return false;
+    if (!current)
+      preamble_end = line;
+    else
+      current->ranges.back().second = line - data;
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      it = index_.emplace(key, sections_.size()).first;
+      sections_.emplace_back(std::make_shared<Section>(key, text_));
+    }
+    current = sections_[it->second].get();
+    current->ranges.emplace_back(line - data, size);
+
+    /* Skip the rest of the header */
+    p = FindStatementEnd(p, end);
+    if (!p)
+      break;
+  }
+
+  /* Parse the preamble now, a section cannot extend one of its tables */
+  preamble_ = Parse(data, preamble_end - data);
+  for (const auto& entry : *preamble_) {
+    if (index_.count(entry.first))
+      return false;
+    preamble_keys_.push_back(entry.first);
+  }
+  return true;
+}
+
+void
+LazyDocument::Reuse(const LazyDocument& previous)
+{
+  for (auto& section : sections_) {
+    auto it = previous.index_.find(section->key);
+    if (it == previous.index_.end())
+      continue;
+    const std::shared_ptr<Section>& old = previous.sections_[it->second];
+    if (old->HasSameBytes(*section))
+      section = old;
+  }
+}
+
+const cpptoml::base *
+LazyDocument::GetSection(gsize index, GError **error) const
+{
+  Section& section = *sections_[index];
+  if (!g_atomic_int_get(&section.parsed)) {
+    g_autoptr (GMutexLocker) locker = g_mutex_locker_new(&section.mutex);
+    if (!section.parsed)
+      section.ParseRanges();
+  }
+
+  /* The error is kept, so every lookup of the section reports it */
+  if (!section.error.empty()) {
+    g_set_error(error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse section '%s': %s", section.key.c_str(),
+        section.error.c_str());
+    return nullptr;
+  }
+  return section.value.get();
+}
+
+bool
+LazyDocument::Check(const LazyDocument *previous, GError **error) const
+{
+  for (gsize i = 0; i < sections_.size(); i++) {
+    const std::string& key = sections_[i]->key;
+    if (previous && SharesSection(*previous, key.data(), key.size()))
+      continue;
+    GError *e = nullptr;
+    GetSection(i, &e);
+    if (e) {
+      g_propagate_error(error, e);
+      return false;
+    }
+  }
+  return true;
+}
+
+const cpptoml::base *
+LazyDocument::Lookup(const char *key, gsize len, GError **error) const
+{
+  const std::string k {key, len};
+  if (preamble_->contains(k))
+    return preamble_->get(k).get();
+  auto it = index_.find(k);
+  return it != index_.end() ? GetSection(it->second, error) : nullptr;
+}
+
+gsize
+LazyDocument::GetLength() const
+{
+  return preamble_keys_.size() + sections_.size();
+}
+
+const cpptoml::base *
+LazyDocument::GetNth(gsize index, const char **key) const
+{
+  if (index < preamble_keys_.size()) {
+    *key = preamble_keys_[index].c_str();
+    return preamble_->get(preamble_keys_[index]).get();
+  }
+  index -= preamble_keys_.size();
+  if (index >= sections_.size())
+    return nullptr;
+  *key = sections_[index]->key.c_str();
+  return GetSection(index);
+}
+
+const char *
+LazyDocument::GetNthKey(gsize index) const
+{
+  if (index < preamble_keys_.size())
+    return preamble_keys_[index].c_str();
+  index -= preamble_keys_.size();
+  return index < sections_.size() ? sections_[index]->key.c_str() : nullptr;
+}
+
+bool
+LazyDocument::Contains(const char *key, gsize len) const
+{
+  const std::string k {key, len};
+  return preamble_->contains(k) || index_.count(k) > 0;
+}
+
+bool
+LazyDocument::SharesSection(const LazyDocument& other, const char *key,
+    gsize len) const
+{
+  const std::string k {key, len};
+  auto it = index_.find(k);
+  auto other_it = other.index_.find(k);
+  return it != index_.end() && other_it != other.index_.end() &&
+      sections_[it->second] == other.sections_[other_it->second];
+}
+
+std::shared_ptr<cpptoml::table>
+LazyDocument::Load() const
+{
+  gsize size = 0;
+  const char *data = static_cast<const char *>(g_bytes_get_data(text_, &size));
+  return Parse(data, size);
+}
+
+bool
+LazyDocument::HasText(const char *data, gsize size) const
+{
+  gsize text_size = 0;
+  const char *text = static_cast<const char *>(g_bytes_get_data(text_,
+      &text_size));
+  return size == text_size && (size == 0 || std::memcmp(text, data, size) == 0);
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
@@ -0,0 +1,157 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_LAZY_H__
+#define __CG_TOML_LAZY_H__
+
+/* C++ STL */
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* GLib */
+#include <glib.h>
+
+namespace cg {
+namespace toml {
+
+/* The LazyDocument class, a document whose top-level sections are only
+ * parsed when first looked up. The text is scanned up front to find the
+ * byte ranges of each section, the key/value pairs before the first table
+ * header are parsed right away. */
+class LazyDocument {
+ public:
+  /* Scans a text, returns null if it cannot be split into sections, in
+   * which case it must be parsed as a whole. Takes the ownership of the
+   * bytes, throws if the key/value pairs before the first header are
+   * invalid. The unchanged sections of the previous revision, if any, are
+   * reused */
+  static std::shared_ptr<const LazyDocument> New(GBytes *text,
+      const LazyDocument *previous = nullptr);
+
+  /* Destructor */
+  virtual ~LazyDocument();
+
+  /* Looks up a top-level key, parsing its section if needed. Returns null
+   * if the key does not exist, or sets the error if its section is
+   * invalid */
+  const cpptoml::base *Lookup(const char *key, gsize len,
+      GError **error = nullptr) const;
+
+  /* Gets the number of top-level keys */
+  gsize GetLength() const;
+
+  /* Gets the top-level key at the given position and its value, parsing
+   * its section if needed */
+  const cpptoml::base *GetNth(gsize index, const char **key) const;
+
+  /* Gets the top-level key at the given position without parsing it */
+  const char *GetNthKey(gsize index) const;
+
+  /* Checks whether a top-level key exists, without parsing it */
+  bool Contains(const char *key, gsize len) const;
+
+  /* Checks whether a top-level key is a section shared with another
+   * revision, in which case it has the same value in both */
+  bool SharesSection(const LazyDocument& other, const char *key,
+      gsize len) const;
+
+  /* Parses the sections that were not parsed yet, fails on the first one
+   * that is invalid. The sections shared with a previous revision, if any,
+   * are skipped */
+  bool Check(const LazyDocument *previous, GError **error) const;
+
+  /* Parses the whole text into a cpptoml tree */
+  std::shared_ptr<cpptoml::table> Load() const;
+
+  /* Checks whether the document was scanned from the given text */
+  bool HasText(const char *data, gsize size) const;
+
+ private:
+  /* A top-level section, split into the ranges of its headers. It keeps
+   * the text it was found in, as it may outlive its document */
+  struct Section {
+    Section(const std::string& key, GBytes *text);
+    ~Section();
+
+    /* Checks whether another section has the same bytes */
+    bool HasSameBytes(const Section& other) const;
+
+    /* Parses the ranges into the value, or keeps the error if they are
+     * invalid */
+    void ParseRanges();
+
+    std::string key;
+    GBytes *text;
+    std::vector<std::pair<gsize, gsize>> ranges;
+    std::shared_ptr<cpptoml::base> value;
+
+    /* The parse error, empty if the section is valid */
+    std::string error;
+
+    /* Set once the value is parsed, read without the mutex so that parsed
+     * sections are looked up without any shared write */
+    gint parsed;
+
+    /* Guards the parsing */
+    GMutex mutex;
+  };
+
+  /* Constructor */
+  LazyDocument(GBytes *text);
+
+  /* Splits the text into the preamble and its sections */
+  bool Scan();
+
+  /* Shares the sections whose bytes did not change with a previous
+   * revision */
+  void Reuse(const LazyDocument& previous);
+
+  /* Gets the value of a section, parsing it if needed. Returns null and
+   * sets the error if the section is invalid */
+  const cpptoml::base *GetSection(gsize index,
+      GError **error = nullptr) const;
+
+  /* Copy Constructor */
+  LazyDocument(const LazyDocument&) = delete;
+
+  /* Move Constructor */
+  LazyDocument(LazyDocument &&) = delete;
+
+  /* Copy-Assign Constructor */
+  LazyDocument& operator=(const LazyDocument&) = delete;
+
+  /* Move-Assign Constructr */
+  LazyDocument& operator=(LazyDocument &&) = delete;
+
+ private:
+  /* The text */
+  GBytes *const text_;
+
+  /* The key/value pairs before the first header */
+  std::shared_ptr<cpptoml::table> preamble_;
+
+  /* The keys of the preamble, in a stable order */
+  std::vector<std::string> preamble_keys_;
+
+  /* The sections, in the order of their first header */
+  std::vector<std::shared_ptr<Section>> sections_;
+
+  /* The position of each section by key */
+  std::unordered_map<std::string, gsize> index_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
@@ -0,0 +1,377 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <algorithm>
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* TOML */
+#include "private.h"
+#include "buffer.h"
+#include "node.h"
+#include "lazy.h"
+#include "diff.h"
+#include "directory.h"
+#include "error.h"
+#include "monitor.h"
+
+namespace cg {
+namespace toml {
+
+/* The default delay between the last change on disk and the reload */
+constexpr guint MONITOR_DEFAULT_DELAY = 200;
+
+/* A file of a monitored directory, kept to only parse it again once its
+ * bytes change */
+struct MonitorFragment {
+  std::shared_ptr<GBytes> text;
+  std::shared_ptr<cpptoml::table> root;
+};
+
+/* The files of a monitored directory by name */
+using MonitorFragments = std::map<std::string, MonitorFragment>;
+
+namespace {
+
+/* Reads a whole file */
+std::shared_ptr<GBytes> MonitorRead(const char *path, GError **error) {
+  char *contents = nullptr;
+  gsize len = 0;
+  if (!g_file_get_contents(path, &contents, &len, error))
+    return nullptr;
+  return {g_bytes_new_take(contents, len), g_bytes_unref};
+}
+
+/* Parses a whole text */
+std::shared_ptr<cpptoml::table> MonitorParse(GBytes *text) {
+  gsize size = 0;
+  const char *data = static_cast<const char *>(g_bytes_get_data(text, &size));
+  MemoryBuffer buffer {data, size};
+  std::istream stream {&buffer};
+  cpptoml::parser parser {stream};
+  return parser.parse();
+}
+
+}  /* namespace */
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+struct _CgTomlMonitor
+{
+  GObject parent;
+
+  char *path;
+  gboolean directory;
+  GFileMonitor *monitor;
+  guint delay;
+  guint timeout_id;
+  CgTomlFile *file;
+  cg::toml::MonitorFragments *fragments;
+};
+
+enum {
+  SIGNAL_CHANGED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS] = { 0, };
+
+G_DEFINE_TYPE (CgTomlMonitor, cg_toml_monitor, G_TYPE_OBJECT)
+
+static void
+cg_toml_monitor_init (CgTomlMonitor * self)
+{
+  self->delay = cg::toml::MONITOR_DEFAULT_DELAY;
+}
+
+static void
+cg_toml_monitor_dispose (GObject * object)
+{
+  CgTomlMonitor *self = CG_TOML_MONITOR (object);
+
+  if (self->timeout_id) {
+    g_source_remove (self->timeout_id);
+    self->timeout_id = 0;
+  }
+  if (self->monitor) {
+    g_file_monitor_cancel (self->monitor);
+    g_signal_handlers_disconnect_by_data (self->monitor, self);
+    g_clear_object (&self->monitor);
+  }
+
+  G_OBJECT_CLASS (cg_toml_monitor_parent_class)->dispose (object);
+}
+
+static void
+cg_toml_monitor_finalize (GObject * object)
+{
+  CgTomlMonitor *self = CG_TOML_MONITOR (object);
+
+  g_clear_pointer (&self->path, g_free);
+  g_clear_pointer (&self->file, cg_toml_file_unref);
+  delete self->fragments;
+  self->fragments = nullptr;
+
+  G_OBJECT_CLASS (cg_toml_monitor_parent_class)->finalize (object);
+}
+
+static void
+cg_toml_monitor_class_init (CgTomlMonitorClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = cg_toml_monitor_dispose;
+  object_class->finalize = cg_toml_monitor_finalize;
+
+  signals[SIGNAL_CHANGED] = g_signal_new ("changed",
+      G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST, 0, nullptr, nullptr,
+      nullptr, G_TYPE_NONE, 2, cg_toml_file_get_type (), G_TYPE_STRV);
+}
+
+/* Loads a file, sharing the sections that did not change with the current
+ * revision */
+static gboolean
+monitor_load_file (CgTomlMonitor *self, cg::toml::OwnedNode *res,
+    GError **error)
+{
+  std::shared_ptr<GBytes> text = cg::toml::MonitorRead (self->path, error);
+  if (!text)
+    return false;
+
+  const cg::toml::LazyDocument *previous = nullptr;
+  if (self->file) {
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (self->file);
+    const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+        cg_toml_table_get_data (table));
+    previous = d->node.GetLazy();
+  }
+
+  /* Texts that cannot be split into sections are parsed as a whole */
+  std::shared_ptr<const cg::toml::LazyDocument> document =
+      cg::toml::LazyDocument::New (g_bytes_ref (text.get()), previous);
+  if (document) {
+    /* Parse the sections that changed, so that an invalid one is not
+     * published as if its keys were removed */
+    if (!document->Check(previous, error)) {
+      g_prefix_error (error, "Could not parse '%s': ", self->path);
+      return false;
+    }
+    *res = {document, cg::toml::Node {document.get()}};
+  } else {
+    std::shared_ptr<cpptoml::table> root = cg::toml::MonitorParse (
+        text.get());
+    *res = {root, cg::toml::Node {root.get()}};
+  }
+  return true;
+}
+
+/* Loads a directory, parsing only the files whose bytes changed */
+static gboolean
+monitor_load_directory (CgTomlMonitor *self, cg::toml::OwnedNode *res,
+    GError **error)
+{
+  std::vector<std::string> names;
+  if (!cg::toml::ListFragments (self->path, &names, error))
+    return false;
+
+  std::unique_ptr<cg::toml::MonitorFragments> fragments {
+      new cg::toml::MonitorFragments {}};
+  std::shared_ptr<cpptoml::table> root;
+  for (const auto& name : names) {
+    g_autofree char *path = g_build_filename (self->path, name.c_str (),
+        nullptr);
+    cg::toml::MonitorFragment f;
+    f.text = cg::toml::MonitorRead (path, error);
+    if (!f.text)
+      return false;
+
+    /* Reuse the tree of the files that did not change */
+    const cg::toml::MonitorFragment *previous = nullptr;
+    if (self->fragments) {
+      auto it = self->fragments->find (name);
+      if (it != self->fragments->end())
+        previous = &it->second;
+    }
+    if (previous && g_bytes_equal (previous->text.get(), f.text.get())) {
+      f.root = previous->root;
+    } else {
+      try {
+        f.root = cg::toml::MonitorParse (f.text.get());
+      } catch (cpptoml::parse_exception& e) {
+        g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+            "Could not parse '%s': %s", path, e.what());
+        return false;
+      }
+    }
+
+    root = root ? cg::toml::Merge (*root, *f.root) : f.root;
+    fragments->emplace (name, std::move (f));
+  }
+  if (!root)
+    root = cpptoml::make_table();
+
+  delete self->fragments;
+  self->fragments = fragments.release();
+  *res = {root, cg::toml::Node {root.get()}};
+  return true;
+}
+
+static gboolean
+monitor_load (CgTomlMonitor *self, cg::toml::OwnedNode *res, GError **error)
+{
+  try {
+    return self->directory ? monitor_load_directory (self, res, error) :
+        monitor_load_file (self, res, error);
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not load '%s': %s", self->path, ba.what());
+    return false;
+  } catch (std::exception& e) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Could not parse '%s': %s", self->path, e.what());
+    return false;
+  }
+}
+
+static gboolean
+monitor_on_timeout (gpointer data)
+{
+  CgTomlMonitor *self = CG_TOML_MONITOR (data);
+  g_autoptr (GError) error = nullptr;
+
+  self->timeout_id = 0;
+  if (!cg_toml_monitor_reload (self, &error))
+    g_warning ("Could not reload '%s': %s", self->path, error->message);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+monitor_on_changed (GFileMonitor *monitor, GFile *file, GFile *other,
+    GFileMonitorEvent event, gpointer data)
+{
+  CgTomlMonitor *self = CG_TOML_MONITOR (data);
+
+  /* Debounce, the reload happens once the writes settle */
+  if (self->timeout_id)
+    g_source_remove (self->timeout_id);
+  self->timeout_id = g_timeout_add (self->delay, monitor_on_timeout, self);
+}
+
+CgTomlMonitor *
+cg_toml_monitor_new (const char *path, GError **error)
+{
+  g_return_val_if_fail (path, nullptr);
+
+  g_autoptr (CgTomlMonitor) self = CG_TOML_MONITOR (
+      g_object_new (CG_TOML_TYPE_MONITOR, nullptr));
+  self->path = g_strdup (path);
+  self->directory = g_file_test (path, G_FILE_TEST_IS_DIR);
+
+  /* Load the current revision */
+  cg::toml::OwnedNode data;
+  if (!monitor_load (self, &data, error))
+    return nullptr;
+  self->file = cg_toml_file_new_from_node (path, &data);
+  if (!self->file) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not load '%s'", path);
+    return nullptr;
+  }
+
+  /* Watch it, files are watched through their directory to catch editors
+   * replacing them */
+  g_autoptr (GFile) file = g_file_new_for_path (path);
+  self->monitor = self->directory ?
+      g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES, nullptr,
+          error) :
+      g_file_monitor_file (file, G_FILE_MONITOR_WATCH_MOVES, nullptr, error);
+  if (!self->monitor)
+    return nullptr;
+  g_signal_connect (self->monitor, "changed",
+      G_CALLBACK (monitor_on_changed), self);
+
+  return static_cast<CgTomlMonitor *>(g_steal_pointer (&self));
+}
+
+CgTomlFile *
+cg_toml_monitor_get_file (CgTomlMonitor *self)
+{
+  g_return_val_if_fail (CG_TOML_IS_MONITOR (self), nullptr);
+
+  return cg_toml_file_ref (self->file);
+}
+
+void
+cg_toml_monitor_set_delay (CgTomlMonitor *self, guint delay_ms)
+{
+  g_return_if_fail (CG_TOML_IS_MONITOR (self));
+
+  self->delay = delay_ms;
+}
+
+gboolean
+cg_toml_monitor_reload (CgTomlMonitor *self, GError **error)
+{
+  g_return_val_if_fail (CG_TOML_IS_MONITOR (self), false);
+
+  /* Load the new revision */
+  cg::toml::OwnedNode data;
+  if (!monitor_load (self, &data, error))
+    return false;
+
+  /* Find what changed, parsing only the sections that were edited */
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (self->file);
+  const cg::toml::OwnedNode *current =
+      static_cast<const cg::toml::OwnedNode *>(
+          cg_toml_table_get_data (table));
+  g_autoptr (GPtrArray) keys = g_ptr_array_new_with_free_func (g_free);
+  try {
+    cg::toml::Changes changes;
+    if (!cg::toml::Diff (current->node, data.node, &changes, error)) {
+      g_prefix_error (error, "Could not compare '%s': ", self->path);
+      return false;
+    }
+    for (const auto& key : changes.added)
+      g_ptr_array_add (keys, g_strdup (key.c_str ()));
+    for (const auto& key : changes.removed)
+      g_ptr_array_add (keys, g_strdup (key.c_str ()));
+    for (const auto& key : changes.modified)
+      g_ptr_array_add (keys, g_strdup (key.c_str ()));
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not compare '%s': %s", self->path, ba.what());
+    return false;
+  }
+  if (keys->len == 0)
+    return true;
+  g_ptr_array_sort (keys, [](gconstpointer a, gconstpointer b) {
+    return g_strcmp0 (*static_cast<char *const *>(a),
+        *static_cast<char *const *>(b));
+  });
+  g_ptr_array_add (keys, nullptr);
+
+  /* Publish it */
+  CgTomlFile *file = cg_toml_file_new_from_node (self->path, &data);
+  if (!file) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not reload '%s'", self->path);
+    return false;
+  }
+  g_clear_pointer (&self->file, cg_toml_file_unref);
+  self->file = file;
+  g_signal_emit (self, signals[SIGNAL_CHANGED], 0, self->file, keys->pdata);
+  return true;
+}
@@ -0,0 +1,38 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_MONITOR_H__
+#define __CG_TOML_MONITOR_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "file.h"
+
+G_BEGIN_DECLS
+
+/* CgTomlMonitor, reloads a file or a conf.d style directory when it changes
+ * on disk. Bursts of writes are debounced into a single reload, and only
+ * the parts of the text that changed are parsed again. The "changed" signal
+ * is emitted with the new CgTomlFile and the sorted qualified keys that were
+ * added, removed or modified, nothing is emitted if no value changed. A
+ * revision with any invalid section is not published, the current file is
+ * kept and the reload fails with CG_TOML_ERROR_PARSE */
+#define CG_TOML_TYPE_MONITOR (cg_toml_monitor_get_type ())
+G_DECLARE_FINAL_TYPE (CgTomlMonitor, cg_toml_monitor, CG_TOML, MONITOR,
+    GObject)
+CgTomlMonitor * cg_toml_monitor_new (const char *path, GError **error);
+
+/* API */
+CgTomlFile * cg_toml_monitor_get_file (CgTomlMonitor *self);
+void cg_toml_monitor_set_delay (CgTomlMonitor *self, guint delay_ms);
+gboolean cg_toml_monitor_reload (CgTomlMonitor *self, GError **error);
+
+G_END_DECLS
+
+#endif
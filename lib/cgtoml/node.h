@@ -0,0 +1,581 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_NODE_H__
+#define __CG_TOML_NODE_H__
+
+/* C++ STL */
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* GLib */
+#include <glib.h>
+
+/* TOML */
+#include "value.h"
+#include "dom.h"
+#include "lazy.h"
+
+namespace cg {
+namespace toml {
+
+/* Borrowed access to the nodes of a document. None of these helpers
+ * touch the reference counts of the nodes they return, so the caller must
+ * keep the document alive while using them. */
+
+/* A segment of a compiled path, hashed up front for the compact DOM */
+struct Segment {
+  std::string key;
+  guint32 hash;
+};
+
+/* The segments of a compiled path */
+using Segments = std::vector<Segment>;
+
+/* A node of either a cpptoml tree, a compact DOM or the root of a lazy
+ * document. Compact nodes have the lowest bit of their address set and lazy
+ * roots the next one, which are free since both are aligned */
+class Node {
+ public:
+  /* Constructors */
+  Node() :
+      bits_(0) {
+  }
+
+  Node(const cpptoml::base *node) :
+      bits_(reinterpret_cast<guintptr>(node)) {
+  }
+
+  Node(const dom::Node *node) :
+      bits_(node ? reinterpret_cast<guintptr>(node) | COMPACT : 0) {
+  }
+
+  Node(const LazyDocument *node) :
+      bits_(node ? reinterpret_cast<guintptr>(node) | LAZY : 0) {
+  }
+
+  /* Gets the node stored in the data of a view or iterator */
+  static Node FromData(gconstpointer data) {
+    Node node;
+    node.bits_ = reinterpret_cast<guintptr>(data);
+    return node;
+  }
+
+  /* Gets the data to store in a view or iterator */
+  gconstpointer ToData() const {
+    return reinterpret_cast<gconstpointer>(bits_);
+  }
+
+  /* Whether the node exists */
+  explicit operator bool() const {
+    return bits_ != 0;
+  }
+
+  /* Gets the cpptoml node, if any */
+  const cpptoml::base *GetBase() const {
+    return bits_ & TAGS ? nullptr :
+        reinterpret_cast<const cpptoml::base *>(bits_);
+  }
+
+  /* Gets the compact node, if any */
+  const dom::Node *GetCompact() const {
+    return bits_ & COMPACT ?
+        reinterpret_cast<const dom::Node *>(bits_ & ~TAGS) : nullptr;
+  }
+
+  /* Gets the lazy document, if any */
+  const LazyDocument *GetLazy() const {
+    return bits_ & LAZY ?
+        reinterpret_cast<const LazyDocument *>(bits_ & ~TAGS) : nullptr;
+  }
+
+ private:
+  /* The bit set on compact nodes */
+  static constexpr guintptr COMPACT = 1;
+
+  /* The bit set on lazy roots */
+  static constexpr guintptr LAZY = 2;
+
+  /* All the tag bits */
+  static constexpr guintptr TAGS = COMPACT | LAZY;
+
+  /* The tagged address */
+  guintptr bits_;
+};
+
+/* A node along with whatever keeps its memory alive */
+struct OwnedNode {
+  std::shared_ptr<const void> owner;
+  Node node;
+};
+
+/* Takes a reference on a node found under an owned node. A cpptoml node can
+ * be kept alive on its own, a compact one needs its whole document */
+inline OwnedNode Own(const std::shared_ptr<const void>& owner, Node node) {
+  if (const cpptoml::base *base = node.GetBase())
+    return {base->shared_from_this(), node};
+  return {owner, node};
+}
+
+/* Casts a node into a value of the given type. Values are never derived
+ * from, so comparing the exact type is enough and cheaper than a cast */
+template <typename T>
+inline const cpptoml::value<T> *AsValue(const cpptoml::base *node) {
+  return node && typeid(*node) == typeid(cpptoml::value<T>) ?
+      static_cast<const cpptoml::value<T> *>(node) : nullptr;
+}
+
+/* Casts a node into a table */
+inline const cpptoml::table *AsTable(const cpptoml::base *node) {
+  return node && node->is_table() ?
+      static_cast<const cpptoml::table *>(node) : nullptr;
+}
+
+/* Casts a node into an array */
+inline const cpptoml::array *AsArray(const cpptoml::base *node) {
+  return node && node->is_array() ?
+      static_cast<const cpptoml::array *>(node) : nullptr;
+}
+
+/* Casts a node into an array of tables */
+inline const cpptoml::table_array *AsTableArray(const cpptoml::base *node) {
+  return node && node->is_table_array() ?
+      static_cast<const cpptoml::table_array *>(node) : nullptr;
+}
+
+/* Gets the type of a node */
+inline CgTomlValueType GetValueType(Node node) {
+  if (const dom::Node *n = node.GetCompact())
+    return static_cast<CgTomlValueType>(n->type);
+  if (node.GetLazy())
+    return CG_TOML_VALUE_TYPE_TABLE;
+  const cpptoml::base *base = node.GetBase();
+  if (!base)
+    return CG_TOML_VALUE_TYPE_NONE;
+  if (base->is_table())
+    return CG_TOML_VALUE_TYPE_TABLE;
+  if (base->is_array())
+    return CG_TOML_VALUE_TYPE_ARRAY;
+  if (base->is_table_array())
+    return CG_TOML_VALUE_TYPE_TABLE_ARRAY;
+  if (AsValue<bool>(base))
+    return CG_TOML_VALUE_TYPE_BOOLEAN;
+  if (AsValue<int64_t>(base))
+    return CG_TOML_VALUE_TYPE_INT64;
+  if (AsValue<double>(base))
+    return CG_TOML_VALUE_TYPE_DOUBLE;
+  if (AsValue<std::string>(base))
+    return CG_TOML_VALUE_TYPE_STRING;
+  if (AsValue<cpptoml::local_date>(base))
+    return CG_TOML_VALUE_TYPE_LOCAL_DATE;
+  if (AsValue<cpptoml::local_time>(base))
+    return CG_TOML_VALUE_TYPE_LOCAL_TIME;
+  if (AsValue<cpptoml::local_datetime>(base))
+    return CG_TOML_VALUE_TYPE_LOCAL_DATETIME;
+  if (AsValue<cpptoml::offset_datetime>(base))
+    return CG_TOML_VALUE_TYPE_OFFSET_DATETIME;
+  return CG_TOML_VALUE_TYPE_NONE;
+}
+
+/* Checks whether a node is a table */
+inline bool IsTable(Node node) {
+  if (const dom::Node *n = node.GetCompact())
+    return n->type == CG_TOML_VALUE_TYPE_TABLE;
+  if (node.GetLazy())
+    return true;
+  return AsTable(node.GetBase()) != nullptr;
+}
+
+/* Checks whether a node is an array */
+inline bool IsArray(Node node) {
+  if (const dom::Node *n = node.GetCompact())
+    return n->type == CG_TOML_VALUE_TYPE_ARRAY;
+  return AsArray(node.GetBase()) != nullptr;
+}
+
+/* Checks whether a node is an array of tables */
+inline bool IsTableArray(Node node) {
+  if (const dom::Node *n = node.GetCompact())
+    return n->type == CG_TOML_VALUE_TYPE_TABLE_ARRAY;
+  return AsTableArray(node.GetBase()) != nullptr;
+}
+
+/* Gets the integer of a node */
+inline bool GetInteger(Node node, int64_t *val) {
+  if (const dom::Node *n = node.GetCompact()) {
+    if (n->type != CG_TOML_VALUE_TYPE_INT64)
+      return false;
+    *val = n->integer;
+    return true;
+  }
+  const cpptoml::value<int64_t> *v = AsValue<int64_t>(node.GetBase());
+  if (!v)
+    return false;
+  *val = v->get();
+  return true;
+}
+
+/* Gets an integer value, failing if it does not fit in the given type */
+template <typename T>
+inline typename std::enable_if<
+    std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+GetValue(Node node, T *val) {
+  int64_t i;
+  if (!GetInteger(node, &i))
+    return false;
+  if (std::is_signed<T>::value) {
+    if (i < static_cast<int64_t>(std::numeric_limits<T>::min()) ||
+        i > static_cast<int64_t>(std::numeric_limits<T>::max()))
+      return false;
+  } else {
+    if (i < 0 ||
+        static_cast<uint64_t>(i) >
+            static_cast<uint64_t>(std::numeric_limits<T>::max()))
+      return false;
+  }
+  *val = static_cast<T>(i);
+  return true;
+}
+
+/* Gets a boolean value */
+inline bool GetValue(Node node, bool *val) {
+  if (const dom::Node *n = node.GetCompact()) {
+    if (n->type != CG_TOML_VALUE_TYPE_BOOLEAN)
+      return false;
+    *val = n->boolean != 0;
+    return true;
+  }
+  const cpptoml::value<bool> *v = AsValue<bool>(node.GetBase());
+  if (!v)
+    return false;
+  *val = v->get();
+  return true;
+}
+
+/* Gets a floating point value, integers are converted */
+inline bool GetValue(Node node, double *val) {
+  if (const dom::Node *n = node.GetCompact()) {
+    if (n->type == CG_TOML_VALUE_TYPE_DOUBLE) {
+      *val = n->floating;
+      return true;
+    }
+  } else if (const cpptoml::value<double> *v = AsValue<double>(
+      node.GetBase())) {
+    *val = v->get();
+    return true;
+  }
+  int64_t i;
+  if (!GetInteger(node, &i))
+    return false;
+  *val = static_cast<double>(i);
+  return true;
+}
+
+/* Gets a NUL terminated string value and its length without copying it */
+inline const char *GetString(Node node, gsize *len) {
+  if (const dom::Node *n = node.GetCompact()) {
+    if (n->type != CG_TOML_VALUE_TYPE_STRING)
+      return nullptr;
+    if (len)
+      *len = n->length;
+    return dom::GetString(n);
+  }
+  const cpptoml::value<std::string> *v = AsValue<std::string>(node.GetBase());
+  if (!v)
+    return nullptr;
+  if (len)
+    *len = v->get().size();
+  return v->get().c_str();
+}
+
+/* Gets the number of elements of an array or array of tables */
+inline gsize GetLength(Node node) {
+  if (const dom::Node *n = node.GetCompact()) {
+    return n->type == CG_TOML_VALUE_TYPE_ARRAY ||
+        n->type == CG_TOML_VALUE_TYPE_TABLE_ARRAY ? n->length : 0;
+  }
+  const cpptoml::base *base = node.GetBase();
+  if (const cpptoml::array *a = AsArray(base))
+    return a->get().size();
+  if (const cpptoml::table_array *ta = AsTableArray(base))
+    return ta->get().size();
+  return 0;
+}
+
+/* Gets the element at the given position of an array or array of tables */
+inline Node GetNth(Node node, gsize index) {
+  if (index >= GetLength(node))
+    return Node {};
+  if (const dom::Node *n = node.GetCompact())
+    return Node {dom::GetElements(n) + index};
+  const cpptoml::base *base = node.GetBase();
+  if (const cpptoml::array *a = AsArray(base))
+    return Node {a->get()[index].get()};
+  return Node {AsTableArray(base)->get()[index].get()};
+}
+
+/* Calls the given callable with each element of an array or array of
+ * tables, until it returns false */
+template <typename F>
+inline void ForEachElement(Node node, F func) {
+  if (const dom::Node *n = node.GetCompact()) {
+    if (n->type != CG_TOML_VALUE_TYPE_ARRAY &&
+        n->type != CG_TOML_VALUE_TYPE_TABLE_ARRAY)
+      return;
+    const dom::Node *elements = dom::GetElements(n);
+    for (guint32 i = 0; i < n->length; i++) {
+      if (!func(Node {elements + i}))
+        return;
+    }
+    return;
+  }
+  const cpptoml::base *base = node.GetBase();
+  if (const cpptoml::array *a = AsArray(base)) {
+    for (const std::shared_ptr<cpptoml::base>& v : a->get()) {
+      if (!func(Node {v.get()}))
+        return;
+    }
+  } else if (const cpptoml::table_array *ta = AsTableArray(base)) {
+    for (const std::shared_ptr<cpptoml::table>& t : ta->get()) {
+      if (!func(Node {t.get()}))
+        return;
+    }
+  }
+}
+
+/* Gets the date and time of a date or time node, the fields a type does not
+ * have are left to zero */
+inline bool GetDatetime(Node node, dom::Datetime *val) {
+  *val = {};
+  if (const dom::Node *n = node.GetCompact()) {
+    if (n->type < CG_TOML_VALUE_TYPE_LOCAL_DATE ||
+        n->type > CG_TOML_VALUE_TYPE_OFFSET_DATETIME)
+      return false;
+    *val = *dom::GetDatetime(n);
+    return true;
+  }
+  const cpptoml::base *base = node.GetBase();
+  const cpptoml::local_date *date = nullptr;
+  const cpptoml::local_time *time = nullptr;
+  if (const auto *v = AsValue<cpptoml::local_date>(base)) {
+    date = &v->get();
+  } else if (const auto *v = AsValue<cpptoml::local_time>(base)) {
+    time = &v->get();
+  } else if (const auto *v = AsValue<cpptoml::local_datetime>(base)) {
+    date = &v->get();
+    time = &v->get();
+  } else if (const auto *v = AsValue<cpptoml::offset_datetime>(base)) {
+    date = &v->get();
+    time = &v->get();
+    val->hour_offset = v->get().hour_offset;
+    val->minute_offset = v->get().minute_offset;
+  } else {
+    return false;
+  }
+  if (date) {
+    val->year = date->year;
+    val->month = date->month;
+    val->day = date->day;
+  }
+  if (time) {
+    val->hour = time->hour;
+    val->minute = time->minute;
+    val->second = time->second;
+    val->microsecond = time->microsecond;
+  }
+  return true;
+}
+
+/* Calls the given callable with the key, key length and value of each entry
+ * of a table, until it returns false. Lazy sections are parsed as they are
+ * reached */
+template <typename F>
+inline void ForEachEntry(Node table, F func) {
+  if (const dom::Node *t = table.GetCompact()) {
+    if (t->type != CG_TOML_VALUE_TYPE_TABLE)
+      return;
+    const dom::Entry *entries = dom::GetEntries(t);
+    const dom::Node *values = dom::GetValues(t);
+    for (guint32 i = 0; i < t->length; i++) {
+      if (!func(dom::GetKey(entries + i), entries[i].length,
+          Node {values + i}))
+        return;
+    }
+    return;
+  }
+  if (const LazyDocument *l = table.GetLazy()) {
+    for (gsize i = 0; i < l->GetLength(); i++) {
+      const char *key;
+      const cpptoml::base *value = l->GetNth(i, &key);
+      if (!func(key, std::strlen(key), Node {value}))
+        return;
+    }
+    return;
+  }
+  if (const cpptoml::table *t = AsTable(table.GetBase())) {
+    for (const auto& entry : *t) {
+      if (!func(entry.first.c_str(), entry.first.size(),
+          Node {entry.second.get()}))
+        return;
+    }
+  }
+}
+
+/* A key to match against the entries of a table, hashed up front */
+struct KeyRef {
+  const char *key;
+  gsize len;
+  guint32 hash;
+};
+
+/* Sorts keys the way the entries of a compact table are */
+inline bool operator<(const KeyRef& a, const KeyRef& b) {
+  if (a.hash != b.hash)
+    return a.hash < b.hash;
+  const int cmp = std::memcmp(a.key, b.key, std::min(a.len, b.len));
+  return cmp != 0 ? cmp < 0 : a.len < b.len;
+}
+
+/* Calls the given callable with the position and value of each of the
+ * given keys, sorted, found in a table, until it returns false. Compact
+ * tables are merged with the keys on their hashes, lazy documents only
+ * parse the sections of the keys and any other table is walked once */
+template <typename F>
+inline void MatchEntries(Node table, const KeyRef *keys, gsize n, F func) {
+  auto matches = [](const KeyRef& k, const char *key, gsize len) {
+    return k.len == len && std::memcmp(k.key, key, len) == 0;
+  };
+
+  if (const dom::Node *t = table.GetCompact()) {
+    if (t->type != CG_TOML_VALUE_TYPE_TABLE)
+      return;
+    const dom::Entry *entries = dom::GetEntries(t);
+    const dom::Node *values = dom::GetValues(t);
+    gsize j = 0;
+    for (guint32 i = 0; i < t->length && j < n; i++) {
+      while (j < n && keys[j].hash < entries[i].hash)
+        j++;
+      for (gsize k = j; k < n && keys[k].hash == entries[i].hash; k++) {
+        if (matches(keys[k], dom::GetKey(entries + i), entries[i].length) &&
+            !func(k, Node {values + i}))
+          return;
+      }
+    }
+    return;
+  }
+
+  if (const LazyDocument *l = table.GetLazy()) {
+    for (gsize k = 0; k < n; k++) {
+      const Node value {l->Lookup(keys[k].key, keys[k].len)};
+      if (value && !func(k, value))
+        return;
+    }
+    return;
+  }
+
+  ForEachEntry(table, [&](const char *key, gsize len, Node value) {
+    const KeyRef ref {key, len, dom::Hash(key, len)};
+    const KeyRef *k = std::lower_bound(keys, keys + n, ref);
+    for (; k != keys + n && matches(*k, key, len); k++) {
+      if (!func(k - keys, value))
+        return false;
+    }
+    return true;
+  });
+}
+
+/* Looks up a key in a cpptoml table */
+inline const cpptoml::base *Find(const cpptoml::table *table,
+    const std::string& key) {
+  return table && table->contains(key) ? table->get(key).get() : nullptr;
+}
+
+/* Looks up a key of the given length in a table */
+inline Node Lookup(Node table, const char *key, gsize len) {
+  if (const dom::Node *t = table.GetCompact()) {
+    if (t->type != CG_TOML_VALUE_TYPE_TABLE)
+      return Node {};
+    return Node {dom::Lookup(t, key, len, dom::Hash(key, len))};
+  }
+  if (const LazyDocument *l = table.GetLazy())
+    return Node {l->Lookup(key, len)};
+  return Node {Find(AsTable(table.GetBase()), std::string {key, len})};
+}
+
+/* Looks up a segment of a compiled path in a table */
+inline Node Lookup(Node table, const Segment& segment) {
+  if (const dom::Node *t = table.GetCompact()) {
+    if (t->type != CG_TOML_VALUE_TYPE_TABLE)
+      return Node {};
+    return Node {dom::Lookup(t, segment.key.data(), segment.key.size(),
+        segment.hash)};
+  }
+  if (const LazyDocument *l = table.GetLazy())
+    return Node {l->Lookup(segment.key.data(), segment.key.size())};
+  return Node {Find(AsTable(table.GetBase()), segment.key)};
+}
+
+/* Looks up a dotted key in a table, splitting it while walking the tree */
+inline Node LookupQualified(Node table, const char *key) {
+  Node node = table;
+  while (node) {
+    const char *end = std::strchr(key, '.');
+    node = Lookup(node, key, end ? static_cast<gsize>(end - key) :
+        std::strlen(key));
+    if (!end)
+      break;
+    key = end + 1;
+  }
+  return node;
+}
+
+/* Looks up a dotted key of the given length in a table */
+inline Node LookupQualified(Node table, const char *key, gsize len) {
+  const char *end = key + len;
+  Node node = table;
+  while (node) {
+    const char *dot = static_cast<const char *>(
+        std::memchr(key, '.', end - key));
+    node = Lookup(node, key, (dot ? dot : end) - key);
+    if (!dot)
+      break;
+    key = dot + 1;
+  }
+  return node;
+}
+
+/* Looks up the already split segments of a path in a table */
+inline Node LookupPath(Node table, const Segments& segments) {
+  Node node = table;
+  for (const Segment& segment : segments) {
+    node = Lookup(node, segment);
+    if (!node)
+      break;
+  }
+  return node;
+}
+
+/* Looks up a key, optionally qualified, in a table */
+inline Node Lookup(Node table, const char *key, bool qualified) {
+  return qualified ? LookupQualified(table, key) :
+      Lookup(table, key, std::strlen(key));
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
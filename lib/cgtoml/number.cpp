@@ -0,0 +1,391 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <cmath>
+#include <cstring>
+
+/* TOML */
+#include "number.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* The pairs of decimal digits of the numbers below 100 */
+const char DIGITS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Formats the digits of an unsigned integer */
+gsize FormatDigits(guint64 value, char *buffer) {
+  char digits[20];
+  char *p = digits + sizeof (digits);
+  while (value >= 100) {
+    const guint i = static_cast<guint>(value % 100) * 2;
+    value /= 100;
+    p -= 2;
+    std::memcpy(p, DIGITS + i, 2);
+  }
+  if (value >= 10) {
+    p -= 2;
+    std::memcpy(p, DIGITS + value * 2, 2);
+  } else {
+    *--p = static_cast<char>('0' + value);
+  }
+  const gsize len = digits + sizeof (digits) - p;
+  std::memcpy(buffer, p, len);
+  return len;
+}
+
+/* The shortest digits of a double are found with Grisu2, from "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers" by Florian
+ * Loitsch. It works on 64-bit integers only and its output always parses
+ * back to the same double. It is the shortest possible one but for about
+ * 0.1% of the values, for which it is one digit longer */
+
+/* A floating point number with a 64-bit significand, f * 2^e */
+struct DiyFp {
+  guint64 f;
+  gint e;
+};
+
+/* Subtracts two numbers of the same exponent, x being the largest */
+DiyFp Sub(DiyFp x, DiyFp y) {
+  return {x.f - y.f, x.e};
+}
+
+/* Multiplies two numbers, rounding the significand of the product */
+DiyFp Mul(DiyFp x, DiyFp y) {
+  const guint64 x_lo = x.f & 0xFFFFFFFF;
+  const guint64 x_hi = x.f >> 32;
+  const guint64 y_lo = y.f & 0xFFFFFFFF;
+  const guint64 y_hi = y.f >> 32;
+  const guint64 p0 = x_lo * y_lo;
+  const guint64 p1 = x_lo * y_hi;
+  const guint64 p2 = x_hi * y_lo;
+  const guint64 p3 = x_hi * y_hi;
+  guint64 mid = (p0 >> 32) + (p1 & 0xFFFFFFFF) + (p2 & 0xFFFFFFFF);
+  mid += G_GUINT64_CONSTANT (1) << 31;
+  return {p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32), x.e + y.e + 64};
+}
+
+/* Shifts a number until the highest bit of its significand is set */
+DiyFp Normalize(DiyFp x) {
+  while (!(x.f >> 63)) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/* The bounds of the interval of numbers that round to a double */
+struct Boundaries {
+  DiyFp minus;
+  DiyFp plus;
+};
+
+/* Gets a positive double and its boundaries, all normalized to the same
+ * exponent */
+DiyFp Decompose(double value, Boundaries *b) {
+  constexpr gint BIAS = 1075;
+  constexpr guint64 HIDDEN_BIT = G_GUINT64_CONSTANT (1) << 52;
+  guint64 bits;
+  std::memcpy(&bits, &value, sizeof (bits));
+  const guint64 fraction = bits & (HIDDEN_BIT - 1);
+  const gint exponent = static_cast<gint>(bits >> 52);
+  const DiyFp v = exponent == 0 ? DiyFp {fraction, 1 - BIAS} :
+      DiyFp {fraction + HIDDEN_BIT, exponent - BIAS};
+
+  /* The lower boundary is closer for powers of two, but the smallest
+   * normal one */
+  b->plus = Normalize({2 * v.f + 1, v.e - 1});
+  const DiyFp minus = fraction == 0 && exponent > 1 ?
+      DiyFp {4 * v.f - 1, v.e - 2} : DiyFp {2 * v.f - 1, v.e - 1};
+  b->minus = {minus.f << (minus.e - b->plus.e), b->plus.e};
+  return Normalize(v);
+}
+
+/* A cached power of ten, 10^k ~= f * 2^e */
+struct CachedPower {
+  guint64 f;
+  gint e;
+  gint k;
+};
+
+/* The powers of ten from 10^-300 to 10^324, every 8 */
+const CachedPower CACHED_POWERS[] = {
+  { G_GUINT64_CONSTANT (0xAB70FE17C79AC6CA), -1060, -300 },
+  { G_GUINT64_CONSTANT (0xFF77B1FCBEBCDC4F), -1034, -292 },
+  { G_GUINT64_CONSTANT (0xBE5691EF416BD60C), -1007, -284 },
+  { G_GUINT64_CONSTANT (0x8DD01FAD907FFC3C), -980, -276 },
+  { G_GUINT64_CONSTANT (0xD3515C2831559A83), -954, -268 },
+  { G_GUINT64_CONSTANT (0x9D71AC8FADA6C9B5), -927, -260 },
+  { G_GUINT64_CONSTANT (0xEA9C227723EE8BCB), -901, -252 },
+  { G_GUINT64_CONSTANT (0xAECC49914078536D), -874, -244 },
+  { G_GUINT64_CONSTANT (0x823C12795DB6CE57), -847, -236 },
+  { G_GUINT64_CONSTANT (0xC21094364DFB5637), -821, -228 },
+  { G_GUINT64_CONSTANT (0x9096EA6F3848984F), -794, -220 },
+  { G_GUINT64_CONSTANT (0xD77485CB25823AC7), -768, -212 },
+  { G_GUINT64_CONSTANT (0xA086CFCD97BF97F4), -741, -204 },
+  { G_GUINT64_CONSTANT (0xEF340A98172AACE5), -715, -196 },
+  { G_GUINT64_CONSTANT (0xB23867FB2A35B28E), -688, -188 },
+  { G_GUINT64_CONSTANT (0x84C8D4DFD2C63F3B), -661, -180 },
+  { G_GUINT64_CONSTANT (0xC5DD44271AD3CDBA), -635, -172 },
+  { G_GUINT64_CONSTANT (0x936B9FCEBB25C996), -608, -164 },
+  { G_GUINT64_CONSTANT (0xDBAC6C247D62A584), -582, -156 },
+  { G_GUINT64_CONSTANT (0xA3AB66580D5FDAF6), -555, -148 },
+  { G_GUINT64_CONSTANT (0xF3E2F893DEC3F126), -529, -140 },
+  { G_GUINT64_CONSTANT (0xB5B5ADA8AAFF80B8), -502, -132 },
+  { G_GUINT64_CONSTANT (0x87625F056C7C4A8B), -475, -124 },
+  { G_GUINT64_CONSTANT (0xC9BCFF6034C13053), -449, -116 },
+  { G_GUINT64_CONSTANT (0x964E858C91BA2655), -422, -108 },
+  { G_GUINT64_CONSTANT (0xDFF9772470297EBD), -396, -100 },
+  { G_GUINT64_CONSTANT (0xA6DFBD9FB8E5B88F), -369, -92 },
+  { G_GUINT64_CONSTANT (0xF8A95FCF88747D94), -343, -84 },
+  { G_GUINT64_CONSTANT (0xB94470938FA89BCF), -316, -76 },
+  { G_GUINT64_CONSTANT (0x8A08F0F8BF0F156B), -289, -68 },
+  { G_GUINT64_CONSTANT (0xCDB02555653131B6), -263, -60 },
+  { G_GUINT64_CONSTANT (0x993FE2C6D07B7FAC), -236, -52 },
+  { G_GUINT64_CONSTANT (0xE45C10C42A2B3B06), -210, -44 },
+  { G_GUINT64_CONSTANT (0xAA242499697392D3), -183, -36 },
+  { G_GUINT64_CONSTANT (0xFD87B5F28300CA0E), -157, -28 },
+  { G_GUINT64_CONSTANT (0xBCE5086492111AEB), -130, -20 },
+  { G_GUINT64_CONSTANT (0x8CBCCC096F5088CC), -103, -12 },
+  { G_GUINT64_CONSTANT (0xD1B71758E219652C), -77, -4 },
+  { G_GUINT64_CONSTANT (0x9C40000000000000), -50, 4 },
+  { G_GUINT64_CONSTANT (0xE8D4A51000000000), -24, 12 },
+  { G_GUINT64_CONSTANT (0xAD78EBC5AC620000), 3, 20 },
+  { G_GUINT64_CONSTANT (0x813F3978F8940984), 30, 28 },
+  { G_GUINT64_CONSTANT (0xC097CE7BC90715B3), 56, 36 },
+  { G_GUINT64_CONSTANT (0x8F7E32CE7BEA5C70), 83, 44 },
+  { G_GUINT64_CONSTANT (0xD5D238A4ABE98068), 109, 52 },
+  { G_GUINT64_CONSTANT (0x9F4F2726179A2245), 136, 60 },
+  { G_GUINT64_CONSTANT (0xED63A231D4C4FB27), 162, 68 },
+  { G_GUINT64_CONSTANT (0xB0DE65388CC8ADA8), 189, 76 },
+  { G_GUINT64_CONSTANT (0x83C7088E1AAB65DB), 216, 84 },
+  { G_GUINT64_CONSTANT (0xC45D1DF942711D9A), 242, 92 },
+  { G_GUINT64_CONSTANT (0x924D692CA61BE758), 269, 100 },
+  { G_GUINT64_CONSTANT (0xDA01EE641A708DEA), 295, 108 },
+  { G_GUINT64_CONSTANT (0xA26DA3999AEF774A), 322, 116 },
+  { G_GUINT64_CONSTANT (0xF209787BB47D6B85), 348, 124 },
+  { G_GUINT64_CONSTANT (0xB454E4A179DD1877), 375, 132 },
+  { G_GUINT64_CONSTANT (0x865B86925B9BC5C2), 402, 140 },
+  { G_GUINT64_CONSTANT (0xC83553C5C8965D3D), 428, 148 },
+  { G_GUINT64_CONSTANT (0x952AB45CFA97A0B3), 455, 156 },
+  { G_GUINT64_CONSTANT (0xDE469FBD99A05FE3), 481, 164 },
+  { G_GUINT64_CONSTANT (0xA59BC234DB398C25), 508, 172 },
+  { G_GUINT64_CONSTANT (0xF6C69A72A3989F5C), 534, 180 },
+  { G_GUINT64_CONSTANT (0xB7DCBF5354E9BECE), 561, 188 },
+  { G_GUINT64_CONSTANT (0x88FCF317F22241E2), 588, 196 },
+  { G_GUINT64_CONSTANT (0xCC20CE9BD35C78A5), 614, 204 },
+  { G_GUINT64_CONSTANT (0x98165AF37B2153DF), 641, 212 },
+  { G_GUINT64_CONSTANT (0xE2A0B5DC971F303A), 667, 220 },
+  { G_GUINT64_CONSTANT (0xA8D9D1535CE3B396), 694, 228 },
+  { G_GUINT64_CONSTANT (0xFB9B7CD9A4A7443C), 720, 236 },
+  { G_GUINT64_CONSTANT (0xBB764C4CA7A44410), 747, 244 },
+  { G_GUINT64_CONSTANT (0x8BAB8EEFB6409C1A), 774, 252 },
+  { G_GUINT64_CONSTANT (0xD01FEF10A657842C), 800, 260 },
+  { G_GUINT64_CONSTANT (0x9B10A4E5E9913129), 827, 268 },
+  { G_GUINT64_CONSTANT (0xE7109BFBA19C0C9D), 853, 276 },
+  { G_GUINT64_CONSTANT (0xAC2820D9623BF429), 880, 284 },
+  { G_GUINT64_CONSTANT (0x80444B5E7AA7CF85), 907, 292 },
+  { G_GUINT64_CONSTANT (0xBF21E44003ACDD2D), 933, 300 },
+  { G_GUINT64_CONSTANT (0x8E679C2F5E44FF8F), 960, 308 },
+  { G_GUINT64_CONSTANT (0xD433179D9C8CB841), 986, 316 },
+  { G_GUINT64_CONSTANT (0x9E19DB92B4E31BA9), 1013, 324 },
+};
+
+/* The range the exponent of the scaled numbers is kept in, so their
+ * integral part fits in 32 bits */
+constexpr gint ALPHA = -60;
+constexpr gint GAMMA = -32;
+
+/* Gets the cached power of ten that scales a number of the given binary
+ * exponent into [ALPHA, GAMMA] */
+const CachedPower& GetCachedPower(gint e) {
+  /* k = ceil((ALPHA - e - 1) * log10(2)) */
+  const gint f = ALPHA - e - 1;
+  const gint k = (f * 78913) / (1 << 18) + (f > 0);
+  const gint index = (300 + k + 7) / 8;
+  return CACHED_POWERS[index];
+}
+
+/* Gets the number of digits of a 32-bit integer and the power of ten of
+ * its first digit */
+gint GetLength(guint32 n, guint32 *pow10) {
+  gint len = 10;
+  *pow10 = 1000000000;
+  while (len > 1 && n < *pow10) {
+    *pow10 /= 10;
+    len--;
+  }
+  return len;
+}
+
+/* Moves the last digit towards the exact value, as long as it stays in
+ * the rounding interval */
+void Round(char *digits, gint n, guint64 dist, guint64 delta, guint64 rest,
+    guint64 ten_k) {
+  while (rest < dist && delta - rest >= ten_k &&
+      (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    digits[n - 1]--;
+    rest += ten_k;
+  }
+}
+
+/* Generates the shortest digits of w in the interval [low, high], all of
+ * them scaled, such that w ~= digits * 10^exponent */
+void GenerateDigits(char *digits, gint *n, gint *exponent, DiyFp low,
+    DiyFp w, DiyFp high) {
+  guint64 delta = Sub(high, low).f;
+  guint64 dist = Sub(high, w).f;
+  const DiyFp one {G_GUINT64_CONSTANT (1) << -high.e, high.e};
+
+  /* The integral part, at most 10 digits */
+  guint32 p1 = static_cast<guint32>(high.f >> -one.e);
+  guint64 p2 = high.f & (one.f - 1);
+  guint32 pow10;
+  gint k = GetLength(p1, &pow10);
+  while (k > 0) {
+    digits[(*n)++] = static_cast<char>('0' + p1 / pow10);
+    p1 %= pow10;
+    k--;
+    const guint64 rest = (static_cast<guint64>(p1) << -one.e) + p2;
+    if (rest <= delta) {
+      *exponent += k;
+      Round(digits, *n, dist, delta, rest,
+          static_cast<guint64>(pow10) << -one.e);
+      return;
+    }
+    pow10 /= 10;
+  }
+
+  /* The fractional part */
+  gint m = 0;
+  do {
+    p2 *= 10;
+    digits[(*n)++] = static_cast<char>('0' + (p2 >> -one.e));
+    p2 &= one.f - 1;
+    delta *= 10;
+    dist *= 10;
+    m++;
+  } while (p2 > delta);
+  *exponent -= m;
+  Round(digits, *n, dist, delta, p2, one.f);
+}
+
+/* Gets the shortest digits of a positive double, value ~= digits *
+ * 10^exponent */
+void Grisu2(double value, char *digits, gint *n, gint *exponent) {
+  Boundaries b;
+  const DiyFp v = Decompose(value, &b);
+  const CachedPower& c = GetCachedPower(b.plus.e);
+  const DiyFp c_k {c.f, c.e};
+  const DiyFp w = Mul(v, c_k);
+  const DiyFp low = Mul(b.minus, c_k);
+  const DiyFp high = Mul(b.plus, c_k);
+
+  /* Shrink the interval by one unit to cover the rounding of the
+   * products */
+  *n = 0;
+  *exponent = -c.k;
+  GenerateDigits(digits, n, exponent, {low.f + 1, low.e}, w,
+      {high.f - 1, high.e});
+}
+
+/* Lays out digits * 10^exponent as a TOML float, in plain notation unless
+ * the number is very large or very small */
+gsize FormatFloat(const char *digits, gint n, gint exponent, char *buffer) {
+  char *p = buffer;
+  const gint point = n + exponent;
+
+  if (n <= point && point <= 15) {
+    /* 1234500.0 */
+    std::memcpy(p, digits, n);
+    p += n;
+    std::memset(p, '0', point - n);
+    p += point - n;
+    *p++ = '.';
+    *p++ = '0';
+  } else if (0 < point && point <= 15) {
+    /* 123.45 */
+    std::memcpy(p, digits, point);
+    p += point;
+    *p++ = '.';
+    std::memcpy(p, digits + point, n - point);
+    p += n - point;
+  } else if (-4 < point && point <= 0) {
+    /* 0.0012345 */
+    *p++ = '0';
+    *p++ = '.';
+    std::memset(p, '0', -point);
+    p += -point;
+    std::memcpy(p, digits, n);
+    p += n;
+  } else {
+    /* 1.2345e+20 */
+    *p++ = digits[0];
+    if (n > 1) {
+      *p++ = '.';
+      std::memcpy(p, digits + 1, n - 1);
+      p += n - 1;
+    }
+    *p++ = 'e';
+    *p++ = point - 1 < 0 ? '-' : '+';
+    p += FormatDigits(std::abs(point - 1), p);
+  }
+  return p - buffer;
+}
+
+}  /* namespace */
+
+gsize
+FormatInteger(int64_t value, char *buffer)
+{
+  guint64 magnitude = static_cast<guint64>(value);
+  if (value >= 0)
+    return FormatDigits(magnitude, buffer);
+  buffer[0] = '-';
+  return 1 + FormatDigits(0 - magnitude, buffer + 1);
+}
+
+gsize
+FormatDouble(double value, char *buffer)
+{
+  char *p = buffer;
+  if (std::isnan(value)) {
+    std::memcpy(p, "nan", 3);
+    return 3;
+  }
+  if (std::signbit(value)) {
+    *p++ = '-';
+    value = -value;
+  }
+  if (std::isinf(value)) {
+    std::memcpy(p, "inf", 3);
+    return p + 3 - buffer;
+  }
+  if (value == 0) {
+    std::memcpy(p, "0.0", 3);
+    return p + 3 - buffer;
+  }
+
+  char digits[20];
+  gint n;
+  gint exponent;
+  Grisu2(value, digits, &n, &exponent);
+  return p - buffer + FormatFloat(digits, n, exponent, p);
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
@@ -0,0 +1,37 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_NUMBER_H__
+#define __CG_TOML_NUMBER_H__
+
+/* GLib */
+#include <glib.h>
+
+/* C */
+#include <stdint.h>
+
+namespace cg {
+namespace toml {
+
+/* The largest text of a formatted number */
+constexpr gsize MAX_NUMBER_LENGTH = 32;
+
+/* Formats an integer into a buffer of at least MAX_NUMBER_LENGTH bytes and
+ * returns its length. The text is not NUL terminated */
+gsize FormatInteger(int64_t value, char *buffer);
+
+/* Formats a double as a TOML float, with the fewest digits that parse back
+ * to the same value, into a buffer of at least MAX_NUMBER_LENGTH bytes and
+ * returns its length. The text is not NUL terminated. Neither the locale
+ * nor the heap are involved */
+gsize FormatDouble(double value, char *buffer);
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
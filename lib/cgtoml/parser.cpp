@@ -0,0 +1,996 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* TOML */
+#include "scanner.h"
+#include "error.h"
+#include "parser.h"
+
+namespace cg {
+namespace toml {
+
+/* Thrown when the document is not valid */
+class SyntaxError : public std::runtime_error {
+ public:
+  /* Constructor */
+  SyntaxError(guint line, const char *what) :
+      std::runtime_error(what),
+      line_(line) {
+  }
+
+  /* Gets the line where the error was found */
+  guint GetLine() const {
+    return line_;
+  }
+
+ private:
+  /* The line */
+  guint line_;
+};
+
+/* Thrown when an event stops the parsing */
+class Stopped : public std::exception {
+};
+
+/* The Parser class, emits the events of a document one statement at a time.
+ * Only the statement being parsed is looked at, so besides the scratch
+ * buffers for unescaped strings and the start of a statement split across
+ * chunks, the memory used only grows with nesting */
+class Parser {
+ public:
+  /* The maximum nesting of arrays, inline tables and dotted keys */
+  static constexpr guint MAX_DEPTH = 128;
+
+  /* Constructor */
+  Parser(const CgTomlParserEvents& events, gpointer user_data) :
+      events_(events),
+      user_data_(user_data),
+      line_(1) {
+  }
+
+  /* Destructor */
+  virtual ~Parser() {
+  }
+
+  /* Gets ready for a new document */
+  void Reset() {
+    line_ = 1;
+    open_.clear();
+    pending_.clear();
+    scanner_.Reset();
+  }
+
+  /* Feeds a chunk of a document, parsing the statements it completes. The
+   * statements that fit in the chunk are parsed in place, only the start of
+   * a statement spilling over to the next chunk is kept */
+  void Feed(const char *data, gsize size) {
+    const char *p = data;
+    const char *end = data + size;
+
+    /* Complete the statement started by the previous chunks */
+    if (!pending_.empty()) {
+      const char *statement_end = scanner_.Scan(p, end);
+      if (!statement_end) {
+        pending_.append(p, size);
+        return;
+      }
+      pending_.append(p, statement_end - p);
+      ParseStatement(pending_.data(), pending_.data() + pending_.size());
+      pending_.clear();
+      p = statement_end;
+    }
+
+    while (p < end) {
+      const char *statement_end = scanner_.Scan(p, end);
+      if (!statement_end) {
+        pending_.assign(p, end - p);
+        return;
+      }
+      ParseStatement(p, statement_end);
+      p = statement_end;
+    }
+  }
+
+  /* Ends the document, parsing its last statement even without a newline */
+  void End() {
+    if (!pending_.empty())
+      ParseStatement(pending_.data(), pending_.data() + pending_.size());
+    CloseTableArrays(0);
+    Reset();
+  }
+
+ private:
+  /* Parses a whole statement */
+  void ParseStatement(const char *start, const char *end) {
+    start_ = start;
+    p_ = start;
+    end_ = end;
+
+    SkipWhitespace();
+    if (p_ < end_ && *p_ == '[') {
+      ParseHeader();
+    } else {
+      if (p_ < end_ && *p_ != '#' && *p_ != '\n' && *p_ != '\r')
+        ParseKeyValue();
+      EndLine();
+    }
+
+    line_ += std::count(start, end, '\n');
+  }
+
+  /* Parses a table or array of tables header */
+  void ParseHeader() {
+    const bool array = p_ + 1 < end_ && p_[1] == '[';
+    p_ += array ? 2 : 1;
+    ParseKey();
+    Expect(']');
+    if (array)
+      Expect(']');
+    EndLine();
+
+    /* Elements of arrays of tables end with the first header outside them */
+    guint n_open = open_.size();
+    while (n_open > 0 && !IsInside(open_[n_open - 1]))
+      n_open--;
+    CloseTableArrays(n_open);
+
+    if (array) {
+      open_.emplace_back();
+      for (const CgTomlSlice& key : keys_)
+        open_.back().emplace_back(key.data, key.len);
+      if (events_.table_array_begin)
+        Check(events_.table_array_begin(keys_.data(), keys_.size(),
+            user_data_));
+    } else if (events_.table) {
+      Check(events_.table(keys_.data(), keys_.size(), user_data_));
+    }
+  }
+
+  /* Parses a key/value pair */
+  void ParseKeyValue() {
+    ParseKey();
+    Expect('=');
+    if (events_.key)
+      Check(events_.key(keys_.data(), keys_.size(), user_data_));
+    SkipWhitespace();
+    ParseValue(0);
+  }
+
+  /* Parses a possibly dotted key into the key slices */
+  void ParseKey() {
+    keys_.clear();
+    unescaped_.clear();
+    while (true) {
+      if (keys_.size() >= MAX_DEPTH)
+        Fail("the key has too many segments");
+      if (key_scratch_.size() <= keys_.size())
+        key_scratch_.resize(keys_.size() + 1);
+
+      SkipWhitespace();
+      const char *start = p_;
+      CgTomlSlice key;
+      if (p_ < end_ && (*p_ == '"' || *p_ == '\'')) {
+        key = ParseString(&key_scratch_[keys_.size()], false);
+      } else {
+        while (p_ < end_ && IsBareKey(*p_))
+          p_++;
+        if (p_ == start)
+          Fail("expected a key");
+        key = {start, static_cast<gsize>(p_ - start)};
+      }
+      unescaped_.push_back(key.data == key_scratch_[keys_.size()].data());
+      keys_.push_back(key);
+
+      SkipWhitespace();
+      if (p_ == end_ || *p_ != '.')
+        break;
+      p_++;
+    }
+
+    /* Growing the scratch buffers may have moved the unescaped keys */
+    for (gsize i = 0; i < keys_.size(); i++) {
+      if (unescaped_[i])
+        keys_[i].data = key_scratch_[i].data();
+    }
+  }
+
+  /* Parses a value */
+  void ParseValue(guint depth) {
+    if (depth >= MAX_DEPTH)
+      Fail("the value is nested too deeply");
+    if (p_ == end_)
+      Fail("expected a value");
+
+    switch (*p_) {
+      case '"':
+      case '\'': {
+        CgTomlScalar scalar = {};
+        scalar.type = CG_TOML_VALUE_TYPE_STRING;
+        scalar.text = ParseString(&string_scratch_, true);
+        EmitScalar(scalar);
+        break;
+      }
+      case '[':
+        ParseArray(depth);
+        break;
+      case '{':
+        ParseInlineTable(depth);
+        break;
+      default:
+        ParseBareValue();
+        break;
+    }
+  }
+
+  /* Parses an array, which may span several lines */
+  void ParseArray(guint depth) {
+    p_++;
+    if (events_.array_begin)
+      Check(events_.array_begin(user_data_));
+    while (true) {
+      SkipBlank();
+      if (p_ < end_ && *p_ == ']')
+        break;
+      ParseValue(depth + 1);
+      SkipBlank();
+      if (p_ < end_ && *p_ == ',') {
+        p_++;
+        continue;
+      }
+      if (p_ < end_ && *p_ == ']')
+        break;
+      Fail("expected ',' or ']'");
+    }
+    p_++;
+    if (events_.array_end)
+      Check(events_.array_end(user_data_));
+  }
+
+  /* Parses an inline table, which must fit in a single line */
+  void ParseInlineTable(guint depth) {
+    p_++;
+    if (events_.inline_table_begin)
+      Check(events_.inline_table_begin(user_data_));
+    SkipWhitespace();
+    if (p_ < end_ && *p_ == '}') {
+      p_++;
+    } else {
+      while (true) {
+        ParseKey();
+        Expect('=');
+        if (events_.key)
+          Check(events_.key(keys_.data(), keys_.size(), user_data_));
+        SkipWhitespace();
+        ParseValue(depth + 1);
+        SkipWhitespace();
+        if (p_ < end_ && *p_ == ',') {
+          p_++;
+          continue;
+        }
+        Expect('}');
+        break;
+      }
+    }
+    if (events_.inline_table_end)
+      Check(events_.inline_table_end(user_data_));
+  }
+
+  /* Parses a boolean, a number or a date and time */
+  void ParseBareValue() {
+    const char *start = p_;
+    while (p_ < end_ && IsBareValue(*p_))
+      p_++;
+
+    /* A date can be separated from its time by a space */
+    if (p_ - start == 10 && IsDate(start) && end_ - p_ > 3 && *p_ == ' ' &&
+        g_ascii_isdigit(p_[1]) && g_ascii_isdigit(p_[2]) && p_[3] == ':') {
+      p_++;
+      while (p_ < end_ && IsBareValue(*p_))
+        p_++;
+    }
+
+    const gsize len = p_ - start;
+    if (len == 0)
+      Fail("expected a value");
+
+    CgTomlScalar scalar = {};
+    scalar.text = {start, len};
+    if (Equals(start, len, "true") || Equals(start, len, "false")) {
+      scalar.type = CG_TOML_VALUE_TYPE_BOOLEAN;
+      scalar.v_boolean = *start == 't';
+    } else if (len >= 10 && IsDate(start)) {
+      scalar.type = ParseDatetime(start, len);
+    } else if (len >= 8 && IsTime(start, len) == len) {
+      scalar.type = CG_TOML_VALUE_TYPE_LOCAL_TIME;
+    } else {
+      ParseNumber(start, len, &scalar);
+    }
+    EmitScalar(scalar);
+  }
+
+  /* Parses a string, the returned slice either points to the data or, if
+   * the string had to be unescaped, to the given scratch buffer */
+  CgTomlSlice ParseString(std::string *scratch, bool allow_multiline) {
+    const char quote = *p_;
+    const bool basic = quote == '"';
+    const bool multiline = allow_multiline && end_ - p_ >= 3 &&
+        p_[1] == quote && p_[2] == quote;
+    p_ += multiline ? 3 : 1;
+
+    /* A newline right after the opening quotes is trimmed */
+    if (multiline && p_ < end_ && *p_ == '\n')
+      p_++;
+    else if (multiline && end_ - p_ >= 2 && p_[0] == '\r' && p_[1] == '\n')
+      p_ += 2;
+
+    const char *start = p_;
+    bool escaped = false;
+    while (p_ < end_) {
+      const char c = *p_;
+
+      /* The closing quotes, up to two more belong to a multi-line string */
+      if (c == quote) {
+        if (!multiline) {
+          CgTomlSlice res = escaped ?
+              CgTomlSlice {scratch->data(), scratch->size()} :
+              CgTomlSlice {start, static_cast<gsize>(p_ - start)};
+          p_++;
+          return res;
+        }
+        gsize run = 0;
+        while (p_ + run < end_ && p_[run] == quote && run < 5)
+          run++;
+        if (run >= 3) {
+          if (escaped)
+            scratch->append(run - 3, quote);
+          CgTomlSlice res = escaped ?
+              CgTomlSlice {scratch->data(), scratch->size()} :
+              CgTomlSlice {start, static_cast<gsize>(p_ + run - 3 - start)};
+          p_ += run;
+          return res;
+        }
+      }
+
+      if (basic && c == '\\') {
+        if (!escaped) {
+          scratch->assign(start, p_ - start);
+          escaped = true;
+        }
+        ParseEscape(scratch, multiline);
+        continue;
+      }
+
+      if (c == '\n' && !multiline)
+        Fail("unterminated string");
+      if (static_cast<guchar>(c) < 0x20 && c != '\t' && c != '\n' &&
+          c != '\r')
+        Fail("control character in string");
+      if (c == 0x7f)
+        Fail("control character in string");
+      if (escaped)
+        scratch->push_back(c);
+      p_++;
+    }
+    Fail("unterminated string");
+  }
+
+  /* Parses an escape sequence of a basic string into the scratch buffer */
+  void ParseEscape(std::string *scratch, bool multiline) {
+    p_++;
+    if (p_ == end_)
+      Fail("unterminated string");
+    switch (*p_) {
+      case 'b': scratch->push_back('\b'); break;
+      case 't': scratch->push_back('\t'); break;
+      case 'n': scratch->push_back('\n'); break;
+      case 'f': scratch->push_back('\f'); break;
+      case 'r': scratch->push_back('\r'); break;
+      case '"': scratch->push_back('"'); break;
+      case '\\': scratch->push_back('\\'); break;
+      case 'u':
+      case 'U': {
+        const gsize n = *p_ == 'u' ? 4 : 8;
+        gunichar c = 0;
+        for (gsize i = 1; i <= n; i++) {
+          if (p_ + i >= end_ || !g_ascii_isxdigit(p_[i]))
+            Fail("invalid unicode escape");
+          c = (c << 4) | g_ascii_xdigit_value(p_[i]);
+        }
+        if (!g_unichar_validate(c))
+          Fail("invalid unicode escape");
+        char utf8[6];
+        scratch->append(utf8, g_unichar_to_utf8(c, utf8));
+        p_ += n;
+        break;
+      }
+      default: {
+        /* A backslash at the end of a line trims the whitespace after it */
+        const char *s = p_;
+        while (s < end_ && (*s == ' ' || *s == '\t'))
+          s++;
+        if (!multiline || s == end_ || (*s != '\n' && *s != '\r'))
+          Fail("invalid escape sequence");
+        while (s < end_ && g_ascii_isspace(*s))
+          s++;
+        p_ = s;
+        return;
+      }
+    }
+    p_++;
+  }
+
+  /* Gets the type of a date, optionally followed by a time and an offset */
+  CgTomlValueType ParseDatetime(const char *s, gsize len) {
+    if (len == 10)
+      return CG_TOML_VALUE_TYPE_LOCAL_DATE;
+    if (s[10] != 'T' && s[10] != 't' && s[10] != ' ')
+      Fail("invalid date");
+    const gsize time = IsTime(s + 11, len - 11);
+    if (time == 0)
+      Fail("invalid time");
+    const char *offset = s + 11 + time;
+    const gsize offset_len = len - 11 - time;
+    if (offset_len == 0)
+      return CG_TOML_VALUE_TYPE_LOCAL_DATETIME;
+    if ((offset_len == 1 && (*offset == 'Z' || *offset == 'z')) ||
+        (offset_len == 6 && (*offset == '+' || *offset == '-') &&
+         IsDigits(offset + 1, 2) && offset[3] == ':' &&
+         IsDigits(offset + 4, 2)))
+      return CG_TOML_VALUE_TYPE_OFFSET_DATETIME;
+    Fail("invalid offset");
+  }
+
+  /* Parses an integer or a floating point number */
+  void ParseNumber(const char *s, gsize len, CgTomlScalar *scalar) {
+    const char *end = s + len;
+    const char *digits = s + (*s == '+' || *s == '-' ? 1 : 0);
+
+    /* Infinity and not a number */
+    if (Equals(digits, end - digits, "inf") ||
+        Equals(digits, end - digits, "nan")) {
+      scalar->type = CG_TOML_VALUE_TYPE_DOUBLE;
+      scalar->v_double = digits[0] == 'i' ?
+          std::numeric_limits<double>::infinity() :
+          std::numeric_limits<double>::quiet_NaN();
+      if (*s == '-')
+        scalar->v_double = -scalar->v_double;
+      return;
+    }
+
+    /* Hexadecimal, octal and binary integers, which cannot have a sign */
+    guint base = 10;
+    if (digits == s && len > 2 && s[0] == '0') {
+      if (s[1] == 'x')
+        base = 16;
+      else if (s[1] == 'o')
+        base = 8;
+      else if (s[1] == 'b')
+        base = 2;
+      if (base != 10)
+        digits = s + 2;
+    }
+
+    /* Underscores must be between digits */
+    number_scratch_.clear();
+    bool floating = false;
+    for (const char *c = digits; c < end; c++) {
+      if (*c == '_') {
+        if (c == digits || c + 1 == end || !IsDigit(c[-1], base) ||
+            !IsDigit(c[1], base))
+          Fail("invalid number");
+        continue;
+      }
+      if (base == 10 && (*c == '.' || *c == 'e' || *c == 'E'))
+        floating = true;
+      number_scratch_.push_back(*c);
+    }
+    if (number_scratch_.empty())
+      Fail("invalid number");
+
+    /* Decimal numbers cannot have leading zeros */
+    if (base == 10 && number_scratch_[0] == '0' &&
+        number_scratch_.size() > 1 && g_ascii_isdigit(number_scratch_[1]))
+      Fail("invalid number");
+
+    if (floating) {
+      if (!IsFloat(number_scratch_))
+        Fail("invalid number");
+      if (*s == '-')
+        number_scratch_.insert(0, 1, '-');
+      scalar->type = CG_TOML_VALUE_TYPE_DOUBLE;
+      scalar->v_double = g_ascii_strtod(number_scratch_.c_str(), nullptr);
+      return;
+    }
+
+    if (base == 10 && *s == '-')
+      number_scratch_.insert(0, 1, '-');
+    gint64 val = 0;
+    if (!g_ascii_string_to_signed(number_scratch_.c_str(), base, G_MININT64,
+        G_MAXINT64, &val, nullptr))
+      Fail("invalid integer");
+    scalar->type = CG_TOML_VALUE_TYPE_INT64;
+    scalar->v_int64 = val;
+  }
+
+  /* Checks the syntax of an unsigned float without underscores */
+  static bool IsFloat(const std::string& s) {
+    gsize i = 0;
+    const gsize n = s.size();
+    const gsize int_start = i;
+    while (i < n && g_ascii_isdigit(s[i]))
+      i++;
+    if (i == int_start)
+      return false;
+    if (i < n && s[i] == '.') {
+      const gsize frac_start = ++i;
+      while (i < n && g_ascii_isdigit(s[i]))
+        i++;
+      if (i == frac_start)
+        return false;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+      i++;
+      if (i < n && (s[i] == '+' || s[i] == '-'))
+        i++;
+      const gsize exp_start = i;
+      while (i < n && g_ascii_isdigit(s[i]))
+        i++;
+      if (i == exp_start)
+        return false;
+    }
+    return i == n;
+  }
+
+  /* Checks whether a character is a digit of the given base */
+  static bool IsDigit(char c, guint base) {
+    if (base == 16)
+      return g_ascii_isxdigit(c);
+    return c >= '0' && c < static_cast<char>('0' + base);
+  }
+
+  /* Checks whether a number of characters are decimal digits */
+  static bool IsDigits(const char *s, gsize n) {
+    for (gsize i = 0; i < n; i++) {
+      if (!g_ascii_isdigit(s[i]))
+        return false;
+    }
+    return true;
+  }
+
+  /* Checks whether the text starts with a YYYY-MM-DD date */
+  static bool IsDate(const char *s) {
+    return IsDigits(s, 4) && s[4] == '-' && IsDigits(s + 5, 2) &&
+        s[7] == '-' && IsDigits(s + 8, 2);
+  }
+
+  /* Gets the length of the HH:MM:SS time, with optional fractional
+   * seconds, the text starts with, or 0 if it does not start with one */
+  static gsize IsTime(const char *s, gsize len) {
+    if (len < 8 || !IsDigits(s, 2) || s[2] != ':' || !IsDigits(s + 3, 2) ||
+        s[5] != ':' || !IsDigits(s + 6, 2))
+      return 0;
+    gsize i = 8;
+    if (i < len && s[i] == '.') {
+      i++;
+      const gsize start = i;
+      while (i < len && g_ascii_isdigit(s[i]))
+        i++;
+      if (i == start)
+        return 0;
+    }
+    return i;
+  }
+
+  /* Checks whether a character can be part of a bare key */
+  static bool IsBareKey(char c) {
+    return g_ascii_isalnum(c) || c == '_' || c == '-';
+  }
+
+  /* Checks whether a character can be part of a boolean, a number or a
+   * date and time */
+  static bool IsBareValue(char c) {
+    return g_ascii_isalnum(c) || c == '_' || c == '-' || c == '+' ||
+        c == '.' || c == ':';
+  }
+
+  /* Compares a slice with a NUL terminated string */
+  static bool Equals(const char *s, gsize len, const char *str) {
+    return std::strlen(str) == len && std::memcmp(s, str, len) == 0;
+  }
+
+  /* Skips spaces and tabs */
+  void SkipWhitespace() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t'))
+      p_++;
+  }
+
+  /* Skips whitespace, newlines and comments, as allowed inside arrays */
+  void SkipBlank() {
+    while (p_ < end_) {
+      if (*p_ == '#') {
+        while (p_ < end_ && *p_ != '\n')
+          p_++;
+      } else if (g_ascii_isspace(*p_)) {
+        p_++;
+      } else {
+        break;
+      }
+    }
+  }
+
+  /* Expects the given character after optional whitespace */
+  void Expect(char c) {
+    SkipWhitespace();
+    if (p_ == end_ || *p_ != c)
+      Fail((std::string {"expected '"} + c + "'").c_str());
+    p_++;
+  }
+
+  /* Expects the end of the line, optionally after a comment */
+  void EndLine() {
+    SkipWhitespace();
+    if (p_ < end_ && *p_ == '#') {
+      while (p_ < end_ && *p_ != '\n')
+        p_++;
+    }
+    if (p_ < end_ && *p_ == '\r')
+      p_++;
+    if (p_ < end_ && *p_ == '\n')
+      p_++;
+    if (p_ != end_)
+      Fail("expected the end of the line");
+  }
+
+  /* Ends the elements of arrays of tables, keeping the given number open */
+  void CloseTableArrays(gsize n_open) {
+    while (open_.size() > n_open) {
+      open_.pop_back();
+      if (events_.table_array_end)
+        Check(events_.table_array_end(user_data_));
+    }
+  }
+
+  /* Checks whether the current key is inside an array of tables */
+  bool IsInside(const std::vector<std::string>& array) const {
+    if (array.size() >= keys_.size())
+      return false;
+    for (gsize i = 0; i < array.size(); i++) {
+      if (array[i].size() != keys_[i].len ||
+          std::memcmp(array[i].data(), keys_[i].data, keys_[i].len) != 0)
+        return false;
+    }
+    return true;
+  }
+
+  /* Emits a scalar */
+  void EmitScalar(const CgTomlScalar& scalar) {
+    if (events_.scalar)
+      Check(events_.scalar(&scalar, user_data_));
+  }
+
+  /* Stops the parsing if an event asked for it */
+  static void Check(gboolean res) {
+    if (!res)
+      throw Stopped {};
+  }
+
+  /* Reports a syntax error at the current position */
+  [[noreturn]] void Fail(const char *what) const {
+    throw SyntaxError {line_ + static_cast<guint>(std::count(start_,
+        std::min(p_, end_), '\n')), what};
+  }
+
+  /* Copy Constructor */
+  Parser(const Parser&) = delete;
+
+  /* Move Constructor */
+  Parser(Parser &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Parser& operator=(const Parser&) = delete;
+
+  /* Move-Assign Constructr */
+  Parser& operator=(Parser &&) = delete;
+
+ private:
+  /* The events */
+  const CgTomlParserEvents events_;
+
+  /* The data passed to the events */
+  const gpointer user_data_;
+
+  /* The line the current statement starts at */
+  guint line_;
+
+  /* The current statement and position */
+  const char *start_ = nullptr;
+  const char *p_ = nullptr;
+  const char *end_ = nullptr;
+
+  /* The segments of the last key, and whether they had to be unescaped */
+  std::vector<CgTomlSlice> keys_;
+  std::vector<bool> unescaped_;
+
+  /* The paths of the open elements of arrays of tables */
+  std::vector<std::vector<std::string>> open_;
+
+  /* Finds where the statements end */
+  StatementScanner scanner_;
+
+  /* The start of a statement spilling over to the next chunk */
+  std::string pending_;
+
+  /* Scratch buffers for unescaped keys, strings and numbers */
+  std::vector<std::string> key_scratch_;
+  std::string string_scratch_;
+  std::string number_scratch_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+/* The size of the chunks read from streams */
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+struct _CgTomlParser
+{
+  cg::toml::Parser *data;
+};
+
+G_DEFINE_BOXED_TYPE(CgTomlParser, cg_toml_parser, cg_toml_parser_ref,
+    cg_toml_parser_unref)
+
+CgTomlParser *
+cg_toml_parser_new (const CgTomlParserEvents *events, gpointer user_data)
+{
+  g_return_val_if_fail (events, nullptr);
+
+  try {
+    g_autoptr (CgTomlParser) self = g_atomic_rc_box_new0 (CgTomlParser);
+
+    /* Set the data */
+    self->data = new cg::toml::Parser {*events, user_data};
+
+    return static_cast<CgTomlParser *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlParser: %s", ba.what());
+    return nullptr;
+  } catch (...) {
+    g_critical ("Could not create CgTomlParser");
+    return nullptr;
+  }
+}
+
+CgTomlParser *
+cg_toml_parser_ref (CgTomlParser * self)
+{
+  return static_cast<CgTomlParser *>(
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
+}
+
+void
+cg_toml_parser_unref (CgTomlParser * self)
+{
+  static void (*free_func)(gpointer) = [](gpointer p){
+    CgTomlParser *t = static_cast<CgTomlParser *>(p);
+    delete t->data;
+  };
+  g_atomic_rc_box_release_full (self, free_func);
+}
+
+namespace {
+
+/* Runs a step of the parser, mapping its exceptions to errors. The parser is
+ * reset on errors, the next chunk fed starts a new document */
+template <typename F>
+gboolean
+parser_run (CgTomlParser *self, F step, GError **error)
+{
+  try {
+    step(self->data);
+    return true;
+  } catch (cg::toml::SyntaxError& e) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE, "Line %u: %s",
+        e.GetLine(), e.what());
+  } catch (cg::toml::Stopped&) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_STOPPED,
+        "Parsing was stopped by an event");
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not parse: %s", ba.what());
+  }
+  self->data->Reset();
+  return false;
+}
+
+}  /* namespace */
+
+gboolean
+cg_toml_parser_parse (CgTomlParser *self, const char *data, gsize size,
+    GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (data || size == 0, false);
+
+  return parser_run (self, [data, size](cg::toml::Parser *parser) {
+    parser->Reset();
+    parser->Feed(data, size);
+    parser->End();
+  }, error);
+}
+
+gboolean
+cg_toml_parser_feed (CgTomlParser *self, const char *data, gsize len,
+    GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (data || len == 0, false);
+
+  return parser_run (self, [data, len](cg::toml::Parser *parser) {
+    parser->Feed(data, len);
+  }, error);
+}
+
+gboolean
+cg_toml_parser_end (CgTomlParser *self, GError **error)
+{
+  g_return_val_if_fail (self, false);
+
+  return parser_run (self, [](cg::toml::Parser *parser) {
+    parser->End();
+  }, error);
+}
+
+gboolean
+cg_toml_parser_parse_file (CgTomlParser *self, const char *name,
+    GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (name, false);
+
+  /* Map the file, it is never copied */
+  g_autoptr (GMappedFile) mapped = g_mapped_file_new (name, FALSE, error);
+  if (!mapped)
+    return false;
+
+  return cg_toml_parser_parse (self, g_mapped_file_get_contents (mapped),
+      g_mapped_file_get_length (mapped), error);
+}
+
+gboolean
+cg_toml_parser_parse_stream (CgTomlParser *self, GInputStream *stream,
+    GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), false);
+
+  /* Start a new document */
+  self->data->Reset();
+
+  g_autofree char *chunk = static_cast<char *>(g_malloc (STREAM_CHUNK_SIZE));
+  while (true) {
+    gssize n = g_input_stream_read (stream, chunk, STREAM_CHUNK_SIZE,
+        cancellable, error);
+    if (n < 0) {
+      self->data->Reset();
+      return false;
+    }
+    if (n == 0)
+      return cg_toml_parser_end (self, error);
+    if (!cg_toml_parser_feed (self, chunk, n, error))
+      return false;
+  }
+}
+
+namespace {
+
+/* The state of an asynchronous parse */
+struct StreamTask {
+  CgTomlParser *parser;
+  GInputStream *stream;
+};
+
+void
+stream_task_free (gpointer p)
+{
+  StreamTask *t = static_cast<StreamTask *>(p);
+  cg_toml_parser_unref (t->parser);
+  g_object_unref (t->stream);
+  g_free (t);
+}
+
+void stream_task_read (GTask *task);
+
+void
+stream_task_read_done (GObject *source, GAsyncResult *res, gpointer data)
+{
+  g_autoptr (GTask) task = G_TASK (data);
+  StreamTask *t = static_cast<StreamTask *>(g_task_get_task_data (task));
+  GError *error = nullptr;
+
+  g_autoptr (GBytes) bytes = g_input_stream_read_bytes_finish (
+      G_INPUT_STREAM (source), res, &error);
+  if (!bytes) {
+    t->parser->data->Reset();
+    g_task_return_error (task, error);
+    return;
+  }
+
+  /* An empty read is the end of the stream */
+  gsize size = 0;
+  const char *chunk = static_cast<const char *>(g_bytes_get_data (bytes,
+      &size));
+  if (size == 0) {
+    if (cg_toml_parser_end (t->parser, &error))
+      g_task_return_boolean (task, TRUE);
+    else
+      g_task_return_error (task, error);
+    return;
+  }
+
+  if (!cg_toml_parser_feed (t->parser, chunk, size, &error)) {
+    g_task_return_error (task, error);
+    return;
+  }
+
+  stream_task_read (static_cast<GTask *>(g_steal_pointer (&task)));
+}
+
+/* Reads the next chunk, takes the ownership of the task */
+void
+stream_task_read (GTask *task)
+{
+  StreamTask *t = static_cast<StreamTask *>(g_task_get_task_data (task));
+  g_input_stream_read_bytes_async (t->stream, STREAM_CHUNK_SIZE,
+      g_task_get_priority (task), g_task_get_cancellable (task),
+      stream_task_read_done, task);
+}
+
+}  /* namespace */
+
+void
+cg_toml_parser_parse_stream_async (CgTomlParser *self, GInputStream *stream,
+    int io_priority, GCancellable *cancellable, GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (G_IS_INPUT_STREAM (stream));
+
+  GTask *task = g_task_new (nullptr, cancellable, callback, user_data);
+  g_task_set_source_tag (task,
+      reinterpret_cast<gpointer>(cg_toml_parser_parse_stream_async));
+  g_task_set_priority (task, io_priority);
+
+  StreamTask *t = g_new0 (StreamTask, 1);
+  t->parser = cg_toml_parser_ref (self);
+  t->stream = G_INPUT_STREAM (g_object_ref (stream));
+  g_task_set_task_data (task, t, stream_task_free);
+
+  /* Start a new document */
+  self->data->Reset();
+  stream_task_read (task);
+}
+
+gboolean
+cg_toml_parser_parse_stream_finish (CgTomlParser *self, GAsyncResult *res,
+    GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (g_task_is_valid (res, nullptr), false);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
@@ -0,0 +1,88 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_PARSER_H__
+#define __CG_TOML_PARSER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include <stdint.h>
+
+#include "value.h"
+
+G_BEGIN_DECLS
+
+/* CgTomlSlice, borrowed bytes that are only valid during an event. They are
+ * not NUL terminated */
+typedef struct _CgTomlSlice CgTomlSlice;
+struct _CgTomlSlice {
+  const char *data;
+  gsize len;
+};
+
+/* CgTomlScalar, the text holds the contents of strings and the raw text of
+ * any other type */
+typedef struct _CgTomlScalar CgTomlScalar;
+struct _CgTomlScalar {
+  CgTomlValueType type;
+  CgTomlSlice text;
+  gboolean v_boolean;
+  int64_t v_int64;
+  double v_double;
+};
+
+/* CgTomlParserEvents, any of them can be NULL. Returning FALSE from an event
+ * stops the parsing */
+typedef struct _CgTomlParserEvents CgTomlParserEvents;
+struct _CgTomlParserEvents {
+  gboolean (*table) (const CgTomlSlice *keys, guint n_keys,
+      gpointer user_data);
+  gboolean (*table_array_begin) (const CgTomlSlice *keys, guint n_keys,
+      gpointer user_data);
+  gboolean (*table_array_end) (gpointer user_data);
+  gboolean (*key) (const CgTomlSlice *keys, guint n_keys, gpointer user_data);
+  gboolean (*scalar) (const CgTomlScalar *scalar, gpointer user_data);
+  gboolean (*array_begin) (gpointer user_data);
+  gboolean (*array_end) (gpointer user_data);
+  gboolean (*inline_table_begin) (gpointer user_data);
+  gboolean (*inline_table_end) (gpointer user_data);
+};
+
+/* CgTomlParser */
+GType cg_toml_parser_get_type (void);
+typedef struct _CgTomlParser CgTomlParser;
+CgTomlParser * cg_toml_parser_new (const CgTomlParserEvents *events,
+    gpointer user_data);
+CgTomlParser * cg_toml_parser_ref (CgTomlParser * self);
+void cg_toml_parser_unref (CgTomlParser * self);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlParser, cg_toml_parser_unref)
+
+/* API */
+gboolean cg_toml_parser_parse (CgTomlParser *self, const char *data,
+    gsize size, GError **error);
+gboolean cg_toml_parser_parse_file (CgTomlParser *self, const char *name,
+    GError **error);
+
+/* Incremental API, the document is fed in chunks of any size and ended with
+ * cg_toml_parser_end(). The events of a statement are emitted as soon as the
+ * chunk ending it is fed. An error resets the parser */
+gboolean cg_toml_parser_feed (CgTomlParser *self, const char *data,
+    gsize len, GError **error);
+gboolean cg_toml_parser_end (CgTomlParser *self, GError **error);
+gboolean cg_toml_parser_parse_stream (CgTomlParser *self,
+    GInputStream *stream, GCancellable *cancellable, GError **error);
+void cg_toml_parser_parse_stream_async (CgTomlParser *self,
+    GInputStream *stream, int io_priority, GCancellable *cancellable,
+    GAsyncReadyCallback callback, gpointer user_data);
+gboolean cg_toml_parser_parse_stream_finish (CgTomlParser *self,
+    GAsyncResult *res, GError **error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,516 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/* TOML */
+#include "scanner.h"
+#include "diff.h"
+#include "builder.h"
+#include "error.h"
+#include "patch.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* Skips the blanks of a line */
+inline const char *SkipBlanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+  return p;
+}
+
+/* Checks whether a character ends a value that is not a string nor a
+ * container */
+inline bool IsTokenEnd(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#' ||
+      c == ',' || c == ']' || c == '}';
+}
+
+/* Checks whether a key is the given table or one of its descendants */
+inline bool IsUnder(const std::string& key, const std::string& table) {
+  return key.size() > table.size() &&
+      key.compare(0, table.size(), table) == 0 && key[table.size()] == '.';
+}
+
+/* Decodes the escapes of a quoted key into the given string, returns the
+ * position after the closing quote or null */
+const char *ParseBasicKey(const char *p, const char *end, std::string *key) {
+  while (p < end && *p != '"') {
+    if (*p == '\n')
+      return nullptr;
+    if (*p != '\\') {
+      key->push_back(*p++);
+      continue;
+    }
+    if (++p == end)
+      return nullptr;
+    gsize digits = 0;
+    switch (*p++) {
+      case 'b': key->push_back('\b'); break;
+      case 't': key->push_back('\t'); break;
+      case 'n': key->push_back('\n'); break;
+      case 'f': key->push_back('\f'); break;
+      case 'r': key->push_back('\r'); break;
+      case '"': key->push_back('"'); break;
+      case '\\': key->push_back('\\'); break;
+      case 'u': digits = 4; break;
+      case 'U': digits = 8; break;
+      default: return nullptr;
+    }
+    if (digits == 0)
+      continue;
+    if (static_cast<gsize>(end - p) < digits)
+      return nullptr;
+    gunichar c = 0;
+    for (gsize i = 0; i < digits; i++, p++) {
+      const gint d = g_ascii_xdigit_value(*p);
+      if (d < 0)
+        return nullptr;
+      c = c << 4 | d;
+    }
+    char utf8[6];
+    key->append(utf8, g_unichar_to_utf8(c, utf8));
+  }
+  return p < end ? p + 1 : nullptr;
+}
+
+/* Parses a key, dotted or not, into its qualified form as the keys of the
+ * changes are. Returns the position after it and its blanks, or null. The
+ * dots, if wanted, are given as the length of the qualified key before
+ * each of them and the position after it */
+const char *ParseKey(const char *p, const char *end, std::string *key,
+    std::vector<std::pair<gsize, const char *>> *dots = nullptr) {
+  for (;;) {
+    p = SkipBlanks(p, end);
+    if (p == end)
+      return nullptr;
+    if (*p == '"') {
+      p = ParseBasicKey(p + 1, end, key);
+    } else if (*p == '\'') {
+      const char *q = static_cast<const char *>(
+          std::memchr(p + 1, '\'', end - p - 1));
+      if (q)
+        key->append(p + 1, q - p - 1);
+      p = q ? q + 1 : nullptr;
+    } else {
+      const char *start = p;
+      while (p < end && (g_ascii_isalnum(*p) || *p == '_' || *p == '-'))
+        p++;
+      if (p == start)
+        return nullptr;
+      key->append(start, p - start);
+    }
+    if (!p)
+      return nullptr;
+    p = SkipBlanks(p, end);
+    if (p == end || *p != '.')
+      return p;
+    if (dots)
+      dots->emplace_back(key->size(), p + 1);
+    key->push_back('.');
+    p++;
+  }
+}
+
+/* Finds where the value starting at the given position ends */
+const char *FindValueEnd(const char *p, const char *end) {
+  if (p == end)
+    return p;
+  const char c = *p;
+
+  /* Strings, up to two quotes before the closing ones of a multi-line
+   * string are part of it */
+  if (c == '"' || c == '\'') {
+    const bool multiline = end - p >= 3 && p[1] == c && p[2] == c;
+    p += multiline ? 3 : 1;
+    while (p < end) {
+      if (*p == '\\' && c == '"') {
+        p = std::min(p + 2, end);
+        continue;
+      }
+      if (*p == '\n' && !multiline)
+        return p;
+      if (*p == c) {
+        if (!multiline)
+          return p + 1;
+        if (end - p >= 3 && p[1] == c && p[2] == c) {
+          p += 3;
+          for (guint i = 0; i < 2 && p < end && *p == c; i++)
+            p++;
+          return p;
+        }
+      }
+      p++;
+    }
+    return end;
+  }
+
+  /* Containers, they can hold strings and comments */
+  if (c == '[' || c == '{') {
+    gint depth = 0;
+    while (p < end) {
+      const char d = *p;
+      if (d == '"' || d == '\'') {
+        p = FindValueEnd(p, end);
+        continue;
+      }
+      if (d == '#') {
+        while (p < end && *p != '\n')
+          p++;
+        continue;
+      }
+      if (d == '[' || d == '{') {
+        depth++;
+      } else if ((d == ']' || d == '}') && --depth == 0) {
+        return p + 1;
+      }
+      p++;
+    }
+    return end;
+  }
+
+  /* Anything else is a single token, except a date followed by a time */
+  const char *start = p;
+  while (p < end && !IsTokenEnd(*p))
+    p++;
+  if (p - start == 10 && start[4] == '-' && end - p > 1 && *p == ' ' &&
+      g_ascii_isdigit(p[1])) {
+    p++;
+    while (p < end && !IsTokenEnd(*p))
+      p++;
+  }
+  return p;
+}
+
+/* The statement of a key and value pair, as offsets into the text */
+struct ValueSpan {
+  gsize start;
+  gsize value_start;
+  gsize value_end;
+  gsize end;
+};
+
+/* A section of the text, from its header to the next one */
+struct Section {
+  std::string key;
+  gsize start;
+  gsize end;
+  gsize insert;
+};
+
+/* A table defined by dotted keys, its new keys go after the last of them
+ * and start as they do */
+struct DottedTable {
+  gsize insert;
+  std::string prefix;
+};
+
+/* A range of the text replaced by new text, an empty range inserts it */
+struct Edit {
+  gsize start;
+  gsize end;
+  std::string text;
+};
+
+/* The Patcher class, finds where the statements of the text are and turns
+ * the changes between two tables into edits of those statements */
+class Patcher {
+ public:
+  /* Constructor */
+  Patcher(const char *text, gsize size) :
+      text_(text),
+      size_(size),
+      root_insert_(0) {
+  }
+
+  /* Destructor */
+  virtual ~Patcher() {
+  }
+
+  /* Finds the statements of the text. Values of arrays of tables are left
+   * out, as their keys do not tell the elements apart */
+  bool Scan(GError **error) {
+    const char *p = text_;
+    const char *end = text_ + size_;
+    Section *section = nullptr;
+    bool in_array = false;
+    std::vector<std::string> arrays;
+    guint line = 1;
+
+    while (p < end) {
+      const char *start = p;
+      p = SkipBlanks(p, end);
+      const char *next = FindStatementEnd(p, end);
+      if (!next)
+        next = end;
+
+      if (p < end && *p == '[') {
+        /* A header starts a section */
+        const bool array = end - p > 1 && p[1] == '[';
+        std::string key;
+        const char *q = ParseKey(p + (array ? 2 : 1), next, &key);
+        if (!q || *q != ']')
+          return Fail(line, error);
+        if (section)
+          section->end = start - text_;
+        if (array)
+          arrays.push_back(key);
+        in_array = array || std::any_of(arrays.begin(), arrays.end(),
+            [&key](const std::string& a) { return IsUnder(key, a); });
+        sections_.push_back({key, static_cast<gsize>(start - text_), size_,
+            static_cast<gsize>(next - text_)});
+        section = &sections_.back();
+      } else if (p < end && *p != '\n' && *p != '#') {
+        /* A key and value pair */
+        std::string key;
+        if (section) {
+          key = section->key;
+          key.push_back('.');
+        }
+        std::vector<std::pair<gsize, const char *>> dots;
+        const char *q = ParseKey(p, next, &key, &dots);
+        if (!q || *q != '=')
+          return Fail(line, error);
+        const char *value = SkipBlanks(q + 1, next);
+        if (!in_array) {
+          values_[key] = {static_cast<gsize>(start - text_),
+              static_cast<gsize>(value - text_),
+              static_cast<gsize>(FindValueEnd(value, next) - text_),
+              static_cast<gsize>(next - text_)};
+          for (const auto& dot : dots)
+            dotted_[key.substr(0, dot.first)] = {
+                static_cast<gsize>(next - text_), std::string {p, dot.second}};
+        }
+        if (section)
+          section->insert = next - text_;
+        else
+          root_insert_ = next - text_;
+      }
+
+      for (const char *c = start; c < next; c++)
+        line += *c == '\n';
+      p = next;
+    }
+    return true;
+  }
+
+  /* Turns the changes between two tables into edits */
+  bool Plan(Node old_table, Node new_table, GError **error) {
+    Changes changes;
+    if (!Diff(old_table, new_table, &changes, error))
+      return false;
+    for (const std::string& key : changes.removed)
+      Change(key, new_table, true, false);
+    for (const std::string& key : changes.modified)
+      Change(key, new_table, true, true);
+    for (const std::string& key : changes.added)
+      Change(key, new_table, false, true);
+    return true;
+  }
+
+  /* Writes the text with the edits applied */
+  bool Apply(const WriteFunc& func) {
+    std::stable_sort(edits_.begin(), edits_.end(),
+        [](const Edit& a, const Edit& b) {
+      return a.start < b.start || (a.start == b.start && a.end < b.end);
+    });
+
+    /* Edits within a range already replaced are dropped */
+    gsize pos = 0;
+    for (const Edit& edit : edits_) {
+      if (edit.start < pos)
+        continue;
+      if (edit.start > pos && !func(text_ + pos, edit.start - pos))
+        return false;
+      if (!edit.text.empty() && !func(edit.text.data(), edit.text.size()))
+        return false;
+      pos = edit.end;
+    }
+    if (pos < size_ && !func(text_ + pos, size_ - pos))
+      return false;
+
+    /* New sections, after a blank line */
+    if (!tail_)
+      return true;
+    std::string text;
+    if (size_ > 0 && text_[size_ - 1] != '\n')
+      text.push_back('\n');
+    if (size_ > 0)
+      text.push_back('\n');
+    return Write(Node {static_cast<const cpptoml::base *>(tail_.get())},
+        [&](const char *data, gsize size) {
+      if (!text.empty()) {
+        if (!func(text.data(), text.size()))
+          return false;
+        text.clear();
+      }
+      return func(data, size);
+    }, nullptr);
+  }
+
+ private:
+  /* Reports text that could not be scanned */
+  static bool Fail(guint line, GError **error) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE,
+        "Line %u: Could not find the statement", line);
+    return false;
+  }
+
+  /* Turns a changed key into edits */
+  void Change(const std::string& key, Node new_table, bool in_old,
+      bool in_new) {
+    /* The outermost value written as a whole that holds the key, such as
+     * an inline table, is written again */
+    for (gsize dot = key.find('.'); ; dot = key.find('.', dot + 1)) {
+      const std::string outer = key.substr(0, dot);
+      const auto it = values_.find(outer);
+      if (it != values_.end()) {
+        if (!replaced_.insert(outer).second)
+          return;
+        const ValueSpan& span = it->second;
+        const Node value = LookupQualified(new_table, outer.c_str());
+        if (value)
+          edits_.push_back({span.value_start, span.value_end,
+              FormatValue(value)});
+        else
+          edits_.push_back({span.start, span.end, std::string {}});
+        return;
+      }
+      if (dot == std::string::npos)
+        break;
+    }
+
+    if (in_old)
+      Remove(key);
+    if (in_new)
+      Add(key, LookupQualified(new_table, key.c_str()));
+  }
+
+  /* Removes the sections and statements of a key */
+  void Remove(const std::string& key) {
+    for (const Section& s : sections_) {
+      if (s.key == key || IsUnder(s.key, key))
+        edits_.push_back({s.start, s.end, std::string {}});
+    }
+    for (const auto& entry : values_) {
+      if (IsUnder(entry.first, key))
+        edits_.push_back({entry.second.start, entry.second.end,
+            std::string {}});
+    }
+  }
+
+  /* Adds a key, a plain value goes at the end of the last section of its
+   * table, or after the last dotted key defining it, and anything else at
+   * the end of the text. A table defined by dotted keys cannot be given a
+   * header */
+  void Add(const std::string& key, Node value) {
+    const CgTomlValueType type = GetValueType(value);
+    if (type != CG_TOML_VALUE_TYPE_TABLE &&
+        (type != CG_TOML_VALUE_TYPE_TABLE_ARRAY || GetLength(value) == 0)) {
+      const gsize dot = key.rfind('.');
+      const std::string table = dot == std::string::npos ? std::string {} :
+          key.substr(0, dot);
+      const char *leaf = key.c_str() + (dot == std::string::npos ? 0 :
+          dot + 1);
+      gsize insert = root_insert_;
+      std::string prefix;
+      bool found = table.empty();
+      for (const Section& s : sections_) {
+        if (s.key == table) {
+          insert = s.insert;
+          found = true;
+        }
+      }
+      const auto it = dotted_.find(table);
+      if (!found && it != dotted_.end()) {
+        insert = it->second.insert;
+        prefix = it->second.prefix;
+        found = true;
+      }
+      if (found) {
+        std::string text;
+        if (insert == size_ && size_ > 0 && text_[size_ - 1] != '\n')
+          text.push_back('\n');
+        text += prefix;
+        text += FormatEntry(leaf, std::strlen(leaf), value);
+        edits_.push_back({insert, insert, std::move(text)});
+        return;
+      }
+    }
+    tail_ = Set(Node {static_cast<const cpptoml::base *>(tail_.get())},
+        key.c_str(), true, Thaw(value));
+  }
+
+  /* Copy Constructor */
+  Patcher(const Patcher&) = delete;
+
+  /* Move Constructor */
+  Patcher(Patcher &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Patcher& operator=(const Patcher&) = delete;
+
+  /* Move-Assign Constructr */
+  Patcher& operator=(Patcher &&) = delete;
+
+ private:
+  /* The text */
+  const char *text_;
+
+  /* The size of the text */
+  const gsize size_;
+
+  /* The statements of the values by qualified key */
+  std::unordered_map<std::string, ValueSpan> values_;
+
+  /* The sections in the order of the text */
+  std::vector<Section> sections_;
+
+  /* The tables defined by dotted keys by qualified key */
+  std::unordered_map<std::string, DottedTable> dotted_;
+
+  /* Where new values of the root table go */
+  gsize root_insert_;
+
+  /* The values already written again */
+  std::unordered_set<std::string> replaced_;
+
+  /* The edits */
+  std::vector<Edit> edits_;
+
+  /* The keys appended at the end of the text */
+  std::shared_ptr<cpptoml::table> tail_;
+};
+
+}  /* namespace */
+
+bool
+Patch(const char *text, gsize size, Node old_table, Node new_table,
+    const WriteFunc& func, GError **error)
+{
+  Patcher patcher {text, size};
+  if (!patcher.Scan(error))
+    return false;
+  if (!patcher.Plan(old_table, new_table, error))
+    return false;
+  return patcher.Apply(func);
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
@@ -0,0 +1,34 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_PATCH_H__
+#define __CG_TOML_PATCH_H__
+
+/* TOML */
+#include "node.h"
+#include "writer.h"
+
+namespace cg {
+namespace toml {
+
+/* Writes the text a table was parsed from, changed so that it holds a new
+ * revision of that table. Only the statements of the keys that differ are
+ * rewritten, everything else, comments and layout included, is passed on
+ * in runs straight out of the text. Values are replaced where they are,
+ * removed keys and tables lose their statements and sections, and new
+ * plain values go after the last statement of their table. New tables, and
+ * values whose table has no section of its own, are appended at the end.
+ * Returns false if the text could not be scanned or as soon as the
+ * function does */
+bool Patch(const char *text, gsize size, Node old_table, Node new_table,
+    const WriteFunc& func, GError **error);
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
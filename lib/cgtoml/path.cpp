@@ -0,0 +1,154 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* TOML */
+#include "private.h"
+#include "node.h"
+#include "path.h"
+
+namespace cg {
+namespace toml {
+
+/* The Path class */
+class Path {
+ public:
+  /* Constructor */
+  Path(std::string key) :
+      key_(std::move(key)),
+      segments_(Split(key_)) {
+  }
+
+  /* Destructor */
+  virtual ~Path() {
+  }
+
+  /* Gets the dotted key the path was compiled from */
+  const std::string& GetKey() const {
+    return key_;
+  }
+
+  /* Gets the segments of the path */
+  const Segments& GetSegments() const {
+    return segments_;
+  }
+
+ private:
+  /* Splits a dotted key into its segments */
+  static Segments Split(const std::string& key) {
+    Segments segments;
+    std::string::size_type start = 0;
+    while (true) {
+      const std::string::size_type end = key.find('.', start);
+      const std::string::size_type len =
+          end == std::string::npos ? std::string::npos : end - start;
+      std::string segment = key.substr(start, len);
+      if (segment.empty())
+        throw std::invalid_argument("empty segment in '" + key + "'");
+      const guint32 hash = dom::Hash(segment.data(), segment.size());
+      segments.push_back({std::move(segment), hash});
+      if (end == std::string::npos)
+        break;
+      start = end + 1;
+    }
+    return segments;
+  }
+
+  /* Copy Constructor */
+  Path(const Path&) = delete;
+
+  /* Move Constructor */
+  Path(Path &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Path& operator=(const Path&) = delete;
+
+  /* Move-Assign Constructr */
+  Path& operator=(Path &&) = delete;
+
+ private:
+  /* The dotted key */
+  const std::string key_;
+
+  /* The segments */
+  const Segments segments_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+struct _CgTomlPath
+{
+  const cg::toml::Path *data;
+};
+
+G_DEFINE_BOXED_TYPE(CgTomlPath, cg_toml_path, cg_toml_path_ref,
+    cg_toml_path_unref)
+
+CgTomlPath *
+cg_toml_path_new (const char *key)
+{
+  g_return_val_if_fail (key, nullptr);
+
+  try {
+    g_autoptr (CgTomlPath) self = g_atomic_rc_box_new0 (CgTomlPath);
+
+    /* Compile the key */
+    self->data = new cg::toml::Path {key};
+
+    return static_cast<CgTomlPath *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlPath from '%s': %s", key, ba.what());
+    return nullptr;
+  } catch (std::exception& e) {
+    g_critical ("Could not create CgTomlPath from '%s': %s", key, e.what());
+    return nullptr;
+  } catch (...) {
+    g_critical ("Could not create CgTomlPath from '%s'", key);
+    return nullptr;
+  }
+}
+
+CgTomlPath *
+cg_toml_path_ref (CgTomlPath * self)
+{
+  return static_cast<CgTomlPath *>(
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
+}
+
+void
+cg_toml_path_unref (CgTomlPath * self)
+{
+  static void (*free_func)(gpointer) = [](gpointer p){
+    CgTomlPath *path = static_cast<CgTomlPath *>(p);
+    delete path->data;
+  };
+  g_atomic_rc_box_release_full (self, free_func);
+}
+
+gconstpointer
+cg_toml_path_get_segments (const CgTomlPath *self)
+{
+  return static_cast<gconstpointer>(&self->data->GetSegments());
+}
+
+const char *
+cg_toml_path_get_key (const CgTomlPath *self)
+{
+  return self->data->GetKey().c_str();
+}
+
+guint
+cg_toml_path_get_n_segments (const CgTomlPath *self)
+{
+  return self->data->GetSegments().size();
+}
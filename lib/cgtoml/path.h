@@ -0,0 +1,30 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_PATH_H__
+#define __CG_TOML_PATH_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* CgTomlPath */
+GType cg_toml_path_get_type (void);
+typedef struct _CgTomlPath CgTomlPath;
+CgTomlPath * cg_toml_path_new (const char *key);
+CgTomlPath * cg_toml_path_ref (CgTomlPath * self);
+void cg_toml_path_unref (CgTomlPath * self);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlPath, cg_toml_path_unref)
+
+/* API */
+const char * cg_toml_path_get_key (const CgTomlPath *self);
+guint cg_toml_path_get_n_segments (const CgTomlPath *self);
+
+G_END_DECLS
+
+#endif
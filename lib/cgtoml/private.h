@@ -18,9 +18,21 @@ struct _CgTomlArray;
 typedef struct _CgTomlArray CgTomlArray;
 struct _TomlTable;
 typedef struct _CgTomlTable CgTomlTable;
+struct _CgTomlPath;
+typedef struct _CgTomlPath CgTomlPath;
+struct _CgTomlFile;
+typedef struct _CgTomlFile CgTomlFile;
+struct _CgTomlSchema;
+typedef struct _CgTomlSchema CgTomlSchema;
 
 CgTomlArray * cg_toml_array_new (gconstpointer data);
+gconstpointer cg_toml_array_get_data (const CgTomlArray *self);
 CgTomlTable * cg_toml_table_new (gconstpointer data);
+gconstpointer cg_toml_table_get_data (const CgTomlTable *self);
+gconstpointer cg_toml_path_get_segments (const CgTomlPath *self);
+CgTomlFile * cg_toml_file_new_from_node (const char *name, gconstpointer data);
+gboolean cg_toml_schema_decode (const CgTomlSchema *self, gconstpointer node,
+    gpointer dst, GError **error);
 
 G_END_DECLS
 
@@ -0,0 +1,180 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_SCANNER_H__
+#define __CG_TOML_SCANNER_H__
+
+/* GLib */
+#include <glib.h>
+
+namespace cg {
+namespace toml {
+
+/* The StatementScanner class, finds where statements end along with any
+ * value spanning several lines. Only strings, comments and brackets are
+ * looked at, the statements themselves are not validated. The text can be
+ * scanned in chunks of any size, the state is kept in between. */
+class StatementScanner {
+ public:
+  /* Constructor */
+  StatementScanner() {
+    Reset();
+  }
+
+  /* Destructor */
+  virtual ~StatementScanner() {
+  }
+
+  /* Gets ready for a new statement */
+  void Reset() {
+    state_ = State::CODE;
+    quote_ = '\0';
+    quotes_ = 0;
+    depth_ = 0;
+  }
+
+  /* Scans a chunk of the current statement, returns the position right
+   * after its newline, or null if the chunk ends before the statement. The
+   * state is reset when a statement ends */
+  const char *Scan(const char *p, const char *end) {
+    while (p < end) {
+      const char c = *p;
+      switch (state_) {
+        case State::CODE:
+          if (c == '"' || c == '\'') {
+            state_ = State::OPENING;
+            quote_ = c;
+            quotes_ = 1;
+          } else if (c == '#') {
+            state_ = State::COMMENT;
+          } else if (c == '[' || c == '{') {
+            depth_++;
+          } else if (c == ']' || c == '}') {
+            depth_--;
+          } else if (c == '\n' && depth_ <= 0) {
+            Reset();
+            return p + 1;
+          }
+          break;
+
+        case State::COMMENT:
+          if (c == '\n') {
+            state_ = State::CODE;
+            continue;
+          }
+          break;
+
+        /* Up to three quotes tell the kind of string apart */
+        case State::OPENING:
+          if (c == quote_ && quotes_ < 3) {
+            if (++quotes_ == 3) {
+              state_ = State::MULTILINE;
+              quotes_ = 0;
+            }
+            break;
+          }
+          /* Two quotes are an empty string */
+          state_ = quotes_ == 2 ? State::CODE : State::STRING;
+          quotes_ = 0;
+          continue;
+
+        /* A single-line string stops at the end of its line */
+        case State::STRING:
+          if (c == '\\' && quote_ == '"') {
+            state_ = State::ESCAPE;
+          } else if (c == quote_) {
+            state_ = State::CODE;
+          } else if (c == '\n') {
+            state_ = State::CODE;
+            continue;
+          }
+          break;
+
+        case State::ESCAPE:
+          state_ = State::STRING;
+          break;
+
+        /* Three quotes or more close a multi-line string, up to two of them
+         * are part of the string itself */
+        case State::MULTILINE:
+          if (c == quote_) {
+            if (++quotes_ == 5) {
+              state_ = State::CODE;
+              quotes_ = 0;
+            }
+            break;
+          }
+          if (quotes_ >= 3) {
+            state_ = State::CODE;
+            quotes_ = 0;
+            continue;
+          }
+          quotes_ = 0;
+          if (c == '\\' && quote_ == '"')
+            state_ = State::MULTILINE_ESCAPE;
+          break;
+
+        case State::MULTILINE_ESCAPE:
+          state_ = State::MULTILINE;
+          break;
+      }
+      p++;
+    }
+    return nullptr;
+  }
+
+ private:
+  /* Where the scanner is */
+  enum class State {
+    CODE,
+    COMMENT,
+    OPENING,
+    STRING,
+    ESCAPE,
+    MULTILINE,
+    MULTILINE_ESCAPE,
+  };
+
+  /* Copy Constructor */
+  StatementScanner(const StatementScanner&) = delete;
+
+  /* Move Constructor */
+  StatementScanner(StatementScanner &&) = delete;
+
+  /* Copy-Assign Constructor */
+  StatementScanner& operator=(const StatementScanner&) = delete;
+
+  /* Move-Assign Constructr */
+  StatementScanner& operator=(StatementScanner &&) = delete;
+
+ private:
+  /* The state */
+  State state_;
+
+  /* The quote of the current string */
+  char quote_;
+
+  /* The number of consecutive quotes seen */
+  guint quotes_;
+
+  /* The nesting of brackets */
+  gint depth_;
+};
+
+/* Finds the end of the statement starting at the given position, right
+ * after its newline. Returns null if the data ends before the statement
+ * does */
+inline const char *FindStatementEnd(const char *p, const char *end) {
+  StatementScanner scanner;
+  return scanner.Scan(p, end);
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
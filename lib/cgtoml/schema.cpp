@@ -0,0 +1,300 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* TOML */
+#include "private.h"
+#include "node.h"
+#include "field.h"
+#include "error.h"
+#include "schema.h"
+
+namespace cg {
+namespace toml {
+
+/* The Schema class */
+class Schema {
+ public:
+  /* Constructor, throws if a field is invalid */
+  Schema(const CgTomlField *fields, guint n_fields, gsize struct_size) :
+      struct_size_(struct_size) {
+    for (guint i = 0; i < n_fields; i++)
+      fields_.push_back(Compile(fields[i]));
+
+    /* Sort the fields by hash and name, as the entries of a compact table */
+    for (guint i = 0; i < n_fields; i++)
+      index_.push_back(i);
+    std::sort(index_.begin(), index_.end(), [this](guint a, guint b) {
+      return GetKey(fields_[a]) < GetKey(fields_[b]);
+    });
+    for (gsize i = 0; i < index_.size(); i++) {
+      keys_.push_back(GetKey(fields_[index_[i]]));
+      if (i > 0 && fields_[index_[i - 1]].name == fields_[index_[i]].name)
+        throw std::invalid_argument("duplicate field '" +
+            fields_[index_[i]].name + "'");
+    }
+  }
+
+  /* Destructor */
+  virtual ~Schema() {
+  }
+
+  /* Gets the size of the struct */
+  gsize GetStructSize() const {
+    return struct_size_;
+  }
+
+  /* Gets the number of fields */
+  guint GetNFields() const {
+    return fields_.size();
+  }
+
+  /* Fills a struct from a table, matching its entries against the fields
+   * in a single pass. The struct is left cleared on error */
+  bool Decode(Node table, gpointer dst, GError **error) const {
+    if (!IsTable(table)) {
+      g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+          "Value is not a table");
+      return false;
+    }
+
+    guint8 *seen = g_newa (guint8, fields_.size() + 1);
+    std::memset(seen, 0, fields_.size());
+    for (const Field& f : fields_) {
+      if (f.type == CG_TOML_FIELD_TYPE_STRING)
+        *Member<char *>(f, dst) = nullptr;
+    }
+
+    bool res = true;
+    MatchEntries(table, keys_.data(), keys_.size(), [&](gsize k, Node value) {
+      const guint i = index_[k];
+      seen[i] = 1;
+      res = DecodeField(fields_[i], value, dst, error);
+      return res;
+    });
+
+    /* Defaults and required fields */
+    for (guint i = 0; i < fields_.size() && res; i++) {
+      if (seen[i])
+        continue;
+      const Field& f = fields_[i];
+      if (f.required) {
+        g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_MISSING_FIELD,
+            "Missing required field '%s'", f.name.c_str());
+        res = false;
+      } else {
+        StoreFieldDefault(f.type, f.default_value, Member<void>(f, dst));
+      }
+    }
+
+    if (!res)
+      Clear(dst);
+    return res;
+  }
+
+  /* Frees the strings of a struct */
+  void Clear(gpointer dst) const {
+    for (const Field& f : fields_) {
+      if (f.type == CG_TOML_FIELD_TYPE_STRING)
+        g_clear_pointer (Member<char *>(f, dst), g_free);
+    }
+  }
+
+ private:
+  /* A compiled field */
+  struct Field {
+    std::string name;
+    guint32 hash;
+    CgTomlFieldType type;
+    gsize offset;
+    bool required;
+    CgTomlFieldDefault default_value;
+  };
+
+  /* Validates a field and hashes its name */
+  Field Compile(const CgTomlField& field) const {
+    if (!field.name || !*field.name)
+      throw std::invalid_argument("field without a name");
+    const gsize size = GetFieldTypeSize(field.type);
+    if (size == 0)
+      throw std::invalid_argument(std::string {"invalid type of field '"} +
+          field.name + "'");
+    if (field.offset > struct_size_ || size > struct_size_ - field.offset)
+      throw std::invalid_argument(std::string {"field '"} + field.name +
+          "' does not fit in the struct");
+    if (!field.required &&
+        !CheckFieldDefault(field.type, field.default_value))
+      throw std::invalid_argument(std::string {"default of field '"} +
+          field.name + "' is out of range");
+    return {field.name, dom::Hash(field.name, std::strlen(field.name)),
+        field.type, field.offset, field.required != FALSE,
+        field.default_value};
+  }
+
+  /* Gets the member of a struct a field points to */
+  template <typename T>
+  static T *Member(const Field& f, gpointer dst) {
+    return reinterpret_cast<T *>(static_cast<guint8 *>(dst) + f.offset);
+  }
+
+  /* Gets the key of a field */
+  static KeyRef GetKey(const Field& f) {
+    return {f.name.data(), f.name.size(), f.hash};
+  }
+
+  /* Stores the value of a field */
+  static bool DecodeField(const Field& f, Node value, gpointer dst,
+      GError **error) {
+    if (StoreField(f.type, value, Member<void>(f, dst)))
+      return true;
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+        "Field '%s' is not a valid %s value", f.name.c_str(),
+        GetFieldTypeName(f.type));
+    return false;
+  }
+
+  /* Copy Constructor */
+  Schema(const Schema&) = delete;
+
+  /* Move Constructor */
+  Schema(Schema &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Schema& operator=(const Schema&) = delete;
+
+  /* Move-Assign Constructr */
+  Schema& operator=(Schema &&) = delete;
+
+ private:
+  /* The size of the struct */
+  const gsize struct_size_;
+
+  /* The fields, in the given order */
+  std::vector<Field> fields_;
+
+  /* The positions of the fields sorted by hash and name */
+  std::vector<guint> index_;
+
+  /* The keys of the fields in the same order */
+  std::vector<KeyRef> keys_;
+};
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+struct _CgTomlSchema
+{
+  const cg::toml::Schema *data;
+};
+
+G_DEFINE_BOXED_TYPE(CgTomlSchema, cg_toml_schema, cg_toml_schema_ref,
+    cg_toml_schema_unref)
+
+CgTomlSchema *
+cg_toml_schema_new (const CgTomlField *fields, guint n_fields,
+    gsize struct_size)
+{
+  g_return_val_if_fail (fields || n_fields == 0, nullptr);
+
+  try {
+    g_autoptr (CgTomlSchema) self = g_atomic_rc_box_new0 (CgTomlSchema);
+
+    /* Compile the fields */
+    self->data = new cg::toml::Schema {fields, n_fields, struct_size};
+
+    return static_cast<CgTomlSchema *>(g_steal_pointer (&self));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlSchema: %s", ba.what());
+    return nullptr;
+  } catch (std::exception& e) {
+    g_critical ("Could not create CgTomlSchema: %s", e.what());
+    return nullptr;
+  } catch (...) {
+    g_critical ("Could not create CgTomlSchema");
+    return nullptr;
+  }
+}
+
+CgTomlSchema *
+cg_toml_schema_ref (CgTomlSchema * self)
+{
+  return static_cast<CgTomlSchema *>(
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
+}
+
+void
+cg_toml_schema_unref (CgTomlSchema * self)
+{
+  static void (*free_func)(gpointer) = [](gpointer p){
+    CgTomlSchema *schema = static_cast<CgTomlSchema *>(p);
+    delete schema->data;
+  };
+  g_atomic_rc_box_release_full (self, free_func);
+}
+
+gsize
+cg_toml_schema_get_struct_size (const CgTomlSchema *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return self->data->GetStructSize();
+}
+
+guint
+cg_toml_schema_get_n_fields (const CgTomlSchema *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return self->data->GetNFields();
+}
+
+void
+cg_toml_schema_clear (const CgTomlSchema *self, gpointer dst)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (dst);
+
+  self->data->Clear(dst);
+}
+
+void
+cg_toml_schema_free_array (const CgTomlSchema *self, gpointer array,
+    guint n_elements)
+{
+  g_return_if_fail (self);
+
+  if (!array)
+    return;
+  guint8 *p = static_cast<guint8 *>(array);
+  for (guint i = 0; i < n_elements; i++)
+    self->data->Clear(p + i * self->data->GetStructSize());
+  g_free (array);
+}
+
+gboolean
+cg_toml_schema_decode (const CgTomlSchema *self, gconstpointer node,
+    gpointer dst, GError **error)
+{
+  g_return_val_if_fail (self, false);
+  g_return_val_if_fail (dst, false);
+
+  try {
+    return self->data->Decode(cg::toml::Node::FromData(node), dst, error);
+  } catch (std::bad_alloc& ba) {
+    self->data->Clear(dst);
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not decode table: %s", ba.what());
+    return false;
+  }
+}
@@ -0,0 +1,75 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_SCHEMA_H__
+#define __CG_TOML_SCHEMA_H__
+
+#include <glib-object.h>
+
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* CgTomlFieldType, the C type of a field */
+typedef enum {
+  CG_TOML_FIELD_TYPE_BOOLEAN,   /* gboolean */
+  CG_TOML_FIELD_TYPE_INT8,      /* int8_t */
+  CG_TOML_FIELD_TYPE_UINT8,     /* uint8_t */
+  CG_TOML_FIELD_TYPE_INT16,     /* int16_t */
+  CG_TOML_FIELD_TYPE_UINT16,    /* uint16_t */
+  CG_TOML_FIELD_TYPE_INT32,     /* int32_t */
+  CG_TOML_FIELD_TYPE_UINT32,    /* uint32_t */
+  CG_TOML_FIELD_TYPE_INT64,     /* int64_t */
+  CG_TOML_FIELD_TYPE_UINT64,    /* uint64_t */
+  CG_TOML_FIELD_TYPE_DOUBLE,    /* double, integers are converted */
+  CG_TOML_FIELD_TYPE_STRING,    /* char *, newly allocated */
+} CgTomlFieldType;
+
+/* CgTomlFieldDefault, the value of an optional field missing from the
+ * table. Integers use v_int64, except unsigned 64-bit ones that use
+ * v_uint64. A NULL string default leaves the field NULL */
+typedef union _CgTomlFieldDefault CgTomlFieldDefault;
+union _CgTomlFieldDefault {
+  gboolean v_boolean;
+  int64_t v_int64;
+  uint64_t v_uint64;
+  double v_double;
+  const char *v_string;
+};
+
+/* CgTomlField, describes a key of a table and where its value goes in a
+ * struct, the offset is usually given with G_STRUCT_OFFSET() */
+typedef struct _CgTomlField CgTomlField;
+struct _CgTomlField {
+  const char *name;
+  CgTomlFieldType type;
+  gsize offset;
+  gboolean required;
+  CgTomlFieldDefault default_value;
+};
+
+/* CgTomlSchema, a compiled set of fields. Compiling it up front lets a
+ * table be decoded in a single pass over its entries */
+GType cg_toml_schema_get_type (void);
+typedef struct _CgTomlSchema CgTomlSchema;
+CgTomlSchema * cg_toml_schema_new (const CgTomlField *fields, guint n_fields,
+    gsize struct_size);
+CgTomlSchema * cg_toml_schema_ref (CgTomlSchema * self);
+void cg_toml_schema_unref (CgTomlSchema * self);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlSchema, cg_toml_schema_unref)
+
+/* API */
+gsize cg_toml_schema_get_struct_size (const CgTomlSchema *self);
+guint cg_toml_schema_get_n_fields (const CgTomlSchema *self);
+void cg_toml_schema_clear (const CgTomlSchema *self, gpointer dst);
+void cg_toml_schema_free_array (const CgTomlSchema *self, gpointer array,
+    guint n_elements);
+
+G_END_DECLS
+
+#endif
@@ -7,13 +7,29 @@
  */
 
 /* C++ STL */
+#include <algorithm>
+#include <cerrno>
 #include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 /* CPPTOML */
 #include <include/cpptoml.h>
 
+/* POSIX */
+#include <unistd.h>
+
 /* TOML */
 #include "private.h"
+#include "node.h"
+#include "field.h"
+#include "diff.h"
+#include "builder.h"
+#include "writer.h"
+#include "variant.h"
+#include "error.h"
 #include "table.h"
 
 namespace cg {
@@ -23,7 +39,7 @@ namespace toml {
 class Table {
  public:
   /* The data of the array */
-  using Data = std::shared_ptr<const cpptoml::table>;
+  using Data = OwnedNode;
 
   /* Constructor */
   Table(Data data) :
@@ -34,39 +50,19 @@ class Table {
   virtual ~Table() {
   }
 
-  /* Determines if this table contains the given key */
-  bool Contains(const std::string& key) const {
-    return data_->contains(key);
-  }
-
-  /* Gets a value */
-  template <typename T>
-  bool GetValue(const std::string& key, T *val, bool qualified) const {
-    g_return_val_if_fail (val, false);
-    const cpptoml::option<T> opt =
-        qualified ? data_->get_qualified_as<T>(key) : data_->get_as<T>(key);
-    if (!opt)
-      return false;
-    *val = *opt;
-    return true;
-  }
-
-  /* Gets an array of values */
-  std::shared_ptr<const cpptoml::array> GetArray(const std::string& key,
-      bool qualified) const {
-    return qualified ? data_->get_array_qualified(key) : data_->get_array(key);
+  /* Gets the table without increasing its reference count */
+  Node Get() const {
+    return data_.node;
   }
 
-  /* Gets an array of tables */
-  std::shared_ptr<const cpptoml::table_array> GetTableArray(
-      const std::string& key, bool qualified) const {
-    return qualified ? data_->get_table_array_qualified(key) :
-        data_->get_table_array(key);
+  /* Gets what keeps the table alive */
+  const std::shared_ptr<const void>& GetOwner() const {
+    return data_.owner;
   }
 
-  /* Gets a nested table */
-  Data GetTable(const std::string& key, bool qualified) const {
-    return qualified ? data_->get_table_qualified(key) : data_->get_table(key);
+  /* Gets the table along with its owner */
+  const Data& GetData() const {
+    return data_;
   }
 
  private:
@@ -91,11 +87,15 @@ class Table {
 class TableArray {
  public:
   /* The data of the array */
-  using Data = std::shared_ptr<const cpptoml::table_array>;
+  using Data = OwnedNode;
 
   /* The for each function for arrays of tables */
   using ForEachFunction = std::function<void(CgTomlTable *, gpointer)>;
 
+  /* The for each function for views of arrays of tables */
+  using ForEachViewFunction =
+      std::function<void(const CgTomlTableView *, gpointer)>;
+
   /* Constructor */
   TableArray(Data data) :
       data_(std::move(data)) {
@@ -105,13 +105,36 @@ class TableArray {
   virtual ~TableArray() {
   }
 
+  /* Gets the array without increasing its reference count */
+  Node Get() const {
+    return data_.node;
+  }
+
+  /* Gets what keeps the array alive */
+  const std::shared_ptr<const void>& GetOwner() const {
+    return data_.owner;
+  }
+
   /* Calls the given callback for arrays of values */
   void ForEach(ForEachFunction func, gpointer user_data) const {
-    for (const auto& table : *data_) {
-      gconstpointer p = static_cast<gconstpointer>(&table);
-      g_autoptr (CgTomlTable) t = cg_toml_table_new(p);
-      func(t, user_data);
-    }
+    ForEachElement(data_.node, [&](Node t) {
+        OwnedNode table = Own(data_.owner, t);
+        g_autoptr (CgTomlTable) tt =
+            cg_toml_table_new(static_cast<gconstpointer>(&table));
+        func(tt, user_data);
+        return true;
+      });
+  }
+
+  /* Calls the given callback with a view of each table */
+  static void ForEachView(Node array, ForEachViewFunction func,
+      gpointer user_data) {
+    CgTomlTableView view = {};
+    ForEachElement(array, [&](Node t) {
+        view.data = t.ToData();
+        func(&view, user_data);
+        return true;
+      });
   }
 
  private:
@@ -157,7 +180,7 @@ cg_toml_table_new (gconstpointer data)
   g_return_val_if_fail (data, nullptr);
 
   try {
-    g_autoptr (CgTomlTable) self = g_rc_box_new (CgTomlTable);
+    g_autoptr (CgTomlTable) self = g_atomic_rc_box_new (CgTomlTable);
 
     /* Set the data */
     const cg::toml::Table::Data *d =
@@ -178,7 +201,7 @@ CgTomlTable *
 cg_toml_table_ref (CgTomlTable * self)
 {
   return static_cast<CgTomlTable *>(
-    g_rc_box_acquire (static_cast<gpointer>(self)));
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
 }
 
 void
@@ -188,7 +211,13 @@ cg_toml_table_unref (CgTomlTable * self)
     CgTomlTable *t = static_cast<CgTomlTable *>(p);
     delete t->data;
   };
-  g_rc_box_release_full (self, free_func);
+  g_atomic_rc_box_release_full (self, free_func);
+}
+
+gconstpointer
+cg_toml_table_get_data (const CgTomlTable *self)
+{
+  return static_cast<gconstpointer>(&self->data->GetData());
 }
 
 static CgTomlTableArray *
@@ -197,7 +226,7 @@ cg_toml_table_array_new (gconstpointer data)
   g_return_val_if_fail (data, nullptr);
 
   try {
-    g_autoptr (CgTomlTableArray) self = g_rc_box_new (CgTomlTableArray);
+    g_autoptr (CgTomlTableArray) self = g_atomic_rc_box_new (CgTomlTableArray);
 
     /* Set the data */
     const cg::toml::TableArray::Data *d =
@@ -218,7 +247,7 @@ CgTomlTableArray *
 cg_toml_table_array_ref (CgTomlTableArray * self)
 {
   return static_cast<CgTomlTableArray *>(
-    g_rc_box_acquire (static_cast<gpointer>(self)));
+    g_atomic_rc_box_acquire (static_cast<gpointer>(self)));
 }
 
 void
@@ -228,229 +257,582 @@ cg_toml_table_array_unref (CgTomlTableArray * self)
     CgTomlTableArray *at = static_cast<CgTomlTableArray *>(p);
     delete at->data;
   };
-  g_rc_box_release_full (self, free_func);
+  g_atomic_rc_box_release_full (self, free_func);
 }
 
-gboolean
-cg_toml_table_contains (const CgTomlTable *self, const char *key) {
-  return self->data->Contains(key);
+static inline cg::toml::Node
+table_data (const CgTomlTable *self)
+{
+  return self->data->Get();
 }
 
-gboolean
-cg_toml_table_get_boolean (const CgTomlTable *self, const char *key,
-  gboolean *val)
+static inline cg::toml::Node
+table_data (const CgTomlTableView *self)
+{
+  return cg::toml::Node::FromData(self->data);
+}
+
+static inline cg::toml::Node
+table_array_data (const CgTomlTableArray *self)
+{
+  return self->data->Get();
+}
+
+static inline cg::toml::Node
+table_array_data (const CgTomlTableArrayView *self)
+{
+  return cg::toml::Node::FromData(self->data);
+}
+
+static char **
+dup_keys (std::vector<std::string>& keys)
+{
+  std::sort (keys.begin (), keys.end ());
+  char **res = g_new (char *, keys.size () + 1);
+  for (gsize i = 0; i < keys.size (); i++)
+    res[i] = g_strndup (keys[i].data (), keys[i].size ());
+  res[keys.size ()] = nullptr;
+  return res;
+}
+
+static gboolean
+get_many (cg::toml::Node table, const CgTomlQuery *queries, gsize n,
+    guint64 *found)
+{
+  g_return_val_if_fail (queries || n == 0, false);
+
+  /* A query split into the dotted key of its table and its last segment */
+  struct Item {
+    const char *parent;
+    gsize parent_len;
+    cg::toml::KeyRef leaf;
+    gsize query;
+    bool found;
+  };
+
+  try {
+    /* Sort the queries by table, then as the entries of the table */
+    std::vector<Item> items;
+    items.reserve (n);
+    for (gsize i = 0; i < n; i++) {
+      const char *key = queries[i].key;
+      const char *dot = strrchr (key, '.');
+      const char *leaf = dot ? dot + 1 : key;
+      const gsize len = strlen (leaf);
+      items.push_back ({key, dot ? static_cast<gsize>(dot - key) : 0,
+          {leaf, len, cg::toml::dom::Hash (leaf, len)}, i, false});
+    }
+    std::sort (items.begin (), items.end (), [](const Item& a,
+        const Item& b) {
+      const int cmp = memcmp (a.parent, b.parent,
+          std::min (a.parent_len, b.parent_len));
+      if (cmp != 0 || a.parent_len != b.parent_len)
+        return cmp != 0 ? cmp < 0 : a.parent_len < b.parent_len;
+      return a.leaf < b.leaf;
+    });
+    std::vector<cg::toml::KeyRef> keys;
+    keys.reserve (n);
+    for (const Item& item : items)
+      keys.push_back (item.leaf);
+
+    /* Match each table once against the queries under it */
+    gsize n_found = 0;
+    for (gsize start = 0, end = 0; start < n; start = end) {
+      const Item& first = items[start];
+      end = start + 1;
+      while (end < n && items[end].parent_len == first.parent_len &&
+          memcmp (items[end].parent, first.parent, first.parent_len) == 0)
+        end++;
+      const cg::toml::Node parent = first.parent_len > 0 ?
+          cg::toml::LookupQualified (table, first.parent, first.parent_len) :
+          table;
+      if (!parent)
+        continue;
+      cg::toml::MatchEntries (parent, keys.data () + start, end - start,
+          [&](gsize k, cg::toml::Node value) {
+        Item& item = items[start + k];
+        const CgTomlQuery& q = queries[item.query];
+        if (!item.found && cg::toml::StoreField (q.type, value, q.dst)) {
+          item.found = true;
+          n_found++;
+        }
+        return true;
+      });
+    }
+
+    /* Defaults and status */
+    if (found)
+      memset (found, 0, CG_TOML_QUERY_BITMAP_SIZE (n) * sizeof (guint64));
+    for (const Item& item : items) {
+      const CgTomlQuery& q = queries[item.query];
+      if (!item.found)
+        cg::toml::StoreFieldDefault (q.type, q.default_value, q.dst);
+      else if (found)
+        found[item.query / 64] |= G_GUINT64_CONSTANT (1) << (item.query % 64);
+    }
+    return n_found == n;
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not look up the queries: %s", ba.what());
+    return false;
+  }
+}
+
+static inline const cg::toml::Segments&
+get_path_segments (const CgTomlPath *path)
+{
+  return *static_cast<const cg::toml::Segments *>(
+      cg_toml_path_get_segments (path));
+}
+
+static inline gboolean
+get_boolean (cg::toml::Node node, gboolean *val)
 {
   bool v;
-  if (!self->data->GetValue<bool>(key, &v, false))
+  if (!cg::toml::GetValue(node, &v))
     return false;
   *val = v ? TRUE : FALSE;
   return true;
 }
 
+template <typename T>
+static inline gboolean
+get_value (cg::toml::Node node, T *val)
+{
+  g_return_val_if_fail (val, false);
+  return cg::toml::GetValue(node, val);
+}
+
+static inline char *
+dup_string (cg::toml::Node node)
+{
+  gsize len = 0;
+  const char *str = cg::toml::GetString(node, &len);
+  return str ? g_strndup (str, len) : nullptr;
+}
+
+static inline const char *
+peek_string (cg::toml::Node node, gsize *len)
+{
+  return cg::toml::GetString(node, len);
+}
+
+template <typename T>
+static CgTomlArray *
+new_array (const T *self, cg::toml::Node node)
+{
+  if (!cg::toml::IsArray(node))
+    return nullptr;
+  cg::toml::OwnedNode array = cg::toml::Own(self->data->GetOwner(), node);
+  return cg_toml_array_new (static_cast<gconstpointer>(&array));
+}
+
+template <typename T>
+static CgTomlTable *
+new_table (const T *self, cg::toml::Node node)
+{
+  if (!cg::toml::IsTable(node))
+    return nullptr;
+  cg::toml::OwnedNode table = cg::toml::Own(self->data->GetOwner(), node);
+  return cg_toml_table_new (static_cast<gconstpointer>(&table));
+}
+
+template <typename T>
+static CgTomlTableArray *
+new_table_array (const T *self, cg::toml::Node node)
+{
+  if (!cg::toml::IsTableArray(node))
+    return nullptr;
+  cg::toml::OwnedNode array_table =
+      cg::toml::Own(self->data->GetOwner(), node);
+  return cg_toml_table_array_new (static_cast<gconstpointer>(&array_table));
+}
+
+static gboolean
+get_array_view (cg::toml::Node node, CgTomlArrayView *view)
+{
+  g_return_val_if_fail (view, false);
+  if (!cg::toml::IsArray(node))
+    return false;
+  *view = {};
+  view->data = node.ToData();
+  return true;
+}
+
+static gboolean
+get_table_view (cg::toml::Node node, CgTomlTableView *view)
+{
+  g_return_val_if_fail (view, false);
+  if (!cg::toml::IsTable(node))
+    return false;
+  *view = {};
+  view->data = node.ToData();
+  return true;
+}
+
+static gboolean
+get_table_array_view (cg::toml::Node node, CgTomlTableArrayView *view)
+{
+  g_return_val_if_fail (view, false);
+  if (!cg::toml::IsTableArray(node))
+    return false;
+  *view = {};
+  view->data = node.ToData();
+  return true;
+}
+
+/* The position of a table iterator is kept in its reserved fields, as an
+ * index for compact tables and lazy roots or as a map iterator for cpptoml
+ * ones, which only works as long as the map iterator is a plain pointer
+ * wrapper */
+using TableIterPosition = cpptoml::table::const_iterator;
+static_assert (
+    sizeof (TableIterPosition) <= sizeof (CgTomlTableIter::reserved),
+    "CgTomlTableIter is too small to hold a table iterator");
+static_assert (std::is_trivially_destructible<TableIterPosition>::value,
+    "Table iterators must be trivially destructible");
+
+static inline TableIterPosition *
+table_iter_position (CgTomlTableIter *iter)
+{
+  return reinterpret_cast<TableIterPosition *>(iter->reserved);
+}
+
+static void
+table_iter_init (CgTomlTableIter *iter, cg::toml::Node table)
+{
+  g_return_if_fail (iter);
+  *iter = {};
+  iter->data = table.ToData();
+  if (const cpptoml::table *t = cg::toml::AsTable(table.GetBase()))
+    new (iter->reserved) TableIterPosition (t->begin());
+}
+
+static void
+table_array_iter_init (CgTomlTableArrayIter *iter, cg::toml::Node array)
+{
+  g_return_if_fail (iter);
+  *iter = {};
+  iter->data = array.ToData();
+}
+
+gboolean
+cg_toml_table_contains (const CgTomlTable *self, const char *key) {
+  return cg::toml::Lookup (table_data (self), key, false) ? TRUE : FALSE;
+}
+
+gboolean
+cg_toml_table_get_boolean (const CgTomlTable *self, const char *key,
+    gboolean *val)
+{
+  return get_boolean (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
 gboolean
 cg_toml_table_get_qualified_boolean (const CgTomlTable *self, const char *key,
     gboolean *val)
 {
-  bool v;
-  if (!self->data->GetValue<bool>(key, &v, true))
-    return false;
-  *val = v ? TRUE : FALSE;
-  return true;
+  return get_boolean (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_int8 (const CgTomlTable *self, const char *key, int8_t *val)
 {
-  return self->data->GetValue<int8_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_int8 (const CgTomlTable *self, const char *key,
     int8_t *val)
 {
-  return self->data->GetValue<int8_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_uint8 (const CgTomlTable *self, const char *key, uint8_t *val)
 {
-  return self->data->GetValue<uint8_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_uint8 (const CgTomlTable *self, const char *key,
     uint8_t *val)
 {
-  return self->data->GetValue<uint8_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_int16 (const CgTomlTable *self, const char *key, int16_t *val)
 {
-  return self->data->GetValue<int16_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_int16 (const CgTomlTable *self, const char *key,
     int16_t *val)
 {
-  return self->data->GetValue<int16_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_uint16 (const CgTomlTable *self, const char *key,
     uint16_t *val)
 {
-  return self->data->GetValue<uint16_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_uint16 (const CgTomlTable *self, const char *key,
     uint16_t *val)
 {
-  return self->data->GetValue<uint16_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_int32 (const CgTomlTable *self, const char *key, int32_t *val)
 {
-  return self->data->GetValue<int32_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_int32 (const CgTomlTable *self, const char *key,
     int32_t *val)
 {
-  return self->data->GetValue<int32_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_uint32 (const CgTomlTable *self, const char *key,
     uint32_t *val)
 {
-  return self->data->GetValue<uint32_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_uint32 (const CgTomlTable *self, const char *key,
     uint32_t *val)
 {
-  return self->data->GetValue<uint32_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_int64 (const CgTomlTable *self, const char *key, int64_t *val)
 {
-  return self->data->GetValue<int64_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_int64 (const CgTomlTable *self, const char *key,
     int64_t *val)
 {
-  return self->data->GetValue<int64_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_uint64 (const CgTomlTable *self, const char *key,
     uint64_t *val)
 {
-  return self->data->GetValue<uint64_t>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_uint64 (const CgTomlTable *self, const char *key,
     uint64_t *val)
 {
-  return self->data->GetValue<uint64_t>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 gboolean
 cg_toml_table_get_double (const CgTomlTable *self, const char *key, double *val)
 {
-  return self->data->GetValue<double>(key, val, false);
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
 }
 
 gboolean
 cg_toml_table_get_qualified_double (const CgTomlTable *self, const char *key,
     double *val)
 {
-  return self->data->GetValue<double>(key, val, true);
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
 }
 
 char *
 cg_toml_table_get_string (const CgTomlTable *self, const char *key)
 {
-  std::string str;
-  return self->data->GetValue<std::string>(key, &str, false) ?
-      g_strdup (str.c_str()) : nullptr;
+  return dup_string (cg::toml::Lookup (table_data (self), key, false));
 }
 
 char *
 cg_toml_table_get_qualified_string (const CgTomlTable *self, const char *key)
 {
-  std::string str;
-  return self->data->GetValue<std::string>(key, &str, true) ?
-      g_strdup (str.c_str()) : nullptr;
+  return dup_string (cg::toml::Lookup (table_data (self), key, true));
+}
+
+const char *
+cg_toml_table_peek_string (const CgTomlTable *self, const char *key, gsize *len)
+{
+  return peek_string (cg::toml::Lookup (table_data (self), key, false), len);
+}
+
+const char *
+cg_toml_table_peek_qualified_string (const CgTomlTable *self, const char *key,
+    gsize *len)
+{
+  return peek_string (cg::toml::Lookup (table_data (self), key, true), len);
 }
 
 CgTomlArray *
 cg_toml_table_get_array (const CgTomlTable *self, const char *key)
 {
-  std::shared_ptr<const cpptoml::array> array =
-      self->data->GetArray(key, false);
-  return array ?
-      cg_toml_array_new (static_cast<gconstpointer>(&array)) :
-      nullptr;
+  return new_array (self, cg::toml::Lookup (table_data (self), key, false));
 }
 
 CgTomlArray *
 cg_toml_table_get_qualified_array (const CgTomlTable *self, const char *key)
 {
-  std::shared_ptr<const cpptoml::array> array =
-      self->data->GetArray(key, true);
-  return array ?
-      cg_toml_array_new (static_cast<gconstpointer>(&array)) :
-      nullptr;
+  return new_array (self, cg::toml::Lookup (table_data (self), key, true));
 }
 
 CgTomlTable *
 cg_toml_table_get_table (const CgTomlTable *self, const char *key)
 {
-  cg::toml::Table::Data table = self->data->GetTable(key, false);
-  return table ?
-      cg_toml_table_new (static_cast<gconstpointer>(&table)) :
-      nullptr;
+  return new_table (self, cg::toml::Lookup (table_data (self), key, false));
 }
 
 CgTomlTable *
 cg_toml_table_get_qualified_table (const CgTomlTable *self, const char *key)
 {
-  cg::toml::Table::Data table = self->data->GetTable(key, true);
-  return table ?
-      cg_toml_table_new (static_cast<gconstpointer>(&table)) :
-      nullptr;
+  return new_table (self, cg::toml::Lookup (table_data (self), key, true));
 }
 
 CgTomlTableArray *
 cg_toml_table_get_array_table (const CgTomlTable *self, const char *key)
 {
-  std::shared_ptr<const cpptoml::table_array> array_table =
-      self->data->GetTableArray(key, false);
-  return array_table ?
-      cg_toml_table_array_new (static_cast<gconstpointer>(&array_table)) :
-      nullptr;
+  return new_table_array (self,
+      cg::toml::Lookup (table_data (self), key, false));
 }
 
 CgTomlTableArray *
 cg_toml_table_get_qualified_array_table (const CgTomlTable *self,
     const char *key)
 {
-  std::shared_ptr<const cpptoml::table_array> array_table =
-      self->data->GetTableArray(key, true);
-  return array_table ?
-      cg_toml_table_array_new (static_cast<gconstpointer>(&array_table)) :
-      nullptr;
+  return new_table_array (self,
+      cg::toml::Lookup (table_data (self), key, true));
+}
+
+gboolean
+cg_toml_table_get_path_boolean (const CgTomlTable *self, const CgTomlPath *path,
+    gboolean *val)
+{
+  return get_boolean (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_int8 (const CgTomlTable *self, const CgTomlPath *path,
+    int8_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_uint8 (const CgTomlTable *self, const CgTomlPath *path,
+    uint8_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_int16 (const CgTomlTable *self, const CgTomlPath *path,
+    int16_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_uint16 (const CgTomlTable *self, const CgTomlPath *path,
+    uint16_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_int32 (const CgTomlTable *self, const CgTomlPath *path,
+    int32_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_uint32 (const CgTomlTable *self, const CgTomlPath *path,
+    uint32_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_int64 (const CgTomlTable *self, const CgTomlPath *path,
+    int64_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_uint64 (const CgTomlTable *self, const CgTomlPath *path,
+    uint64_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_get_path_double (const CgTomlTable *self, const CgTomlPath *path,
+    double *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+char *
+cg_toml_table_get_path_string (const CgTomlTable *self, const CgTomlPath *path)
+{
+  return dup_string (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)));
+}
+
+const char *
+cg_toml_table_peek_path_string (const CgTomlTable *self, const CgTomlPath *path,
+    gsize *len)
+{
+  return peek_string (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), len);
+}
+
+CgTomlArray *
+cg_toml_table_get_path_array (const CgTomlTable *self, const CgTomlPath *path)
+{
+  return new_array (self, cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)));
+}
+
+CgTomlTable *
+cg_toml_table_get_path_table (const CgTomlTable *self, const CgTomlPath *path)
+{
+  return new_table (self, cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)));
+}
+
+CgTomlTableArray *
+cg_toml_table_get_path_array_table (const CgTomlTable *self,
+    const CgTomlPath *path)
+{
+  return new_table_array (self, cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)));
 }
 
 void
@@ -459,3 +841,1008 @@ cg_toml_table_array_for_each (const CgTomlTableArray *self,
 {
   self->data->ForEach(func, user_data);
 }
+
+void
+cg_toml_table_array_for_each_view (const CgTomlTableArray *self,
+    CgTomlTableArrayViewForEachFunc func, gpointer user_data)
+{
+  cg::toml::TableArray::ForEachView(table_array_data (self), func, user_data);
+}
+
+guint
+cg_toml_table_array_get_length (const CgTomlTableArray *self)
+{
+  return cg::toml::GetLength(table_array_data (self));
+}
+
+CgTomlTable *
+cg_toml_table_array_get_nth (const CgTomlTableArray *self, guint n)
+{
+  return new_table (self, cg::toml::GetNth(table_array_data (self), n));
+}
+
+gboolean
+cg_toml_table_array_get_nth_view (const CgTomlTableArray *self, guint n,
+    CgTomlTableView *view)
+{
+  return get_table_view (cg::toml::GetNth(table_array_data (self), n), view);
+}
+
+void
+cg_toml_table_get_view (const CgTomlTable *self, CgTomlTableView *view)
+{
+  get_table_view (table_data (self), view);
+}
+
+void
+cg_toml_table_array_get_view (const CgTomlTableArray *self,
+    CgTomlTableArrayView *view)
+{
+  get_table_array_view (table_array_data (self), view);
+}
+
+gboolean
+cg_toml_table_view_contains (const CgTomlTableView *self, const char *key)
+{
+  return cg::toml::Lookup (table_data (self), key, false) ? TRUE : FALSE;
+}
+
+gboolean
+cg_toml_table_view_get_boolean (const CgTomlTableView *self, const char *key,
+    gboolean *val)
+{
+  return get_boolean (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_boolean (const CgTomlTableView *self,
+    const char *key, gboolean *val)
+{
+  return get_boolean (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_int8 (const CgTomlTableView *self, const char *key,
+    int8_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_int8 (const CgTomlTableView *self,
+    const char *key, int8_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_uint8 (const CgTomlTableView *self, const char *key,
+    uint8_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_uint8 (const CgTomlTableView *self,
+    const char *key, uint8_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_int16 (const CgTomlTableView *self, const char *key,
+    int16_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_int16 (const CgTomlTableView *self,
+    const char *key, int16_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_uint16 (const CgTomlTableView *self, const char *key,
+    uint16_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_uint16 (const CgTomlTableView *self,
+    const char *key, uint16_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_int32 (const CgTomlTableView *self, const char *key,
+    int32_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_int32 (const CgTomlTableView *self,
+    const char *key, int32_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_uint32 (const CgTomlTableView *self, const char *key,
+    uint32_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_uint32 (const CgTomlTableView *self,
+    const char *key, uint32_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_int64 (const CgTomlTableView *self, const char *key,
+    int64_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_int64 (const CgTomlTableView *self,
+    const char *key, int64_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_uint64 (const CgTomlTableView *self, const char *key,
+    uint64_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_uint64 (const CgTomlTableView *self,
+    const char *key, uint64_t *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+gboolean
+cg_toml_table_view_get_double (const CgTomlTableView *self, const char *key,
+    double *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, false), val);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_double (const CgTomlTableView *self,
+    const char *key, double *val)
+{
+  return get_value (cg::toml::Lookup (table_data (self), key, true), val);
+}
+
+char *
+cg_toml_table_view_get_string (const CgTomlTableView *self, const char *key)
+{
+  return dup_string (cg::toml::Lookup (table_data (self), key, false));
+}
+
+char *
+cg_toml_table_view_get_qualified_string (const CgTomlTableView *self,
+    const char *key)
+{
+  return dup_string (cg::toml::Lookup (table_data (self), key, true));
+}
+
+const char *
+cg_toml_table_view_peek_string (const CgTomlTableView *self, const char *key,
+    gsize *len)
+{
+  return peek_string (cg::toml::Lookup (table_data (self), key, false), len);
+}
+
+const char *
+cg_toml_table_view_peek_qualified_string (const CgTomlTableView *self,
+    const char *key, gsize *len)
+{
+  return peek_string (cg::toml::Lookup (table_data (self), key, true), len);
+}
+
+gboolean
+cg_toml_table_view_get_array (const CgTomlTableView *self, const char *key,
+    CgTomlArrayView *array)
+{
+  return get_array_view (cg::toml::Lookup (table_data (self), key, false),
+      array);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_array (const CgTomlTableView *self,
+    const char *key, CgTomlArrayView *array)
+{
+  return get_array_view (cg::toml::Lookup (table_data (self), key, true),
+      array);
+}
+
+gboolean
+cg_toml_table_view_get_table (const CgTomlTableView *self, const char *key,
+    CgTomlTableView *table)
+{
+  return get_table_view (cg::toml::Lookup (table_data (self), key, false),
+      table);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_table (const CgTomlTableView *self,
+    const char *key, CgTomlTableView *table)
+{
+  return get_table_view (cg::toml::Lookup (table_data (self), key, true),
+      table);
+}
+
+gboolean
+cg_toml_table_view_get_array_table (const CgTomlTableView *self,
+    const char *key, CgTomlTableArrayView *array_table)
+{
+  return get_table_array_view (cg::toml::Lookup (table_data (self), key, false),
+      array_table);
+}
+
+gboolean
+cg_toml_table_view_get_qualified_array_table (const CgTomlTableView *self,
+    const char *key, CgTomlTableArrayView *array_table)
+{
+  return get_table_array_view (cg::toml::Lookup (table_data (self), key, true),
+      array_table);
+}
+
+gboolean
+cg_toml_table_view_get_path_boolean (const CgTomlTableView *self,
+    const CgTomlPath *path, gboolean *val)
+{
+  return get_boolean (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_int8 (const CgTomlTableView *self,
+    const CgTomlPath *path, int8_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_uint8 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint8_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_int16 (const CgTomlTableView *self,
+    const CgTomlPath *path, int16_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_uint16 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint16_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_int32 (const CgTomlTableView *self,
+    const CgTomlPath *path, int32_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_uint32 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint32_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_int64 (const CgTomlTableView *self,
+    const CgTomlPath *path, int64_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_uint64 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint64_t *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+gboolean
+cg_toml_table_view_get_path_double (const CgTomlTableView *self,
+    const CgTomlPath *path, double *val)
+{
+  return get_value (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), val);
+}
+
+char *
+cg_toml_table_view_get_path_string (const CgTomlTableView *self,
+    const CgTomlPath *path)
+{
+  return dup_string (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)));
+}
+
+const char *
+cg_toml_table_view_peek_path_string (const CgTomlTableView *self,
+    const CgTomlPath *path, gsize *len)
+{
+  return peek_string (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), len);
+}
+
+gboolean
+cg_toml_table_view_get_path_array (const CgTomlTableView *self,
+    const CgTomlPath *path, CgTomlArrayView *array)
+{
+  return get_array_view (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), array);
+}
+
+gboolean
+cg_toml_table_view_get_path_table (const CgTomlTableView *self,
+    const CgTomlPath *path, CgTomlTableView *table)
+{
+  return get_table_view (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), table);
+}
+
+gboolean
+cg_toml_table_view_get_path_array_table (const CgTomlTableView *self,
+    const CgTomlPath *path, CgTomlTableArrayView *array_table)
+{
+  return get_table_array_view (cg::toml::LookupPath (table_data (self),
+      get_path_segments (path)), array_table);
+}
+
+void
+cg_toml_table_array_view_for_each (const CgTomlTableArrayView *self,
+    CgTomlTableArrayViewForEachFunc func, gpointer user_data)
+{
+  cg::toml::TableArray::ForEachView(table_array_data (self), func, user_data);
+}
+
+guint
+cg_toml_table_array_view_get_length (const CgTomlTableArrayView *self)
+{
+  return cg::toml::GetLength(table_array_data (self));
+}
+
+gboolean
+cg_toml_table_array_view_get_nth (const CgTomlTableArrayView *self, guint n,
+    CgTomlTableView *view)
+{
+  return get_table_view (cg::toml::GetNth(table_array_data (self), n), view);
+}
+
+gboolean
+cg_toml_value_view_get_table (const CgTomlValueView *self,
+    CgTomlTableView *table)
+{
+  return get_table_view (cg::toml::Node::FromData(self->data), table);
+}
+
+gboolean
+cg_toml_value_view_get_array_table (const CgTomlValueView *self,
+    CgTomlTableArrayView *array_table)
+{
+  return get_table_array_view (cg::toml::Node::FromData(self->data),
+      array_table);
+}
+
+void
+cg_toml_table_iter_init (CgTomlTableIter *iter, const CgTomlTable *table)
+{
+  table_iter_init (iter, table_data (table));
+}
+
+void
+cg_toml_table_iter_init_view (CgTomlTableIter *iter,
+    const CgTomlTableView *table)
+{
+  table_iter_init (iter, table_data (table));
+}
+
+gboolean
+cg_toml_table_iter_next (CgTomlTableIter *iter, const char **key,
+    CgTomlValueView *value)
+{
+  g_return_val_if_fail (iter, false);
+  const cg::toml::Node table = cg::toml::Node::FromData(iter->data);
+  const char *k;
+  cg::toml::Node v;
+
+  if (const cg::toml::dom::Node *t = table.GetCompact()) {
+    const gsize index = GPOINTER_TO_SIZE (iter->reserved[0]);
+    if (index >= t->length)
+      return false;
+    k = cg::toml::dom::GetKey(cg::toml::dom::GetEntries(t) + index);
+    v = cg::toml::Node {cg::toml::dom::GetValues(t) + index};
+    iter->reserved[0] = GSIZE_TO_POINTER (index + 1);
+  } else if (const cg::toml::LazyDocument *l = table.GetLazy()) {
+    const gsize index = GPOINTER_TO_SIZE (iter->reserved[0]);
+    if (index >= l->GetLength())
+      return false;
+    v = cg::toml::Node {l->GetNth(index, &k)};
+    iter->reserved[0] = GSIZE_TO_POINTER (index + 1);
+  } else {
+    const cpptoml::table *base = cg::toml::AsTable(table.GetBase());
+    TableIterPosition *pos = table_iter_position (iter);
+    if (*pos == base->end())
+      return false;
+    k = (*pos)->first.c_str();
+    v = cg::toml::Node {(*pos)->second.get()};
+    ++*pos;
+  }
+
+  if (key)
+    *key = k;
+  if (value) {
+    *value = {};
+    value->data = v.ToData();
+  }
+  return true;
+}
+
+gboolean
+cg_toml_table_get_many (const CgTomlTable *self, const CgTomlQuery *queries,
+    gsize n, guint64 *found)
+{
+  g_return_val_if_fail (self, false);
+
+  return get_many (table_data (self), queries, n, found);
+}
+
+gboolean
+cg_toml_table_view_get_many (const CgTomlTableView *self,
+    const CgTomlQuery *queries, gsize n, guint64 *found)
+{
+  g_return_val_if_fail (self, false);
+
+  return get_many (table_data (self), queries, n, found);
+}
+
+gboolean
+cg_toml_table_decode (const CgTomlTable *self, const CgTomlSchema *schema,
+    gpointer dst, GError **error)
+{
+  g_return_val_if_fail (self, false);
+
+  return cg_toml_schema_decode (schema, table_data (self).ToData (), dst,
+      error);
+}
+
+gboolean
+cg_toml_table_view_decode (const CgTomlTableView *self,
+    const CgTomlSchema *schema, gpointer dst, GError **error)
+{
+  g_return_val_if_fail (self, false);
+
+  return cg_toml_schema_decode (schema, table_data (self).ToData (), dst,
+      error);
+}
+
+gpointer
+cg_toml_table_array_decode (const CgTomlTableArray *self,
+    const CgTomlSchema *schema, guint *n_elements, GError **error)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (schema, nullptr);
+
+  const cg::toml::Node array = table_array_data (self);
+  const guint length = cg::toml::GetLength (array);
+  const gsize size = cg_toml_schema_get_struct_size (schema);
+
+  /* Decode each table in place, at least one struct is allocated so that
+   * an empty array is not mistaken for an error */
+  guint8 *res = static_cast<guint8 *>(g_malloc0_n (MAX (length, 1), size));
+  for (guint i = 0; i < length; i++) {
+    if (!cg_toml_schema_decode (schema,
+        cg::toml::GetNth (array, i).ToData (), res + i * size, error)) {
+      g_prefix_error (error, "Table %u: ", i);
+      cg_toml_schema_free_array (schema, res, i);
+      return nullptr;
+    }
+  }
+
+  if (n_elements)
+    *n_elements = length;
+  return res;
+}
+
+CgTomlTableDiff *
+cg_toml_table_diff (const CgTomlTable *old_table, const CgTomlTable *new_table,
+    GError **error)
+{
+  g_return_val_if_fail (old_table, nullptr);
+  g_return_val_if_fail (new_table, nullptr);
+
+  try {
+    cg::toml::Changes changes;
+    if (!cg::toml::Diff (table_data (old_table), table_data (new_table),
+        &changes, error))
+      return nullptr;
+    CgTomlTableDiff *res = g_new0 (CgTomlTableDiff, 1);
+    res->added = dup_keys (changes.added);
+    res->removed = dup_keys (changes.removed);
+    res->modified = dup_keys (changes.modified);
+    return res;
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not compare tables: %s", ba.what());
+    return nullptr;
+  }
+}
+
+void
+cg_toml_table_diff_free (CgTomlTableDiff *self)
+{
+  g_return_if_fail (self);
+  g_strfreev (self->added);
+  g_strfreev (self->removed);
+  g_strfreev (self->modified);
+  g_free (self);
+}
+
+gboolean
+cg_toml_table_write (const CgTomlTable *self, GOutputStream *stream,
+    GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+  try {
+    return cg::toml::Write (table_data (self),
+        [&](const char *data, gsize size) {
+      return g_output_stream_write_all (stream, data, size, nullptr,
+          cancellable, error);
+    }, error);
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not write table: %s", ba.what());
+    return FALSE;
+  }
+}
+
+gboolean
+cg_toml_table_write_fd (const CgTomlTable *self, int fd, GError **error)
+{
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (fd >= 0, FALSE);
+
+  try {
+    return cg::toml::Write (table_data (self),
+        [&](const char *data, gsize size) {
+      while (size > 0) {
+        const gssize n = write (fd, data, size);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0) {
+          const int saved = errno;
+          g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+              "Could not write table: %s", g_strerror (saved));
+          return false;
+        }
+        data += n;
+        size -= n;
+      }
+      return true;
+    }, error);
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not write table: %s", ba.what());
+    return FALSE;
+  }
+}
+
+void
+cg_toml_table_write_string (const CgTomlTable *self, GString *string)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (string);
+
+  try {
+    GError *error = nullptr;
+    if (!cg::toml::Write (table_data (self), [string](const char *data,
+        gsize size) {
+      g_string_append_len (string, data, size);
+      return true;
+    }, &error)) {
+      g_warning ("Could not write CgTomlTable: %s", error->message);
+      g_error_free (error);
+    }
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not write CgTomlTable: %s", ba.what());
+  }
+}
+
+GVariant *
+cg_toml_table_to_variant (const CgTomlTable *self, GError **error)
+{
+  g_return_val_if_fail (self, nullptr);
+
+  try {
+    return cg::toml::ToVariant (table_data (self), error);
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not convert table to a variant: %s", ba.what());
+    return nullptr;
+  }
+}
+
+static CgTomlTable *
+table_new_tree (const std::shared_ptr<cpptoml::table>& table)
+{
+  const cg::toml::OwnedNode d {table, cg::toml::Node {table.get()}};
+  return cg_toml_table_new (static_cast<gconstpointer>(&d));
+}
+
+template <typename F>
+static CgTomlTable *
+table_set (const CgTomlTable *self, const char *key, bool qualified,
+    F make_value)
+{
+  try {
+    std::shared_ptr<cpptoml::table> res = cg::toml::Set (table_data (self),
+        key, qualified, make_value ());
+    return res ? table_new_tree (res) : nullptr;
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not set '%s' in CgTomlTable: %s", key, ba.what());
+    return nullptr;
+  } catch (cpptoml::parse_exception& e) {
+    g_warning ("Could not set '%s' in CgTomlTable: %s", key, e.what());
+    return nullptr;
+  }
+}
+
+static CgTomlTable *
+table_set_boolean (const CgTomlTable *self, const char *key, bool qualified,
+    gboolean val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (key, nullptr);
+
+  return table_set (self, key, qualified, [val]() {
+    return cpptoml::make_value (val != FALSE);
+  });
+}
+
+static CgTomlTable *
+table_set_int64 (const CgTomlTable *self, const char *key, bool qualified,
+    int64_t val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (key, nullptr);
+
+  return table_set (self, key, qualified, [val]() {
+    return cpptoml::make_value (static_cast<int64_t>(val));
+  });
+}
+
+static CgTomlTable *
+table_set_double (const CgTomlTable *self, const char *key, bool qualified,
+    double val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (key, nullptr);
+
+  return table_set (self, key, qualified, [val]() {
+    return cpptoml::make_value (static_cast<double>(val));
+  });
+}
+
+static CgTomlTable *
+table_set_string (const CgTomlTable *self, const char *key, bool qualified,
+    const char *val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (key, nullptr);
+  g_return_val_if_fail (val, nullptr);
+
+  return table_set (self, key, qualified, [val]() {
+    return cpptoml::make_value (std::string {val});
+  });
+}
+
+static CgTomlTable *
+table_set_node (const CgTomlTable *self, const char *key, bool qualified,
+    cg::toml::Node val)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (key, nullptr);
+
+  return table_set (self, key, qualified, [val]() {
+    return cg::toml::Thaw (val);
+  });
+}
+
+static CgTomlTable *
+table_remove (const CgTomlTable *self, const char *key, bool qualified)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (key, nullptr);
+
+  /* Nothing to copy if the key is missing. It may be in an invalid section
+   * of a lazy document, which copying it reports */
+  const cg::toml::Node data = table_data (self);
+  if (!data.GetLazy() && !cg::toml::Lookup (data, key, qualified))
+    return cg_toml_table_ref (const_cast<CgTomlTable *>(self));
+  return table_set (self, key, qualified, []() {
+    return std::shared_ptr<cpptoml::base> {};
+  });
+}
+
+CgTomlTable *
+cg_toml_table_new_empty (void)
+{
+  try {
+    return table_new_tree (cpptoml::make_table ());
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlTable: %s", ba.what());
+    return nullptr;
+  }
+}
+
+CgTomlTable *
+cg_toml_table_new_from_variant (GVariant *variant, GError **error)
+{
+  g_return_val_if_fail (variant, nullptr);
+
+  try {
+    std::shared_ptr<cpptoml::table> res = cg::toml::FromVariant (variant,
+        error);
+    return res ? table_new_tree (res) : nullptr;
+  } catch (std::bad_alloc& ba) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_FAILED,
+        "Could not create CgTomlTable from a variant: %s", ba.what());
+    return nullptr;
+  }
+}
+
+CgTomlTable *
+cg_toml_table_set_boolean (const CgTomlTable *self, const char *key,
+    gboolean val)
+{
+  return table_set_boolean (self, key, false, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_boolean (const CgTomlTable *self, const char *key,
+    gboolean val)
+{
+  return table_set_boolean (self, key, true, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_int64 (const CgTomlTable *self, const char *key,
+    int64_t val)
+{
+  return table_set_int64 (self, key, false, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_int64 (const CgTomlTable *self, const char *key,
+    int64_t val)
+{
+  return table_set_int64 (self, key, true, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_double (const CgTomlTable *self, const char *key,
+    double val)
+{
+  return table_set_double (self, key, false, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_double (const CgTomlTable *self, const char *key,
+    double val)
+{
+  return table_set_double (self, key, true, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_string (const CgTomlTable *self, const char *key,
+    const char *val)
+{
+  return table_set_string (self, key, false, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_string (const CgTomlTable *self, const char *key,
+    const char *val)
+{
+  return table_set_string (self, key, true, val);
+}
+
+CgTomlTable *
+cg_toml_table_set_array (const CgTomlTable *self, const char *key,
+    const CgTomlArray *val)
+{
+  g_return_val_if_fail (val, nullptr);
+
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_array_get_data (val));
+  return table_set_node (self, key, false, d->node);
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_array (const CgTomlTable *self, const char *key,
+    const CgTomlArray *val)
+{
+  g_return_val_if_fail (val, nullptr);
+
+  const cg::toml::OwnedNode *d = static_cast<const cg::toml::OwnedNode *>(
+      cg_toml_array_get_data (val));
+  return table_set_node (self, key, true, d->node);
+}
+
+CgTomlTable *
+cg_toml_table_set_table (const CgTomlTable *self, const char *key,
+    const CgTomlTable *val)
+{
+  g_return_val_if_fail (val, nullptr);
+
+  return table_set_node (self, key, false, table_data (val));
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_table (const CgTomlTable *self, const char *key,
+    const CgTomlTable *val)
+{
+  g_return_val_if_fail (val, nullptr);
+
+  return table_set_node (self, key, true, table_data (val));
+}
+
+CgTomlTable *
+cg_toml_table_set_array_table (const CgTomlTable *self, const char *key,
+    const CgTomlTableArray *val)
+{
+  g_return_val_if_fail (val, nullptr);
+
+  return table_set_node (self, key, false, table_array_data (val));
+}
+
+CgTomlTable *
+cg_toml_table_set_qualified_array_table (const CgTomlTable *self,
+    const char *key, const CgTomlTableArray *val)
+{
+  g_return_val_if_fail (val, nullptr);
+
+  return table_set_node (self, key, true, table_array_data (val));
+}
+
+CgTomlTable *
+cg_toml_table_remove (const CgTomlTable *self, const char *key)
+{
+  return table_remove (self, key, false);
+}
+
+CgTomlTable *
+cg_toml_table_remove_qualified (const CgTomlTable *self, const char *key)
+{
+  return table_remove (self, key, true);
+}
+
+CgTomlTableArray *
+cg_toml_table_array_new_empty (void)
+{
+  try {
+    std::shared_ptr<cpptoml::table_array> array =
+        cpptoml::make_table_array ();
+    const cg::toml::OwnedNode d {array, cg::toml::Node {array.get()}};
+    return cg_toml_table_array_new (static_cast<gconstpointer>(&d));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not create CgTomlTableArray: %s", ba.what());
+    return nullptr;
+  }
+}
+
+CgTomlTableArray *
+cg_toml_table_array_append (const CgTomlTableArray *self,
+    const CgTomlTable *table)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (table, nullptr);
+
+  try {
+    std::shared_ptr<cpptoml::table_array> array = cg::toml::AppendTable (
+        table_array_data (self), std::static_pointer_cast<cpptoml::table>(
+            cg::toml::Thaw (table_data (table))));
+    const cg::toml::OwnedNode d {array, cg::toml::Node {array.get()}};
+    return cg_toml_table_array_new (static_cast<gconstpointer>(&d));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not append to CgTomlTableArray: %s", ba.what());
+    return nullptr;
+  } catch (cpptoml::parse_exception& e) {
+    g_warning ("Could not append to CgTomlTableArray: %s", e.what());
+    return nullptr;
+  }
+}
+
+CgTomlTableArray *
+cg_toml_table_array_extend (const CgTomlTableArray *self,
+    const CgTomlTable *const *tables, gsize n)
+{
+  g_return_val_if_fail (self, nullptr);
+  g_return_val_if_fail (tables || n == 0, nullptr);
+  for (gsize i = 0; i < n; i++)
+    g_return_val_if_fail (tables[i], nullptr);
+
+  try {
+    std::vector<std::shared_ptr<cpptoml::table>> values;
+    values.reserve (n);
+    for (gsize i = 0; i < n; i++)
+      values.push_back (std::static_pointer_cast<cpptoml::table>(
+          cg::toml::Thaw (table_data (tables[i]))));
+    std::shared_ptr<cpptoml::table_array> array = cg::toml::ExtendTables (
+        table_array_data (self), values);
+    const cg::toml::OwnedNode d {array, cg::toml::Node {array.get()}};
+    return cg_toml_table_array_new (static_cast<gconstpointer>(&d));
+  } catch (std::bad_alloc& ba) {
+    g_critical ("Could not append to CgTomlTableArray: %s", ba.what());
+    return nullptr;
+  } catch (cpptoml::parse_exception& e) {
+    g_warning ("Could not append to CgTomlTableArray: %s", e.what());
+    return nullptr;
+  }
+}
+
+void
+cg_toml_table_array_iter_init (CgTomlTableArrayIter *iter,
+    const CgTomlTableArray *array)
+{
+  table_array_iter_init (iter, table_array_data (array));
+}
+
+void
+cg_toml_table_array_iter_init_view (CgTomlTableArrayIter *iter,
+    const CgTomlTableArrayView *array)
+{
+  table_array_iter_init (iter, table_array_data (array));
+}
+
+gboolean
+cg_toml_table_array_iter_next (CgTomlTableArrayIter *iter,
+    CgTomlTableView *table)
+{
+  g_return_val_if_fail (iter, false);
+  const cg::toml::Node t = cg::toml::GetNth(
+      cg::toml::Node::FromData(iter->data), iter->index);
+  if (!t)
+    return false;
+  iter->index++;
+  if (table) {
+    *table = {};
+    table->data = t.ToData();
+  }
+  return true;
+}
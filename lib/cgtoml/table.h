@@ -10,10 +10,14 @@
 #define __CG_TOML_TABLE_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <stdint.h>
 
+#include "value.h"
 #include "array.h"
+#include "path.h"
+#include "schema.h"
 
 G_BEGIN_DECLS
 
@@ -31,6 +35,39 @@ CgTomlTableArray * cg_toml_table_array_ref (CgTomlTableArray * self);
 void cg_toml_table_array_unref (CgTomlTableArray * self);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlTableArray, cg_toml_table_array_unref)
 
+/* CgTomlTableView */
+typedef struct _CgTomlTableView CgTomlTableView;
+struct _CgTomlTableView {
+  /*< private >*/
+  gconstpointer data;
+  gpointer reserved[3];
+};
+
+/* CgTomlTableArrayView */
+typedef struct _CgTomlTableArrayView CgTomlTableArrayView;
+struct _CgTomlTableArrayView {
+  /*< private >*/
+  gconstpointer data;
+  gpointer reserved[3];
+};
+
+/* CgTomlTableIter */
+typedef struct _CgTomlTableIter CgTomlTableIter;
+struct _CgTomlTableIter {
+  /*< private >*/
+  gconstpointer data;
+  gpointer reserved[3];
+};
+
+/* CgTomlTableArrayIter */
+typedef struct _CgTomlTableArrayIter CgTomlTableArrayIter;
+struct _CgTomlTableArrayIter {
+  /*< private >*/
+  gconstpointer data;
+  gsize index;
+  gpointer reserved[2];
+};
+
 /* API */
 gboolean cg_toml_table_contains (const CgTomlTable *self, const char *key);
 gboolean cg_toml_table_get_boolean (const CgTomlTable *self, const char *key,
@@ -76,6 +113,10 @@ gboolean cg_toml_table_get_qualified_double (const CgTomlTable *self,
 char * cg_toml_table_get_string (const CgTomlTable *self, const char *key);
 char * cg_toml_table_get_qualified_string (const CgTomlTable *self,
     const char *key);
+const char * cg_toml_table_peek_string (const CgTomlTable *self,
+    const char *key, gsize *len);
+const char * cg_toml_table_peek_qualified_string (const CgTomlTable *self,
+    const char *key, gsize *len);
 CgTomlArray * cg_toml_table_get_array (const CgTomlTable *self, const char *key);
 CgTomlArray * cg_toml_table_get_qualified_array (const CgTomlTable *self,
     const char *key);
@@ -86,9 +127,293 @@ CgTomlTableArray *cg_toml_table_get_array_table (const CgTomlTable *self,
     const char *key);
 CgTomlTableArray *cg_toml_table_get_qualified_array_table (
     const CgTomlTable *self, const char *key);
+gboolean cg_toml_table_get_path_boolean (const CgTomlTable *self,
+    const CgTomlPath *path, gboolean *val);
+gboolean cg_toml_table_get_path_int8 (const CgTomlTable *self,
+    const CgTomlPath *path, int8_t *val);
+gboolean cg_toml_table_get_path_uint8 (const CgTomlTable *self,
+    const CgTomlPath *path, uint8_t *val);
+gboolean cg_toml_table_get_path_int16 (const CgTomlTable *self,
+    const CgTomlPath *path, int16_t *val);
+gboolean cg_toml_table_get_path_uint16 (const CgTomlTable *self,
+    const CgTomlPath *path, uint16_t *val);
+gboolean cg_toml_table_get_path_int32 (const CgTomlTable *self,
+    const CgTomlPath *path, int32_t *val);
+gboolean cg_toml_table_get_path_uint32 (const CgTomlTable *self,
+    const CgTomlPath *path, uint32_t *val);
+gboolean cg_toml_table_get_path_int64 (const CgTomlTable *self,
+    const CgTomlPath *path, int64_t *val);
+gboolean cg_toml_table_get_path_uint64 (const CgTomlTable *self,
+    const CgTomlPath *path, uint64_t *val);
+gboolean cg_toml_table_get_path_double (const CgTomlTable *self,
+    const CgTomlPath *path, double *val);
+char * cg_toml_table_get_path_string (const CgTomlTable *self,
+    const CgTomlPath *path);
+const char * cg_toml_table_peek_path_string (const CgTomlTable *self,
+    const CgTomlPath *path, gsize *len);
+CgTomlArray * cg_toml_table_get_path_array (const CgTomlTable *self,
+    const CgTomlPath *path);
+CgTomlTable * cg_toml_table_get_path_table (const CgTomlTable *self,
+    const CgTomlPath *path);
+CgTomlTableArray *cg_toml_table_get_path_array_table (const CgTomlTable *self,
+    const CgTomlPath *path);
 typedef void (*CgTomlTableArrayForEachFunc)(const CgTomlTable *, gpointer);
 void cg_toml_table_array_for_each (const CgTomlTableArray *self,
     CgTomlTableArrayForEachFunc func, gpointer uder_data);
+guint cg_toml_table_array_get_length (const CgTomlTableArray *self);
+CgTomlTable * cg_toml_table_array_get_nth (const CgTomlTableArray *self,
+    guint n);
+gboolean cg_toml_table_array_get_nth_view (const CgTomlTableArray *self,
+    guint n, CgTomlTableView *view);
+typedef void (*CgTomlTableArrayViewForEachFunc)(const CgTomlTableView *,
+    gpointer);
+void cg_toml_table_array_for_each_view (const CgTomlTableArray *self,
+    CgTomlTableArrayViewForEachFunc func, gpointer user_data);
+
+/* Views API */
+void cg_toml_table_get_view (const CgTomlTable *self, CgTomlTableView *view);
+void cg_toml_table_array_get_view (const CgTomlTableArray *self,
+    CgTomlTableArrayView *view);
+gboolean cg_toml_table_view_contains (const CgTomlTableView *self,
+    const char *key);
+gboolean cg_toml_table_view_get_boolean (const CgTomlTableView *self,
+    const char *key, gboolean *val);
+gboolean cg_toml_table_view_get_qualified_boolean (const CgTomlTableView *self,
+    const char *key, gboolean *val);
+gboolean cg_toml_table_view_get_int8 (const CgTomlTableView *self,
+    const char *key, int8_t *val);
+gboolean cg_toml_table_view_get_qualified_int8 (const CgTomlTableView *self,
+    const char *key, int8_t *val);
+gboolean cg_toml_table_view_get_uint8 (const CgTomlTableView *self,
+    const char *key, uint8_t *val);
+gboolean cg_toml_table_view_get_qualified_uint8 (const CgTomlTableView *self,
+    const char *key, uint8_t *val);
+gboolean cg_toml_table_view_get_int16 (const CgTomlTableView *self,
+    const char *key, int16_t *val);
+gboolean cg_toml_table_view_get_qualified_int16 (const CgTomlTableView *self,
+    const char *key, int16_t *val);
+gboolean cg_toml_table_view_get_uint16 (const CgTomlTableView *self,
+    const char *key, uint16_t *val);
+gboolean cg_toml_table_view_get_qualified_uint16 (const CgTomlTableView *self,
+    const char *key, uint16_t *val);
+gboolean cg_toml_table_view_get_int32 (const CgTomlTableView *self,
+    const char *key, int32_t *val);
+gboolean cg_toml_table_view_get_qualified_int32 (const CgTomlTableView *self,
+    const char *key, int32_t *val);
+gboolean cg_toml_table_view_get_uint32 (const CgTomlTableView *self,
+    const char *key, uint32_t *val);
+gboolean cg_toml_table_view_get_qualified_uint32 (const CgTomlTableView *self,
+    const char *key, uint32_t *val);
+gboolean cg_toml_table_view_get_int64 (const CgTomlTableView *self,
+    const char *key, int64_t *val);
+gboolean cg_toml_table_view_get_qualified_int64 (const CgTomlTableView *self,
+    const char *key, int64_t *val);
+gboolean cg_toml_table_view_get_uint64 (const CgTomlTableView *self,
+    const char *key, uint64_t *val);
+gboolean cg_toml_table_view_get_qualified_uint64 (const CgTomlTableView *self,
+    const char *key, uint64_t *val);
+gboolean cg_toml_table_view_get_double (const CgTomlTableView *self,
+    const char *key, double *val);
+gboolean cg_toml_table_view_get_qualified_double (const CgTomlTableView *self,
+    const char *key, double *val);
+char * cg_toml_table_view_get_string (const CgTomlTableView *self,
+    const char *key);
+char * cg_toml_table_view_get_qualified_string (const CgTomlTableView *self,
+    const char *key);
+const char * cg_toml_table_view_peek_string (const CgTomlTableView *self,
+    const char *key, gsize *len);
+const char * cg_toml_table_view_peek_qualified_string (
+    const CgTomlTableView *self, const char *key, gsize *len);
+gboolean cg_toml_table_view_get_array (const CgTomlTableView *self,
+    const char *key, CgTomlArrayView *array);
+gboolean cg_toml_table_view_get_qualified_array (const CgTomlTableView *self,
+    const char *key, CgTomlArrayView *array);
+gboolean cg_toml_table_view_get_table (const CgTomlTableView *self,
+    const char *key, CgTomlTableView *table);
+gboolean cg_toml_table_view_get_qualified_table (const CgTomlTableView *self,
+    const char *key, CgTomlTableView *table);
+gboolean cg_toml_table_view_get_array_table (const CgTomlTableView *self,
+    const char *key, CgTomlTableArrayView *array_table);
+gboolean cg_toml_table_view_get_qualified_array_table (
+    const CgTomlTableView *self, const char *key,
+    CgTomlTableArrayView *array_table);
+gboolean cg_toml_table_view_get_path_boolean (const CgTomlTableView *self,
+    const CgTomlPath *path, gboolean *val);
+gboolean cg_toml_table_view_get_path_int8 (const CgTomlTableView *self,
+    const CgTomlPath *path, int8_t *val);
+gboolean cg_toml_table_view_get_path_uint8 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint8_t *val);
+gboolean cg_toml_table_view_get_path_int16 (const CgTomlTableView *self,
+    const CgTomlPath *path, int16_t *val);
+gboolean cg_toml_table_view_get_path_uint16 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint16_t *val);
+gboolean cg_toml_table_view_get_path_int32 (const CgTomlTableView *self,
+    const CgTomlPath *path, int32_t *val);
+gboolean cg_toml_table_view_get_path_uint32 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint32_t *val);
+gboolean cg_toml_table_view_get_path_int64 (const CgTomlTableView *self,
+    const CgTomlPath *path, int64_t *val);
+gboolean cg_toml_table_view_get_path_uint64 (const CgTomlTableView *self,
+    const CgTomlPath *path, uint64_t *val);
+gboolean cg_toml_table_view_get_path_double (const CgTomlTableView *self,
+    const CgTomlPath *path, double *val);
+char * cg_toml_table_view_get_path_string (const CgTomlTableView *self,
+    const CgTomlPath *path);
+const char * cg_toml_table_view_peek_path_string (const CgTomlTableView *self,
+    const CgTomlPath *path, gsize *len);
+gboolean cg_toml_table_view_get_path_array (const CgTomlTableView *self,
+    const CgTomlPath *path, CgTomlArrayView *array);
+gboolean cg_toml_table_view_get_path_table (const CgTomlTableView *self,
+    const CgTomlPath *path, CgTomlTableView *table);
+gboolean cg_toml_table_view_get_path_array_table (const CgTomlTableView *self,
+    const CgTomlPath *path, CgTomlTableArrayView *array_table);
+void cg_toml_table_array_view_for_each (const CgTomlTableArrayView *self,
+    CgTomlTableArrayViewForEachFunc func, gpointer user_data);
+guint cg_toml_table_array_view_get_length (const CgTomlTableArrayView *self);
+gboolean cg_toml_table_array_view_get_nth (const CgTomlTableArrayView *self,
+    guint n, CgTomlTableView *view);
+gboolean cg_toml_value_view_get_table (const CgTomlValueView *self,
+    CgTomlTableView *table);
+gboolean cg_toml_value_view_get_array_table (const CgTomlValueView *self,
+    CgTomlTableArrayView *array_table);
+
+/* Decoding API, every key of the schema is stored in a struct in a single
+ * pass over the table. Optional fields missing from the table get their
+ * default, a missing required field or a value of the wrong type fails the
+ * whole decoding and leaves no string allocated. The strings of a decoded
+ * struct are freed with cg_toml_schema_clear(). Table arrays are decoded
+ * into a newly allocated array of contiguous structs, freed with
+ * cg_toml_schema_free_array() */
+gboolean cg_toml_table_decode (const CgTomlTable *self,
+    const CgTomlSchema *schema, gpointer dst, GError **error);
+gboolean cg_toml_table_view_decode (const CgTomlTableView *self,
+    const CgTomlSchema *schema, gpointer dst, GError **error);
+gpointer cg_toml_table_array_decode (const CgTomlTableArray *self,
+    const CgTomlSchema *schema, guint *n_elements, GError **error);
+
+/* Batched API, looks up many keys, optionally dotted, at once. Keys under
+ * the same table are matched against its entries in a single pass. The
+ * value of each query is stored in its destination, of the C type given by
+ * the field type, or its default if the key is missing or has another type.
+ * Bit i of the optional bitmap, of CG_TOML_QUERY_BITMAP_SIZE(n) words, is
+ * set if query i was found. Returns whether every query was found */
+typedef struct _CgTomlQuery CgTomlQuery;
+struct _CgTomlQuery {
+  const char *key;
+  CgTomlFieldType type;
+  gpointer dst;
+  CgTomlFieldDefault default_value;
+};
+#define CG_TOML_QUERY_BITMAP_SIZE(n) (((n) + 63) / 64)
+#define CG_TOML_QUERY_FOUND(bitmap, i) \
+    ((((bitmap)[(i) / 64]) >> ((i) % 64)) & 1)
+gboolean cg_toml_table_get_many (const CgTomlTable *self,
+    const CgTomlQuery *queries, gsize n, guint64 *found);
+gboolean cg_toml_table_view_get_many (const CgTomlTableView *self,
+    const CgTomlQuery *queries, gsize n, guint64 *found);
+
+/* Diff API, the keys are qualified, sorted and NULL terminated. Tables
+ * found in both are compared key by key, any other value as a whole.
+ * Subtrees of two compact documents with the same content hash are skipped
+ * without being walked. Fails with CG_TOML_ERROR_PARSE if a lazy document
+ * has an invalid section */
+typedef struct _CgTomlTableDiff CgTomlTableDiff;
+struct _CgTomlTableDiff {
+  char **added;
+  char **removed;
+  char **modified;
+};
+CgTomlTableDiff * cg_toml_table_diff (const CgTomlTable *old_table,
+    const CgTomlTable *new_table, GError **error);
+void cg_toml_table_diff_free (CgTomlTableDiff *self);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CgTomlTableDiff, cg_toml_table_diff_free)
+
+/* Write API, writes a table as a TOML document, in chunks large enough to
+ * keep the number of writes low. Numbers are written with the fewest
+ * digits that parse back to the same value, independently of the locale.
+ * The entries of a table are written in no particular order. A lazy
+ * document with an invalid section fails with CG_TOML_ERROR_PARSE before
+ * anything is written, the string variant warns and leaves it as it is */
+gboolean cg_toml_table_write (const CgTomlTable *self, GOutputStream *stream,
+    GCancellable *cancellable, GError **error);
+gboolean cg_toml_table_write_fd (const CgTomlTable *self, int fd,
+    GError **error);
+void cg_toml_table_write_string (const CgTomlTable *self, GString *string);
+
+/* Variant API, a table is an a{sv} dictionary, as sent over D-Bus. Tables
+ * nested in it are a{sv} as well, arrays are av, arrays of tables aa{sv},
+ * and dates and times are strings as written in TOML. The variant is laid
+ * out in a single buffer and returned floating. Reading one back accepts
+ * any dictionary with string keys, integers of any size and arrays of any
+ * type whose elements have a TOML counterpart. A lazy document with an
+ * invalid section fails with CG_TOML_ERROR_PARSE */
+GVariant * cg_toml_table_to_variant (const CgTomlTable *self,
+    GError **error);
+CgTomlTable * cg_toml_table_new_from_variant (GVariant *variant,
+    GError **error);
+
+/* Builder API, tables and arrays of tables are immutable so a change gives
+ * a new one, or NULL if a key along a dotted path holds something else
+ * than a table. Everything off the path of the change is shared with the
+ * original, which is left as it was for whoever still reads it. The first
+ * change of a compact or lazy document deep-copies the whole document into
+ * a tree, parsing every section of a lazy one, so keep changing the result
+ * rather than the original. A lazy document with an invalid section gives
+ * NULL and a warning, as its copy would miss the keys of that section.
+ * Removing a missing key gives a new reference on the original, except on
+ * a lazy document. Every append copies the list of tables of the array, so
+ * build large ones with cg_toml_table_array_extend() */
+CgTomlTable * cg_toml_table_new_empty (void);
+CgTomlTable * cg_toml_table_set_boolean (const CgTomlTable *self,
+    const char *key, gboolean val);
+CgTomlTable * cg_toml_table_set_qualified_boolean (const CgTomlTable *self,
+    const char *key, gboolean val);
+CgTomlTable * cg_toml_table_set_int64 (const CgTomlTable *self,
+    const char *key, int64_t val);
+CgTomlTable * cg_toml_table_set_qualified_int64 (const CgTomlTable *self,
+    const char *key, int64_t val);
+CgTomlTable * cg_toml_table_set_double (const CgTomlTable *self,
+    const char *key, double val);
+CgTomlTable * cg_toml_table_set_qualified_double (const CgTomlTable *self,
+    const char *key, double val);
+CgTomlTable * cg_toml_table_set_string (const CgTomlTable *self,
+    const char *key, const char *val);
+CgTomlTable * cg_toml_table_set_qualified_string (const CgTomlTable *self,
+    const char *key, const char *val);
+CgTomlTable * cg_toml_table_set_array (const CgTomlTable *self,
+    const char *key, const CgTomlArray *val);
+CgTomlTable * cg_toml_table_set_qualified_array (const CgTomlTable *self,
+    const char *key, const CgTomlArray *val);
+CgTomlTable * cg_toml_table_set_table (const CgTomlTable *self,
+    const char *key, const CgTomlTable *val);
+CgTomlTable * cg_toml_table_set_qualified_table (const CgTomlTable *self,
+    const char *key, const CgTomlTable *val);
+CgTomlTable * cg_toml_table_set_array_table (const CgTomlTable *self,
+    const char *key, const CgTomlTableArray *val);
+CgTomlTable * cg_toml_table_set_qualified_array_table (
+    const CgTomlTable *self, const char *key, const CgTomlTableArray *val);
+CgTomlTable * cg_toml_table_remove (const CgTomlTable *self,
+    const char *key);
+CgTomlTable * cg_toml_table_remove_qualified (const CgTomlTable *self,
+    const char *key);
+CgTomlTableArray * cg_toml_table_array_new_empty (void);
+CgTomlTableArray * cg_toml_table_array_append (const CgTomlTableArray *self,
+    const CgTomlTable *table);
+CgTomlTableArray * cg_toml_table_array_extend (const CgTomlTableArray *self,
+    const CgTomlTable *const *tables, gsize n);
+
+/* Iterators API */
+void cg_toml_table_iter_init (CgTomlTableIter *iter, const CgTomlTable *table);
+void cg_toml_table_iter_init_view (CgTomlTableIter *iter,
+    const CgTomlTableView *table);
+gboolean cg_toml_table_iter_next (CgTomlTableIter *iter, const char **key,
+    CgTomlValueView *value);
+void cg_toml_table_array_iter_init (CgTomlTableArrayIter *iter,
+    const CgTomlTableArray *array);
+void cg_toml_table_array_iter_init_view (CgTomlTableArrayIter *iter,
+    const CgTomlTableArrayView *array);
+gboolean cg_toml_table_array_iter_next (CgTomlTableArrayIter *iter,
+    CgTomlTableView *table);
 
 G_END_DECLS
 
@@ -0,0 +1,58 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* TOML */
+#include "private.h"
+#include "node.h"
+#include "value.h"
+
+static inline cg::toml::Node
+value_data (const CgTomlValueView *self)
+{
+  return cg::toml::Node::FromData(self->data);
+}
+
+CgTomlValueType
+cg_toml_value_view_get_value_type (const CgTomlValueView *self)
+{
+  return cg::toml::GetValueType(value_data (self));
+}
+
+gboolean
+cg_toml_value_view_get_boolean (const CgTomlValueView *self, gboolean *val)
+{
+  g_return_val_if_fail (val, false);
+  bool v;
+  if (!cg::toml::GetValue(value_data (self), &v))
+    return false;
+  *val = v ? TRUE : FALSE;
+  return true;
+}
+
+gboolean
+cg_toml_value_view_get_int64 (const CgTomlValueView *self, int64_t *val)
+{
+  g_return_val_if_fail (val, false);
+  return cg::toml::GetValue(value_data (self), val);
+}
+
+gboolean
+cg_toml_value_view_get_double (const CgTomlValueView *self, double *val)
+{
+  g_return_val_if_fail (val, false);
+  return cg::toml::GetValue(value_data (self), val);
+}
+
+const char *
+cg_toml_value_view_peek_string (const CgTomlValueView *self, gsize *len)
+{
+  return cg::toml::GetString(value_data (self), len);
+}
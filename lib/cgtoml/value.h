@@ -0,0 +1,56 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_VALUE_H__
+#define __CG_TOML_VALUE_H__
+
+#include <glib-object.h>
+
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* CgTomlValueType */
+typedef enum {
+  CG_TOML_VALUE_TYPE_NONE,
+  CG_TOML_VALUE_TYPE_BOOLEAN,
+  CG_TOML_VALUE_TYPE_INT64,
+  CG_TOML_VALUE_TYPE_DOUBLE,
+  CG_TOML_VALUE_TYPE_STRING,
+  CG_TOML_VALUE_TYPE_LOCAL_DATE,
+  CG_TOML_VALUE_TYPE_LOCAL_TIME,
+  CG_TOML_VALUE_TYPE_LOCAL_DATETIME,
+  CG_TOML_VALUE_TYPE_OFFSET_DATETIME,
+  CG_TOML_VALUE_TYPE_ARRAY,
+  CG_TOML_VALUE_TYPE_TABLE,
+  CG_TOML_VALUE_TYPE_TABLE_ARRAY,
+} CgTomlValueType;
+
+/* CgTomlValueView */
+typedef struct _CgTomlValueView CgTomlValueView;
+struct _CgTomlValueView {
+  /*< private >*/
+  gconstpointer data;
+  gpointer reserved[3];
+};
+
+/* API */
+CgTomlValueType cg_toml_value_view_get_value_type (
+    const CgTomlValueView *self);
+gboolean cg_toml_value_view_get_boolean (const CgTomlValueView *self,
+    gboolean *val);
+gboolean cg_toml_value_view_get_int64 (const CgTomlValueView *self,
+    int64_t *val);
+gboolean cg_toml_value_view_get_double (const CgTomlValueView *self,
+    double *val);
+const char * cg_toml_value_view_peek_string (const CgTomlValueView *self,
+    gsize *len);
+
+G_END_DECLS
+
+#endif
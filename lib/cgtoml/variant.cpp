@@ -0,0 +1,460 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* TOML */
+#include "writer.h"
+#include "error.h"
+#include "variant.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* The alignment of the containers and variants of the layout, as they all
+ * hold variants. Scalars only appear inside variants so they are aligned
+ * as well */
+constexpr gsize ALIGNMENT = 8;
+
+/* Aligns an offset */
+inline gsize Align(gsize offset) {
+  return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+/* Gets the size of a container, its framing offsets are as large as needed
+ * to point anywhere in the whole container */
+gsize GetTotalSize(gsize body, gsize n_offsets) {
+  if (body + n_offsets <= G_MAXUINT8)
+    return body + n_offsets;
+  if (body + 2 * n_offsets <= G_MAXUINT16)
+    return body + 2 * n_offsets;
+  if (body + 4 * n_offsets <= G_MAXUINT32)
+    return body + 4 * n_offsets;
+  return body + 8 * n_offsets;
+}
+
+/* Gets the size of the framing offsets of a container */
+gsize GetOffsetSize(gsize size) {
+  if (size > G_MAXUINT32)
+    return 8;
+  if (size > G_MAXUINT16)
+    return 4;
+  if (size > G_MAXUINT8)
+    return 2;
+  return size > 0 ? 1 : 0;
+}
+
+/* Writes a framing offset, they are little endian */
+inline void WriteOffset(guint8 *p, gsize offset, gsize size) {
+  for (gsize i = 0; i < size; i++)
+    p[i] = static_cast<guint64>(offset) >> (8 * i);
+}
+
+/* Gets the type string of a value, dates and times are strings */
+const char *GetTypeString(CgTomlValueType type) {
+  switch (type) {
+    case CG_TOML_VALUE_TYPE_BOOLEAN:
+      return "b";
+    case CG_TOML_VALUE_TYPE_INT64:
+      return "x";
+    case CG_TOML_VALUE_TYPE_DOUBLE:
+      return "d";
+    case CG_TOML_VALUE_TYPE_ARRAY:
+      return "av";
+    case CG_TOML_VALUE_TYPE_TABLE:
+      return "a{sv}";
+    case CG_TOML_VALUE_TYPE_TABLE_ARRAY:
+      return "aa{sv}";
+    default:
+      return "s";
+  }
+}
+
+/* Gets the length of a string up to any NUL, as seen from the C API */
+inline gsize GetTextLength(const char *str, gsize len) {
+  const char *nul = static_cast<const char *>(std::memchr(str, '\0', len));
+  return nul ? nul - str : len;
+}
+
+/* The VariantWriter class, sizes the layout of a table in a first pass
+ * and writes it in a second one. The sizes of the containers are kept in
+ * the order they are visited, which is the same in both passes */
+class VariantWriter {
+ public:
+  /* Constructor */
+  VariantWriter() :
+      buffer_(nullptr),
+      next_(0) {
+  }
+
+  /* Destructor */
+  virtual ~VariantWriter() {
+  }
+
+  /* Sizes the layout of a table */
+  gsize Size(Node table) {
+    return SizeValue(table, CG_TOML_VALUE_TYPE_TABLE);
+  }
+
+  /* Writes the layout of a table into a zeroed buffer of the size found */
+  void Write(Node table, guint8 *buffer) {
+    buffer_ = buffer;
+    next_ = 0;
+    WriteValue(table, CG_TOML_VALUE_TYPE_TABLE, 0);
+  }
+
+ private:
+  /* The size of a container and its number of framing offsets */
+  struct Frame {
+    gsize size;
+    gsize n_offsets;
+  };
+
+  /* Sizes a value */
+  gsize SizeValue(Node value, CgTomlValueType type) {
+    switch (type) {
+      case CG_TOML_VALUE_TYPE_BOOLEAN:
+        return 1;
+      case CG_TOML_VALUE_TYPE_INT64:
+      case CG_TOML_VALUE_TYPE_DOUBLE:
+        return 8;
+      case CG_TOML_VALUE_TYPE_STRING: {
+        gsize len = 0;
+        const char *str = GetString(value, &len);
+        return GetTextLength(str, len) + 1;
+      }
+      case CG_TOML_VALUE_TYPE_TABLE: {
+        const gsize frame = Push();
+        gsize body = 0;
+        gsize n = 0;
+        ForEachEntry(value, [&](const char *key, gsize len, Node v) {
+          const CgTomlValueType t = GetValueType(v);
+          if (t == CG_TOML_VALUE_TYPE_NONE)
+            return true;
+          body = Align(body) + SizeEntry(key, len, v, t);
+          n++;
+          return true;
+        });
+        return Pop(frame, body, n);
+      }
+      case CG_TOML_VALUE_TYPE_ARRAY:
+      case CG_TOML_VALUE_TYPE_TABLE_ARRAY: {
+        const gsize frame = Push();
+        gsize body = 0;
+        gsize n = 0;
+        ForEachElement(value, [&](Node element) {
+          if (type == CG_TOML_VALUE_TYPE_ARRAY)
+            body = Align(body) + SizeVariant(element, GetValueType(element));
+          else
+            body = Align(body) + SizeValue(element, CG_TOML_VALUE_TYPE_TABLE);
+          n++;
+          return true;
+        });
+        return Pop(frame, body, n);
+      }
+      default:
+        return FormatValue(value).size() + 1;
+    }
+  }
+
+  /* Sizes a dictionary entry, the end of its key is framed */
+  gsize SizeEntry(const char *key, gsize len, Node value,
+      CgTomlValueType type) {
+    const gsize frame = Push();
+    const gsize body = Align(GetTextLength(key, len) + 1) +
+        SizeVariant(value, type);
+    return Pop(frame, body, 1);
+  }
+
+  /* Sizes a variant, the value is followed by a NUL and its type */
+  gsize SizeVariant(Node value, CgTomlValueType type) {
+    return SizeValue(value, type) + 1 + std::strlen(GetTypeString(type));
+  }
+
+  /* Adds the frame of a container before sizing its children */
+  gsize Push() {
+    frames_.push_back({0, 0});
+    return frames_.size() - 1;
+  }
+
+  /* Sets the frame of a container once its children are sized */
+  gsize Pop(gsize frame, gsize body, gsize n_offsets) {
+    frames_[frame] = {GetTotalSize(body, n_offsets), n_offsets};
+    return frames_[frame].size;
+  }
+
+  /* Writes a value at an offset, returns where it ends */
+  gsize WriteValue(Node value, CgTomlValueType type, gsize pos) {
+    switch (type) {
+      case CG_TOML_VALUE_TYPE_BOOLEAN: {
+        bool b = false;
+        GetValue(value, &b);
+        buffer_[pos] = b;
+        return pos + 1;
+      }
+      case CG_TOML_VALUE_TYPE_INT64: {
+        int64_t i = 0;
+        GetInteger(value, &i);
+        std::memcpy(buffer_ + pos, &i, sizeof (i));
+        return pos + sizeof (i);
+      }
+      case CG_TOML_VALUE_TYPE_DOUBLE: {
+        double d = 0;
+        GetValue(value, &d);
+        std::memcpy(buffer_ + pos, &d, sizeof (d));
+        return pos + sizeof (d);
+      }
+      case CG_TOML_VALUE_TYPE_STRING: {
+        gsize len = 0;
+        const char *str = GetString(value, &len);
+        len = GetTextLength(str, len);
+        std::memcpy(buffer_ + pos, str, len);
+        return pos + len + 1;
+      }
+      case CG_TOML_VALUE_TYPE_TABLE: {
+        const Frame frame = frames_[next_++];
+        const gsize osize = GetOffsetSize(frame.size);
+        const gsize start = pos;
+        guint8 *offsets = buffer_ + start + frame.size -
+            frame.n_offsets * osize;
+        ForEachEntry(value, [&](const char *key, gsize len, Node v) {
+          const CgTomlValueType t = GetValueType(v);
+          if (t == CG_TOML_VALUE_TYPE_NONE)
+            return true;
+          pos = WriteEntry(key, len, v, t, Align(pos));
+          WriteOffset(offsets, pos - start, osize);
+          offsets += osize;
+          return true;
+        });
+        return start + frame.size;
+      }
+      case CG_TOML_VALUE_TYPE_ARRAY:
+      case CG_TOML_VALUE_TYPE_TABLE_ARRAY: {
+        const Frame frame = frames_[next_++];
+        const gsize osize = GetOffsetSize(frame.size);
+        const gsize start = pos;
+        guint8 *offsets = buffer_ + start + frame.size -
+            frame.n_offsets * osize;
+        ForEachElement(value, [&](Node element) {
+          if (type == CG_TOML_VALUE_TYPE_ARRAY)
+            pos = WriteVariant(element, GetValueType(element), Align(pos));
+          else
+            pos = WriteValue(element, CG_TOML_VALUE_TYPE_TABLE, Align(pos));
+          WriteOffset(offsets, pos - start, osize);
+          offsets += osize;
+          return true;
+        });
+        return start + frame.size;
+      }
+      default: {
+        const std::string text = FormatValue(value);
+        std::memcpy(buffer_ + pos, text.data(), text.size());
+        return pos + text.size() + 1;
+      }
+    }
+  }
+
+  /* Writes a dictionary entry */
+  gsize WriteEntry(const char *key, gsize len, Node value,
+      CgTomlValueType type, gsize pos) {
+    const Frame frame = frames_[next_++];
+    const gsize osize = GetOffsetSize(frame.size);
+    const gsize key_end = GetTextLength(key, len) + 1;
+    std::memcpy(buffer_ + pos, key, key_end - 1);
+    WriteVariant(value, type, pos + Align(key_end));
+    WriteOffset(buffer_ + pos + frame.size - osize, key_end, osize);
+    return pos + frame.size;
+  }
+
+  /* Writes a variant */
+  gsize WriteVariant(Node value, CgTomlValueType type, gsize pos) {
+    const char *type_string = GetTypeString(type);
+    const gsize type_len = std::strlen(type_string);
+    pos = WriteValue(value, type, pos) + 1;
+    std::memcpy(buffer_ + pos, type_string, type_len);
+    return pos + type_len;
+  }
+
+  /* Copy Constructor */
+  VariantWriter(const VariantWriter&) = delete;
+
+  /* Move Constructor */
+  VariantWriter(VariantWriter &&) = delete;
+
+  /* Copy-Assign Constructor */
+  VariantWriter& operator=(const VariantWriter&) = delete;
+
+  /* Move-Assign Constructr */
+  VariantWriter& operator=(VariantWriter &&) = delete;
+
+ private:
+  /* The buffer being written */
+  guint8 *buffer_;
+
+  /* The frames of the containers in the order they are visited */
+  std::vector<Frame> frames_;
+
+  /* The next frame to write */
+  gsize next_;
+};
+
+/* Checks whether a type is a dictionary with string keys */
+inline bool IsDictionary(const char *type_string) {
+  return std::strncmp(type_string, "a{s", 3) == 0;
+}
+
+/* Reports a value that has no TOML counterpart */
+void Unsupported(GVariant *value, const std::string& key, GError **error) {
+  g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+      "Value of '%s' has unsupported type '%s'", key.c_str(),
+      g_variant_get_type_string(value));
+}
+
+std::shared_ptr<cpptoml::base> Convert(GVariant *value,
+    const std::string& key, GError **error);
+
+/* Converts a dictionary into a table */
+std::shared_ptr<cpptoml::table> ConvertTable(GVariant *value,
+    const std::string& key, GError **error) {
+  std::shared_ptr<cpptoml::table> res = cpptoml::make_table();
+  const gsize n = g_variant_n_children(value);
+  for (gsize i = 0; i < n; i++) {
+    g_autoptr (GVariant) entry = g_variant_get_child_value(value, i);
+    g_autoptr (GVariant) k = g_variant_get_child_value(entry, 0);
+    g_autoptr (GVariant) v = g_variant_get_child_value(entry, 1);
+    const char *name = g_variant_get_string(k, nullptr);
+    std::shared_ptr<cpptoml::base> converted = Convert(v,
+        key.empty() ? std::string {name} : key + "." + name, error);
+    if (!converted)
+      return nullptr;
+    res->insert(name, converted);
+  }
+  return res;
+}
+
+/* Converts an array into an array or, if it holds dictionaries, into an
+ * array of tables. The elements must all have the same type */
+std::shared_ptr<cpptoml::base> ConvertArray(GVariant *value,
+    const std::string& key, GError **error) {
+  std::vector<std::shared_ptr<cpptoml::base>> elements;
+  const gsize n = g_variant_n_children(value);
+  for (gsize i = 0; i < n; i++) {
+    g_autoptr (GVariant) child = g_variant_get_child_value(value, i);
+    std::shared_ptr<cpptoml::base> converted = Convert(child, key, error);
+    if (!converted)
+      return nullptr;
+    if (!elements.empty() && GetValueType(Node {converted.get()}) !=
+        GetValueType(Node {elements[0].get()})) {
+      g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+          "Elements of '%s' are not all of the same type", key.c_str());
+      return nullptr;
+    }
+    elements.push_back(std::move(converted));
+  }
+
+  if (elements.empty() ? IsDictionary(g_variant_get_type_string(value) + 1) :
+      elements[0]->is_table()) {
+    std::shared_ptr<cpptoml::table_array> res = cpptoml::make_table_array();
+    for (const auto& e : elements)
+      res->get().push_back(std::static_pointer_cast<cpptoml::table>(e));
+    return res;
+  }
+  std::shared_ptr<cpptoml::array> res = cpptoml::make_array();
+  res->get() = std::move(elements);
+  return res;
+}
+
+/* Converts a value, integers of any size become 64-bit ones and object
+ * paths and signatures become strings */
+std::shared_ptr<cpptoml::base> Convert(GVariant *value,
+    const std::string& key, GError **error) {
+  switch (g_variant_classify(value)) {
+    case G_VARIANT_CLASS_BOOLEAN:
+      return cpptoml::make_value<bool>(g_variant_get_boolean(value) != FALSE);
+    case G_VARIANT_CLASS_BYTE:
+      return cpptoml::make_value<int64_t>(g_variant_get_byte(value));
+    case G_VARIANT_CLASS_INT16:
+      return cpptoml::make_value<int64_t>(g_variant_get_int16(value));
+    case G_VARIANT_CLASS_UINT16:
+      return cpptoml::make_value<int64_t>(g_variant_get_uint16(value));
+    case G_VARIANT_CLASS_INT32:
+      return cpptoml::make_value<int64_t>(g_variant_get_int32(value));
+    case G_VARIANT_CLASS_UINT32:
+      return cpptoml::make_value<int64_t>(g_variant_get_uint32(value));
+    case G_VARIANT_CLASS_INT64:
+      return cpptoml::make_value<int64_t>(g_variant_get_int64(value));
+    case G_VARIANT_CLASS_UINT64: {
+      const guint64 u = g_variant_get_uint64(value);
+      if (u > G_MAXINT64) {
+        g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+            "Value of '%s' is out of range", key.c_str());
+        return nullptr;
+      }
+      return cpptoml::make_value<int64_t>(u);
+    }
+    case G_VARIANT_CLASS_DOUBLE:
+      return cpptoml::make_value<double>(g_variant_get_double(value));
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+      return cpptoml::make_value<std::string>(
+          g_variant_get_string(value, nullptr));
+    case G_VARIANT_CLASS_VARIANT: {
+      g_autoptr (GVariant) child = g_variant_get_variant(value);
+      return Convert(child, key, error);
+    }
+    case G_VARIANT_CLASS_ARRAY:
+      if (IsDictionary(g_variant_get_type_string(value)))
+        return ConvertTable(value, key, error);
+      return ConvertArray(value, key, error);
+    default:
+      Unsupported(value, key, error);
+      return nullptr;
+  }
+}
+
+}  /* namespace */
+
+GVariant *
+ToVariant(Node table, GError **error)
+{
+  /* Lazy documents are only found at the root, an invalid section would be
+   * left out of the layout */
+  if (const LazyDocument *l = table.GetLazy()) {
+    if (!l->Check(nullptr, error))
+      return nullptr;
+  }
+
+  VariantWriter writer;
+  const gsize size = writer.Size(table);
+  g_autofree guint8 *data = static_cast<guint8 *>(g_malloc0(size));
+  writer.Write(table, data);
+  const guint8 *bytes = data;
+  return g_variant_new_from_data(G_VARIANT_TYPE_VARDICT, bytes, size, TRUE,
+      g_free, g_steal_pointer(&data));
+}
+
+std::shared_ptr<cpptoml::table>
+FromVariant(GVariant *variant, GError **error)
+{
+  if (!IsDictionary(g_variant_get_type_string(variant))) {
+    g_set_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH,
+        "Variant of type '%s' is not a dictionary with string keys",
+        g_variant_get_type_string(variant));
+    return nullptr;
+  }
+  return ConvertTable(variant, std::string {}, error);
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
@@ -0,0 +1,38 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_VARIANT_H__
+#define __CG_TOML_VARIANT_H__
+
+/* C++ STL */
+#include <memory>
+
+/* CPPTOML */
+#include <include/cpptoml.h>
+
+/* TOML */
+#include "node.h"
+
+namespace cg {
+namespace toml {
+
+/* Serializes a table as an a{sv} variant. The whole layout is sized in a
+ * first pass and then written into a single buffer in normal form, which
+ * the variant takes over without copying nor checking it. Returns nullptr
+ * if the table is a lazy document with an invalid section */
+GVariant *ToVariant(Node table, GError **error);
+
+/* Builds a table out of a dictionary variant with string keys. Returns
+ * nullptr if a value has no TOML counterpart */
+std::shared_ptr<cpptoml::table> FromVariant(GVariant *variant,
+    GError **error);
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
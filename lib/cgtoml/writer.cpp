@@ -0,0 +1,466 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* C++ STL */
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+/* TOML */
+#include "number.h"
+#include "writer.h"
+
+namespace cg {
+namespace toml {
+
+namespace {
+
+/* The size of the chunks given to the write function */
+constexpr gsize CHUNK_SIZE = 256 * 1024;
+
+/* The size of the chunks used to format a single value */
+constexpr gsize VALUE_CHUNK_SIZE = 256;
+
+/* The largest text of a date and time */
+constexpr gsize MAX_DATETIME_LENGTH = 48;
+
+/* Checks whether a byte of a string must be escaped */
+inline bool NeedsEscape(char c) {
+  return static_cast<guchar>(c) < 0x20 || c == '"' || c == '\\' ||
+      c == 0x7f;
+}
+
+/* Checks whether a key can be written without quotes */
+bool IsBareKey(const char *key, gsize len) {
+  if (len == 0)
+    return false;
+  for (gsize i = 0; i < len; i++) {
+    if (!g_ascii_isalnum(key[i]) && key[i] != '_' && key[i] != '-')
+      return false;
+  }
+  return true;
+}
+
+/* Calls the given callable with the runs of a string as a quoted basic
+ * string, the bytes that need no escaping are passed on in bulk */
+template <typename F>
+void Escape(const char *str, gsize len, F append) {
+  static const char HEX[] = "0123456789ABCDEF";
+  const char *end = str + len;
+  append("\"", 1);
+  while (str < end) {
+    const char *run = str;
+    while (str < end && !NeedsEscape(*str))
+      str++;
+    if (str > run)
+      append(run, str - run);
+    if (str == end)
+      break;
+
+    char escape[6] = {'\\', 0};
+    gsize escape_len = 2;
+    switch (*str) {
+      case '\b': escape[1] = 'b'; break;
+      case '\t': escape[1] = 't'; break;
+      case '\n': escape[1] = 'n'; break;
+      case '\f': escape[1] = 'f'; break;
+      case '\r': escape[1] = 'r'; break;
+      case '"': escape[1] = '"'; break;
+      case '\\': escape[1] = '\\'; break;
+      default:
+        escape[1] = 'u';
+        escape[2] = '0';
+        escape[3] = '0';
+        escape[4] = HEX[static_cast<guchar>(*str) >> 4];
+        escape[5] = HEX[static_cast<guchar>(*str) & 0xf];
+        escape_len = 6;
+        break;
+    }
+    append(escape, escape_len);
+    str++;
+  }
+  append("\"", 1);
+}
+
+/* Writes a number with the given number of digits, padded with zeros */
+char *FormatPadded(char *p, gint value, gint width) {
+  for (gint i = width - 1; i >= 0; i--) {
+    p[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  return p + width;
+}
+
+/* Formats a date or time and returns its length */
+gsize FormatDatetime(CgTomlValueType type, const dom::Datetime& d,
+    char *buffer) {
+  char *p = buffer;
+  if (type != CG_TOML_VALUE_TYPE_LOCAL_TIME) {
+    p = FormatPadded(p, d.year, 4);
+    *p++ = '-';
+    p = FormatPadded(p, d.month, 2);
+    *p++ = '-';
+    p = FormatPadded(p, d.day, 2);
+    if (type == CG_TOML_VALUE_TYPE_LOCAL_DATE)
+      return p - buffer;
+    *p++ = 'T';
+  }
+  p = FormatPadded(p, d.hour, 2);
+  *p++ = ':';
+  p = FormatPadded(p, d.minute, 2);
+  *p++ = ':';
+  p = FormatPadded(p, d.second, 2);
+  if (d.microsecond > 0) {
+    *p++ = '.';
+    p = FormatPadded(p, d.microsecond, 6);
+    while (p[-1] == '0')
+      p--;
+  }
+  if (type == CG_TOML_VALUE_TYPE_OFFSET_DATETIME) {
+    if (d.hour_offset == 0 && d.minute_offset == 0) {
+      *p++ = 'Z';
+    } else {
+      *p++ = d.hour_offset < 0 || d.minute_offset < 0 ? '-' : '+';
+      p = FormatPadded(p, std::abs(d.hour_offset), 2);
+      *p++ = ':';
+      p = FormatPadded(p, std::abs(d.minute_offset), 2);
+    }
+  }
+  return p - buffer;
+}
+
+/* The Writer class, formats a document into a chunk that is handed over
+ * to the write function whenever it is full */
+class Writer {
+ public:
+  /* Constructor */
+  Writer(const WriteFunc& func, gsize chunk_size = CHUNK_SIZE) :
+      func_(func),
+      buffer_(new char[chunk_size]),
+      chunk_size_(chunk_size),
+      used_(0),
+      ok_(true),
+      written_(false) {
+  }
+
+  /* Destructor */
+  virtual ~Writer() {
+  }
+
+  /* Writes a document */
+  bool WriteDocument(Node root) {
+    WriteTable(root);
+    Flush();
+    return ok_;
+  }
+
+  /* Writes a single value, containers are written inline */
+  bool WriteSingleValue(Node value) {
+    WriteValue(value, GetValueType(value));
+    Flush();
+    return ok_;
+  }
+
+  /* Writes a single key and value pair, as a line */
+  bool WriteEntry(const char *key, gsize len, Node value) {
+    WriteKey(key, len);
+    Append(" = ", 3);
+    WriteValue(value, GetValueType(value));
+    Append('\n');
+    Flush();
+    return ok_;
+  }
+
+ private:
+  /* Appends bytes, large ones are passed on without being copied */
+  void Append(const char *data, gsize len) {
+    if (len > chunk_size_ - used_) {
+      Flush();
+      if (len >= chunk_size_) {
+        ok_ = ok_ && func_(data, len);
+        return;
+      }
+    }
+    std::memcpy(buffer_.get() + used_, data, len);
+    used_ += len;
+  }
+
+  /* Appends a character */
+  void Append(char c) {
+    if (used_ == chunk_size_)
+      Flush();
+    buffer_[used_++] = c;
+  }
+
+  /* Makes room for at most len bytes and returns where they go, they are
+   * appended with Commit() */
+  char *Reserve(gsize len) {
+    if (len > chunk_size_ - used_)
+      Flush();
+    return buffer_.get() + used_;
+  }
+
+  /* Appends the bytes written in the reserved room */
+  void Commit(gsize len) {
+    used_ += len;
+  }
+
+  /* Hands over the chunk */
+  void Flush() {
+    if (used_ > 0)
+      ok_ = ok_ && func_(buffer_.get(), used_);
+    used_ = 0;
+  }
+
+  /* Writes a string */
+  void WriteString(const char *str, gsize len) {
+    Escape(str, len, [this](const char *data, gsize n) {
+      Append(data, n);
+    });
+  }
+
+  /* Writes a key, quoted if it is not a bare one */
+  void WriteKey(const char *key, gsize len) {
+    if (IsBareKey(key, len))
+      Append(key, len);
+    else
+      WriteString(key, len);
+  }
+
+  /* Writes a value, containers are written inline */
+  void WriteValue(Node value, CgTomlValueType type) {
+    switch (type) {
+      case CG_TOML_VALUE_TYPE_BOOLEAN: {
+        bool b = false;
+        GetValue(value, &b);
+        if (b)
+          Append("true", 4);
+        else
+          Append("false", 5);
+        break;
+      }
+      case CG_TOML_VALUE_TYPE_INT64: {
+        int64_t i = 0;
+        GetInteger(value, &i);
+        Commit(FormatInteger(i, Reserve(MAX_NUMBER_LENGTH)));
+        break;
+      }
+      case CG_TOML_VALUE_TYPE_DOUBLE: {
+        double d = 0;
+        GetValue(value, &d);
+        Commit(FormatDouble(d, Reserve(MAX_NUMBER_LENGTH)));
+        break;
+      }
+      case CG_TOML_VALUE_TYPE_STRING: {
+        gsize len = 0;
+        const char *str = GetString(value, &len);
+        WriteString(str, len);
+        break;
+      }
+      case CG_TOML_VALUE_TYPE_LOCAL_DATE:
+      case CG_TOML_VALUE_TYPE_LOCAL_TIME:
+      case CG_TOML_VALUE_TYPE_LOCAL_DATETIME:
+      case CG_TOML_VALUE_TYPE_OFFSET_DATETIME: {
+        dom::Datetime d;
+        GetDatetime(value, &d);
+        Commit(FormatDatetime(type, d, Reserve(MAX_DATETIME_LENGTH)));
+        break;
+      }
+      case CG_TOML_VALUE_TYPE_ARRAY:
+      case CG_TOML_VALUE_TYPE_TABLE_ARRAY: {
+        bool first = true;
+        Append('[');
+        ForEachElement(value, [&](Node element) {
+          if (!first)
+            Append(", ", 2);
+          first = false;
+          WriteValue(element, GetValueType(element));
+          return ok_;
+        });
+        Append(']');
+        break;
+      }
+      case CG_TOML_VALUE_TYPE_TABLE: {
+        bool first = true;
+        Append('{');
+        ForEachEntry(value, [&](const char *key, gsize len, Node v) {
+          const CgTomlValueType t = GetValueType(v);
+          if (t == CG_TOML_VALUE_TYPE_NONE)
+            return true;
+          Append(first ? " " : ", ", first ? 1 : 2);
+          first = false;
+          WriteKey(key, len);
+          Append(" = ", 3);
+          WriteValue(v, t);
+          return ok_;
+        });
+        Append(first ? "}" : " }", first ? 1 : 2);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  /* Checks whether a value is written under a header of its own */
+  static bool HasHeader(Node value, CgTomlValueType type) {
+    return type == CG_TOML_VALUE_TYPE_TABLE ||
+        (type == CG_TOML_VALUE_TYPE_TABLE_ARRAY && GetLength(value) > 0);
+  }
+
+  /* Checks whether a table needs a header of its own. A table holding
+   * nothing but other tables is defined by their headers already */
+  static bool NeedsHeader(Node table) {
+    bool empty = true;
+    bool plain = false;
+    ForEachEntry(table, [&](const char *, gsize, Node value) {
+      const CgTomlValueType type = GetValueType(value);
+      if (type == CG_TOML_VALUE_TYPE_NONE)
+        return true;
+      empty = false;
+      plain = !HasHeader(value, type);
+      return !plain;
+    });
+    return empty || plain;
+  }
+
+  /* Writes the header of a table or of an element of an array of tables */
+  void WriteHeader(bool element) {
+    if (written_)
+      Append('\n');
+    Append(element ? "[[" : "[", element ? 2 : 1);
+    Append(path_.data(), path_.size());
+    Append(element ? "]]\n" : "]\n", element ? 3 : 2);
+    written_ = true;
+  }
+
+  /* Writes the entries of a table, under the current path */
+  void WriteTable(Node table) {
+    /* Plain values, they must come before any header */
+    ForEachEntry(table, [&](const char *key, gsize len, Node value) {
+      const CgTomlValueType type = GetValueType(value);
+      if (type == CG_TOML_VALUE_TYPE_NONE || HasHeader(value, type))
+        return true;
+      WriteKey(key, len);
+      Append(" = ", 3);
+      WriteValue(value, type);
+      Append('\n');
+      written_ = true;
+      return ok_;
+    });
+
+    /* Tables and arrays of tables, under their qualified keys */
+    ForEachEntry(table, [&](const char *key, gsize len, Node value) {
+      const CgTomlValueType type = GetValueType(value);
+      if (!HasHeader(value, type))
+        return true;
+      const gsize path_len = path_.size();
+      if (path_len > 0)
+        path_.push_back('.');
+      if (IsBareKey(key, len)) {
+        path_.append(key, len);
+      } else {
+        Escape(key, len, [this](const char *data, gsize n) {
+          path_.append(data, n);
+        });
+      }
+      if (type == CG_TOML_VALUE_TYPE_TABLE) {
+        if (NeedsHeader(value))
+          WriteHeader(false);
+        WriteTable(value);
+      } else {
+        ForEachElement(value, [&](Node element) {
+          WriteHeader(true);
+          WriteTable(element);
+          return ok_;
+        });
+      }
+      path_.resize(path_len);
+      return ok_;
+    });
+  }
+
+  /* Copy Constructor */
+  Writer(const Writer&) = delete;
+
+  /* Move Constructor */
+  Writer(Writer &&) = delete;
+
+  /* Copy-Assign Constructor */
+  Writer& operator=(const Writer&) = delete;
+
+  /* Move-Assign Constructr */
+  Writer& operator=(Writer &&) = delete;
+
+ private:
+  /* The write function */
+  const WriteFunc& func_;
+
+  /* The chunk being filled */
+  std::unique_ptr<char[]> buffer_;
+
+  /* The size of the chunk */
+  const gsize chunk_size_;
+
+  /* The bytes used in the chunk */
+  gsize used_;
+
+  /* Whether the write function succeeded so far */
+  bool ok_;
+
+  /* Whether anything was written, headers are preceded by a blank line */
+  bool written_;
+
+  /* The qualified key of the current table, as written in headers */
+  std::string path_;
+};
+
+}  /* namespace */
+
+bool
+Write(Node table, const WriteFunc& func, GError **error)
+{
+  /* Lazy documents are only found at the root */
+  if (const LazyDocument *l = table.GetLazy()) {
+    if (!l->Check(nullptr, error))
+      return false;
+  }
+
+  Writer writer {func};
+  return writer.WriteDocument(table);
+}
+
+std::string
+FormatValue(Node value)
+{
+  std::string res;
+  const WriteFunc func = [&res](const char *data, gsize size) {
+    res.append(data, size);
+    return true;
+  };
+  Writer writer {func, VALUE_CHUNK_SIZE};
+  writer.WriteSingleValue(value);
+  return res;
+}
+
+std::string
+FormatEntry(const char *key, gsize len, Node value)
+{
+  std::string res;
+  const WriteFunc func = [&res](const char *data, gsize size) {
+    res.append(data, size);
+    return true;
+  };
+  Writer writer {func, VALUE_CHUNK_SIZE};
+  writer.WriteEntry(key, len, value);
+  return res;
+}
+
+}  /* namespace toml */
+}  /* namespace cg */
@@ -0,0 +1,43 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __CG_TOML_WRITER_H__
+#define __CG_TOML_WRITER_H__
+
+/* C++ STL */
+#include <functional>
+#include <string>
+
+/* TOML */
+#include "node.h"
+
+namespace cg {
+namespace toml {
+
+/* Receives the text of a document in large chunks, returns false to stop */
+using WriteFunc = std::function<bool(const char *data, gsize size)>;
+
+/* Writes a table as a TOML document. The plain values of each table come
+ * first, then its tables and arrays of tables under their own headers.
+ * Tables holding only other tables get no header of their own and tables
+ * inside arrays are written inline. Returns false as soon as the function
+ * does. A lazy document is checked before anything is written, it fails
+ * with CG_TOML_ERROR_PARSE if a section is invalid rather than leaving the
+ * section out */
+bool Write(Node table, const WriteFunc& func, GError **error);
+
+/* Formats a value as it is written after a key, containers inline */
+std::string FormatValue(Node value);
+
+/* Formats a key and value pair as a line, the key is quoted if needed */
+std::string FormatEntry(const char *key, gsize len, Node value);
+
+}  /* namespace toml */
+}  /* namespace cg */
+
+#endif
@@ -0,0 +1,1116 @@
+/* CgToml
+ *
+ * Copyright © 2019 Collabora Ltd.
+ * Copyright © 2021 Julian Bouzas
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <fcntl.h>
+
+#include <glib/gstdio.h>
+
+#include <cgtoml/cgtoml.h>
+
+/* Sizes of the generated documents */
+#define DEEP_DEPTH 64
+#define WIDE_KEYS 10000
+#define TABLE_ARRAY_ENTRIES 10000
+#define LONG_ARRAY_ELEMENTS 100000
+#define SECTIONS 1000
+#define SECTION_KEYS 10
+#define FRAGMENTS 32
+#define FRAGMENT_KEYS 1000
+
+/* Allocation counters, glibc lets us interpose the allocator */
+#if defined (__GLIBC__)
+static guint64 total_allocations = 0;
+static guint64 total_allocated_bytes = 0;
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *p, size_t size);
+
+static inline void
+count_allocation (size_t size)
+{
+  __atomic_add_fetch (&total_allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&total_allocated_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *
+malloc (size_t size)
+{
+  count_allocation (size);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  count_allocation (n * size);
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *p, size_t size)
+{
+  count_allocation (size);
+  return __libc_realloc (p, size);
+}
+
+static void
+get_allocation_stats (guint64 *allocations, guint64 *bytes)
+{
+  *allocations = __atomic_load_n (&total_allocations, __ATOMIC_RELAXED);
+  *bytes = __atomic_load_n (&total_allocated_bytes, __ATOMIC_RELAXED);
+}
+#else
+static void
+get_allocation_stats (guint64 *allocations, guint64 *bytes)
+{
+  *allocations = 0;
+  *bytes = 0;
+}
+#endif
+
+static guint64
+get_time_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (guint64) ts.tv_sec * 1000000000 + (guint64) ts.tv_nsec;
+}
+
+static long
+get_peak_rss_kb (void)
+{
+  struct rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) < 0)
+    return -1;
+  return usage.ru_maxrss;
+}
+
+/* Runs a benchmark and prints its results as a JSON line */
+typedef void (*BenchmarkFunc) (gconstpointer data);
+static void
+run_benchmark (const char *name, BenchmarkFunc func, gconstpointer data,
+    guint iterations, guint ops_per_iteration)
+{
+  guint64 allocs_start, bytes_start, allocs_end, bytes_end;
+  guint64 ops = (guint64) iterations * ops_per_iteration;
+
+  /* Warm up */
+  func (data);
+
+  get_allocation_stats (&allocs_start, &bytes_start);
+  guint64 start = get_time_ns ();
+  for (guint i = 0; i < iterations; i++)
+    func (data);
+  guint64 end = get_time_ns ();
+  get_allocation_stats (&allocs_end, &bytes_end);
+
+  printf ("{\"name\": \"%s\", \"ops\": %" G_GUINT64_FORMAT ", "
+      "\"ns_per_op\": %.2f, \"allocs_per_op\": %.2f, "
+      "\"bytes_allocated_per_op\": %.2f, \"peak_rss_kb\": %ld}\n",
+      name, ops,
+      (double) (end - start) / ops,
+      (double) (allocs_end - allocs_start) / ops,
+      (double) (bytes_end - bytes_start) / ops,
+      get_peak_rss_kb ());
+  fflush (stdout);
+}
+
+/* Synthetic document generators */
+
+static char *
+generate_deep (const char *dir)
+{
+  GString *s = g_string_new (NULL);
+  GString *header = g_string_new (NULL);
+  for (guint i = 0; i < DEEP_DEPTH; i++) {
+    g_string_append_printf (header, "%sl%u", i > 0 ? "." : "", i);
+    g_string_append_printf (s, "[%s]\nkey = %u\nname = \"level %u\"\n\n",
+        header->str, i, i);
+  }
+  g_string_free (header, TRUE);
+
+  char *path = g_build_filename (dir, "deep.toml", NULL);
+  g_assert_true (g_file_set_contents (path, s->str, s->len, NULL));
+  g_string_free (s, TRUE);
+  return path;
+}
+
+static char *
+generate_wide (const char *dir)
+{
+  GString *s = g_string_new (NULL);
+  for (guint i = 0; i < WIDE_KEYS; i++)
+    g_string_append_printf (s, "key%u = %u\n", i, i);
+  for (guint i = 0; i < WIDE_KEYS; i++)
+    g_string_append_printf (s, "str%u = \"value %u\"\n", i, i);
+
+  char *path = g_build_filename (dir, "wide.toml", NULL);
+  g_assert_true (g_file_set_contents (path, s->str, s->len, NULL));
+  g_string_free (s, TRUE);
+  return path;
+}
+
+static char *
+generate_table_array (const char *dir)
+{
+  GString *s = g_string_new (NULL);
+  for (guint i = 0; i < TABLE_ARRAY_ENTRIES; i++)
+    g_string_append_printf (s,
+        "[[servers]]\nname = \"server-%u\"\nport = %u\nweight = %u.5\n\n",
+        i, 1024 + i, i);
+
+  char *path = g_build_filename (dir, "table-array.toml", NULL);
+  g_assert_true (g_file_set_contents (path, s->str, s->len, NULL));
+  g_string_free (s, TRUE);
+  return path;
+}
+
+static char *
+generate_long_arrays (const char *dir)
+{
+  GString *s = g_string_new (NULL);
+
+  g_string_append (s, "ints = [");
+  for (guint i = 0; i < LONG_ARRAY_ELEMENTS; i++)
+    g_string_append_printf (s, "%s%u", i > 0 ? ", " : "", i);
+  g_string_append (s, "]\ndoubles = [");
+  for (guint i = 0; i < LONG_ARRAY_ELEMENTS; i++)
+    g_string_append_printf (s, "%s%u.25", i > 0 ? ", " : "", i);
+  g_string_append (s, "]\nbools = [");
+  for (guint i = 0; i < LONG_ARRAY_ELEMENTS; i++)
+    g_string_append_printf (s, "%s%s", i > 0 ? ", " : "",
+        i % 2 ? "true" : "false");
+  g_string_append (s, "]\nstrings = [");
+  for (guint i = 0; i < LONG_ARRAY_ELEMENTS; i++)
+    g_string_append_printf (s, "%s\"s%u\"", i > 0 ? ", " : "", i);
+  g_string_append (s, "]\n");
+
+  char *path = g_build_filename (dir, "long-arrays.toml", NULL);
+  g_assert_true (g_file_set_contents (path, s->str, s->len, NULL));
+  g_string_free (s, TRUE);
+  return path;
+}
+
+static char *
+generate_sections (const char *dir, const char *name, guint edited)
+{
+  GString *s = g_string_new (NULL);
+  for (guint i = 0; i < SECTIONS; i++) {
+    g_string_append_printf (s, "[section%u]\n", i);
+    for (guint j = 0; j < SECTION_KEYS; j++)
+      g_string_append_printf (s, "key%u = \"value %u\"\n", j,
+          i == edited ? j + 1 : j);
+    g_string_append (s, "\n");
+  }
+
+  char *path = g_build_filename (dir, name, NULL);
+  g_assert_true (g_file_set_contents (path, s->str, s->len, NULL));
+  g_string_free (s, TRUE);
+  return path;
+}
+
+static char *
+generate_fragments (const char *dir)
+{
+  char *path = g_build_filename (dir, "conf.d", NULL);
+  g_assert_cmpint (g_mkdir (path, 0700), ==, 0);
+
+  for (guint i = 0; i < FRAGMENTS; i++) {
+    GString *s = g_string_new (NULL);
+    g_string_append_printf (s, "[shared]\nkey%u = %u\n\n", i, i);
+    g_string_append_printf (s, "[fragment%u]\n", i);
+    for (guint j = 0; j < FRAGMENT_KEYS; j++)
+      g_string_append_printf (s, "key%u = \"value %u\"\n", j, j);
+
+    g_autofree char *name = g_strdup_printf ("%02u-fragment.toml", i);
+    g_autofree char *file = g_build_filename (path, name, NULL);
+    g_assert_true (g_file_set_contents (file, s->str, s->len, NULL));
+    g_string_free (s, TRUE);
+  }
+  return path;
+}
+
+/* Parse benchmark */
+
+static void
+bench_parse (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlFile *file = cg_toml_file_new (path);
+  g_assert_nonnull (file);
+  cg_toml_file_unref (file);
+}
+
+static void
+bench_parse_compact (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlFile *file = cg_toml_file_new_full (path, CG_TOML_FILE_FLAGS_COMPACT);
+  g_assert_nonnull (file);
+  cg_toml_file_unref (file);
+}
+
+static void
+bench_load_snapshot (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlFile *file = cg_toml_file_new_from_snapshot (path, NULL);
+  g_assert_nonnull (file);
+  cg_toml_file_unref (file);
+}
+
+static char *
+save_snapshot (const char *path)
+{
+  g_autoptr (CgTomlFile) file = cg_toml_file_new (path);
+  char *res = g_strconcat (path, ".snapshot", NULL);
+  g_assert_true (cg_toml_file_save_snapshot (file, res, NULL));
+  return res;
+}
+
+static void
+bench_parse_one_section (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlFile *file = cg_toml_file_new (path);
+  g_assert_nonnull (file);
+  CgTomlTable *table = cg_toml_file_get_table (file);
+  g_assert_nonnull (cg_toml_table_peek_qualified_string (table,
+      "section500.key5", NULL));
+  cg_toml_table_unref (table);
+  cg_toml_file_unref (file);
+}
+
+static void
+bench_lazy_one_section (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlFile *file = cg_toml_file_new_full (path, CG_TOML_FILE_FLAGS_LAZY);
+  g_assert_nonnull (file);
+  CgTomlTable *table = cg_toml_file_get_table (file);
+  g_assert_nonnull (cg_toml_table_peek_qualified_string (table,
+      "section500.key5", NULL));
+  cg_toml_table_unref (table);
+  cg_toml_file_unref (file);
+}
+
+/* Streaming benchmark */
+
+static gboolean
+count_scalar (const CgTomlScalar *scalar, gpointer user_data)
+{
+  guint *n = user_data;
+  (*n)++;
+  return TRUE;
+}
+
+static void
+bench_stream (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlParserEvents events = { .scalar = count_scalar };
+  guint n = 0;
+  CgTomlParser *parser = cg_toml_parser_new (&events, &n);
+  g_assert_true (cg_toml_parser_parse_file (parser, path, NULL));
+  g_assert_cmpuint (n, >, 0);
+  cg_toml_parser_unref (parser);
+}
+
+static void
+bench_stream_chunked (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlParserEvents events = { .scalar = count_scalar };
+  guint n = 0;
+  CgTomlParser *parser = cg_toml_parser_new (&events, &n);
+  GFile *file = g_file_new_for_path (path);
+  GFileInputStream *stream = g_file_read (file, NULL, NULL);
+  g_assert_nonnull (stream);
+  g_assert_true (cg_toml_parser_parse_stream (parser, G_INPUT_STREAM (stream),
+      NULL, NULL));
+  g_assert_cmpuint (n, >, 0);
+  g_object_unref (stream);
+  g_object_unref (file);
+  cg_toml_parser_unref (parser);
+}
+
+static void
+bench_directory_sequential (gconstpointer data)
+{
+  const char *path = data;
+  for (guint i = 0; i < FRAGMENTS; i++) {
+    g_autofree char *name = g_strdup_printf ("%02u-fragment.toml", i);
+    g_autofree char *file = g_build_filename (path, name, NULL);
+    CgTomlFile *f = cg_toml_file_new (file);
+    g_assert_nonnull (f);
+    cg_toml_file_unref (f);
+  }
+}
+
+static void
+bench_directory_merge (gconstpointer data)
+{
+  const char *path = data;
+  CgTomlFile *file = cg_toml_file_new_from_directory (path,
+      CG_TOML_FILE_FLAGS_NONE, NULL);
+  g_assert_nonnull (file);
+  cg_toml_file_unref (file);
+}
+
+/* Diff benchmark */
+
+typedef struct {
+  CgTomlTable *old_table;
+  CgTomlTable *new_table;
+} DiffData;
+
+static void
+bench_diff (gconstpointer data)
+{
+  const DiffData *d = data;
+  CgTomlTableDiff *diff = cg_toml_table_diff (d->old_table, d->new_table,
+      NULL);
+  g_assert_nonnull (diff);
+  g_assert_cmpuint (g_strv_length (diff->modified), ==, SECTION_KEYS);
+  cg_toml_table_diff_free (diff);
+}
+
+static void
+run_diff_benchmark (const char *name, const char *old_path,
+    const char *new_path, CgTomlFileFlags flags, guint iterations)
+{
+  g_autoptr (CgTomlFile) old_file = cg_toml_file_new_full (old_path, flags);
+  g_autoptr (CgTomlFile) new_file = cg_toml_file_new_full (new_path, flags);
+  DiffData d = {
+    cg_toml_file_get_table (old_file),
+    cg_toml_file_get_table (new_file),
+  };
+  run_benchmark (name, bench_diff, &d, iterations, 1);
+  cg_toml_table_unref (d.old_table);
+  cg_toml_table_unref (d.new_table);
+}
+
+/* Writing benchmarks */
+
+typedef struct {
+  CgTomlTable *table;
+  int fd;
+} WriteData;
+
+static void
+bench_write_string (gconstpointer data)
+{
+  const WriteData *d = data;
+  GString *string = g_string_new (NULL);
+  cg_toml_table_write_string (d->table, string);
+  g_assert_cmpuint (string->len, >, 0);
+  g_string_free (string, TRUE);
+}
+
+static void
+bench_write_fd (gconstpointer data)
+{
+  const WriteData *d = data;
+  g_assert_true (cg_toml_table_write_fd (d->table, d->fd, NULL));
+}
+
+static void
+run_write_benchmarks (const char *name, const char *path, guint iterations)
+{
+  g_autoptr (CgTomlFile) file = cg_toml_file_new_full (path,
+      CG_TOML_FILE_FLAGS_COMPACT);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  WriteData d = { table, g_open ("/dev/null", O_WRONLY, 0) };
+  g_assert_cmpint (d.fd, >=, 0);
+
+  g_autofree char *string_name = g_strdup_printf ("write/%s", name);
+  run_benchmark (string_name, bench_write_string, &d, iterations, 1);
+  g_autofree char *fd_name = g_strdup_printf ("write-fd/%s", name);
+  run_benchmark (fd_name, bench_write_fd, &d, iterations, 1);
+
+  g_close (d.fd, NULL);
+}
+
+/* Builder benchmarks, one change to a large document */
+
+typedef struct {
+  CgTomlTable *table;
+  const char *key;
+} SetData;
+
+static void
+bench_set_int64 (gconstpointer data)
+{
+  const SetData *d = data;
+  CgTomlTable *res = cg_toml_table_set_qualified_int64 (d->table, d->key, 1);
+  g_assert_nonnull (res);
+  cg_toml_table_unref (res);
+}
+
+/* Patch benchmarks */
+
+typedef struct {
+  CgTomlFile *file;
+  CgTomlTable *table;
+  const char *text;
+  gsize len;
+} PatchData;
+
+static void
+bench_patch (gconstpointer data)
+{
+  const PatchData *d = data;
+  g_assert_true (cg_toml_file_patch (d->file, d->table, NULL, NULL));
+
+  /* Put back the text the file was parsed from, so it can be patched again */
+  g_assert_true (g_file_set_contents (cg_toml_file_get_name (d->file),
+      d->text, d->len, NULL));
+}
+
+/* Variant benchmarks */
+
+static void
+bench_to_variant (gconstpointer data)
+{
+  GVariant *v = g_variant_ref_sink (cg_toml_table_to_variant (data, NULL));
+  g_assert_nonnull (v);
+  g_variant_unref (v);
+}
+
+static void
+bench_from_variant (gconstpointer data)
+{
+  CgTomlTable *table = cg_toml_table_new_from_variant ((GVariant *) data,
+      NULL);
+  g_assert_nonnull (table);
+  cg_toml_table_unref (table);
+}
+
+static void
+run_variant_benchmarks (const char *name, const char *path, guint iterations)
+{
+  g_autoptr (CgTomlFile) file = cg_toml_file_new_full (path,
+      CG_TOML_FILE_FLAGS_COMPACT);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  g_autoptr (GVariant) v = g_variant_ref_sink (
+      cg_toml_table_to_variant (table, NULL));
+
+  g_autofree char *to_name = g_strdup_printf ("to-variant/%s", name);
+  run_benchmark (to_name, bench_to_variant, table, iterations, 1);
+  g_autofree char *from_name = g_strdup_printf ("from-variant/%s", name);
+  run_benchmark (from_name, bench_from_variant, v, iterations, 1);
+}
+
+/* Lookup benchmarks */
+
+typedef struct {
+  CgTomlTable *table;
+  char **keys;
+  guint n_keys;
+} LookupData;
+
+static void
+bench_get_int64 (gconstpointer data)
+{
+  const LookupData *d = data;
+  for (guint i = 0; i < d->n_keys; i++) {
+    int64_t val;
+    g_assert_true (cg_toml_table_get_int64 (d->table, d->keys[i], &val));
+  }
+}
+
+static void
+bench_get_string (gconstpointer data)
+{
+  const LookupData *d = data;
+  for (guint i = 0; i < d->n_keys; i++) {
+    char *val = cg_toml_table_get_string (d->table, d->keys[i]);
+    g_assert_nonnull (val);
+    g_free (val);
+  }
+}
+
+static void
+bench_get_optional_int64 (gconstpointer data)
+{
+  const LookupData *d = data;
+  for (guint i = 0; i < d->n_keys; i++) {
+    int64_t val = -1;
+    if (cg_toml_table_contains (d->table, d->keys[i]))
+      g_assert_true (cg_toml_table_get_int64 (d->table, d->keys[i], &val));
+  }
+}
+
+typedef struct {
+  CgTomlTable *table;
+  CgTomlQuery *queries;
+  gsize n_queries;
+  guint64 *found;
+} GetManyData;
+
+static void
+bench_get_many_int64 (gconstpointer data)
+{
+  const GetManyData *d = data;
+  g_assert_true (cg_toml_table_get_many (d->table, d->queries, d->n_queries,
+      d->found));
+}
+
+static void
+bench_get_qualified_int64 (gconstpointer data)
+{
+  const LookupData *d = data;
+  for (guint i = 0; i < d->n_keys; i++) {
+    int64_t val;
+    g_assert_true (cg_toml_table_get_qualified_int64 (d->table, d->keys[i],
+        &val));
+  }
+}
+
+static void
+bench_get_qualified_table (gconstpointer data)
+{
+  const LookupData *d = data;
+  for (guint i = 0; i < d->n_keys; i++) {
+    CgTomlTable *t = cg_toml_table_get_qualified_table (d->table, d->keys[i]);
+    g_assert_nonnull (t);
+    cg_toml_table_unref (t);
+  }
+}
+
+/* Concurrent lookups on a shared table, one pass over the keys per
+ * thread */
+typedef struct {
+  LookupData lookup;
+  guint n_threads;
+} ThreadsData;
+
+static gpointer
+lookup_thread (gpointer data)
+{
+  const LookupData *d = data;
+  CgTomlTable *table = cg_toml_table_ref (d->table);
+  LookupData local = { table, d->keys, d->n_keys };
+  bench_get_int64 (&local);
+  cg_toml_table_unref (table);
+  return NULL;
+}
+
+static void
+bench_threads_get_int64 (gconstpointer data)
+{
+  const ThreadsData *d = data;
+  GThread **threads = g_newa (GThread *, d->n_threads);
+  for (guint i = 0; i < d->n_threads; i++)
+    threads[i] = g_thread_new ("lookup", lookup_thread, (gpointer) &d->lookup);
+  for (guint i = 0; i < d->n_threads; i++)
+    g_thread_join (threads[i]);
+}
+
+static void
+run_threads_benchmark (const char *prefix, CgTomlTable *table, guint scale)
+{
+  ThreadsData d = { { table, g_new0 (char *, WIDE_KEYS + 1), WIDE_KEYS }, 1 };
+  for (guint i = 0; i < WIDE_KEYS; i++)
+    d.lookup.keys[i] = g_strdup_printf ("key%u", i);
+
+  /* The time per op is the aggregate one, it shrinks as threads scale */
+  const guint max_threads = MAX (1, g_get_num_processors ());
+  for (d.n_threads = 1; d.n_threads <= max_threads; d.n_threads *= 2) {
+    g_autofree char *name = g_strdup_printf ("%s/%u", prefix, d.n_threads);
+    run_benchmark (name, bench_threads_get_int64, &d, 20 * scale,
+        d.n_threads * WIDE_KEYS);
+  }
+
+  g_strfreev (d.lookup.keys);
+}
+
+/* Snapshot holder benchmarks */
+
+#define HOLDER_ACQUIRES 10000
+
+typedef struct {
+  CgTomlSnapshotHolder *holder;
+  CgTomlFile *file;
+  gint stop;
+} HolderData;
+
+static void
+bench_holder_acquire (gconstpointer data)
+{
+  const HolderData *d = data;
+  for (guint i = 0; i < HOLDER_ACQUIRES; i++) {
+    CgTomlFile *file = cg_toml_snapshot_holder_acquire (d->holder);
+    g_assert_nonnull (file);
+    cg_toml_file_unref (file);
+  }
+}
+
+static gpointer
+holder_publish_thread (gpointer data)
+{
+  HolderData *d = data;
+  while (!g_atomic_int_get (&d->stop))
+    cg_toml_snapshot_holder_publish (d->holder, d->file);
+  return NULL;
+}
+
+/* Iteration benchmarks */
+
+static void
+count_boolean (const gboolean *v, gpointer user_data)
+{
+  (*(guint64 *) user_data) += v && *v;
+}
+
+static void
+count_int64 (const int64_t *v, gpointer user_data)
+{
+  (*(guint64 *) user_data) += v ? 1 : 0;
+}
+
+static void
+count_double (const double *v, gpointer user_data)
+{
+  (*(guint64 *) user_data) += v ? 1 : 0;
+}
+
+static void
+count_string (const char *v, gpointer user_data)
+{
+  (*(guint64 *) user_data) += v ? 1 : 0;
+}
+
+static void
+count_table (const CgTomlTable *t, gpointer user_data)
+{
+  int64_t port = 0;
+  cg_toml_table_get_int64 (t, "port", &port);
+  (*(guint64 *) user_data) += port;
+}
+
+static void
+count_table_view (const CgTomlTableView *t, gpointer user_data)
+{
+  int64_t port = 0;
+  cg_toml_table_view_get_int64 (t, "port", &port);
+  (*(guint64 *) user_data) += port;
+}
+
+static void
+bench_for_each_boolean (gconstpointer data)
+{
+  guint64 count = 0;
+  cg_toml_array_for_each_boolean (data, count_boolean, &count);
+}
+
+static void
+bench_for_each_int64 (gconstpointer data)
+{
+  guint64 count = 0;
+  cg_toml_array_for_each_int64 (data, count_int64, &count);
+  g_assert_cmpuint (count, ==, LONG_ARRAY_ELEMENTS);
+}
+
+static void
+bench_for_each_double (gconstpointer data)
+{
+  guint64 count = 0;
+  cg_toml_array_for_each_double (data, count_double, &count);
+  g_assert_cmpuint (count, ==, LONG_ARRAY_ELEMENTS);
+}
+
+static void
+bench_for_each_string (gconstpointer data)
+{
+  guint64 count = 0;
+  cg_toml_array_for_each_string (data, count_string, &count);
+  g_assert_cmpuint (count, ==, LONG_ARRAY_ELEMENTS);
+}
+
+static void
+bench_table_array_for_each (gconstpointer data)
+{
+  guint64 total = 0;
+  cg_toml_table_array_for_each (data, count_table, &total);
+  g_assert_cmpuint (total, >, 0);
+}
+
+static void
+bench_table_array_for_each_view (gconstpointer data)
+{
+  guint64 total = 0;
+  cg_toml_table_array_for_each_view (data, count_table_view, &total);
+  g_assert_cmpuint (total, >, 0);
+}
+
+/* Decoding benchmarks, into the struct of a server */
+
+typedef struct {
+  char *name;
+  uint16_t port;
+  double weight;
+} Server;
+
+static const CgTomlField server_fields[] = {
+  { "name", CG_TOML_FIELD_TYPE_STRING, G_STRUCT_OFFSET (Server, name), TRUE },
+  { "port", CG_TOML_FIELD_TYPE_UINT16, G_STRUCT_OFFSET (Server, port), TRUE },
+  { "weight", CG_TOML_FIELD_TYPE_DOUBLE, G_STRUCT_OFFSET (Server, weight),
+      TRUE },
+};
+
+static void
+decode_server_getters (const CgTomlTable *table, gpointer data)
+{
+  Server *s = data;
+  s->name = cg_toml_table_get_string (table, "name");
+  g_assert_true (cg_toml_table_get_uint16 (table, "port", &s->port));
+  g_assert_true (cg_toml_table_get_double (table, "weight", &s->weight));
+  g_free (s->name);
+}
+
+static void
+bench_decode_getters (gconstpointer data)
+{
+  Server s;
+  cg_toml_table_array_for_each (data, decode_server_getters, &s);
+}
+
+typedef struct {
+  CgTomlTableArray *servers;
+  CgTomlSchema *schema;
+} DecodeData;
+
+static void
+bench_decode_schema (gconstpointer data)
+{
+  const DecodeData *d = data;
+  guint n = 0;
+  Server *servers = cg_toml_table_array_decode (d->servers, d->schema, &n,
+      NULL);
+  g_assert_nonnull (servers);
+  g_assert_cmpuint (n, ==, TABLE_ARRAY_ENTRIES);
+  cg_toml_schema_free_array (d->schema, servers, n);
+}
+
+static void
+bench_copy_int64 (gconstpointer data)
+{
+  static int64_t dst[LONG_ARRAY_ELEMENTS];
+  g_assert_true (cg_toml_array_copy_int64 (data, dst, LONG_ARRAY_ELEMENTS,
+      NULL));
+}
+
+static void
+bench_copy_double (gconstpointer data)
+{
+  static double dst[LONG_ARRAY_ELEMENTS];
+  g_assert_true (cg_toml_array_copy_double (data, dst, LONG_ARRAY_ELEMENTS,
+      NULL));
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* Allow scaling the number of iterations */
+  const char *scale_env = g_getenv ("CGTOML_BENCHMARK_SCALE");
+  guint scale = scale_env ? MAX (1, atoi (scale_env)) : 1;
+
+  /* Generate the documents */
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-benchmark-XXXXXX", NULL);
+  g_assert_nonnull (dir);
+  g_autofree char *deep = generate_deep (dir);
+  g_autofree char *wide = generate_wide (dir);
+  g_autofree char *table_array = generate_table_array (dir);
+  g_autofree char *long_arrays = generate_long_arrays (dir);
+  g_autofree char *sections = generate_sections (dir, "sections.toml",
+      G_MAXUINT);
+  g_autofree char *sections_edited = generate_sections (dir,
+      "sections-edited.toml", SECTIONS / 2);
+  g_autofree char *fragments = generate_fragments (dir);
+
+  /* Parse */
+  run_benchmark ("parse/deep", bench_parse, deep, 200 * scale, 1);
+  run_benchmark ("parse/wide", bench_parse, wide, 5 * scale, 1);
+  run_benchmark ("parse/table-array", bench_parse, table_array, 5 * scale, 1);
+  run_benchmark ("parse/long-arrays", bench_parse, long_arrays, 5 * scale, 1);
+  run_benchmark ("parse-compact/deep", bench_parse_compact, deep, 200 * scale,
+      1);
+  run_benchmark ("parse-compact/wide", bench_parse_compact, wide, 5 * scale,
+      1);
+  run_benchmark ("parse-compact/table-array", bench_parse_compact,
+      table_array, 5 * scale, 1);
+  run_benchmark ("parse-compact/long-arrays", bench_parse_compact,
+      long_arrays, 5 * scale, 1);
+
+  /* Stream events without building a tree */
+  run_benchmark ("stream/wide", bench_stream, wide, 5 * scale, 1);
+  run_benchmark ("stream/table-array", bench_stream, table_array, 5 * scale,
+      1);
+  run_benchmark ("stream/long-arrays", bench_stream, long_arrays, 5 * scale,
+      1);
+  run_benchmark ("stream/chunked", bench_stream_chunked, long_arrays,
+      5 * scale, 1);
+
+  /* Write whole documents back */
+  run_write_benchmarks ("wide", wide, 5 * scale);
+  run_write_benchmarks ("table-array", table_array, 5 * scale);
+  run_write_benchmarks ("long-arrays", long_arrays, 5 * scale);
+
+  /* Convert whole documents to variants and back */
+  run_variant_benchmarks ("wide", wide, 5 * scale);
+  run_variant_benchmarks ("table-array", table_array, 5 * scale);
+
+  /* Read one section out of many */
+  run_benchmark ("one-section/parse", bench_parse_one_section, sections,
+      20 * scale, 1);
+  run_benchmark ("one-section/lazy", bench_lazy_one_section, sections,
+      20 * scale, 1);
+
+  /* Load a directory of fragments */
+  run_benchmark ("directory/sequential", bench_directory_sequential,
+      fragments, 5 * scale, 1);
+  run_benchmark ("directory/merge", bench_directory_merge, fragments,
+      5 * scale, 1);
+
+  /* Diff two revisions with one section edited */
+  run_diff_benchmark ("diff/tree", sections, sections_edited,
+      CG_TOML_FILE_FLAGS_NONE, 200 * scale);
+  run_diff_benchmark ("diff/compact", sections, sections_edited,
+      CG_TOML_FILE_FLAGS_COMPACT, 200 * scale);
+
+  /* Load snapshots */
+  g_autofree char *wide_snapshot = save_snapshot (wide);
+  g_autofree char *table_array_snapshot = save_snapshot (table_array);
+  run_benchmark ("load-snapshot/wide", bench_load_snapshot, wide_snapshot,
+      200 * scale, 1);
+  run_benchmark ("load-snapshot/table-array", bench_load_snapshot,
+      table_array_snapshot, 200 * scale, 1);
+
+  /* Plain getters on a wide table */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (wide);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    LookupData d = { table, g_new0 (char *, WIDE_KEYS + 1), WIDE_KEYS };
+
+    for (guint i = 0; i < WIDE_KEYS; i++)
+      d.keys[i] = g_strdup_printf ("key%u", i);
+    run_benchmark ("get/int64", bench_get_int64, &d, 20 * scale, WIDE_KEYS);
+    run_benchmark ("get/optional-int64", bench_get_optional_int64, &d,
+        20 * scale, WIDE_KEYS);
+
+    /* The same keys resolved with a single batched call */
+    int64_t *values = g_new0 (int64_t, WIDE_KEYS);
+    GetManyData m = { table, g_new0 (CgTomlQuery, WIDE_KEYS), WIDE_KEYS,
+        g_new0 (guint64, CG_TOML_QUERY_BITMAP_SIZE (WIDE_KEYS)) };
+    for (guint i = 0; i < WIDE_KEYS; i++) {
+      m.queries[i].key = d.keys[i];
+      m.queries[i].type = CG_TOML_FIELD_TYPE_INT64;
+      m.queries[i].dst = &values[i];
+      m.queries[i].default_value.v_int64 = -1;
+    }
+    run_benchmark ("get-many/int64", bench_get_many_int64, &m, 20 * scale,
+        WIDE_KEYS);
+    g_free (m.found);
+    g_free (m.queries);
+    g_free (values);
+
+    for (guint i = 0; i < WIDE_KEYS; i++) {
+      g_free (d.keys[i]);
+      d.keys[i] = g_strdup_printf ("str%u", i);
+    }
+    run_benchmark ("get/string", bench_get_string, &d, 20 * scale, WIDE_KEYS);
+
+    g_strfreev (d.keys);
+  }
+
+  /* Plain getters on a compact wide table */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (wide,
+        CG_TOML_FILE_FLAGS_COMPACT);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    LookupData d = { table, g_new0 (char *, WIDE_KEYS + 1), WIDE_KEYS };
+
+    for (guint i = 0; i < WIDE_KEYS; i++)
+      d.keys[i] = g_strdup_printf ("key%u", i);
+    run_benchmark ("get-compact/int64", bench_get_int64, &d, 20 * scale,
+        WIDE_KEYS);
+
+    g_strfreev (d.keys);
+  }
+
+  /* Getters on a wide table shared by several threads */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (wide);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    run_threads_benchmark ("threads/get/int64", table, scale);
+  }
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (wide,
+        CG_TOML_FILE_FLAGS_COMPACT);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    run_threads_benchmark ("threads/get-compact/int64", table, scale);
+  }
+
+  /* Pin the current revision, with and without a concurrent writer */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (wide);
+    HolderData d = { cg_toml_snapshot_holder_new (file), file, 0 };
+    run_benchmark ("holder/acquire", bench_holder_acquire, &d, 20 * scale,
+        HOLDER_ACQUIRES);
+    GThread *writer = g_thread_new ("writer", holder_publish_thread, &d);
+    run_benchmark ("holder/acquire-publishing", bench_holder_acquire, &d,
+        20 * scale, HOLDER_ACQUIRES);
+    g_atomic_int_set (&d.stop, 1);
+    g_thread_join (writer);
+    cg_toml_snapshot_holder_unref (d.holder);
+  }
+
+  /* Change one key of a parsed document */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (wide);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    SetData d = { table, "key0" };
+    run_benchmark ("set/wide", bench_set_int64, &d, 200 * scale, 1);
+  }
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (deep);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    GString *key = g_string_new (NULL);
+    for (guint i = 0; i < DEEP_DEPTH; i++)
+      g_string_append_printf (key, "l%u.", i);
+    g_string_append (key, "key");
+    SetData d = { table, key->str };
+    run_benchmark ("set/deep", bench_set_int64, &d, 2000 * scale, 1);
+    g_string_free (key, TRUE);
+  }
+
+  /* Write one changed key back, patching a copy of the document */
+  {
+    g_autofree char *text = NULL;
+    gsize len = 0;
+    g_assert_true (g_file_get_contents (wide, &text, &len, NULL));
+    g_autofree char *path = g_build_filename (dir, "patch.toml", NULL);
+    g_assert_true (g_file_set_contents (path, text, len, NULL));
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (path);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_autoptr (CgTomlTable) changed = cg_toml_table_set_int64 (table, "key0",
+        1);
+    PatchData d = { file, changed, text, len };
+    run_benchmark ("patch/wide", bench_patch, &d, 5 * scale, 1);
+    g_remove (path);
+  }
+
+  /* Qualified getters on a deeply nested table */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (deep);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    LookupData d = { table, g_new0 (char *, DEEP_DEPTH + 1), DEEP_DEPTH };
+
+    GString *path = g_string_new (NULL);
+    for (guint i = 0; i < DEEP_DEPTH; i++) {
+      g_string_append_printf (path, "%sl%u", i > 0 ? "." : "", i);
+      d.keys[i] = g_strdup_printf ("%s.key", path->str);
+    }
+    run_benchmark ("get-qualified/int64", bench_get_qualified_int64, &d,
+        200 * scale, DEEP_DEPTH);
+
+    g_string_truncate (path, 0);
+    for (guint i = 0; i < DEEP_DEPTH; i++) {
+      g_string_append_printf (path, "%sl%u", i > 0 ? "." : "", i);
+      g_free (d.keys[i]);
+      d.keys[i] = g_strdup (path->str);
+    }
+    run_benchmark ("get-qualified/table", bench_get_qualified_table, &d,
+        200 * scale, DEEP_DEPTH);
+
+    g_string_free (path, TRUE);
+    g_strfreev (d.keys);
+  }
+
+  /* Array iteration */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (long_arrays);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_autoptr (CgTomlArray) bools = cg_toml_table_get_array (table, "bools");
+    g_autoptr (CgTomlArray) ints = cg_toml_table_get_array (table, "ints");
+    g_autoptr (CgTomlArray) doubles = cg_toml_table_get_array (table,
+        "doubles");
+    g_autoptr (CgTomlArray) strings = cg_toml_table_get_array (table,
+        "strings");
+
+    run_benchmark ("array-for-each/boolean", bench_for_each_boolean, bools,
+        20 * scale, LONG_ARRAY_ELEMENTS);
+    run_benchmark ("array-for-each/int64", bench_for_each_int64, ints,
+        20 * scale, LONG_ARRAY_ELEMENTS);
+    run_benchmark ("array-for-each/double", bench_for_each_double, doubles,
+        20 * scale, LONG_ARRAY_ELEMENTS);
+    run_benchmark ("array-for-each/string", bench_for_each_string, strings,
+        20 * scale, LONG_ARRAY_ELEMENTS);
+    run_benchmark ("array-copy/int64", bench_copy_int64, ints,
+        20 * scale, LONG_ARRAY_ELEMENTS);
+    run_benchmark ("array-copy/double", bench_copy_double, doubles,
+        20 * scale, LONG_ARRAY_ELEMENTS);
+  }
+
+  /* Table array iteration */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (table_array);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_autoptr (CgTomlTableArray) servers = cg_toml_table_get_array_table (
+        table, "servers");
+
+    run_benchmark ("table-array-for-each", bench_table_array_for_each,
+        servers, 20 * scale, TABLE_ARRAY_ENTRIES);
+    run_benchmark ("table-array-for-each-view",
+        bench_table_array_for_each_view, servers, 20 * scale,
+        TABLE_ARRAY_ENTRIES);
+  }
+
+  /* Decode a table array into structs, one getter per field or a schema */
+  for (guint i = 0; i < 2; i++) {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (table_array,
+        i == 0 ? CG_TOML_FILE_FLAGS_NONE : CG_TOML_FILE_FLAGS_COMPACT);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_autoptr (CgTomlTableArray) servers = cg_toml_table_get_array_table (
+        table, "servers");
+    g_autoptr (CgTomlSchema) schema = cg_toml_schema_new (server_fields,
+        G_N_ELEMENTS (server_fields), sizeof (Server));
+    DecodeData d = { servers, schema };
+
+    run_benchmark (i == 0 ? "decode/getters" : "decode-compact/getters",
+        bench_decode_getters, servers, 20 * scale, TABLE_ARRAY_ENTRIES);
+    run_benchmark (i == 0 ? "decode/schema" : "decode-compact/schema",
+        bench_decode_schema, &d, 20 * scale, TABLE_ARRAY_ENTRIES);
+  }
+
+  /* Cleanup */
+  g_unlink (deep);
+  g_unlink (wide);
+  g_unlink (table_array);
+  g_unlink (long_arrays);
+  g_unlink (sections);
+  g_unlink (sections_edited);
+  for (guint i = 0; i < FRAGMENTS; i++) {
+    g_autofree char *name = g_strdup_printf ("%02u-fragment.toml", i);
+    g_autofree char *file = g_build_filename (fragments, name, NULL);
+    g_unlink (file);
+  }
+  g_rmdir (fragments);
+  g_unlink (wide_snapshot);
+  g_unlink (table_array_snapshot);
+  g_rmdir (dir);
+
+  return 0;
+}
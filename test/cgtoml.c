@@ -6,6 +6,9 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <fcntl.h>
+#include <glib/gstdio.h>
+
 #include <cgtoml/cgtoml.h>
 
 #define TOML_FILE_BASIC_TABLE "files/basic-table.toml"
@@ -13,6 +16,8 @@
 #define TOML_FILE_NESTED_ARRAY "files/nested-array.toml"
 #define TOML_FILE_NESTED_TABLE "files/nested-table.toml"
 #define TOML_FILE_TABLE_ARRAY "files/table-array.toml"
+#define TOML_FILE_LAZY "files/lazy.toml"
+#define TOML_DIR_CONF_D "files/conf.d"
 
 static void
 test_basic_table (void)
@@ -133,6 +138,18 @@ test_basic_table (void)
     g_assert_cmpstr (val, ==, "str");
   }
 
+  /* Test borrowed string */
+  {
+    gsize len = 0;
+    g_assert_null (cg_toml_table_peek_string (table, "invalid-key", &len));
+    g_assert_null (cg_toml_table_peek_string (table, "int8", &len));
+    const char *val = cg_toml_table_peek_string (table, "str", &len);
+    g_assert_nonnull (val);
+    g_assert_cmpstr (val, ==, "str");
+    g_assert_cmpuint (len, ==, 3);
+    g_assert_true (val == cg_toml_table_peek_string (table, "str", NULL));
+  }
+
   /* Test big string */
   {
     g_autofree char *val = cg_toml_table_get_string (table, "invalid-key");
@@ -250,6 +267,67 @@ test_basic_array (void)
     g_assert_cmpstr (buffer, ==, "a string array");
   }
 
+  /* Test borrowed string array elements */
+  {
+    g_autoptr (CgTomlArray) a = cg_toml_table_get_array (table, "str-array");
+    g_assert_nonnull (a);
+    gsize len = 0;
+    const char *val = cg_toml_array_peek_string (a, 1, &len);
+    g_assert_cmpstr (val, ==, "string ");
+    g_assert_cmpuint (len, ==, 7);
+    g_assert_null (cg_toml_array_peek_string (a, 3, &len));
+  }
+
+  /* Test random access */
+  {
+    g_autoptr (CgTomlArray) a = cg_toml_table_get_array (table, "int64-array");
+    g_assert_nonnull (a);
+    int64_t val = 0;
+    g_assert_true (cg_toml_array_get_nth_int64 (a, 2, &val));
+    g_assert_cmpint (val, ==, 3);
+    g_assert_false (cg_toml_array_get_nth_int64 (a, 5, &val));
+    gboolean b = FALSE;
+    g_assert_false (cg_toml_array_get_nth_boolean (a, 0, &b));
+    g_autofree char *str = cg_toml_array_get_nth_string (a, 0);
+    g_assert_null (str);
+  }
+
+  /* Test bulk copies */
+  {
+    g_autoptr (CgTomlArray) ints = cg_toml_table_get_array (table,
+        "int64-array");
+    g_assert_nonnull (ints);
+    g_assert_cmpuint (cg_toml_array_get_length (ints), ==, 5);
+    int64_t dst[5] = { 0, };
+    g_assert_true (cg_toml_array_copy_int64 (ints, dst, 5, NULL));
+    g_assert_cmpint (dst[0], ==, 1);
+    g_assert_cmpint (dst[4], ==, 5);
+
+    g_autoptr (CgTomlArray) doubles = cg_toml_table_get_array (table,
+        "double-array");
+    g_assert_nonnull (doubles);
+    g_autoptr (GArray) d = cg_toml_array_dup_double (doubles, NULL);
+    g_assert_nonnull (d);
+    g_assert_cmpuint (d->len, ==, 3);
+    g_assert_cmpfloat_with_epsilon (g_array_index (d, double, 2), 2.1, 0.01);
+
+    g_autoptr (CgTomlArray) bools = cg_toml_table_get_array (table,
+        "bool-array");
+    g_assert_nonnull (bools);
+    g_autoptr (GArray) b = cg_toml_array_dup_boolean (bools, NULL);
+    g_assert_nonnull (b);
+    g_assert_cmpuint (b->len, ==, 7);
+    g_assert_true (g_array_index (b, gboolean, 0));
+    g_assert_false (g_array_index (b, gboolean, 1));
+
+    g_autoptr (CgTomlArray) strs = cg_toml_table_get_array (table,
+        "str-array");
+    g_assert_nonnull (strs);
+    g_autoptr (GError) error = NULL;
+    g_assert_false (cg_toml_array_copy_int64 (strs, dst, 5, &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH);
+  }
+
   /* Try to parse a string array as an int64 array */
   {
     g_autoptr (CgTomlArray) a = cg_toml_table_get_array (table, "str-array");
@@ -289,6 +367,48 @@ test_nested_table (void)
   g_assert_cmpstr (key3, ==, "hello world");
 }
 
+static void
+test_path (void)
+{
+  /* Parse the file and get its table */
+  g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_NESTED_TABLE);
+  g_assert_nonnull (file);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  g_assert_nonnull (table);
+
+  /* Compile the paths */
+  g_autoptr (CgTomlPath) key2_path = cg_toml_path_new ("table.key2");
+  g_assert_nonnull (key2_path);
+  g_assert_cmpstr (cg_toml_path_get_key (key2_path), ==, "table.key2");
+  g_assert_cmpuint (cg_toml_path_get_n_segments (key2_path), ==, 2);
+  g_autoptr (CgTomlPath) key3_path = cg_toml_path_new ("table.subtable.key3");
+  g_assert_nonnull (key3_path);
+  g_autoptr (CgTomlPath) subtable_path = cg_toml_path_new ("table.subtable");
+  g_assert_nonnull (subtable_path);
+  g_autoptr (CgTomlPath) invalid_path = cg_toml_path_new ("table.invalid");
+  g_assert_nonnull (invalid_path);
+
+  /* Lookup the values several times with the same paths */
+  for (int i = 0; i < 3; i++) {
+    int32_t key2 = 0;
+    g_assert_true (cg_toml_table_get_path_int32 (table, key2_path, &key2));
+    g_assert_cmpint (key2, ==, 1284);
+    g_assert_false (cg_toml_table_get_path_int32 (table, invalid_path, &key2));
+    g_autofree char *key3 = cg_toml_table_get_path_string (table, key3_path);
+    g_assert_cmpstr (key3, ==, "hello world");
+  }
+
+  /* Wrong types are not returned */
+  g_assert_null (cg_toml_table_get_path_string (table, key2_path));
+  g_assert_null (cg_toml_table_get_path_table (table, key2_path));
+
+  /* Get a nested table */
+  g_autoptr (CgTomlTable) subtable = cg_toml_table_get_path_table (table,
+      subtable_path);
+  g_assert_nonnull (subtable);
+  g_assert_true (cg_toml_table_contains (subtable, "key3"));
+}
+
 static void
 nested_array_for_each (CgTomlArray *a, gpointer user_data)
 {
@@ -377,6 +497,2268 @@ test_table_array ()
   char buffer[256] = "";
   cg_toml_table_array_for_each (table_array, table_array_for_each, buffer);
   g_assert_cmpstr (buffer, ==, "hello, can you hear me?");
+
+  /* Random access */
+  g_assert_cmpuint (cg_toml_table_array_get_length (table_array), ==, 2);
+  g_assert_null (cg_toml_table_array_get_nth (table_array, 2));
+  g_autoptr (CgTomlTable) second = cg_toml_table_array_get_nth (table_array,
+      1);
+  g_assert_nonnull (second);
+  g_autofree char *key1 = cg_toml_table_get_string (second, "key1");
+  g_assert_cmpstr (key1, ==, ", can you hear me?");
+  CgTomlTableView first;
+  g_assert_true (cg_toml_table_array_get_nth_view (table_array, 0, &first));
+  g_assert_cmpstr (cg_toml_table_view_peek_string (&first, "key1", NULL), ==,
+      "hello");
+}
+
+static void
+table_array_for_each_view (const CgTomlTableView *view, gpointer user_data)
+{
+  char *buffer = user_data;
+
+  /* Test all the array values could be parsed into a table view correctly */
+  g_assert_nonnull (view);
+
+  /* Check for key1 string without copying it */
+  const char *key1 = cg_toml_table_view_peek_string (view, "key1", NULL);
+  g_assert_nonnull (key1);
+
+  /* Concatenate */
+  g_strlcat(buffer, key1, 256);
+}
+
+static void
+nested_array_for_each_view (const CgTomlArrayView *view, gpointer user_data)
+{
+  int *count = user_data;
+
+  /* Test all the array values could be parsed into array views correctly */
+  g_assert_nonnull (view);
+
+  /* Only check the first nested array */
+  if (*count == 0) {
+    int64_t total = 0;
+    cg_toml_array_view_for_each_int64 (view, int64_array_for_each, &total);
+    g_assert_cmpint (total, ==, 15);
+  }
+
+  /* Increase the counter */
+  (*count)++;
+}
+
+static void
+test_views (void)
+{
+  /* Walk the nested tables with views */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_NESTED_TABLE);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+
+    CgTomlTableView root, table1, table2;
+    cg_toml_table_get_view (table, &root);
+    g_assert_false (cg_toml_table_view_get_table (&root, "invalid-key",
+        &table1));
+    g_assert_true (cg_toml_table_view_get_table (&root, "table", &table1));
+    int32_t key2 = 0;
+    g_assert_true (cg_toml_table_view_get_int32 (&table1, "key2", &key2));
+    g_assert_cmpint (key2, ==, 1284);
+    g_assert_true (cg_toml_table_view_get_table (&table1, "subtable",
+        &table2));
+    g_assert_true (cg_toml_table_view_contains (&table2, "key3"));
+    g_assert_cmpstr (cg_toml_table_view_peek_string (&table2, "key3", NULL),
+        ==, "hello world");
+    g_assert_cmpstr (cg_toml_table_view_peek_qualified_string (&root,
+        "table.subtable.key3", NULL), ==, "hello world");
+  }
+
+  /* Iterate a table array with views */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_TABLE_ARRAY);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+
+    CgTomlTableView root;
+    CgTomlTableArrayView table_array;
+    cg_toml_table_get_view (table, &root);
+    g_assert_true (cg_toml_table_view_get_array_table (&root, "table-array",
+        &table_array));
+    char buffer[256] = "";
+    cg_toml_table_array_view_for_each (&table_array, table_array_for_each_view,
+        buffer);
+    g_assert_cmpstr (buffer, ==, "hello, can you hear me?");
+  }
+
+  /* Iterate nested arrays with views */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_NESTED_ARRAY);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+    g_autoptr (CgTomlArray) a = cg_toml_table_get_array (table,
+        "nested-array");
+    g_assert_nonnull (a);
+
+    int count = 0;
+    cg_toml_array_for_each_array_view (a, nested_array_for_each_view, &count);
+    g_assert_cmpint (count, ==, 3);
+  }
+}
+
+static void
+test_iterators (void)
+{
+  /* Iterate the keys of a table */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_NESTED_TABLE);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+
+    CgTomlTableView root, nested;
+    cg_toml_table_get_view (table, &root);
+    g_assert_true (cg_toml_table_view_get_table (&root, "table", &nested));
+
+    CgTomlTableIter iter;
+    const char *key = NULL;
+    CgTomlValueView value;
+    guint n_keys = 0;
+    cg_toml_table_iter_init_view (&iter, &nested);
+    while (cg_toml_table_iter_next (&iter, &key, &value)) {
+      n_keys++;
+      if (g_str_equal (key, "key1")) {
+        double d = 0.0;
+        g_assert_cmpint (cg_toml_value_view_get_value_type (&value), ==,
+            CG_TOML_VALUE_TYPE_DOUBLE);
+        g_assert_true (cg_toml_value_view_get_double (&value, &d));
+        g_assert_cmpfloat (d, ==, 0.1);
+      } else if (g_str_equal (key, "key2")) {
+        int64_t i = 0;
+        g_assert_cmpint (cg_toml_value_view_get_value_type (&value), ==,
+            CG_TOML_VALUE_TYPE_INT64);
+        g_assert_true (cg_toml_value_view_get_int64 (&value, &i));
+        g_assert_cmpint (i, ==, 1284);
+      } else if (g_str_equal (key, "subtable")) {
+        CgTomlTableView subtable;
+        int64_t i = 0;
+        g_assert_cmpint (cg_toml_value_view_get_value_type (&value), ==,
+            CG_TOML_VALUE_TYPE_TABLE);
+        g_assert_false (cg_toml_value_view_get_int64 (&value, &i));
+        g_assert_true (cg_toml_value_view_get_table (&value, &subtable));
+        g_assert_cmpstr (cg_toml_table_view_peek_string (&subtable, "key3",
+            NULL), ==, "hello world");
+      } else {
+        g_assert_not_reached ();
+      }
+    }
+    g_assert_cmpuint (n_keys, ==, 3);
+    g_assert_false (cg_toml_table_iter_next (&iter, NULL, NULL));
+  }
+
+  /* Iterate the values of an array and stop early */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_BASIC_ARRAY);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+    g_autoptr (CgTomlArray) a = cg_toml_table_get_array (table, "int64-array");
+    g_assert_nonnull (a);
+
+    CgTomlArrayIter iter;
+    CgTomlValueView value;
+    int64_t sum = 0;
+    cg_toml_array_iter_init (&iter, a);
+    while (cg_toml_array_iter_next (&iter, &value)) {
+      int64_t i = 0;
+      g_assert_true (cg_toml_value_view_get_int64 (&value, &i));
+      if (i == 4)
+        break;
+      sum += i;
+    }
+    g_assert_cmpint (sum, ==, 6);
+    g_assert_true (cg_toml_array_iter_next (&iter, &value));
+    g_assert_false (cg_toml_array_iter_next (&iter, NULL));
+
+    g_autoptr (CgTomlArray) s = cg_toml_table_get_array (table, "str-array");
+    g_assert_nonnull (s);
+    char buffer[256] = "";
+    cg_toml_array_iter_init (&iter, s);
+    while (cg_toml_array_iter_next (&iter, &value)) {
+      gsize len = 0;
+      const char *str = cg_toml_value_view_peek_string (&value, &len);
+      g_assert_nonnull (str);
+      g_assert_cmpuint (len, ==, strlen (str));
+      g_strlcat (buffer, str, sizeof (buffer));
+    }
+    g_assert_cmpstr (buffer, ==, "a string array");
+  }
+
+  /* Iterate nested arrays */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_NESTED_ARRAY);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+    g_autoptr (CgTomlArray) a = cg_toml_table_get_array (table,
+        "nested-array");
+    g_assert_nonnull (a);
+
+    CgTomlArrayIter iter;
+    CgTomlValueView value;
+    guint lengths = 0;
+    cg_toml_array_iter_init (&iter, a);
+    while (cg_toml_array_iter_next (&iter, &value)) {
+      CgTomlArrayView nested;
+      g_assert_cmpint (cg_toml_value_view_get_value_type (&value), ==,
+          CG_TOML_VALUE_TYPE_ARRAY);
+      g_assert_true (cg_toml_value_view_get_array (&value, &nested));
+      lengths = lengths * 10 + cg_toml_array_view_get_length (&nested);
+    }
+    g_assert_cmpuint (lengths, ==, 523);
+  }
+
+  /* Iterate a table array */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_TABLE_ARRAY);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+    g_autoptr (CgTomlTableArray) table_array = cg_toml_table_get_array_table (
+        table, "table-array");
+    g_assert_nonnull (table_array);
+
+    CgTomlTableArrayIter iter;
+    CgTomlTableView t;
+    char buffer[256] = "";
+    cg_toml_table_array_iter_init (&iter, table_array);
+    while (cg_toml_table_array_iter_next (&iter, &t))
+      g_strlcat (buffer, cg_toml_table_view_peek_string (&t, "key1", NULL),
+          sizeof (buffer));
+    g_assert_cmpstr (buffer, ==, "hello, can you hear me?");
+  }
+}
+
+static void
+test_compact (void)
+{
+  /* Values of a compact table */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (TOML_FILE_BASIC_TABLE,
+        CG_TOML_FILE_FLAGS_COMPACT);
+    g_assert_nonnull (file);
+    g_assert_cmpstr (cg_toml_file_get_name (file), ==, TOML_FILE_BASIC_TABLE);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+
+    gboolean b = FALSE;
+    int8_t i8 = 0;
+    uint8_t u8 = 0;
+    int64_t i64 = 0;
+    double d = 0.0;
+    gsize len = 0;
+    g_assert_false (cg_toml_table_contains (table, "invalid-key"));
+    g_assert_true (cg_toml_table_get_boolean (table, "bool", &b));
+    g_assert_true (b);
+    g_assert_true (cg_toml_table_get_int8 (table, "int8", &i8));
+    g_assert_cmpint (i8, ==, -8);
+    g_assert_false (cg_toml_table_get_uint8 (table, "int8", &u8));
+    g_assert_true (cg_toml_table_get_int64 (table, "uint64", &i64));
+    g_assert_cmpint (i64, ==, 64);
+    g_assert_true (cg_toml_table_get_double (table, "double", &d));
+    g_assert_cmpfloat (d, ==, 3.141592);
+    g_assert_false (cg_toml_table_get_double (table, "str", &d));
+    g_assert_cmpstr (cg_toml_table_peek_string (table, "str", &len), ==,
+        "str");
+    g_assert_cmpuint (len, ==, 3);
+    g_autofree char *big_str = cg_toml_table_get_string (table, "big_str");
+    g_assert_cmpstr (big_str, ==, "this is a big string with special "
+        "characters (!@#$%^&&*'') to make sure the cgtoml library parses it "
+        "correctly");
+
+    /* Every key is visited once */
+    CgTomlTableIter iter;
+    guint n_keys = 0;
+    const char *key = NULL;
+    cg_toml_table_iter_init (&iter, table);
+    while (cg_toml_table_iter_next (&iter, &key, NULL)) {
+      g_assert_true (cg_toml_table_contains (table, key));
+      n_keys++;
+    }
+    g_assert_cmpuint (n_keys, ==, 12);
+  }
+
+  /* Nested compact tables outlive the file */
+  {
+    g_autoptr (CgTomlTable) subtable = NULL;
+    {
+      g_autoptr (CgTomlFile) file = cg_toml_file_new_full (
+          TOML_FILE_NESTED_TABLE, CG_TOML_FILE_FLAGS_COMPACT);
+      g_assert_nonnull (file);
+      g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+      g_assert_nonnull (table);
+      g_autoptr (CgTomlPath) path = cg_toml_path_new ("table.subtable");
+      subtable = cg_toml_table_get_path_table (table, path);
+      g_assert_null (cg_toml_table_get_qualified_table (table,
+          "table.subtable.key3"));
+      g_assert_cmpstr (cg_toml_table_peek_qualified_string (table,
+          "table.subtable.key3", NULL), ==, "hello world");
+    }
+    g_assert_nonnull (subtable);
+    g_assert_cmpstr (cg_toml_table_peek_string (subtable, "key3", NULL), ==,
+        "hello world");
+  }
+
+  /* Compact arrays */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (TOML_FILE_BASIC_ARRAY,
+        CG_TOML_FILE_FLAGS_COMPACT);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+
+    g_autoptr (CgTomlArray) ints = cg_toml_table_get_array (table,
+        "int64-array");
+    g_assert_nonnull (ints);
+    g_autoptr (GArray) values = cg_toml_array_dup_int64 (ints, NULL);
+    g_assert_nonnull (values);
+    g_assert_cmpuint (values->len, ==, 5);
+    g_assert_cmpint (g_array_index (values, int64_t, 4), ==, 5);
+
+    g_autoptr (CgTomlArray) doubles = cg_toml_table_get_array (table,
+        "double-array");
+    g_assert_nonnull (doubles);
+    double d = 0.0;
+    g_assert_true (cg_toml_array_get_nth_double (doubles, 2, &d));
+    g_assert_cmpfloat (d, ==, 2.1);
+    g_assert_false (cg_toml_array_get_nth_double (doubles, 3, &d));
+
+    g_autoptr (CgTomlArray) strings = cg_toml_table_get_array (table,
+        "str-array");
+    g_assert_nonnull (strings);
+    g_assert_cmpstr (cg_toml_array_peek_string (strings, 1, NULL), ==,
+        "string ");
+  }
+
+  /* Compact arrays of tables */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (TOML_FILE_TABLE_ARRAY,
+        CG_TOML_FILE_FLAGS_COMPACT);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+    g_autoptr (CgTomlTableArray) table_array = cg_toml_table_get_array_table (
+        table, "table-array");
+    g_assert_nonnull (table_array);
+
+    char buffer[256] = "";
+    cg_toml_table_array_for_each (table_array, table_array_for_each, buffer);
+    g_assert_cmpstr (buffer, ==, "hello, can you hear me?");
+    g_assert_cmpuint (cg_toml_table_array_get_length (table_array), ==, 2);
+    g_autoptr (CgTomlTable) second = cg_toml_table_array_get_nth (table_array,
+        1);
+    g_assert_nonnull (second);
+    g_assert_cmpstr (cg_toml_table_peek_string (second, "key1", NULL), ==,
+        ", can you hear me?");
+  }
+}
+
+static void
+test_bytes (void)
+{
+  /* Load the file contents into memory */
+  char *contents = NULL;
+  gsize length = 0;
+  g_assert_true (g_file_get_contents (TOML_FILE_BASIC_TABLE, &contents, &length,
+      NULL));
+  g_autoptr (GBytes) bytes = g_bytes_new_take (contents, length);
+
+  /* Parse the bytes and get its table */
+  g_autoptr (CgTomlFile) file = cg_toml_file_new_from_bytes (bytes);
+  g_assert_nonnull (file);
+  g_assert_null (cg_toml_file_get_name (file));
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  g_assert_nonnull (table);
+
+  /* Check some values */
+  int64_t val = 0;
+  g_assert_true (cg_toml_table_get_int64 (table, "int64", &val));
+  g_assert_cmpint (val, ==, -64);
+  g_autofree char *str = cg_toml_table_get_string (table, "str");
+  g_assert_cmpstr (str, ==, "str");
+
+  /* Invalid bytes must fail cleanly */
+  static const char invalid[] = "key = [1, ";
+  g_autoptr (GBytes) invalid_bytes = g_bytes_new_static (invalid,
+      sizeof (invalid) - 1);
+  g_test_expect_message ("libcgtoml", G_LOG_LEVEL_CRITICAL,
+      "Could not create CgTomlFile*");
+  g_assert_null (cg_toml_file_new_from_bytes (invalid_bytes));
+  g_test_assert_expected_messages ();
+}
+
+static void
+test_mapped (void)
+{
+  /* Parse the mapped file and get its table */
+  g_autoptr (CgTomlFile) file = cg_toml_file_new_mapped (TOML_FILE_TABLE_ARRAY);
+  g_assert_nonnull (file);
+  g_assert_cmpstr (cg_toml_file_get_name (file), ==, TOML_FILE_TABLE_ARRAY);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  g_assert_nonnull (table);
+
+  /* Iterate the table array */
+  g_autoptr (CgTomlTableArray) table_array = cg_toml_table_get_array_table (
+      table, "table-array");
+  g_assert_nonnull (table_array);
+  char buffer[256] = "";
+  cg_toml_table_array_for_each (table_array, table_array_for_each, buffer);
+  g_assert_cmpstr (buffer, ==, "hello, can you hear me?");
+}
+
+static void
+test_snapshot (void)
+{
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-XXXXXX", NULL);
+  g_assert_nonnull (dir);
+  g_autofree char *path = g_build_filename (dir, "nested.snapshot", NULL);
+  g_autofree char *invalid = g_build_filename (dir, "invalid.snapshot", NULL);
+  g_autoptr (GError) error = NULL;
+
+  /* Save a snapshot of a parsed file */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_NESTED_TABLE);
+    g_assert_nonnull (file);
+    g_assert_true (cg_toml_file_save_snapshot (file, path, &error));
+    g_assert_no_error (error);
+  }
+
+  /* Load it back, the values are read from the mapping */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_from_snapshot (path,
+        &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (file);
+    g_assert_cmpstr (cg_toml_file_get_name (file), ==, TOML_FILE_NESTED_TABLE);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_assert_nonnull (table);
+    g_assert_cmpstr (cg_toml_table_peek_qualified_string (table,
+        "table.subtable.key3", NULL), ==, "hello world");
+
+    /* A snapshot of a snapshot is the same snapshot */
+    g_autofree char *again = g_build_filename (dir, "again.snapshot", NULL);
+    g_assert_true (cg_toml_file_save_snapshot (file, again, &error));
+    g_assert_no_error (error);
+    g_autofree char *a = NULL;
+    g_autofree char *b = NULL;
+    gsize a_len = 0, b_len = 0;
+    g_assert_true (g_file_get_contents (path, &a, &a_len, NULL));
+    g_assert_true (g_file_get_contents (again, &b, &b_len, NULL));
+    g_assert_cmpmem (a, a_len, b, b_len);
+    g_assert_cmpint (g_remove (again), ==, 0);
+  }
+
+  /* Text is not a snapshot */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_from_snapshot (
+        TOML_FILE_NESTED_TABLE, &error);
+    g_assert_null (file);
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_INVALID_SNAPSHOT);
+    g_clear_error (&error);
+  }
+
+  /* Neither is a truncated snapshot */
+  {
+    g_autofree char *contents = NULL;
+    gsize length = 0;
+    g_assert_true (g_file_get_contents (path, &contents, &length, NULL));
+    g_assert_true (g_file_set_contents (invalid, contents, length - 8, NULL));
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_from_snapshot (invalid,
+        &error);
+    g_assert_null (file);
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_INVALID_SNAPSHOT);
+    g_clear_error (&error);
+    g_assert_cmpint (g_remove (invalid), ==, 0);
+  }
+
+  /* Nor a corrupted one, whose nodes would point outside of it */
+  {
+    g_autofree char *contents = NULL;
+    gsize length = 0;
+    g_assert_true (g_file_get_contents (path, &contents, &length, NULL));
+    memset (contents + length / 2, 0xff, length - length / 2);
+    g_assert_true (g_file_set_contents (invalid, contents, length, NULL));
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_from_snapshot (invalid,
+        &error);
+    g_assert_null (file);
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_INVALID_SNAPSHOT);
+    g_clear_error (&error);
+    g_assert_cmpint (g_remove (invalid), ==, 0);
+  }
+
+  /* The cache is written on the first load and used on the next ones */
+  {
+    g_autofree char *cache_dir = g_build_filename (dir, "cgtoml", NULL);
+    g_autofree char *source = g_canonicalize_filename (TOML_FILE_TABLE_ARRAY,
+        NULL);
+    g_autofree char *key = g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+        source, -1);
+    g_autofree char *cache_name = g_strconcat (key, ".snapshot", NULL);
+    g_autofree char *cache = g_build_filename (cache_dir, cache_name, NULL);
+    g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+
+    for (guint i = 0; i < 2; i++) {
+      g_autoptr (CgTomlFile) file = cg_toml_file_new_full (
+          TOML_FILE_TABLE_ARRAY, CG_TOML_FILE_FLAGS_CACHE);
+      g_assert_nonnull (file);
+      g_assert_cmpstr (cg_toml_file_get_name (file), ==,
+          TOML_FILE_TABLE_ARRAY);
+      g_assert_true (g_file_test (cache, G_FILE_TEST_IS_REGULAR));
+      g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+      g_autoptr (CgTomlTableArray) table_array = cg_toml_table_get_array_table (
+          table, "table-array");
+      g_assert_nonnull (table_array);
+      char buffer[256] = "";
+      cg_toml_table_array_for_each (table_array, table_array_for_each, buffer);
+      g_assert_cmpstr (buffer, ==, "hello, can you hear me?");
+    }
+
+    g_assert_cmpint (g_remove (cache), ==, 0);
+    g_assert_cmpint (g_rmdir (cache_dir), ==, 0);
+  }
+
+  g_assert_cmpint (g_remove (path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+test_lazy (void)
+{
+  g_autoptr (CgTomlFile) file = cg_toml_file_new_full (TOML_FILE_LAZY,
+      CG_TOML_FILE_FLAGS_LAZY);
+  g_assert_nonnull (file);
+  g_assert_cmpstr (cg_toml_file_get_name (file), ==, TOML_FILE_LAZY);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  g_assert_nonnull (table);
+
+  /* Values before the first header */
+  int64_t i64 = 0;
+  g_assert_true (cg_toml_table_get_int64 (table, "version", &i64));
+  g_assert_cmpint (i64, ==, 3);
+  g_assert_cmpstr (cg_toml_table_peek_string (table, "title", NULL), ==,
+      "lazy");
+  g_assert_false (cg_toml_table_contains (table, "invalid-key"));
+
+  /* Sections, including one split across several headers */
+  g_assert_cmpstr (cg_toml_table_peek_qualified_string (table, "server.host",
+      NULL), ==, "localhost");
+  g_assert_cmpstr (cg_toml_table_peek_qualified_string (table,
+      "server.banner", NULL), ==, "[not-a-header]\nhello");
+  gboolean b = FALSE;
+  g_assert_true (cg_toml_table_get_qualified_boolean (table,
+      "server.tls.enabled", &b));
+  g_assert_true (b);
+  g_autoptr (CgTomlTable) quoted = cg_toml_table_get_table (table,
+      "quoted key");
+  g_assert_nonnull (quoted);
+  g_assert_cmpstr (cg_toml_table_peek_string (quoted, "value", NULL), ==,
+      "literal");
+
+  /* Values spanning several lines */
+  g_autoptr (CgTomlPath) path = cg_toml_path_new ("client.ports");
+  g_autoptr (CgTomlArray) ports = cg_toml_table_get_path_array (table, path);
+  g_assert_nonnull (ports);
+  g_assert_cmpuint (cg_toml_array_get_length (ports), ==, 2);
+
+  /* Arrays of tables split across several headers */
+  g_autoptr (CgTomlTableArray) plugins = cg_toml_table_get_array_table (table,
+      "plugins");
+  g_assert_nonnull (plugins);
+  g_assert_cmpuint (cg_toml_table_array_get_length (plugins), ==, 2);
+  g_autoptr (CgTomlTable) second = cg_toml_table_array_get_nth (plugins, 1);
+  g_assert_cmpstr (cg_toml_table_peek_string (second, "name", NULL), ==,
+      "second");
+
+  /* Every top-level key is visited once */
+  CgTomlTableIter iter;
+  guint n_keys = 0;
+  const char *key = NULL;
+  CgTomlValueView value;
+  cg_toml_table_iter_init (&iter, table);
+  while (cg_toml_table_iter_next (&iter, &key, &value)) {
+    g_assert_true (cg_toml_table_contains (table, key));
+    g_assert_cmpint (cg_toml_value_view_get_value_type (&value), !=,
+        CG_TOML_VALUE_TYPE_NONE);
+    n_keys++;
+  }
+  g_assert_cmpuint (n_keys, ==, 6);
+  g_assert_true (cg_toml_file_check (file, NULL));
+
+  /* Lazy tables outlive their file */
+  g_autoptr (CgTomlTable) server = cg_toml_table_get_table (table, "server");
+  g_clear_pointer (&file, cg_toml_file_unref);
+  g_clear_pointer (&table, cg_toml_table_unref);
+  g_assert_nonnull (server);
+  g_assert_cmpstr (cg_toml_table_peek_string (server, "host", NULL), ==,
+      "localhost");
+
+  /* Invalid sections are told apart from missing keys */
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-lazy-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree char *invalid_path = g_build_filename (dir, "invalid.toml",
+      NULL);
+  g_assert_true (g_file_set_contents (invalid_path,
+      "[valid]\nkey = 1\n[invalid]\nkey = \n", -1, NULL));
+  g_autoptr (CgTomlFile) invalid = cg_toml_file_new_full (invalid_path,
+      CG_TOML_FILE_FLAGS_LAZY);
+  g_assert_nonnull (invalid);
+  g_autoptr (CgTomlTable) invalid_table = cg_toml_file_get_table (invalid);
+  g_assert_true (cg_toml_table_get_qualified_int64 (invalid_table,
+      "valid.key", &i64));
+  g_assert_cmpint (i64, ==, 1);
+  g_assert_false (cg_toml_table_get_qualified_int64 (invalid_table,
+      "invalid.key", &i64));
+  g_assert_false (cg_toml_file_check (invalid, &error));
+  g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+
+  /* Changes fail rather than drop their keys, a patch would delete them */
+  g_test_expect_message ("libcgtoml", G_LOG_LEVEL_WARNING,
+      "Could not set 'valid.key'*invalid*");
+  g_autoptr (CgTomlTable) changed = cg_toml_table_set_qualified_int64 (
+      invalid_table, "valid.key", 2);
+  g_test_assert_expected_messages ();
+  g_assert_null (changed);
+  g_test_expect_message ("libcgtoml", G_LOG_LEVEL_WARNING,
+      "Could not set 'missing'*invalid*");
+  g_autoptr (CgTomlTable) removed = cg_toml_table_remove (invalid_table,
+      "missing");
+  g_test_assert_expected_messages ();
+  g_assert_null (removed);
+  g_autofree char *invalid_text = NULL;
+  g_assert_true (g_file_get_contents (invalid_path, &invalid_text, NULL,
+      NULL));
+  g_assert_cmpstr (invalid_text, ==, "[valid]\nkey = 1\n[invalid]\nkey = \n");
+
+  /* Writing fails rather than leave them out */
+  g_clear_error (&error);
+  g_autoptr (GOutputStream) stream = g_memory_output_stream_new_resizable ();
+  g_assert_false (cg_toml_table_write (invalid_table, stream, NULL, &error));
+  g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+  g_assert_cmpuint (g_memory_output_stream_get_data_size (
+      G_MEMORY_OUTPUT_STREAM (stream)), ==, 0);
+  g_autoptr (GString) string = g_string_new (NULL);
+  g_test_expect_message ("libcgtoml", G_LOG_LEVEL_WARNING,
+      "Could not write CgTomlTable*invalid*");
+  cg_toml_table_write_string (invalid_table, string);
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (string->len, ==, 0);
+
+  /* And so does converting them to a variant */
+  g_clear_error (&error);
+  g_assert_null (cg_toml_table_to_variant (invalid_table, &error));
+  g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+
+  g_assert_cmpint (g_remove (invalid_path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+parser_append_keys (GString *log, const CgTomlSlice *keys, guint n_keys)
+{
+  for (guint i = 0; i < n_keys; i++) {
+    if (i > 0)
+      g_string_append_c (log, '.');
+    g_string_append_len (log, keys[i].data, keys[i].len);
+  }
+}
+
+static gboolean
+parser_on_table (const CgTomlSlice *keys, guint n_keys, gpointer user_data)
+{
+  GString *log = user_data;
+  g_string_append_c (log, '[');
+  parser_append_keys (log, keys, n_keys);
+  g_string_append (log, "] ");
+  return TRUE;
+}
+
+static gboolean
+parser_on_table_array_begin (const CgTomlSlice *keys, guint n_keys,
+    gpointer user_data)
+{
+  GString *log = user_data;
+  g_string_append (log, "[[");
+  parser_append_keys (log, keys, n_keys);
+  g_string_append_c (log, ' ');
+  return TRUE;
+}
+
+static gboolean
+parser_on_table_array_end (gpointer user_data)
+{
+  GString *log = user_data;
+  g_string_append (log, "]] ");
+  return TRUE;
+}
+
+static gboolean
+parser_on_key (const CgTomlSlice *keys, guint n_keys, gpointer user_data)
+{
+  GString *log = user_data;
+  parser_append_keys (log, keys, n_keys);
+  g_string_append_c (log, '=');
+  return TRUE;
+}
+
+static gboolean
+parser_on_scalar (const CgTomlScalar *scalar, gpointer user_data)
+{
+  GString *log = user_data;
+  switch (scalar->type) {
+    case CG_TOML_VALUE_TYPE_BOOLEAN:
+      g_string_append (log, scalar->v_boolean ? "true" : "false");
+      break;
+    case CG_TOML_VALUE_TYPE_INT64:
+      g_string_append_printf (log, "%" G_GINT64_FORMAT, scalar->v_int64);
+      break;
+    case CG_TOML_VALUE_TYPE_DOUBLE:
+      g_string_append_printf (log, "%g", scalar->v_double);
+      break;
+    case CG_TOML_VALUE_TYPE_STRING:
+      g_string_append_c (log, '\'');
+      g_string_append_len (log, scalar->text.data, scalar->text.len);
+      g_string_append_c (log, '\'');
+      break;
+    default:
+      g_string_append_printf (log, "<%d>", scalar->type);
+      g_string_append_len (log, scalar->text.data, scalar->text.len);
+      break;
+  }
+  g_string_append_c (log, ' ');
+  return TRUE;
+}
+
+static gboolean
+parser_on_array_begin (gpointer user_data)
+{
+  g_string_append ((GString *) user_data, "( ");
+  return TRUE;
+}
+
+static gboolean
+parser_on_array_end (gpointer user_data)
+{
+  g_string_append ((GString *) user_data, ") ");
+  return TRUE;
+}
+
+static gboolean
+parser_on_inline_table_begin (gpointer user_data)
+{
+  g_string_append ((GString *) user_data, "{ ");
+  return TRUE;
+}
+
+static gboolean
+parser_on_inline_table_end (gpointer user_data)
+{
+  g_string_append ((GString *) user_data, "} ");
+  return TRUE;
+}
+
+static gboolean
+parser_on_key_stop (const CgTomlSlice *keys, guint n_keys, gpointer user_data)
+{
+  guint *n = user_data;
+  return ++(*n) < 2;
+}
+
+static const CgTomlParserEvents parser_events = {
+  .table = parser_on_table,
+  .table_array_begin = parser_on_table_array_begin,
+  .table_array_end = parser_on_table_array_end,
+  .key = parser_on_key,
+  .scalar = parser_on_scalar,
+  .array_begin = parser_on_array_begin,
+  .array_end = parser_on_array_end,
+  .inline_table_begin = parser_on_inline_table_begin,
+  .inline_table_end = parser_on_inline_table_end,
+};
+
+static void
+test_parser (void)
+{
+  g_autoptr (GString) log = g_string_new (NULL);
+  g_autoptr (CgTomlParser) parser = cg_toml_parser_new (&parser_events, log);
+  g_assert_nonnull (parser);
+  g_autoptr (GError) error = NULL;
+
+  /* Scalars, with escapes and values spanning several lines */
+  {
+    const char *doc =
+        "a = 1_000\n"
+        "b.c = \"x\\ty\"\n"
+        "d = '''\n[not-a-header]'''\n"
+        "e = [1.5, [true],\n  # comment\n  0x10,\n]\n"
+        "f = { g = 1979-05-27T07:32:00Z, h = {} }\n";
+    g_assert_true (cg_toml_parser_parse (parser, doc, strlen (doc), &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==,
+        "a=1000 b.c='x\ty' d='[not-a-header]' "
+        "e=( 1.5 ( true ) 16 ) "
+        "f={ g=<8>1979-05-27T07:32:00Z h={ } } ");
+  }
+
+  /* Elements of arrays of tables end with the first header outside them */
+  {
+    g_string_truncate (log, 0);
+    const char *doc =
+        "[[hosts]]\nname = \"a\"\n"
+        "[hosts.meta]\nrack = 1\n"
+        "[[hosts]]\nname = \"b\"\n"
+        "[other]\n";
+    g_assert_true (cg_toml_parser_parse (parser, doc, strlen (doc), &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==,
+        "[[hosts name='a' [hosts.meta] rack=1 ]] "
+        "[[hosts name='b' ]] [other] ");
+  }
+
+  /* Files are streamed, the last element ends with the document */
+  {
+    g_string_truncate (log, 0);
+    g_assert_true (cg_toml_parser_parse_file (parser, TOML_FILE_TABLE_ARRAY,
+        &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==,
+        "[[table-array key1='hello' ]] "
+        "[[table-array key1=', can you hear me?' ]] ");
+  }
+
+  /* Syntax errors */
+  {
+    const char *doc = "a = 1\nb = \n";
+    g_assert_false (cg_toml_parser_parse (parser, doc, strlen (doc), &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+    g_assert_nonnull (strstr (error->message, "Line 2"));
+    g_clear_error (&error);
+  }
+
+  /* Events can stop the parsing */
+  {
+    CgTomlParserEvents events = { .key = parser_on_key_stop };
+    guint n = 0;
+    g_autoptr (CgTomlParser) stopped = cg_toml_parser_new (&events, &n);
+    const char *doc = "a = 1\nb = 2\nc = 3\n";
+    g_assert_false (cg_toml_parser_parse (stopped, doc, strlen (doc), &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_STOPPED);
+    g_assert_cmpuint (n, ==, 2);
+    g_clear_error (&error);
+  }
+}
+
+typedef struct {
+  CgTomlParser *parser;
+  GMainLoop *loop;
+} ParserStreamData;
+
+static void
+parser_on_stream_done (GObject *source, GAsyncResult *res, gpointer data)
+{
+  ParserStreamData *d = data;
+  g_autoptr (GError) error = NULL;
+  g_assert_true (cg_toml_parser_parse_stream_finish (d->parser, res, &error));
+  g_assert_no_error (error);
+  g_main_loop_quit (d->loop);
+}
+
+static void
+test_parser_feed (void)
+{
+  g_autoptr (GString) log = g_string_new (NULL);
+  g_autoptr (CgTomlParser) parser = cg_toml_parser_new (&parser_events, log);
+  g_assert_nonnull (parser);
+  g_autoptr (GError) error = NULL;
+  const char *doc =
+      "a = \"x\\\"y\" # \"\n"
+      "b = \"\"\"\nq\"\"\"\"\"\n"
+      "c = [1, { d = 'e' },\n  2]\n"
+      "[[t]]\nf = 1.5\n"
+      "[g]\nh = true";
+  const gsize len = strlen (doc);
+
+  /* Parse the whole document */
+  g_assert_true (cg_toml_parser_parse (parser, doc, len, &error));
+  g_assert_no_error (error);
+  g_autofree char *expected = g_strdup (log->str);
+
+  /* Any split of the document emits the same events */
+  for (gsize step = 1; step <= 8; step++) {
+    g_string_truncate (log, 0);
+    for (gsize i = 0; i < len; i += step)
+      g_assert_true (cg_toml_parser_feed (parser, doc + i, MIN (step, len - i),
+          &error));
+    g_assert_true (cg_toml_parser_end (parser, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==, expected);
+  }
+
+  /* Statements are emitted as soon as they end */
+  {
+    g_string_truncate (log, 0);
+    g_assert_true (cg_toml_parser_feed (parser, "a = [1,", 7, &error));
+    g_assert_cmpstr (log->str, ==, "");
+    g_assert_true (cg_toml_parser_feed (parser, " 2]\nb", 5, &error));
+    g_assert_cmpstr (log->str, ==, "a=( 1 2 ) ");
+    g_assert_true (cg_toml_parser_feed (parser, " = 3", 4, &error));
+    g_assert_true (cg_toml_parser_end (parser, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==, "a=( 1 2 ) b=3 ");
+  }
+
+  /* Errors reset the parser */
+  {
+    g_string_truncate (log, 0);
+    g_assert_false (cg_toml_parser_feed (parser, "a = \n", 5, &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+    g_clear_error (&error);
+    g_assert_true (cg_toml_parser_feed (parser, "b = 1", 5, &error));
+    g_assert_true (cg_toml_parser_end (parser, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==, "b=1 ");
+  }
+
+  /* Streams */
+  {
+    g_string_truncate (log, 0);
+    g_autoptr (GInputStream) stream = g_memory_input_stream_new_from_data (
+        doc, len, NULL);
+    g_assert_true (cg_toml_parser_parse_stream (parser, stream, NULL, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (log->str, ==, expected);
+  }
+
+  /* Asynchronous streams */
+  {
+    g_string_truncate (log, 0);
+    g_autoptr (GInputStream) stream = g_memory_input_stream_new_from_data (
+        doc, len, NULL);
+    g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+    ParserStreamData data = { parser, loop };
+    cg_toml_parser_parse_stream_async (parser, stream, G_PRIORITY_DEFAULT,
+        NULL, parser_on_stream_done, &data);
+    g_main_loop_run (loop);
+    g_assert_cmpstr (log->str, ==, expected);
+  }
+}
+
+typedef struct {
+  GMainLoop *loop;
+  CgTomlFile *file;
+  GError *error;
+  goffset progress;
+} FileNewAsyncData;
+
+static void
+file_on_progress (goffset current, goffset total, gpointer data)
+{
+  FileNewAsyncData *d = data;
+  g_assert_cmpint (current, <=, total);
+  g_assert_cmpint (current, >=, d->progress);
+  d->progress = current;
+}
+
+static void
+file_on_new_done (GObject *source, GAsyncResult *res, gpointer data)
+{
+  FileNewAsyncData *d = data;
+  d->file = cg_toml_file_new_finish (res, &d->error);
+  g_main_loop_quit (d->loop);
+}
+
+static void
+test_async (void)
+{
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+
+  /* Load a file, the last progress report covers all of it */
+  {
+    FileNewAsyncData d = { loop, NULL, NULL, 0 };
+    cg_toml_file_new_async (TOML_FILE_BASIC_TABLE, CG_TOML_FILE_FLAGS_NONE,
+        G_PRIORITY_DEFAULT, NULL, file_on_progress, &d, file_on_new_done, &d);
+    g_main_loop_run (loop);
+    g_assert_no_error (d.error);
+    g_assert_nonnull (d.file);
+    g_assert_cmpstr (cg_toml_file_get_name (d.file), ==,
+        TOML_FILE_BASIC_TABLE);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (d.file);
+    g_assert_true (cg_toml_table_contains (table, "bool"));
+    g_assert_cmpint (d.progress, >, 0);
+    cg_toml_file_unref (d.file);
+  }
+
+  /* Flags are honored */
+  {
+    FileNewAsyncData d = { loop, NULL, NULL, 0 };
+    cg_toml_file_new_async (TOML_FILE_LAZY, CG_TOML_FILE_FLAGS_LAZY,
+        G_PRIORITY_DEFAULT, NULL, NULL, NULL, file_on_new_done, &d);
+    g_main_loop_run (loop);
+    g_assert_no_error (d.error);
+    g_assert_nonnull (d.file);
+    cg_toml_file_unref (d.file);
+  }
+
+  /* Errors */
+  {
+    FileNewAsyncData d = { loop, NULL, NULL, 0 };
+    cg_toml_file_new_async ("invalid-file.toml", CG_TOML_FILE_FLAGS_NONE,
+        G_PRIORITY_DEFAULT, NULL, NULL, NULL, file_on_new_done, &d);
+    g_main_loop_run (loop);
+    g_assert_error (d.error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_assert_null (d.file);
+    g_clear_error (&d.error);
+  }
+
+  /* Cached and lazy loads report the real error without criticals */
+  {
+    g_autoptr (GError) error = NULL;
+    g_autofree char *dir = g_dir_make_tmp ("cgtoml-async-XXXXXX", &error);
+    g_assert_no_error (error);
+    g_autofree char *path = g_build_filename (dir, "invalid.toml", NULL);
+    g_assert_true (g_file_set_contents (path, "key = [1, ", -1, NULL));
+    const CgTomlFileFlags flags[] = {
+      CG_TOML_FILE_FLAGS_CACHE, CG_TOML_FILE_FLAGS_LAZY
+    };
+    for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+      FileNewAsyncData d = { loop, NULL, NULL, 0 };
+      cg_toml_file_new_async (path, flags[i], G_PRIORITY_DEFAULT, NULL, NULL,
+          NULL, file_on_new_done, &d);
+      g_main_loop_run (loop);
+      g_assert_error (d.error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+      g_assert_null (d.file);
+      g_clear_error (&d.error);
+    }
+    g_assert_cmpint (g_remove (path), ==, 0);
+    g_assert_cmpint (g_rmdir (dir), ==, 0);
+  }
+
+  /* Cancellation */
+  {
+    FileNewAsyncData d = { loop, NULL, NULL, 0 };
+    g_autoptr (GCancellable) cancellable = g_cancellable_new ();
+    g_cancellable_cancel (cancellable);
+    cg_toml_file_new_async (TOML_FILE_BASIC_TABLE, CG_TOML_FILE_FLAGS_NONE,
+        G_PRIORITY_DEFAULT, cancellable, NULL, NULL, file_on_new_done, &d);
+    g_main_loop_run (loop);
+    g_assert_error (d.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_assert_null (d.file);
+    g_clear_error (&d.error);
+  }
+}
+
+static void
+test_directory (void)
+{
+  g_autoptr (GError) error = NULL;
+
+  for (guint i = 0; i < 2; i++) {
+    CgTomlFileFlags flags = i ? CG_TOML_FILE_FLAGS_COMPACT :
+        CG_TOML_FILE_FLAGS_NONE;
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_from_directory (
+        TOML_DIR_CONF_D, flags, &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (file);
+    g_assert_cmpstr (cg_toml_file_get_name (file), ==, TOML_DIR_CONF_D);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+
+    /* Later files replace the values of earlier ones */
+    g_autofree char *name = cg_toml_table_get_string (table, "name");
+    g_assert_cmpstr (name, ==, "override");
+    int64_t level = 0;
+    g_assert_true (cg_toml_table_get_int64 (table, "level", &level));
+    g_assert_cmpint (level, ==, 2);
+
+    /* Arrays are replaced, not appended */
+    g_autoptr (CgTomlArray) ports = cg_toml_table_get_array (table, "ports");
+    g_assert_cmpuint (cg_toml_array_get_length (ports), ==, 1);
+
+    /* Tables are merged key by key */
+    g_autofree char *host = cg_toml_table_get_qualified_string (table,
+        "server.host");
+    g_assert_cmpstr (host, ==, "localhost");
+    int64_t port = 0;
+    g_assert_true (cg_toml_table_get_qualified_int64 (table, "server.port",
+        &port));
+    g_assert_cmpint (port, ==, 9090);
+    gboolean enabled = FALSE;
+    g_assert_true (cg_toml_table_get_qualified_boolean (table,
+        "server.tls.enabled", &enabled));
+    g_assert_true (enabled);
+    g_autofree char *cert = cg_toml_table_get_qualified_string (table,
+        "server.tls.cert");
+    g_assert_cmpstr (cert, ==, "/etc/base.pem");
+    g_autofree char *log_level = cg_toml_table_get_qualified_string (table,
+        "logging.level");
+    g_assert_cmpstr (log_level, ==, "debug");
+  }
+
+  /* Errors */
+  {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_from_directory (
+        "invalid-dir", CG_TOML_FILE_FLAGS_NONE, &error);
+    g_assert_null (file);
+    g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_clear_error (&error);
+  }
+}
+
+static void
+test_get_many (void)
+{
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (
+        TOML_FILE_NESTED_TABLE, flags[i]);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    double key1 = 0;
+    uint16_t key2 = 0;
+    char *key3 = NULL;
+    char *missing = NULL;
+    int8_t too_big = 0;
+    gboolean wrong_type = TRUE;
+    const CgTomlQuery queries[] = {
+      { "table.subtable.key3", CG_TOML_FIELD_TYPE_STRING, &key3 },
+      { "table.key1", CG_TOML_FIELD_TYPE_DOUBLE, &key1 },
+      { "table.missing", CG_TOML_FIELD_TYPE_STRING, &missing,
+          { .v_string = "default" } },
+      { "table.key2", CG_TOML_FIELD_TYPE_UINT16, &key2 },
+      { "table.key2", CG_TOML_FIELD_TYPE_INT8, &too_big, { .v_int64 = -1 } },
+      { "table", CG_TOML_FIELD_TYPE_BOOLEAN, &wrong_type,
+          { .v_boolean = FALSE } },
+    };
+    guint64 found[CG_TOML_QUERY_BITMAP_SIZE (G_N_ELEMENTS (queries))];
+
+    /* Found values are stored, defaults replace the others */
+    g_assert_false (cg_toml_table_get_many (table, queries,
+        G_N_ELEMENTS (queries), found));
+    g_assert_true (CG_TOML_QUERY_FOUND (found, 0));
+    g_assert_true (CG_TOML_QUERY_FOUND (found, 1));
+    g_assert_false (CG_TOML_QUERY_FOUND (found, 2));
+    g_assert_true (CG_TOML_QUERY_FOUND (found, 3));
+    g_assert_false (CG_TOML_QUERY_FOUND (found, 4));
+    g_assert_false (CG_TOML_QUERY_FOUND (found, 5));
+    g_assert_cmpstr (key3, ==, "hello world");
+    g_assert_cmpfloat_with_epsilon (key1, 0.1, 0.000001);
+    g_assert_cmpstr (missing, ==, "default");
+    g_assert_cmpuint (key2, ==, 1284);
+    g_assert_cmpint (too_big, ==, -1);
+    g_assert_false (wrong_type);
+    g_clear_pointer (&key3, g_free);
+    g_clear_pointer (&missing, g_free);
+
+    /* The same through a view, every query found */
+    CgTomlTableView view;
+    cg_toml_table_get_view (table, &view);
+    g_assert_true (cg_toml_table_view_get_many (&view, queries, 2, NULL));
+    g_assert_cmpstr (key3, ==, "hello world");
+    g_clear_pointer (&key3, g_free);
+  }
+}
+
+typedef struct {
+  gboolean b;
+  int8_t i8;
+  uint8_t u8;
+  int16_t i16;
+  uint16_t u16;
+  int32_t i32;
+  uint32_t u32;
+  int64_t i64;
+  uint64_t u64;
+  double d;
+  char *str;
+  char *missing;
+  int32_t fallback;
+} DecodeBasic;
+
+typedef struct {
+  char *key1;
+  gboolean flag;
+} DecodeEntry;
+
+static void
+test_decode (void)
+{
+  static const CgTomlField basic_fields[] = {
+    { "bool", CG_TOML_FIELD_TYPE_BOOLEAN, G_STRUCT_OFFSET (DecodeBasic, b),
+        TRUE },
+    { "int8", CG_TOML_FIELD_TYPE_INT8, G_STRUCT_OFFSET (DecodeBasic, i8),
+        TRUE },
+    { "uint8", CG_TOML_FIELD_TYPE_UINT8, G_STRUCT_OFFSET (DecodeBasic, u8),
+        TRUE },
+    { "int16", CG_TOML_FIELD_TYPE_INT16, G_STRUCT_OFFSET (DecodeBasic, i16),
+        TRUE },
+    { "uint16", CG_TOML_FIELD_TYPE_UINT16, G_STRUCT_OFFSET (DecodeBasic, u16),
+        TRUE },
+    { "int32", CG_TOML_FIELD_TYPE_INT32, G_STRUCT_OFFSET (DecodeBasic, i32),
+        TRUE },
+    { "uint32", CG_TOML_FIELD_TYPE_UINT32, G_STRUCT_OFFSET (DecodeBasic, u32),
+        TRUE },
+    { "int64", CG_TOML_FIELD_TYPE_INT64, G_STRUCT_OFFSET (DecodeBasic, i64),
+        TRUE },
+    { "uint64", CG_TOML_FIELD_TYPE_UINT64, G_STRUCT_OFFSET (DecodeBasic, u64),
+        TRUE },
+    { "double", CG_TOML_FIELD_TYPE_DOUBLE, G_STRUCT_OFFSET (DecodeBasic, d),
+        TRUE },
+    { "str", CG_TOML_FIELD_TYPE_STRING, G_STRUCT_OFFSET (DecodeBasic, str),
+        TRUE },
+    { "missing", CG_TOML_FIELD_TYPE_STRING,
+        G_STRUCT_OFFSET (DecodeBasic, missing), FALSE,
+        { .v_string = "default" } },
+    { "fallback", CG_TOML_FIELD_TYPE_INT32,
+        G_STRUCT_OFFSET (DecodeBasic, fallback), FALSE, { .v_int64 = -7 } },
+  };
+  static const CgTomlField entry_fields[] = {
+    { "key1", CG_TOML_FIELD_TYPE_STRING, G_STRUCT_OFFSET (DecodeEntry, key1),
+        TRUE },
+    { "bool", CG_TOML_FIELD_TYPE_BOOLEAN, G_STRUCT_OFFSET (DecodeEntry, flag),
+        FALSE, { .v_boolean = FALSE } },
+  };
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+  g_autoptr (CgTomlSchema) basic = cg_toml_schema_new (basic_fields,
+      G_N_ELEMENTS (basic_fields), sizeof (DecodeBasic));
+  g_assert_nonnull (basic);
+  g_assert_cmpuint (cg_toml_schema_get_n_fields (basic), ==,
+      G_N_ELEMENTS (basic_fields));
+  g_autoptr (CgTomlSchema) entry = cg_toml_schema_new (entry_fields,
+      G_N_ELEMENTS (entry_fields), sizeof (DecodeEntry));
+  g_assert_nonnull (entry);
+
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    /* A table, with defaults for the missing fields */
+    {
+      g_autoptr (GError) error = NULL;
+      g_autoptr (CgTomlFile) file = cg_toml_file_new_full (
+          TOML_FILE_BASIC_TABLE, flags[i]);
+      g_assert_nonnull (file);
+      g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+      DecodeBasic d;
+      g_assert_true (cg_toml_table_decode (table, basic, &d, &error));
+      g_assert_no_error (error);
+      g_assert_true (d.b);
+      g_assert_cmpint (d.i8, ==, -8);
+      g_assert_cmpuint (d.u8, ==, 8);
+      g_assert_cmpint (d.i16, ==, -16);
+      g_assert_cmpuint (d.u16, ==, 16);
+      g_assert_cmpint (d.i32, ==, -32);
+      g_assert_cmpuint (d.u32, ==, 32);
+      g_assert_cmpint (d.i64, ==, -64);
+      g_assert_cmpuint (d.u64, ==, 64);
+      g_assert_cmpfloat_with_epsilon (d.d, 3.141592, 0.000001);
+      g_assert_cmpstr (d.str, ==, "str");
+      g_assert_cmpstr (d.missing, ==, "default");
+      g_assert_cmpint (d.fallback, ==, -7);
+      cg_toml_schema_clear (basic, &d);
+      g_assert_null (d.str);
+      g_assert_null (d.missing);
+
+      /* The same through a view */
+      CgTomlTableView view;
+      cg_toml_table_get_view (table, &view);
+      g_assert_true (cg_toml_table_view_decode (&view, basic, &d, &error));
+      g_assert_no_error (error);
+      g_assert_cmpstr (d.str, ==, "str");
+      cg_toml_schema_clear (basic, &d);
+    }
+
+    /* An array of tables into contiguous structs */
+    {
+      g_autoptr (GError) error = NULL;
+      g_autoptr (CgTomlFile) file = cg_toml_file_new_full (
+          TOML_FILE_TABLE_ARRAY, flags[i]);
+      g_assert_nonnull (file);
+      g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+      g_autoptr (CgTomlTableArray) table_array = cg_toml_table_get_array_table (
+          table, "table-array");
+      g_assert_nonnull (table_array);
+      guint n = 0;
+      DecodeEntry *entries = cg_toml_table_array_decode (table_array, entry,
+          &n, &error);
+      g_assert_no_error (error);
+      g_assert_nonnull (entries);
+      g_assert_cmpuint (n, ==, 2);
+      g_assert_cmpstr (entries[0].key1, ==, "hello");
+      g_assert_false (entries[0].flag);
+      g_assert_cmpstr (entries[1].key1, ==, ", can you hear me?");
+      cg_toml_schema_free_array (entry, entries, n);
+
+      /* A required field missing from one of the tables */
+      g_assert_null (cg_toml_table_array_decode (table_array, basic, &n,
+          &error));
+      g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_MISSING_FIELD);
+      g_clear_error (&error);
+    }
+  }
+
+  /* Values of the wrong type or out of range, no string is left behind */
+  {
+    static const CgTomlField wrong_type[] = {
+      { "str", CG_TOML_FIELD_TYPE_STRING, G_STRUCT_OFFSET (DecodeBasic, str),
+          TRUE },
+      { "big_str", CG_TOML_FIELD_TYPE_INT64,
+          G_STRUCT_OFFSET (DecodeBasic, i64), TRUE },
+    };
+    static const CgTomlField out_of_range[] = {
+      { "str", CG_TOML_FIELD_TYPE_STRING, G_STRUCT_OFFSET (DecodeBasic, str),
+          TRUE },
+      { "int16", CG_TOML_FIELD_TYPE_UINT8, G_STRUCT_OFFSET (DecodeBasic, u8),
+          TRUE },
+    };
+    g_autoptr (GError) error = NULL;
+    g_autoptr (CgTomlFile) file = cg_toml_file_new (TOML_FILE_BASIC_TABLE);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    DecodeBasic d;
+
+    g_autoptr (CgTomlSchema) schema = cg_toml_schema_new (wrong_type,
+        G_N_ELEMENTS (wrong_type), sizeof (DecodeBasic));
+    g_assert_false (cg_toml_table_decode (table, schema, &d, &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH);
+    g_assert_null (d.str);
+    g_clear_error (&error);
+
+    g_autoptr (CgTomlSchema) range = cg_toml_schema_new (out_of_range,
+        G_N_ELEMENTS (out_of_range), sizeof (DecodeBasic));
+    g_assert_false (cg_toml_table_decode (table, range, &d, &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH);
+    g_assert_null (d.str);
+  }
+}
+
+#define THREADS_N_THREADS 8
+#define THREADS_N_LOOKUPS 1000
+
+static gpointer
+threads_lookup (gpointer data)
+{
+  CgTomlFile *file = data;
+  g_autoptr (CgTomlPath) path = cg_toml_path_new ("server.tls.enabled");
+
+  for (guint i = 0; i < THREADS_N_LOOKUPS; i++) {
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_autoptr (CgTomlTable) server = cg_toml_table_get_table (table, "server");
+    g_assert_nonnull (server);
+    g_assert_cmpstr (cg_toml_table_peek_string (server, "host", NULL), ==,
+        "localhost");
+    gboolean b = FALSE;
+    g_assert_true (cg_toml_table_get_path_boolean (table, path, &b));
+    g_assert_true (b);
+    g_autoptr (CgTomlTableArray) plugins = cg_toml_table_get_array_table (
+        table, "plugins");
+    g_assert_nonnull (plugins);
+    g_assert_cmpuint (cg_toml_table_array_get_length (plugins), ==, 2);
+  }
+
+  cg_toml_file_unref (file);
+  return NULL;
+}
+
+static void
+test_threads (void)
+{
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  /* Every thread reads the same document, lazy sections are parsed by
+   * whichever thread gets there first */
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (TOML_FILE_LAZY,
+        flags[i]);
+    g_assert_nonnull (file);
+    GThread *threads[THREADS_N_THREADS];
+    for (guint j = 0; j < THREADS_N_THREADS; j++)
+      threads[j] = g_thread_new ("reader", threads_lookup,
+          cg_toml_file_ref (file));
+    for (guint j = 0; j < THREADS_N_THREADS; j++)
+      g_thread_join (threads[j]);
+  }
+}
+
+#define HOLDER_N_THREADS 4
+#define HOLDER_N_REVISIONS 200
+
+typedef struct {
+  CgTomlSnapshotHolder *holder;
+  gint stop;
+} HolderData;
+
+static CgTomlFile *
+holder_new_revision (gint64 revision)
+{
+  g_autofree char *text = g_strdup_printf (
+      "revision = %" G_GINT64_FORMAT "\n"
+      "[copy]\nrevision = %" G_GINT64_FORMAT "\n", revision, revision);
+  g_autoptr (GBytes) bytes = g_bytes_new (text, strlen (text));
+  return cg_toml_file_new_from_bytes (bytes);
+}
+
+static gpointer
+holder_read (gpointer data)
+{
+  HolderData *d = data;
+  int64_t last = 0;
+
+  while (!g_atomic_int_get (&d->stop)) {
+    /* A pinned revision stays consistent and never goes back */
+    g_autoptr (CgTomlFile) file = cg_toml_snapshot_holder_acquire (d->holder);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    int64_t revision = 0, copy = 0;
+    g_assert_true (cg_toml_table_get_int64 (table, "revision", &revision));
+    g_assert_true (cg_toml_table_get_qualified_int64 (table, "copy.revision",
+        &copy));
+    g_assert_cmpint (revision, ==, copy);
+    g_assert_cmpint (revision, >=, last);
+    last = revision;
+  }
+  return NULL;
+}
+
+static void
+test_snapshot_holder (void)
+{
+  /* An empty holder */
+  {
+    g_autoptr (CgTomlSnapshotHolder) holder = cg_toml_snapshot_holder_new (
+        NULL);
+    g_assert_nonnull (holder);
+    g_assert_null (cg_toml_snapshot_holder_acquire (holder));
+  }
+
+  /* A pinned revision outlives the holder */
+  g_autoptr (CgTomlFile) first = holder_new_revision (0);
+  g_autoptr (CgTomlSnapshotHolder) holder = cg_toml_snapshot_holder_new (
+      first);
+  g_autoptr (CgTomlFile) pinned = cg_toml_snapshot_holder_acquire (holder);
+  g_assert_true (pinned == first);
+  {
+    g_autoptr (CgTomlFile) second = holder_new_revision (1);
+    cg_toml_snapshot_holder_publish (holder, second);
+    g_autoptr (CgTomlFile) current = cg_toml_snapshot_holder_acquire (holder);
+    g_assert_true (current == second);
+  }
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (pinned);
+  int64_t revision = -1;
+  g_assert_true (cg_toml_table_get_int64 (table, "revision", &revision));
+  g_assert_cmpint (revision, ==, 0);
+
+  /* Readers only ever see whole revisions while they are published */
+  HolderData d = { holder, 0 };
+  GThread *threads[HOLDER_N_THREADS];
+  for (guint i = 0; i < HOLDER_N_THREADS; i++)
+    threads[i] = g_thread_new ("reader", holder_read, &d);
+  for (gint64 i = 2; i < HOLDER_N_REVISIONS; i++) {
+    g_autoptr (CgTomlFile) file = holder_new_revision (i);
+    cg_toml_snapshot_holder_publish (holder, file);
+  }
+  g_atomic_int_set (&d.stop, 1);
+  for (guint i = 0; i < HOLDER_N_THREADS; i++)
+    g_thread_join (threads[i]);
+}
+
+static void
+diff_check (const char *old_text, const char *new_text, CgTomlFileFlags flags,
+    const char *added, const char *removed, const char *modified)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-diff-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree char *old_path = g_build_filename (dir, "old.toml", NULL);
+  g_autofree char *new_path = g_build_filename (dir, "new.toml", NULL);
+  g_assert_true (g_file_set_contents (old_path, old_text, -1, NULL));
+  g_assert_true (g_file_set_contents (new_path, new_text, -1, NULL));
+
+  g_autoptr (CgTomlFile) old_file = cg_toml_file_new_full (old_path, flags);
+  g_assert_nonnull (old_file);
+  g_autoptr (CgTomlFile) new_file = cg_toml_file_new_full (new_path, flags);
+  g_assert_nonnull (new_file);
+  g_autoptr (CgTomlTable) old_table = cg_toml_file_get_table (old_file);
+  g_autoptr (CgTomlTable) new_table = cg_toml_file_get_table (new_file);
+  g_autoptr (CgTomlTableDiff) diff = cg_toml_table_diff (old_table,
+      new_table, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (diff);
+
+  g_autofree char *a = g_strjoinv (" ", diff->added);
+  g_autofree char *r = g_strjoinv (" ", diff->removed);
+  g_autofree char *m = g_strjoinv (" ", diff->modified);
+  g_assert_cmpstr (a, ==, added);
+  g_assert_cmpstr (r, ==, removed);
+  g_assert_cmpstr (m, ==, modified);
+
+  g_assert_cmpint (g_remove (old_path), ==, 0);
+  g_assert_cmpint (g_remove (new_path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+test_diff (void)
+{
+  static const char *old_text =
+      "name = \"a\"\n"
+      "ports = [80, 443]\n"
+      "[server]\nhost = \"localhost\"\ntimeout = 1.5\n"
+      "[server.tls]\nenabled = false\n"
+      "[logging]\nlevel = \"info\"\n"
+      "[[backend]]\nurl = \"a\"\n";
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    /* Equal documents, whatever their formatting */
+    diff_check (old_text,
+        "name = \"a\" # comment\n"
+        "ports = [ 80, 443 ]\n"
+        "[logging]\nlevel = \"info\"\n"
+        "[server]\nhost = \"localhost\"\ntimeout = 1.5\n"
+        "[server.tls]\nenabled = false\n"
+        "[[backend]]\nurl = \"a\"\n", flags[i], "", "", "");
+
+    /* A change deep in a subtree, the others are left alone */
+    diff_check (old_text,
+        "name = \"a\"\n"
+        "ports = [80, 443]\n"
+        "[server]\nhost = \"localhost\"\ntimeout = 1.5\n"
+        "[server.tls]\nenabled = true\n"
+        "[logging]\nlevel = \"info\"\n"
+        "[[backend]]\nurl = \"a\"\n", flags[i], "", "",
+        "server.tls.enabled");
+
+    /* Added, removed and modified keys, arrays are compared as a whole */
+    diff_check (old_text,
+        "name = \"b\"\n"
+        "ports = [80]\n"
+        "[server]\nhost = \"localhost\"\nuser = \"root\"\n"
+        "[server.tls]\nenabled = false\n"
+        "[metrics]\nenabled = true\n"
+        "[[backend]]\nurl = \"b\"\n", flags[i], "metrics server.user",
+        "logging server.timeout", "backend name ports");
+  }
+
+  /* The keys of an invalid lazy section are not reported as removed */
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-diff-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree char *path = g_build_filename (dir, "invalid.toml", NULL);
+  g_assert_true (g_file_set_contents (path,
+      "[server]\nhost = \"localhost\"\n[logging]\nlevel = \n", -1, NULL));
+  g_autoptr (CgTomlFile) new_file = cg_toml_file_new_full (path,
+      CG_TOML_FILE_FLAGS_LAZY);
+  g_assert_nonnull (new_file);
+  g_autoptr (CgTomlTable) new_table = cg_toml_file_get_table (new_file);
+  static const char valid[] = "[logging]\nlevel = \"info\"\n";
+  g_autoptr (GBytes) old_bytes = g_bytes_new_static (valid,
+      sizeof (valid) - 1);
+  g_autoptr (CgTomlFile) old_file = cg_toml_file_new_from_bytes (old_bytes);
+  g_autoptr (CgTomlTable) old_table = cg_toml_file_get_table (old_file);
+  g_autoptr (CgTomlTableDiff) diff = cg_toml_table_diff (old_table,
+      new_table, &error);
+  g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+  g_assert_null (diff);
+  g_assert_cmpint (g_remove (path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+write_check (const char *text, CgTomlFileFlags flags)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-write-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree char *path = g_build_filename (dir, "in.toml", NULL);
+  g_autofree char *out_path = g_build_filename (dir, "out.toml", NULL);
+  g_assert_true (g_file_set_contents (path, text, -1, NULL));
+
+  g_autoptr (CgTomlFile) file = cg_toml_file_new_full (path, flags);
+  g_assert_nonnull (file);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+
+  /* The same text is written to a string, a stream and a file */
+  g_autoptr (GString) string = g_string_new (NULL);
+  cg_toml_table_write_string (table, string);
+  g_autoptr (GOutputStream) stream = g_memory_output_stream_new_resizable ();
+  g_assert_true (cg_toml_table_write (table, stream, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_true (g_output_stream_close (stream, NULL, NULL));
+  g_assert_cmpmem (g_memory_output_stream_get_data (
+      G_MEMORY_OUTPUT_STREAM (stream)), g_memory_output_stream_get_data_size (
+      G_MEMORY_OUTPUT_STREAM (stream)), string->str, string->len);
+  int fd = g_open (out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  g_assert_cmpint (fd, >=, 0);
+  g_assert_true (cg_toml_table_write_fd (table, fd, &error));
+  g_assert_no_error (error);
+  g_assert_true (g_close (fd, NULL));
+
+  /* Which parses back into the same document */
+  g_autoptr (CgTomlFile) out_file = cg_toml_file_new_full (out_path, flags);
+  g_assert_nonnull (out_file);
+  g_autoptr (CgTomlTable) out_table = cg_toml_file_get_table (out_file);
+  g_autoptr (CgTomlTableDiff) diff = cg_toml_table_diff (table, out_table,
+      &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (diff);
+  g_assert_null (diff->added[0]);
+  g_assert_null (diff->removed[0]);
+  g_assert_null (diff->modified[0]);
+
+  g_assert_cmpint (g_remove (path), ==, 0);
+  g_assert_cmpint (g_remove (out_path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+write_check_text (const char *text, const char *expected)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-write-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree char *path = g_build_filename (dir, "in.toml", NULL);
+  g_assert_true (g_file_set_contents (path, text, -1, NULL));
+
+  g_autoptr (CgTomlFile) file = cg_toml_file_new (path);
+  g_assert_nonnull (file);
+  g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+  g_autoptr (GString) string = g_string_new (NULL);
+  cg_toml_table_write_string (table, string);
+  g_assert_cmpstr (string->str, ==, expected);
+
+  g_assert_cmpint (g_remove (path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+test_write (void)
+{
+  static const char *text =
+      "title = \"quote \\\" backslash \\\\ tab \\t \\u00e9 \\u0001\"\n"
+      "\"quoted key\" = -42\n"
+      "floats = [0.1, 1e-7, 1.7976931348623157e308, -0.0, 1e22, 123.456]\n"
+      "bools = [true, false]\n"
+      "nested = [[1, 2], [\"a\"]]\n"
+      "date = 1979-05-27\n"
+      "time = 07:32:00.999999\n"
+      "local = 1979-05-27T07:32:00\n"
+      "offset = 1979-05-27T00:32:00-07:00\n"
+      "utc = 1979-05-27T07:32:00Z\n"
+      "inline = { x = 1, y = { z = \"w\" } }\n"
+      "points = [{ x = 1 }, { x = 2 }]\n"
+      "[server]\nhost = \"localhost\"\n"
+      "[server.\"tls config\"]\nenabled = false\n"
+      "[empty]\n"
+      "[[backend]]\nurl = \"a\"\n"
+      "[backend.opts]\nretries = 3\n"
+      "[[backend]]\nurl = \"b\"\n";
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  /* Whole documents round trip */
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++)
+    write_check (text, flags[i]);
+
+  /* Values are written in their shortest form */
+  write_check_text ("a = 0.1\n", "a = 0.1\n");
+  write_check_text ("a = 100.0\n", "a = 100.0\n");
+  write_check_text ("a = 1e-7\n", "a = 1e-7\n");
+  write_check_text ("a = 3e20\n", "a = 3e+20\n");
+  write_check_text ("a = -9223372036854775807\n",
+      "a = -9223372036854775807\n");
+  write_check_text ("a = \"x\\ny\\u007f\"\n", "a = \"x\\ny\\u007F\"\n");
+  write_check_text ("\"a.b\" = 1979-05-27T07:32:00.5+01:30\n",
+      "\"a.b\" = 1979-05-27T07:32:00.5+01:30\n");
+  write_check_text ("[a]\nb = [1, 2]\n[[a.d]]\ne = {}\n",
+      "[a]\nb = [1, 2]\n\n[[a.d]]\n\n[a.d.e]\n");
+  write_check_text ("[a.b]\nc = 1\n", "[a.b]\nc = 1\n");
+}
+
+static void
+test_builder (void)
+{
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  /* Build a document from scratch, each step keeps the previous one */
+  g_autoptr (CgTomlTable) empty = cg_toml_table_new_empty ();
+  g_assert_nonnull (empty);
+  g_autoptr (CgTomlTable) t1 = cg_toml_table_set_int64 (empty, "a", 1);
+  g_assert_nonnull (t1);
+  g_autoptr (CgTomlTable) t2 = cg_toml_table_set_qualified_string (t1,
+      "server.host", "localhost");
+  g_assert_nonnull (t2);
+  g_assert_false (cg_toml_table_contains (empty, "a"));
+  g_assert_false (cg_toml_table_contains (t1, "server"));
+  {
+    int64_t a = 0;
+    g_assert_true (cg_toml_table_get_int64 (t2, "a", &a));
+    g_assert_cmpint (a, ==, 1);
+    g_autofree char *host = cg_toml_table_get_qualified_string (t2,
+        "server.host");
+    g_assert_cmpstr (host, ==, "localhost");
+  }
+
+  /* Arrays stay homogeneous */
+  g_autoptr (CgTomlArray) a0 = cg_toml_array_new_empty ();
+  g_autoptr (CgTomlArray) a1 = cg_toml_array_append_int64 (a0, 80);
+  g_autoptr (CgTomlArray) a2 = cg_toml_array_append_int64 (a1, 443);
+  g_assert_null (cg_toml_array_append_string (a2, "http"));
+  g_assert_cmpuint (cg_toml_array_get_length (a0), ==, 0);
+  g_assert_cmpuint (cg_toml_array_get_length (a2), ==, 2);
+  g_autoptr (CgTomlTable) t3 = cg_toml_table_set_qualified_array (t2,
+      "server.ports", a2);
+  g_assert_nonnull (t3);
+
+  /* Several values are appended at once */
+  {
+    static const int64_t ports[] = { 8080, 8443 };
+    static const char *const names[] = { "http", "https" };
+    g_autoptr (CgTomlArray) a3 = cg_toml_array_extend_int64 (a2, ports,
+        G_N_ELEMENTS (ports));
+    g_assert_nonnull (a3);
+    g_assert_cmpuint (cg_toml_array_get_length (a3), ==, 4);
+    int64_t port = 0;
+    g_assert_true (cg_toml_array_get_nth_int64 (a3, 3, &port));
+    g_assert_cmpint (port, ==, 8443);
+    g_assert_null (cg_toml_array_extend_string (a2, names,
+        G_N_ELEMENTS (names)));
+    g_autoptr (CgTomlArray) a4 = cg_toml_array_extend_string (a0, names,
+        G_N_ELEMENTS (names));
+    g_assert_cmpuint (cg_toml_array_get_length (a4), ==, 2);
+  }
+
+  /* Arrays of tables */
+  g_autoptr (CgTomlTableArray) ta0 = cg_toml_table_array_new_empty ();
+  g_autoptr (CgTomlTableArray) ta1 = cg_toml_table_array_append (ta0, t1);
+  g_autoptr (CgTomlTableArray) ta2 = cg_toml_table_array_append (ta1, t1);
+  g_assert_cmpuint (cg_toml_table_array_get_length (ta2), ==, 2);
+  const CgTomlTable *tables[] = { t1, t2 };
+  g_autoptr (CgTomlTableArray) ta3 = cg_toml_table_array_extend (ta2, tables,
+      G_N_ELEMENTS (tables));
+  g_assert_cmpuint (cg_toml_table_array_get_length (ta3), ==, 4);
+  g_autoptr (CgTomlTable) t4 = cg_toml_table_set_array_table (t3, "backend",
+      ta2);
+  g_assert_nonnull (t4);
+
+  /* A value in the way of a dotted key */
+  g_assert_null (cg_toml_table_set_qualified_boolean (t4, "a.b", TRUE));
+
+  /* Removing */
+  g_autoptr (CgTomlTable) t5 = cg_toml_table_remove_qualified (t4,
+      "server.host");
+  g_assert_nonnull (t5);
+  g_autoptr (CgTomlTableDiff) diff = cg_toml_table_diff (t4, t5, NULL);
+  g_assert_null (diff->added[0]);
+  g_assert_cmpstr (diff->removed[0], ==, "server.host");
+  g_assert_null (diff->removed[1]);
+  g_assert_null (diff->modified[0]);
+  g_autoptr (CgTomlTable) t6 = cg_toml_table_remove (t5, "missing");
+  g_assert_true (t6 == t5);
+
+  /* The result is written like any other document */
+  {
+    g_autoptr (CgTomlTable) t = cg_toml_table_set_double (empty, "b", 0.5);
+    g_autoptr (GString) string = g_string_new (NULL);
+    cg_toml_table_write_string (t, string);
+    g_assert_cmpstr (string->str, ==, "b = 0.5\n");
+  }
+
+  /* Changing a parsed document leaves it untouched */
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (
+        TOML_FILE_NESTED_TABLE, flags[i]);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    g_autoptr (CgTomlTable) changed = cg_toml_table_set_qualified_int64 (
+        table, "table.key2", 5);
+    g_assert_nonnull (changed);
+    int64_t v = 0;
+    g_assert_true (cg_toml_table_get_qualified_int64 (table, "table.key2",
+        &v));
+    g_assert_cmpint (v, ==, 1284);
+    g_assert_true (cg_toml_table_get_qualified_int64 (changed, "table.key2",
+        &v));
+    g_assert_cmpint (v, ==, 5);
+    g_autoptr (CgTomlTableDiff) d = cg_toml_table_diff (table, changed,
+        NULL);
+    g_assert_null (d->added[0]);
+    g_assert_null (d->removed[0]);
+    g_assert_cmpstr (d->modified[0], ==, "table.key2");
+    g_assert_null (d->modified[1]);
+
+    /* And can be published as a file of its own */
+    g_autoptr (CgTomlFile) changed_file = cg_toml_file_new_from_table (
+        "changed", changed);
+    g_assert_nonnull (changed_file);
+    g_autoptr (CgTomlTable) changed_table = cg_toml_file_get_table (
+        changed_file);
+    g_assert_true (cg_toml_table_get_qualified_int64 (changed_table,
+        "table.key2", &v));
+    g_assert_cmpint (v, ==, 5);
+  }
+}
+
+static void
+variant_check_error (const char *text)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GVariant) v = g_variant_ref_sink (g_variant_new_parsed (text));
+  g_autoptr (CgTomlTable) table = cg_toml_table_new_from_variant (v, &error);
+  g_assert_null (table);
+  g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_TYPE_MISMATCH);
+}
+
+static void
+test_variant (void)
+{
+  static const char *text =
+      "title = \"config\"\n"
+      "answer = -42\n"
+      "pi = 3.5\n"
+      "enabled = true\n"
+      "date = 1979-05-27\n"
+      "ports = [8000, 8001]\n"
+      "nested = [[1, 2], [\"a\"]]\n"
+      "empty = []\n"
+      "[server]\nhost = \"localhost\"\n"
+      "[server.tls]\n"
+      "[[backend]]\nurl = \"a\"\n"
+      "[[backend]]\nurl = \"b\"\n";
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    g_autoptr (GError) error = NULL;
+    g_autofree char *dir = g_dir_make_tmp ("cgtoml-variant-XXXXXX", &error);
+    g_assert_no_error (error);
+    g_autofree char *path = g_build_filename (dir, "variant.toml", NULL);
+    g_assert_true (g_file_set_contents (path, text, -1, NULL));
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (path, flags[i]);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+
+    /* Values are found where D-Bus peers expect them */
+    g_autoptr (GVariant) v = g_variant_ref_sink (
+        cg_toml_table_to_variant (table, &error));
+    g_assert_no_error (error);
+    g_assert_nonnull (v);
+    g_assert_true (g_variant_is_of_type (v, G_VARIANT_TYPE_VARDICT));
+    {
+      const char *title = NULL, *date = NULL, *host = NULL;
+      gint64 answer = 0;
+      gdouble pi = 0;
+      gboolean enabled = FALSE;
+      g_assert_true (g_variant_lookup (v, "title", "&s", &title));
+      g_assert_cmpstr (title, ==, "config");
+      g_assert_true (g_variant_lookup (v, "answer", "x", &answer));
+      g_assert_cmpint (answer, ==, -42);
+      g_assert_true (g_variant_lookup (v, "pi", "d", &pi));
+      g_assert_cmpfloat (pi, ==, 3.5);
+      g_assert_true (g_variant_lookup (v, "enabled", "b", &enabled));
+      g_assert_true (enabled);
+      g_assert_true (g_variant_lookup (v, "date", "&s", &date));
+      g_assert_cmpstr (date, ==, "1979-05-27");
+      g_autoptr (GVariant) server = g_variant_lookup_value (v, "server",
+          G_VARIANT_TYPE_VARDICT);
+      g_assert_nonnull (server);
+      g_assert_true (g_variant_lookup (server, "host", "&s", &host));
+      g_assert_cmpstr (host, ==, "localhost");
+      g_autoptr (GVariant) backend = g_variant_lookup_value (v, "backend",
+          G_VARIANT_TYPE ("aa{sv}"));
+      g_assert_nonnull (backend);
+      g_assert_cmpuint (g_variant_n_children (backend), ==, 2);
+    }
+
+    /* The layout is the one GLib itself gives the same value */
+    g_autofree char *printed = g_variant_print (v, TRUE);
+    g_autoptr (GVariant) parsed = g_variant_parse (NULL, printed, NULL, NULL,
+        &error);
+    g_assert_no_error (error);
+    g_assert_cmpmem (g_variant_get_data (v), g_variant_get_size (v),
+        g_variant_get_data (parsed), g_variant_get_size (parsed));
+
+    /* And it reads back into the same table, dates as strings */
+    g_autoptr (CgTomlTable) back = cg_toml_table_new_from_variant (v,
+        &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (back);
+    g_autoptr (CgTomlTableDiff) diff = cg_toml_table_diff (table, back,
+        &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (diff);
+    g_assert_null (diff->added[0]);
+    g_assert_null (diff->removed[0]);
+    g_assert_cmpstr (diff->modified[0], ==, "date");
+    g_assert_null (diff->modified[1]);
+
+    g_assert_cmpint (g_remove (path), ==, 0);
+    g_assert_cmpint (g_rmdir (dir), ==, 0);
+  }
+
+  /* Integers of any size and typed arrays are read back as well */
+  {
+    g_autoptr (GError) error = NULL;
+    g_autoptr (GVariant) v = g_variant_ref_sink (g_variant_new_parsed (
+        "{'a': <byte 1>, 'b': <uint32 2>, 'c': <[1, 2]>, 'd': <{'e': 'f'}>}"));
+    g_autoptr (CgTomlTable) table = cg_toml_table_new_from_variant (v,
+        &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (table);
+    int64_t a = 0, b = 0, c1 = 0;
+    g_assert_true (cg_toml_table_get_int64 (table, "a", &a));
+    g_assert_cmpint (a, ==, 1);
+    g_assert_true (cg_toml_table_get_int64 (table, "b", &b));
+    g_assert_cmpint (b, ==, 2);
+    g_autoptr (CgTomlArray) c = cg_toml_table_get_array (table, "c");
+    g_assert_nonnull (c);
+    g_assert_true (cg_toml_array_get_nth_int64 (c, 1, &c1));
+    g_assert_cmpint (c1, ==, 2);
+    g_autofree char *e = cg_toml_table_get_qualified_string (table, "d.e");
+    g_assert_cmpstr (e, ==, "f");
+  }
+
+  /* Values without a TOML counterpart are rejected */
+  variant_check_error ("{'a': <(1, 2)>}");
+  variant_check_error ("{'a': <[<1>, <'b'>]>}");
+  variant_check_error ("{'a': <uint64 18446744073709551615>}");
+  variant_check_error ("[1, 2]");
+}
+
+static CgTomlFile *
+patch_check (CgTomlFile *file, const CgTomlTable *table, CgTomlFileFlags flags,
+    const char *expected)
+{
+  g_autoptr (GError) error = NULL;
+  g_assert_true (cg_toml_file_patch (file, table, NULL, &error));
+  g_assert_no_error (error);
+
+  /* Only the changes are written */
+  g_autofree char *text = NULL;
+  g_assert_true (g_file_get_contents (cg_toml_file_get_name (file), &text,
+      NULL, NULL));
+  g_assert_cmpstr (text, ==, expected);
+
+  /* And they parse back into the new table */
+  CgTomlFile *patched = cg_toml_file_new_full (cg_toml_file_get_name (file),
+      flags);
+  g_assert_nonnull (patched);
+  g_autoptr (CgTomlTable) patched_table = cg_toml_file_get_table (patched);
+  g_autoptr (CgTomlTableDiff) diff = cg_toml_table_diff (table,
+      patched_table, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (diff);
+  g_assert_null (diff->added[0]);
+  g_assert_null (diff->removed[0]);
+  g_assert_null (diff->modified[0]);
+  return patched;
+}
+
+static void
+test_patch (void)
+{
+  static const char *text =
+      "# Service configuration\n"
+      "name = \"svc\"   # the name\n"
+      "point = { x = 1 }\n"
+      "\n"
+      "[server]\n"
+      "host = \"localhost\"  # where\n"
+      "port = 80\n"
+      "\n"
+      "[logging]\n"
+      "level = \"info\"\n"
+      "\n"
+      "[[backend]]\n"
+      "url = \"a\"\n";
+  static const CgTomlFileFlags flags[] = {
+    CG_TOML_FILE_FLAGS_NONE,
+    CG_TOML_FILE_FLAGS_COMPACT,
+    CG_TOML_FILE_FLAGS_LAZY,
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (flags); i++) {
+    g_autoptr (GError) error = NULL;
+    g_autofree char *dir = g_dir_make_tmp ("cgtoml-patch-XXXXXX", &error);
+    g_assert_no_error (error);
+    g_autofree char *path = g_build_filename (dir, "patch.toml", NULL);
+    g_assert_true (g_file_set_contents (path, text, -1, NULL));
+    g_autoptr (CgTomlFile) file = cg_toml_file_new_full (path, flags[i]);
+    g_assert_nonnull (file);
+    g_autoptr (CgTomlTable) t0 = cg_toml_file_get_table (file);
+
+    /* Values are replaced where they are, new ones follow their table */
+    g_autoptr (CgTomlTable) t1 = cg_toml_table_set_string (t0, "name",
+        "svc2");
+    g_autoptr (CgTomlTable) t2 = cg_toml_table_set_qualified_int64 (t1,
+        "point.x", 5);
+    g_autoptr (CgTomlTable) t3 = cg_toml_table_set_qualified_int64 (t2,
+        "server.port", 8080);
+    g_autoptr (CgTomlTable) t4 = cg_toml_table_set_qualified_string (t3,
+        "server.user", "root");
+    g_autoptr (CgTomlTable) t5 = cg_toml_table_remove_qualified (t4,
+        "logging.level");
+    g_autoptr (CgTomlTable) t6 = cg_toml_table_set_qualified_boolean (t5,
+        "metrics.enabled", TRUE);
+    g_autoptr (CgTomlFile) f1 = patch_check (file, t6, flags[i],
+        "# Service configuration\n"
+        "name = \"svc2\"   # the name\n"
+        "point = { x = 5 }\n"
+        "\n"
+        "[server]\n"
+        "host = \"localhost\"  # where\n"
+        "port = 8080\n"
+        "user = \"root\"\n"
+        "\n"
+        "[logging]\n"
+        "\n"
+        "[[backend]]\n"
+        "url = \"a\"\n"
+        "\n"
+        "[metrics]\n"
+        "enabled = true\n");
+
+    /* Removed tables lose their whole section */
+    g_autoptr (CgTomlTable) t7 = cg_toml_file_get_table (f1);
+    g_autoptr (CgTomlTable) t8 = cg_toml_table_remove (t7, "server");
+    g_autoptr (CgTomlTable) t9 = cg_toml_table_remove (t8, "point");
+    g_autoptr (CgTomlFile) f2 = patch_check (f1, t9, flags[i],
+        "# Service configuration\n"
+        "name = \"svc2\"   # the name\n"
+        "\n"
+        "[logging]\n"
+        "\n"
+        "[[backend]]\n"
+        "url = \"a\"\n"
+        "\n"
+        "[metrics]\n"
+        "enabled = true\n");
+
+    /* Nothing changed, nothing is rewritten */
+    g_autoptr (CgTomlTable) t10 = cg_toml_file_get_table (f2);
+    cg_toml_file_unref (patch_check (f2, t10, flags[i],
+        "# Service configuration\n"
+        "name = \"svc2\"   # the name\n"
+        "\n"
+        "[logging]\n"
+        "\n"
+        "[[backend]]\n"
+        "url = \"a\"\n"
+        "\n"
+        "[metrics]\n"
+        "enabled = true\n"));
+
+    /* Tables defined by dotted keys get dotted keys, not a header */
+    g_assert_true (g_file_set_contents (path,
+        "a.b = 1\n"
+        "x = 0\n"
+        "\n"
+        "[c]\n"
+        "d.e = 1\n", -1, NULL));
+    g_autoptr (CgTomlFile) f3 = cg_toml_file_new_full (path, flags[i]);
+    g_assert_nonnull (f3);
+    g_autoptr (CgTomlTable) t11 = cg_toml_file_get_table (f3);
+    g_autoptr (CgTomlTable) t12 = cg_toml_table_set_qualified_int64 (t11,
+        "a.f", 2);
+    g_autoptr (CgTomlTable) t13 = cg_toml_table_set_qualified_int64 (t12,
+        "c.d.g", 3);
+    cg_toml_file_unref (patch_check (f3, t13, flags[i],
+        "a.b = 1\n"
+        "a.f = 2\n"
+        "x = 0\n"
+        "\n"
+        "[c]\n"
+        "d.e = 1\n"
+        "d.g = 3\n"));
+
+    /* A patched file must be reloaded before it is patched again */
+    g_assert_false (cg_toml_file_patch (f3, t13, NULL, &error));
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG);
+    g_clear_error (&error);
+    g_autofree char *unchanged = NULL;
+    g_assert_true (g_file_get_contents (path, &unchanged, NULL, NULL));
+    g_assert_cmpstr (unchanged, ==,
+        "a.b = 1\n"
+        "a.f = 2\n"
+        "x = 0\n"
+        "\n"
+        "[c]\n"
+        "d.e = 1\n"
+        "d.g = 3\n");
+
+    g_assert_cmpint (g_remove (path), ==, 0);
+    g_assert_cmpint (g_rmdir (dir), ==, 0);
+  }
+}
+
+static void
+monitor_on_changed (CgTomlMonitor *monitor, CgTomlFile *file,
+    const char *const *keys, gpointer data)
+{
+  char **res = data;
+  g_free (*res);
+  *res = g_strjoinv (" ", (char **) keys);
+}
+
+static gboolean
+monitor_on_timeout (gpointer data)
+{
+  gboolean *timed_out = data;
+  *timed_out = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_monitor (void)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("cgtoml-monitor-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree char *path = g_build_filename (dir, "config.toml", NULL);
+  g_autofree char *keys = NULL;
+
+  /* Files */
+  {
+    g_assert_true (g_file_set_contents (path,
+        "name = \"a\"\n"
+        "[server]\nhost = \"localhost\"\nport = 80\n"
+        "[server.tls]\nenabled = false\n"
+        "[logging]\nlevel = \"info\"\n", -1, NULL));
+    g_autoptr (CgTomlMonitor) monitor = cg_toml_monitor_new (path, &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (monitor);
+    g_signal_connect (monitor, "changed", G_CALLBACK (monitor_on_changed),
+        &keys);
+
+    /* Nothing is emitted if no value changed */
+    g_assert_true (g_file_set_contents (path,
+        "name = \"a\" # comment\n"
+        "[server]\nhost = \"localhost\"\nport = 80\n"
+        "[server.tls]\nenabled = false\n"
+        "[logging]\nlevel = \"info\"\n", -1, NULL));
+    g_assert_true (cg_toml_monitor_reload (monitor, &error));
+    g_assert_no_error (error);
+    g_assert_null (keys);
+
+    /* Added, removed and modified keys */
+    g_assert_true (g_file_set_contents (path,
+        "name = \"b\"\n"
+        "[server]\nhost = \"localhost\"\nport = 8080\n"
+        "[server.tls]\nenabled = false\ncert = \"a.pem\"\n"
+        "[cache]\nsize = 1\n", -1, NULL));
+    g_assert_true (cg_toml_monitor_reload (monitor, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (keys, ==,
+        "cache logging name server.port server.tls.cert");
+
+    /* The new file is published */
+    g_autoptr (CgTomlFile) file = cg_toml_monitor_get_file (monitor);
+    g_autoptr (CgTomlTable) table = cg_toml_file_get_table (file);
+    int64_t port = 0;
+    g_assert_true (cg_toml_table_get_qualified_int64 (table, "server.port",
+        &port));
+    g_assert_cmpint (port, ==, 8080);
+
+    /* Invalid files keep the current one */
+    g_clear_pointer (&keys, g_free);
+    g_assert_true (g_file_set_contents (path, "name = \n", -1, NULL));
+    g_assert_false (cg_toml_monitor_reload (monitor, &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+    g_clear_error (&error);
+    g_assert_null (keys);
+
+    /* So do invalid edits of a single section */
+    g_assert_true (g_file_set_contents (path,
+        "name = \"b\"\n"
+        "[server]\nhost = \"localhost\"\nport = \n"
+        "[server.tls]\nenabled = false\ncert = \"a.pem\"\n"
+        "[cache]\nsize = 1\n", -1, NULL));
+    g_assert_false (cg_toml_monitor_reload (monitor, &error));
+    g_assert_error (error, CG_TOML_ERROR, CG_TOML_ERROR_PARSE);
+    g_clear_error (&error);
+    g_assert_null (keys);
+    g_autoptr (CgTomlFile) current = cg_toml_monitor_get_file (monitor);
+    g_autoptr (CgTomlTable) current_table = cg_toml_file_get_table (current);
+    g_assert_true (cg_toml_table_get_qualified_int64 (current_table,
+        "server.port", &port));
+    g_assert_cmpint (port, ==, 8080);
+
+    /* Writes on disk are picked up */
+    cg_toml_monitor_set_delay (monitor, 10);
+    g_assert_true (g_file_set_contents (path, "name = \"c\"\n", -1, NULL));
+    gboolean timed_out = FALSE;
+    guint timeout = g_timeout_add_seconds (5, monitor_on_timeout, &timed_out);
+    while (!keys && !timed_out)
+      g_main_context_iteration (NULL, TRUE);
+    if (!timed_out)
+      g_source_remove (timeout);
+    g_assert_cmpstr (keys, ==, "cache name server");
+    g_clear_pointer (&keys, g_free);
+  }
+  g_unlink (path);
+
+  /* Directories */
+  {
+    g_autofree char *base = g_build_filename (dir, "10-base.toml", NULL);
+    g_autofree char *drop_in = g_build_filename (dir, "20-drop-in.toml", NULL);
+    g_assert_true (g_file_set_contents (base,
+        "[server]\nhost = \"localhost\"\nport = 80\n", -1, NULL));
+    g_assert_true (g_file_set_contents (drop_in,
+        "[server]\nport = 8080\n", -1, NULL));
+    g_autoptr (CgTomlMonitor) monitor = cg_toml_monitor_new (dir, &error);
+    g_assert_no_error (error);
+    g_signal_connect (monitor, "changed", G_CALLBACK (monitor_on_changed),
+        &keys);
+
+    g_assert_true (g_file_set_contents (drop_in,
+        "[server]\nport = 9090\ntimeout = 5\n", -1, NULL));
+    g_assert_true (cg_toml_monitor_reload (monitor, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (keys, ==, "server.port server.timeout");
+    g_clear_pointer (&keys, g_free);
+
+    /* Removing a file unmasks the values it replaced */
+    g_unlink (drop_in);
+    g_assert_true (cg_toml_monitor_reload (monitor, &error));
+    g_assert_no_error (error);
+    g_assert_cmpstr (keys, ==, "server.port server.timeout");
+    g_clear_pointer (&keys, g_free);
+    g_unlink (base);
+  }
+  g_rmdir (dir);
 }
 
 int
@@ -388,7 +2770,29 @@ main (int argc, char *argv[])
   g_test_add_func ("/cgtoml/basic_array", test_basic_array);
   g_test_add_func ("/cgtoml/nested_table", test_nested_table);
   g_test_add_func ("/cgtoml/nested_array", test_nested_array);
+  g_test_add_func ("/cgtoml/path", test_path);
   g_test_add_func ("/cgtoml/table_array", test_table_array);
+  g_test_add_func ("/cgtoml/views", test_views);
+  g_test_add_func ("/cgtoml/iterators", test_iterators);
+  g_test_add_func ("/cgtoml/compact", test_compact);
+  g_test_add_func ("/cgtoml/bytes", test_bytes);
+  g_test_add_func ("/cgtoml/mapped", test_mapped);
+  g_test_add_func ("/cgtoml/snapshot", test_snapshot);
+  g_test_add_func ("/cgtoml/lazy", test_lazy);
+  g_test_add_func ("/cgtoml/parser", test_parser);
+  g_test_add_func ("/cgtoml/parser_feed", test_parser_feed);
+  g_test_add_func ("/cgtoml/async", test_async);
+  g_test_add_func ("/cgtoml/directory", test_directory);
+  g_test_add_func ("/cgtoml/get_many", test_get_many);
+  g_test_add_func ("/cgtoml/decode", test_decode);
+  g_test_add_func ("/cgtoml/threads", test_threads);
+  g_test_add_func ("/cgtoml/snapshot_holder", test_snapshot_holder);
+  g_test_add_func ("/cgtoml/diff", test_diff);
+  g_test_add_func ("/cgtoml/write", test_write);
+  g_test_add_func ("/cgtoml/builder", test_builder);
+  g_test_add_func ("/cgtoml/patch", test_patch);
+  g_test_add_func ("/cgtoml/variant", test_variant);
+  g_test_add_func ("/cgtoml/monitor", test_monitor);
 
   return g_test_run ();
 }